@@ -0,0 +1,52 @@
+/*
+ * Eventos registrados pelo controlador_FID (ver lib/RegistroEventos)
+ *
+ * Lista unica de eventos: cada linha é EVENTO(id, formato). o firmware expande
+ * só os ids, num enum, e o texto não vai para a flash; o decodificador no host
+ * (tools/decodifica_eventos.cpp) expande o formato, trocando {a} e {b} pelos
+ * argumentos (16 e 32 bits) em decimal, {a:c} pelo caractere, {b:x} pelo
+ * hexadecimal e {b:d} pelo decimal com sinal.
+ * Novos eventos entram no fim, para os ids de dumps antigos continuarem valendo.
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef Eventos_h
+#define Eventos_h
+
+#define LISTA_EVENTOS(EVENTO)                                                       \
+  EVENTO(EVT_BOOT, "boot, canais={a}")                                              \
+  EVENTO(EVT_RELOGIO, "relogio, micros={b}")                                        \
+  EVENTO(EVT_WIFI_CONECTADO, "wifi conectado, tentativas={a} reconexao_ms={b}")     \
+  EVENTO(EVT_WIFI_QUEDA, "wifi caiu, quedas={a}")                                   \
+  EVENTO(EVT_CLIENTE_CONECTADO, "cliente tcp conectado")                            \
+  EVENTO(EVT_CLIENTE_DESCONECTADO, "cliente tcp desconectado, comandos={b}")        \
+  EVENTO(EVT_COMANDO, "comando {a:c}, sequencia={b}")                               \
+  EVENTO(EVT_ERRO, "erro E{a}, canal={b}")                                          \
+  EVENTO(EVT_CANAL, "canal {a} = {b}")                                              \
+  EVENTO(EVT_DACS_NOTIFICADOS, "dacs notificados, bancos={a}")                      \
+  EVENTO(EVT_DACS_PASSADA, "banco {a} escrito, canais={b}")                         \
+  EVENTO(EVT_DACS_COMPLETO, "atualizacao completa, duracao_us={b}")                 \
+  EVENTO(EVT_CONFIG, "configuracao {a} alterada, valor={b:d}")                      \
+  EVENTO(EVT_CAPTURA_ARMADA, "captura armada, canal={a}")                           \
+  EVENTO(EVT_FLUXO, "fluxo do adc, mascara=0x{b:x}")                                \
+  EVENTO(EVT_ESTADO_SEGURO, "estado seguro, atraso_us={b}")                         \
+  EVENTO(EVT_DACS_TRAVADOS, "passada dos dacs travada, travamentos={b}")            \
+  EVENTO(EVT_DIVERGENCIA, "canal {a} divergente, leitura={b}")                      \
+  EVENTO(EVT_OTA_INICIO, "ota iniciada, comando={a} (0 firmware, 100 spiffs)")     \
+  EVENTO(EVT_OTA_FIM, "ota terminada")                                              \
+  EVENTO(EVT_OTA_ERRO, "ota falhou, erro={a}")                                      \
+  EVENTO(EVT_EVENTOS_LIDOS, "dump do registro de eventos")                          \
+  EVENTO(EVT_SESSAO, "sessao autenticada iniciada")                                 \
+  EVENTO(EVT_SAIDAS_RESTAURADAS, "primeira passada, restauradas={a} parada_ota_ms={b}") \
+  EVENTO(EVT_AUTOTESTE, "autoteste {a} (1 aprovado, 2 reprovado), falhas=0x{b:x}")
+
+#define ID_EVENTO(id, formato) id,
+enum IdEvento
+{
+  LISTA_EVENTOS(ID_EVENTO)
+  EVENTOS_DEFINIDOS
+};
+#undef ID_EVENTO
+
+#endif
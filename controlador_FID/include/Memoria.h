@@ -0,0 +1,97 @@
+/*
+ * Orçamento de RAM do controlador_FID
+ *
+ * Todos os buffers de execução do firmware têm tamanho fixo definido aqui: entrada e saida do socket, endpoint
+ * /metrics, registro de eventos, captura, fluxo do ADC, rastros e as pilhas das tasks (criadas com
+ * xTaskCreateStaticPinnedToCore). o main.cpp declara as areas com esses tamanhos e confere com static_assert que
+ * cada uma ocupa o que está previsto; depois do setup() nada do controlador usa o heap, que fica só para o wifi e
+ * o lwIP. o comando S e o /metrics mostram o heap livre e o minimo já observado para confirmar isso em campo.
+ *
+ * MemoriaFID<Placa> resolve os tamanhos que dependem do numero de canais e lista o uso por subsistema, em tempo
+ * de compilação. tools/memoria_fid.cpp imprime essa tabela para cada placa sem precisar do toolchain do ESP32.
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef Memoria_h
+#define Memoria_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Autenticacao.h"
+#include "Placa.h"
+#include "RegistroADC.h"
+#include "RegistroEventos.h"
+
+// rede
+#define TAM_SAIDA 1536          // buffer de saida (respostas de um ciclo). cabe o maior S (TAM_STATUS no main.cpp)
+#define TAM_PEDIDO_METRICAS 512 // pedidos HTTP maiores são recusados
+#define TAM_SAIDA_METRICAS 1024 // a resposta do /metrics sai em pedaços desse tamanho
+
+// aquisição e diagnostico
+#define AMOSTRAS_CAPTURA 8192  // anel da captura em amostras (16 kB de RAM interna)
+#define REGISTROS_ADC 4        // registros do fluxo do ADC montados/aguardando envio
+#define EVENTOS_POR_NUCLEO 256 // eventos guardados por core (potencia de 2), 16 bytes cada
+#define RASTROS 64             // comandos rastreados guardados até o proximo T
+#define TAM_RASTRO 44          // sizeof(Rastro) no main.cpp: id, sequencia, comando e 8 instantes
+
+// Tamanho das pilhas em bytes. o S devolve o minimo livre já observado em cada uma (pilha_*_livre);
+// ajustar mantendo uns 500 bytes de folga sobre o pior caso medido
+#define PILHA_CONEXAO 5000 // ArduinoOTA.handle() recebe a imagem nessa pilha
+#define PILHA_TCP 3072     // interpretação dos comandos e verificação da tag do quadro
+#define PILHA_DACS 2048    // duas por banco: o worker que troca de core cria o substituto na outra antes de se apagar
+#define PILHA_ADC 2048
+#define PILHA_SUPERVISOR 2048
+
+// limite para a soma das areas fixas. o resto da RAM interna fica para o wifi, o lwIP e os TCBs
+#define ORCAMENTO_RAM (96 * 1024)
+
+struct UsoMemoria
+{
+  const char *subsistema;
+  size_t bytes;
+};
+
+template <typename P>
+struct MemoriaFID
+{
+  static constexpr int canais = P::canais;
+  static constexpr int bancos = MapaCanais<P>::bancos;
+
+  // mensagem recebida: o maior entre o W e o D com todos os canais mais o prefixo de autenticação, e no minimo 42
+  static constexpr int tamW = 1 + 5 * canais; // 'W' + letra e 4 digitos por canal
+  static constexpr int tamD = 8 * canais;     // 'D' + "cc=vvvv" separados por virgula
+  static constexpr int tamMax = tamW > tamD ? tamW : tamD;
+  static constexpr int bufferlen = TAM_PREFIXO_QUADRO + tamMax + 1 > 42 ? TAM_PREFIXO_QUADRO + tamMax + 1 : 42;
+
+  // com todos os canais, um registro do fluxo cabe num segmento TCP
+  static constexpr int quadrosRegistro = (1400 - REGISTRO_CABECALHO) * 2 / 3 / canais;
+  static constexpr size_t tamRegistro = tamanhoRegistro(canais, quadrosRegistro);
+
+  // entrada do socket e mensagem em interpretação, saida, pedido e resposta do /metrics
+  static constexpr size_t rede = 2 * bufferlen + TAM_SAIDA + TAM_PEDIDO_METRICAS + TAM_SAIDA_METRICAS;
+  static constexpr size_t eventos = EVENTOS_NUCLEOS * EVENTOS_POR_NUCLEO * sizeof(Evento);
+  static constexpr size_t captura = AMOSTRAS_CAPTURA * sizeof(uint16_t);
+  static constexpr size_t fluxo = REGISTROS_ADC * tamRegistro;
+  static constexpr size_t rastros = RASTROS * TAM_RASTRO;
+  static constexpr size_t pilhas = PILHA_CONEXAO + PILHA_TCP + PILHA_ADC + PILHA_SUPERVISOR + 2 * bancos * PILHA_DACS;
+
+  static constexpr UsoMemoria subsistemas[] = {
+      {"rede", rede},
+      {"eventos", eventos},
+      {"captura", captura},
+      {"fluxo_adc", fluxo},
+      {"rastros", rastros},
+      {"pilhas", pilhas},
+  };
+
+  static constexpr size_t total()
+  {
+    size_t soma = 0;
+    for (const UsoMemoria &uso : subsistemas)
+      soma += uso.bytes;
+    return soma;
+  }
+};
+
+#endif
@@ -0,0 +1,253 @@
+/*
+ * Descrição das placas do controlador_FID
+ *
+ * Cada placa é uma struct com membros constexpr: numero de canais, modelo dos
+ * DACs e ADCs, pinos de chip select e clock do SPI. O firmware é compilado
+ * para uma delas (PLACA, definido no platformio.ini) e todo o caminho DAC/ADC
+ * usa esses valores como constantes, de modo que os laços por canal têm
+ * limite fixo e uma placa inconsistente não compila (ver ValidaPlaca).
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef Placa_h
+#define Placa_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// o valor de cada modelo é o numero de saidas/entradas por chip
+enum class ModeloDAC : uint8_t
+{
+  MCP4921 = 1,
+  MCP4922 = 2
+};
+
+enum class ModeloADC : uint8_t
+{
+  MCP3201 = 1,
+  MCP3202 = 2,
+  MCP3204 = 4,
+  MCP3208 = 8
+};
+
+constexpr uint8_t saidasPorDAC(ModeloDAC modelo) { return static_cast<uint8_t>(modelo); }
+constexpr uint8_t entradasPorADC(ModeloADC modelo) { return static_cast<uint8_t>(modelo); }
+
+constexpr uint8_t SEM_PINO = 0xFF;
+
+// os dois barramentos SPI livres do ESP32, com os pinos padrão (SCK, MISO, MOSI)
+enum class Barramento : uint8_t
+{
+  Vspi, // 18, 19, 23. também usado pelo ADC
+  Hspi  // 14, 12, 13
+};
+
+// Banco de DACs: um grupo de chips consecutivos num barramento, atualizado pelo seu proprio worker.
+// os chip selects do banco vêm de GPIOs (pinosCS da placa) ou de 74HC595 em cadeia, que recebem a
+// linha ativa por dados/clock e aplicam no latch. nesse caso pinosCS guarda a saida do 595 de cada chip
+struct BancoDAC
+{
+  Barramento barramento;
+  uint8_t chips;
+  uint8_t pinoDadosCS;  // SEM_PINO: CS direto em GPIO
+  uint8_t pinoClockCS;
+  uint8_t pinoLatchCS;
+};
+
+// Placa original: 8 MCP4921, um MCP3208
+struct PlacaFID8
+{
+  static constexpr uint8_t canais = 8;
+  static constexpr ModeloDAC dac = ModeloDAC::MCP4921;
+  static constexpr ModeloADC adc = ModeloADC::MCP3208;
+  static constexpr uint8_t pinosCS[] = {13, 12, 14, 27, 26, 25, 33, 32}; // um por chip de DAC, canal A primeiro
+  static constexpr BancoDAC bancos[] = {{Barramento::Vspi, 8, SEM_PINO, SEM_PINO, SEM_PINO}};
+  static constexpr uint8_t pinosCSADC[] = {22};
+  static constexpr uint8_t pinoLDAC = 15;
+  static constexpr uint8_t pinoDummy = 5; // chip select interno da biblioteca MCP492X, não ligado a nada
+  static constexpr uint32_t clockSPI = 20000000;
+  static constexpr uint32_t clockSPIADC = 1000000;
+};
+
+// Meia placa: 4 MCP4921, um MCP3204
+struct PlacaFID4
+{
+  static constexpr uint8_t canais = 4;
+  static constexpr ModeloDAC dac = ModeloDAC::MCP4921;
+  static constexpr ModeloADC adc = ModeloADC::MCP3204;
+  static constexpr uint8_t pinosCS[] = {13, 12, 14, 27};
+  static constexpr BancoDAC bancos[] = {{Barramento::Vspi, 4, SEM_PINO, SEM_PINO, SEM_PINO}};
+  static constexpr uint8_t pinosCSADC[] = {22};
+  static constexpr uint8_t pinoLDAC = 15;
+  static constexpr uint8_t pinoDummy = 5;
+  static constexpr uint32_t clockSPI = 20000000;
+  static constexpr uint32_t clockSPIADC = 1000000;
+};
+
+// 16 canais: 8 MCP4922 (saidas A e B de cada chip em canais consecutivos), dois MCP3208
+struct PlacaFID16
+{
+  static constexpr uint8_t canais = 16;
+  static constexpr ModeloDAC dac = ModeloDAC::MCP4922;
+  static constexpr ModeloADC adc = ModeloADC::MCP3208;
+  static constexpr uint8_t pinosCS[] = {13, 12, 14, 27, 26, 25, 33, 32};
+  static constexpr BancoDAC bancos[] = {{Barramento::Vspi, 8, SEM_PINO, SEM_PINO, SEM_PINO}};
+  static constexpr uint8_t pinosCSADC[] = {22, 21};
+  static constexpr uint8_t pinoLDAC = 15;
+  static constexpr uint8_t pinoDummy = 5;
+  static constexpr uint32_t clockSPI = 20000000;
+  static constexpr uint32_t clockSPIADC = 1000000;
+};
+
+// 32 canais: 16 MCP4922 em dois bancos, um em cada barramento, com os CS gerados por 74HC595
+// (dois em cadeia por banco, 16 linhas). os bancos são atualizados em paralelo
+struct PlacaFID32
+{
+  static constexpr uint8_t canais = 32;
+  static constexpr ModeloDAC dac = ModeloDAC::MCP4922;
+  static constexpr ModeloADC adc = ModeloADC::MCP3208;
+  static constexpr uint8_t pinosCS[] = {0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5, 6, 7}; // saida do 595 de cada chip
+  static constexpr BancoDAC bancos[] = {{Barramento::Vspi, 8, 27, 26, 25},
+                                        {Barramento::Hspi, 8, 33, 32, 4}};
+  static constexpr uint8_t pinosCSADC[] = {22, 21, 17, 16};
+  static constexpr uint8_t pinoLDAC = 15;
+  static constexpr uint8_t pinoDummy = 5;
+  static constexpr uint32_t clockSPI = 20000000;
+  static constexpr uint32_t clockSPIADC = 1000000;
+};
+
+// Mapeamento canal -> banco/chip/saida, calculado em tempo de compilação
+template <typename P>
+struct MapaCanais
+{
+  static constexpr uint8_t saidas = saidasPorDAC(P::dac);
+  static constexpr uint8_t chips = sizeof(P::pinosCS) / sizeof(P::pinosCS[0]);
+  static constexpr uint8_t bancos = sizeof(P::bancos) / sizeof(P::bancos[0]);
+  static constexpr uint8_t adcs = sizeof(P::pinosCSADC) / sizeof(P::pinosCSADC[0]);
+
+  static constexpr uint8_t chip(uint8_t canal) { return canal / saidas; }
+  static constexpr uint8_t saida(uint8_t canal) { return canal % saidas; }
+  static constexpr uint8_t pinoCS(uint8_t canal) { return P::pinosCS[chip(canal)]; }
+
+  static constexpr uint8_t primeiroChip(uint8_t banco)
+  {
+    uint8_t chip = 0;
+    for (uint8_t b = 0; b < banco; b++)
+      chip += P::bancos[b].chips;
+    return chip;
+  }
+  static constexpr uint8_t primeiroCanal(uint8_t banco) { return primeiroChip(banco) * saidas; }
+  static constexpr uint8_t canaisDoBanco(uint8_t banco) { return P::bancos[banco].chips * saidas; }
+  static constexpr uint8_t banco(uint8_t canal)
+  {
+    uint8_t b = 0;
+    while (b + 1 < bancos && canal >= primeiroCanal(b + 1))
+      b++;
+    return b;
+  }
+  static constexpr bool csDireto(uint8_t banco) { return P::bancos[banco].pinoLatchCS == SEM_PINO; }
+
+  static constexpr uint8_t chipsNosBancos()
+  {
+    return primeiroChip(bancos);
+  }
+  static constexpr bool usaBarramento(Barramento barramento)
+  {
+    for (const BancoDAC &b : P::bancos)
+      if (b.barramento == barramento)
+        return true;
+    return false;
+  }
+};
+
+// verdadeiro se nenhum pino se repete entre chip selects, 595s, barramentos, LDAC e dummy
+template <typename P>
+constexpr bool pinosDistintos()
+{
+  using M = MapaCanais<P>;
+  uint8_t pinos[sizeof(P::pinosCS) + sizeof(P::pinosCSADC) + 3 * sizeof(P::bancos) / sizeof(P::bancos[0]) + 6 + 2] = {};
+  size_t n = 0;
+  for (uint8_t b = 0; b < M::bancos; b++)
+  {
+    if (M::csDireto(b))
+    {
+      for (uint8_t c = M::primeiroChip(b); c < M::primeiroChip(b) + P::bancos[b].chips; c++)
+        pinos[n++] = P::pinosCS[c];
+    }
+    else
+    {
+      pinos[n++] = P::bancos[b].pinoDadosCS;
+      pinos[n++] = P::bancos[b].pinoClockCS;
+      pinos[n++] = P::bancos[b].pinoLatchCS;
+    }
+  }
+  for (uint8_t p : P::pinosCSADC)
+    pinos[n++] = p;
+  pinos[n++] = 18; // VSPI sempre usado pelo ADC
+  pinos[n++] = 19;
+  pinos[n++] = 23;
+  if (M::usaBarramento(Barramento::Hspi))
+  {
+    pinos[n++] = 14;
+    pinos[n++] = 12;
+    pinos[n++] = 13;
+  }
+  pinos[n++] = P::pinoLDAC;
+  pinos[n++] = P::pinoDummy;
+  for (size_t i = 0; i < n; i++)
+    for (size_t j = i + 1; j < n; j++)
+      if (pinos[i] == pinos[j])
+        return false;
+  return true;
+}
+
+template <typename P>
+constexpr bool bancosAte32Canais()
+{
+  for (uint8_t b = 0; b < MapaCanais<P>::bancos; b++)
+    if (MapaCanais<P>::canaisDoBanco(b) > 32)
+      return false;
+  return true;
+}
+
+// verdadeiro se todo banco com 595 cabe em duas cadeias de 8 saidas
+template <typename P>
+constexpr bool bancosComCSValido()
+{
+  using M = MapaCanais<P>;
+  for (uint8_t b = 0; b < M::bancos; b++)
+  {
+    if (M::csDireto(b))
+      continue;
+    if (P::bancos[b].chips > 16)
+      return false;
+    for (uint8_t c = M::primeiroChip(b); c < M::primeiroChip(b) + P::bancos[b].chips; c++)
+      if (P::pinosCS[c] > 15)
+        return false;
+  }
+  return true;
+}
+
+// Checagens feitas em tempo de compilação. instanciar com a placa usada: ValidaPlaca<Placa>
+template <typename P>
+struct ValidaPlaca
+{
+  using M = MapaCanais<P>;
+  static_assert(P::canais > 0, "a placa precisa de pelo menos um canal");
+  static_assert(P::canais <= 52, "o comando W endereça os canais pelas letras A a Z e a a z");
+  static_assert(P::canais % M::saidas == 0, "numero de canais não é multiplo das saidas por DAC");
+  static_assert(M::chips == P::canais / M::saidas, "numero de pinos CS não corresponde ao numero de DACs");
+  static_assert(M::chipsNosBancos() == M::chips, "a soma dos chips dos bancos não corresponde ao numero de DACs");
+  static_assert(M::bancos <= 2, "o ESP32 tem dois barramentos SPI livres");
+  static_assert(bancosAte32Canais<P>(), "cada banco tem uma mascara de 32 bits de canais pendentes");
+  static_assert(M::bancos < 2 || P::bancos[0].barramento != P::bancos[1].barramento, "bancos em paralelo precisam de barramentos diferentes");
+  static_assert(bancosComCSValido<P>(), "banco com 595 aceita no maximo 16 chips (saidas 0 a 15)");
+  static_assert(P::canais <= M::adcs * entradasPorADC(P::adc), "entradas de ADC insuficientes para ler todos os canais");
+  static_assert(P::clockSPI <= 20000000, "MCP492X aceita no maximo 20 MHz");
+  static_assert(P::clockSPIADC <= 2000000, "MCP320x aceita no maximo 2 MHz (5 V)");
+  static_assert(pinosDistintos<P>(), "pino repetido na descrição da placa");
+  static constexpr bool ok = true;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+ * Autenticação dos comandos do controlador_FID
+ */
+
+#include <string.h>
+#include "Autenticacao.h"
+
+static inline uint64_t rotaciona(uint64_t x, int b) { return (x << b) | (x >> (64 - b)); }
+
+// palavras de 8 bytes em little-endian, como no ESP32 e no x86
+static inline uint64_t lePalavra(const uint8_t *p)
+{
+  uint64_t m;
+  memcpy(&m, p, sizeof(m));
+  return m;
+}
+
+SipHash::SipHash(const uint8_t *chave)
+{
+  uint64_t k0 = lePalavra(chave);
+  uint64_t k1 = lePalavra(chave + 8);
+  _v[0] = k0 ^ 0x736f6d6570736575ULL;
+  _v[1] = k1 ^ 0x646f72616e646f6dULL;
+  _v[2] = k0 ^ 0x6c7967656e657261ULL;
+  _v[3] = k1 ^ 0x7465646279746573ULL;
+  _pendente = 0;
+  _total = 0;
+}
+
+void SipHash::rodada(uint64_t m)
+{
+  _v[3] ^= m;
+  for (int i = 0; i < 2; i++)
+  {
+    _v[0] += _v[1];
+    _v[1] = rotaciona(_v[1], 13) ^ _v[0];
+    _v[0] = rotaciona(_v[0], 32);
+    _v[2] += _v[3];
+    _v[3] = rotaciona(_v[3], 16) ^ _v[2];
+    _v[0] += _v[3];
+    _v[3] = rotaciona(_v[3], 21) ^ _v[0];
+    _v[2] += _v[1];
+    _v[1] = rotaciona(_v[1], 17) ^ _v[2];
+    _v[2] = rotaciona(_v[2], 32);
+  }
+  _v[0] ^= m;
+}
+
+void SipHash::acrescenta(const uint8_t *dados, size_t len)
+{
+  size_t i = 0;
+  while (i < len && (_total & 7) != 0) // completa a palavra pendente
+  {
+    _pendente |= (uint64_t)dados[i++] << (8 * (_total++ & 7));
+    if ((_total & 7) == 0)
+    {
+      rodada(_pendente);
+      _pendente = 0;
+    }
+  }
+  for (; i + 8 <= len; i += 8)
+  {
+    rodada(lePalavra(dados + i));
+    _total += 8;
+  }
+  for (; i < len; i++)
+  {
+    _pendente |= (uint64_t)dados[i] << (8 * (_total++ & 7));
+  }
+}
+
+uint64_t SipHash::finaliza()
+{
+  rodada(_pendente | ((uint64_t)(_total & 0xFF) << 56));
+  _v[2] ^= 0xFF;
+  // 4 rodadas de finalização: duas chamadas de rodada() com m = 0 (os xor com m não alteram o estado)
+  rodada(0);
+  rodada(0);
+  return _v[0] ^ _v[1] ^ _v[2] ^ _v[3];
+}
+
+bool leHex(const char *texto, int digitos, uint64_t *valor)
+{
+  uint64_t v = 0;
+  for (int i = 0; i < digitos; i++)
+  {
+    char c = texto[i];
+    int d;
+    if (c >= '0' && c <= '9')
+    {
+      d = c - '0';
+    }
+    else if (c >= 'a' && c <= 'f')
+    {
+      d = c - 'a' + 10;
+    }
+    else if (c >= 'A' && c <= 'F')
+    {
+      d = c - 'A' + 10;
+    }
+    else
+    {
+      return false;
+    }
+    v = (v << 4) | d;
+  }
+  *valor = v;
+  return true;
+}
+
+bool leChave(const char *texto, uint8_t *chave)
+{
+  for (int i = 0; i < TAM_CHAVE; i++)
+  {
+    uint64_t byte;
+    if (!leHex(texto + 2 * i, 2, &byte))
+    {
+      return false;
+    }
+    chave[i] = byte;
+  }
+  return true;
+}
+
+void escreveHex(uint64_t valor, int digitos, char *destino)
+{
+  static const char hex[] = "0123456789abcdef";
+  for (int i = digitos - 1; i >= 0; i--)
+  {
+    destino[i] = hex[valor & 0xF];
+    valor >>= 4;
+  }
+}
+
+void SessaoAutenticada::defineChave(const uint8_t *chave)
+{
+  memcpy(_chave, chave, TAM_CHAVE);
+  encerra();
+}
+
+void SessaoAutenticada::inicia(uint64_t nonceHost, uint64_t nonceControlador)
+{
+  uint8_t entrada[5 + 16] = {'F', 'I', 'D', 's'};
+  memcpy(entrada + 5, &nonceHost, 8);
+  memcpy(entrada + 13, &nonceControlador, 8);
+  for (int metade = 0; metade < 2; metade++)
+  {
+    entrada[4] = metade + 1;
+    SipHash h(_chave);
+    h.acrescenta(entrada, sizeof(entrada));
+    uint64_t k = h.finaliza();
+    memcpy(_chaveSessao + 8 * metade, &k, 8);
+  }
+  _sequencia = 0;
+  _ativa = true;
+}
+
+void SessaoAutenticada::encerra()
+{
+  memset(_chaveSessao, 0, sizeof(_chaveSessao));
+  _sequencia = 0;
+  _ativa = false;
+}
+
+uint64_t SessaoAutenticada::tag(uint32_t sequencia, const char *comando, size_t len) const
+{
+  SipHash h(_chaveSessao);
+  h.acrescenta((const uint8_t *)&sequencia, sizeof(sequencia));
+  h.acrescenta((const uint8_t *)comando, len);
+  return h.finaliza();
+}
+
+ResultadoQuadro SessaoAutenticada::verifica(const char *quadro, const char **comando)
+{
+  uint64_t sequencia, recebida;
+  if (quadro[0] != PREFIXO_QUADRO || !leHex(quadro + 1, 8, &sequencia) || quadro[9] != ',' ||
+      !leHex(quadro + 10, 16, &recebida) || quadro[26] != ' ')
+  {
+    return QUADRO_MAL_FORMADO;
+  }
+  if (!_ativa)
+  {
+    return QUADRO_SEM_SESSAO;
+  }
+  const char *texto = quadro + TAM_PREFIXO_QUADRO;
+  if (tag(sequencia, texto, strcspn(texto, "\r")) != recebida)
+  {
+    return QUADRO_TAG_INVALIDA;
+  }
+  if (sequencia <= _sequencia)
+  {
+    return QUADRO_REPETIDO;
+  }
+  _sequencia = sequencia;
+  *comando = texto;
+  return QUADRO_OK;
+}
+
+void SessaoAutenticada::assina(const char *comando, size_t len, char *prefixo)
+{
+  _sequencia++;
+  prefixo[0] = PREFIXO_QUADRO;
+  escreveHex(_sequencia, 8, prefixo + 1);
+  prefixo[9] = ',';
+  escreveHex(tag(_sequencia, comando, len), 16, prefixo + 10);
+  prefixo[26] = ' ';
+}
@@ -0,0 +1,94 @@
+/*
+ * Autenticação dos comandos do controlador_FID
+ *
+ * Sessão com chave pré-compartilhada (CHAVE_COMANDOS, 16 bytes) e uma tag por comando:
+ *   1. o host envia "N" e um nonce de 16 digitos hexadecimais; o controlador responde com o seu nonce
+ *   2. os dois derivam a chave da sessão: SipHash-2-4(chave, "FIDs" | i | nonce do host | nonce do controlador),
+ *      i = 1 e 2 para as duas metades
+ *   3. cada comando vai como "@ssssssss,tttttttttttttttt comando": sequencia de 32 bits e a tag
+ *      SipHash-2-4(chave da sessão, sequencia | comando), ambas em hexadecimal. o comando vai até o '\r' e inclui
+ *      o "#id " de correlação, se houver
+ * A sequencia tem que crescer a cada comando: um quadro repetido ou fora de ordem é recusado, e um quadro de outra
+ * sessão não confere porque a chave depende do nonce do controlador, novo a cada N. a tag de 64 bits de uma função
+ * feita para mensagens curtas custa uma fração do interpretar de um W, sem o periferico de SHA nem o seu lock.
+ * as respostas não levam tag.
+ *
+ * Usada pelo firmware (verifica) e pelos clientes no host (assina). Não depende do Arduino.
+ */
+
+#ifndef Autenticacao_h
+#define Autenticacao_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TAM_CHAVE 16
+#define DIGITOS_NONCE 16
+#define PREFIXO_QUADRO '@'
+#define TAM_PREFIXO_QUADRO 27 // "@ssssssss,tttttttttttttttt "
+
+enum ResultadoQuadro
+{
+  QUADRO_OK,
+  QUADRO_MAL_FORMADO, // prefixo fora do formato
+  QUADRO_SEM_SESSAO,  // nenhum N aceito nesta conexão
+  QUADRO_TAG_INVALIDA,
+  QUADRO_REPETIDO     // sequencia não maior que a do ultimo quadro aceito
+};
+
+// SipHash-2-4 em partes, para autenticar a sequencia e o comando sem copiá-los para um buffer
+class SipHash
+{
+public:
+  explicit SipHash(const uint8_t *chave);
+  void acrescenta(const uint8_t *dados, size_t len);
+  uint64_t finaliza();
+
+private:
+  void rodada(uint64_t m);
+
+  uint64_t _v[4];
+  uint64_t _pendente; // bytes que ainda não completaram uma palavra de 8
+  size_t _total;
+};
+
+// para validar a chave em tempo de compilação
+constexpr bool digitosHex(const char *texto, int digitos)
+{
+  return digitos == 0 || (((*texto >= '0' && *texto <= '9') || (*texto >= 'a' && *texto <= 'f') ||
+                           (*texto >= 'A' && *texto <= 'F')) &&
+                          digitosHex(texto + 1, digitos - 1));
+}
+
+// le digitos hexadecimais (maiusculos ou minusculos). false se algum não for hex
+bool leHex(const char *texto, int digitos, uint64_t *valor);
+bool leChave(const char *texto, uint8_t *chave); // 2 * TAM_CHAVE digitos
+void escreveHex(uint64_t valor, int digitos, char *destino);
+
+class SessaoAutenticada
+{
+public:
+  void defineChave(const uint8_t *chave);
+
+  // deriva a chave da sessão e zera a sequencia
+  void inicia(uint64_t nonceHost, uint64_t nonceControlador);
+  void encerra();
+  bool ativa() const { return _ativa; }
+
+  // quadro "@seq,tag comando" terminado em '\r' ou '\0'. se QUADRO_OK, *comando aponta para o comando
+  ResultadoQuadro verifica(const char *quadro, const char **comando);
+
+  // lado do host: escreve em prefixo os TAM_PREFIXO_QUADRO caracteres (sem '\0') para o comando de len bytes,
+  // com a proxima sequencia
+  void assina(const char *comando, size_t len, char *prefixo);
+
+private:
+  uint64_t tag(uint32_t sequencia, const char *comando, size_t len) const;
+
+  uint8_t _chave[TAM_CHAVE] = {};
+  uint8_t _chaveSessao[TAM_CHAVE] = {};
+  bool _ativa = false;
+  uint32_t _sequencia = 0; // ultima aceita (controlador) ou enviada (host)
+};
+
+#endif
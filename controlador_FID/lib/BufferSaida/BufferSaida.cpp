@@ -0,0 +1,160 @@
+/*
+ * Buffer de saida do controlador_FID
+ */
+
+#include <string.h>
+#include "BufferSaida.h"
+
+BufferSaida::BufferSaida(char *area, size_t capacidade, FuncaoEnvio envia, void *contexto)
+{
+  _area = area;
+  _capacidade = capacidade;
+  _usado = 0;
+  _envia = envia;
+  _contexto = contexto;
+  _semAcumular = false;
+  zeraMetricas();
+}
+
+void BufferSaida::adiciona(const char *texto)
+{
+  adiciona(texto, strlen(texto));
+}
+
+void BufferSaida::adiciona(const char *dados, size_t len)
+{
+  _escritas++;
+  while (len > 0)
+  {
+    if (_usado == _capacidade)
+    {
+      descarrega();
+    }
+    size_t livre = _capacidade - _usado;
+    size_t n = len < livre ? len : livre;
+    memcpy(_area + _usado, dados, n);
+    _usado += n;
+    dados += n;
+    len -= n;
+  }
+  if (_semAcumular)
+  {
+    descarrega();
+  }
+}
+
+void BufferSaida::adiciona(char c)
+{
+  _escritas++;
+  if (_usado == _capacidade)
+  {
+    descarrega();
+  }
+  _area[_usado++] = c;
+  if (_semAcumular)
+  {
+    descarrega();
+  }
+}
+
+void BufferSaida::adicionaDecimal(uint32_t valor)
+{
+  adicionaDecimal(valor, 1);
+}
+
+void BufferSaida::adicionaDecimal(uint32_t valor, uint8_t largura)
+{
+  // digitos gerados do menos para o mais significativo no fim de um bloco de 10 bytes
+  char digitos[10];
+  uint8_t n = 0;
+  do
+  {
+    digitos[sizeof(digitos) - 1 - n] = '0' + valor % 10;
+    valor /= 10;
+    n++;
+  } while (valor > 0);
+  while (n < largura && n < sizeof(digitos))
+  {
+    digitos[sizeof(digitos) - 1 - n] = '0';
+    n++;
+  }
+  adiciona(digitos + sizeof(digitos) - n, n);
+}
+
+void BufferSaida::adicionaInteiro(int32_t valor)
+{
+  if (valor < 0)
+  {
+    bool semAcumular = _semAcumular;
+    _semAcumular = false; // sinal e digitos contam como uma unica escrita
+    adiciona('-');
+    _escritas--;
+    _semAcumular = semAcumular;
+    adicionaDecimal(0u - (uint32_t)valor);
+    return;
+  }
+  adicionaDecimal((uint32_t)valor);
+}
+
+void BufferSaida::adicionaHexadecimal(uint64_t valor)
+{
+  char digitos[16];
+  uint8_t n = 0;
+  do
+  {
+    digitos[sizeof(digitos) - 1 - n] = "0123456789ABCDEF"[valor & 0xF];
+    valor >>= 4;
+    n++;
+  } while (valor > 0);
+  adiciona(digitos + sizeof(digitos) - n, n);
+}
+
+size_t BufferSaida::descarrega()
+{
+  if (_usado == 0)
+  {
+    return 0;
+  }
+  size_t enviado = _envia(_contexto, (const uint8_t *)_area, _usado);
+  _envios++;
+  _bytesEnviados += enviado;
+  _usado = 0;
+  return enviado;
+}
+
+void BufferSaida::limpa()
+{
+  _usado = 0;
+}
+
+void BufferSaida::semAcumular(bool sim)
+{
+  _semAcumular = sim;
+}
+
+size_t BufferSaida::tamanho() const
+{
+  return _usado;
+}
+
+uint32_t BufferSaida::escritas() const
+{
+  return _escritas;
+}
+
+uint32_t BufferSaida::envios() const
+{
+  return _envios;
+}
+
+uint32_t BufferSaida::bytesEnviados() const
+{
+  return _bytesEnviados;
+}
+
+void BufferSaida::zeraMetricas()
+{
+  _escritas = 0;
+  _envios = 0;
+  _bytesEnviados = 0;
+}
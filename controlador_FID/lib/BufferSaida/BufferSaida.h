@@ -0,0 +1,85 @@
+/*
+ * Buffer de saida do controlador_FID
+ *
+ * Acumula as respostas de um ciclo de processamento numa area fixa (sem
+ * heap) e as entrega ao destino em uma unica chamada, de modo que cada
+ * comando gere um unico write no lwIP em vez de um por cl.print.
+ * Se a area encher antes do fim do ciclo, o conteudo é descarregado
+ * automaticamente e a escrita continua.
+ *
+ * As funções de formatação escrevem direto na area, sem itoa/snprintf em
+ * buffers temporarios. Cada conexão usa o seu proprio BufferSaida.
+ *
+ * Não depende do Arduino: o envio é feito por uma função passada no construtor.
+ */
+
+#ifndef BufferSaida_h
+#define BufferSaida_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Função que entrega os dados ao destino (ex: WiFiClient::write). devolve o numero de bytes aceitos
+typedef size_t (*FuncaoEnvio)(void *contexto, const uint8_t *dados, size_t len);
+
+class BufferSaida
+{
+public:
+  // area e capacidade: memoria fixa usada pelo buffer, normalmente um array global
+  BufferSaida(char *area, size_t capacidade, FuncaoEnvio envia, void *contexto);
+
+  // Acrescenta texto terminado em '\0'
+  void adiciona(const char *texto);
+
+  // Acrescenta len bytes
+  void adiciona(const char *dados, size_t len);
+
+  // Acrescenta um caractere
+  void adiciona(char c);
+
+  // Acrescenta um numero sem sinal em decimal
+  void adicionaDecimal(uint32_t valor);
+
+  // Acrescenta um numero sem sinal em decimal com pelo menos largura digitos (completa com zeros)
+  void adicionaDecimal(uint32_t valor, uint8_t largura);
+
+  // Acrescenta um numero com sinal em decimal
+  void adicionaInteiro(int32_t valor);
+
+  // Acrescenta um numero sem sinal em hexadecimal maiusculo, sem prefixo
+  void adicionaHexadecimal(uint64_t valor);
+
+  // Entrega o conteudo acumulado ao destino com uma unica chamada e esvazia o buffer.
+  // devolve o numero de bytes entregues
+  size_t descarrega();
+
+  // Descarta o conteudo sem enviar (ex: cliente desconectou)
+  void limpa();
+
+  // true: cada adiciona* é entregue na hora, numa chamada propria, como os cl.print de antes do buffer.
+  // só para medir a diferença no host (tools/nativo/envios_fid); o firmware sempre acumula
+  void semAcumular(bool sim);
+
+  size_t tamanho() const;
+
+  // Metricas acumuladas desde a criação ou desde zeraMetricas().
+  // escritas conta as chamadas de adiciona* (o que antes seria um cl.print cada),
+  // envios conta as chamadas à função de envio
+  uint32_t escritas() const;
+  uint32_t envios() const;
+  uint32_t bytesEnviados() const;
+  void zeraMetricas();
+
+private:
+  char *_area;
+  size_t _capacidade;
+  size_t _usado;
+  FuncaoEnvio _envia;
+  void *_contexto;
+  uint32_t _escritas;
+  uint32_t _envios;
+  uint32_t _bytesEnviados;
+  bool _semAcumular;
+};
+
+#endif
@@ -0,0 +1,210 @@
+/*
+ * Captura disparada do ADC do controlador_FID
+ */
+
+#include <string.h>
+#include "Captura.h"
+
+Captura::Captura(uint16_t *area, size_t capacidade, uint8_t canais)
+{
+  _area = area;
+  _canais = canais;
+  _quadros = canais > 0 ? capacidade / canais : 0;
+  _estado = CAPTURA_PARADA;
+  _escrita = 0;
+  _gravados = 0;
+  _inicio = 0;
+  _faltam = 0;
+  _anterior = 0;
+  _canal = 0;
+  _tipo = GATILHO_SUBIDA;
+  _limiar = 0;
+  _pre = 0;
+  _pos = 0;
+  _sequencia = 0;
+  _aplicada = 0;
+  _pedidoArmar = false;
+}
+
+bool Captura::arma(uint8_t canal, TipoGatilho tipo, int32_t limiar, size_t pre, size_t pos)
+{
+  if (canal >= _canais || pos == 0 || pre + pos > _quadros)
+  {
+    return false;
+  }
+  registraPedido(true, canal, tipo, limiar, pre, pos);
+  return true;
+}
+
+void Captura::cancela()
+{
+  registraPedido(false, 0, GATILHO_SUBIDA, 0, 0, 0);
+}
+
+void Captura::registraPedido(bool armar, uint8_t canal, TipoGatilho tipo, int32_t limiar, size_t pre, size_t pos)
+{
+  uint32_t sequencia = _sequencia;
+  __atomic_store_n(&_sequencia, sequencia + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE); // impar antes de qualquer campo
+  _pedidoArmar = armar;
+  _pedidoCanal = canal;
+  _pedidoTipo = tipo;
+  _pedidoLimiar = limiar;
+  _pedidoPre = pre;
+  _pedidoPos = pos;
+  __atomic_store_n(&_sequencia, sequencia + 2, __ATOMIC_RELEASE);
+}
+
+// um pedido sendo escrito, ou reescrito durante a copia, fica para o proximo quadro
+void Captura::aplicaPedido()
+{
+  uint32_t sequencia = __atomic_load_n(&_sequencia, __ATOMIC_ACQUIRE);
+  if (sequencia == _aplicada || (sequencia & 1) != 0)
+  {
+    return;
+  }
+  bool armar = _pedidoArmar;
+  uint8_t canal = _pedidoCanal;
+  TipoGatilho tipo = _pedidoTipo;
+  int32_t limiar = _pedidoLimiar;
+  size_t pre = _pedidoPre;
+  size_t pos = _pedidoPos;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (__atomic_load_n(&_sequencia, __ATOMIC_RELAXED) != sequencia)
+  {
+    return;
+  }
+
+  if (armar)
+  {
+    _canal = canal;
+    _tipo = tipo;
+    _limiar = limiar;
+    _pre = pre;
+    _pos = pos;
+    _gravados = 0;
+    _estado = CAPTURA_ARMADA;
+  }
+  else
+  {
+    _estado = CAPTURA_PARADA;
+  }
+  __atomic_store_n(&_aplicada, sequencia, __ATOMIC_RELEASE);
+}
+
+void Captura::adiciona(const uint16_t *quadro)
+{
+  aplicaPedido();
+  if (_estado == CAPTURA_CONGELADA || _quadros == 0)
+  {
+    return;
+  }
+
+  size_t atual = _escrita;
+  memcpy(_area + atual * _canais, quadro, _canais * sizeof(uint16_t));
+  _escrita = atual + 1 == _quadros ? 0 : atual + 1;
+  if (_gravados < _quadros)
+  {
+    _gravados++;
+  }
+
+  uint16_t amostra = quadro[_canal];
+  if (_estado == CAPTURA_DISPARADA)
+  {
+    _faltam--;
+  }
+  else if (_estado == CAPTURA_ARMADA && _gravados > _pre && dispara(_anterior, amostra))
+  {
+    _inicio = (atual + _quadros - _pre) % _quadros;
+    _faltam = _pos - 1; // o quadro do gatilho é o primeiro do pos
+    _estado = CAPTURA_DISPARADA;
+  }
+  _anterior = amostra;
+
+  if (_estado == CAPTURA_DISPARADA && _faltam == 0)
+  {
+    __atomic_store_n(&_estado, CAPTURA_CONGELADA, __ATOMIC_RELEASE);
+  }
+}
+
+// a primeira amostra depois do armar não dispara: _gravados > _pre garante uma anterior do mesmo armar
+bool Captura::dispara(uint16_t anterior, uint16_t atual) const
+{
+  switch (_tipo)
+  {
+  case GATILHO_SUBIDA:
+    return anterior < _limiar && atual >= _limiar;
+  case GATILHO_DESCIDA:
+    return anterior > _limiar && atual <= _limiar;
+  case GATILHO_INCLINACAO:
+  {
+    int32_t diferenca = (int32_t)atual - (int32_t)anterior;
+    return _limiar >= 0 ? diferenca >= _limiar : diferenca <= _limiar;
+  }
+  }
+  return false;
+}
+
+EstadoCaptura Captura::estado() const
+{
+  if (_sequencia != __atomic_load_n(&_aplicada, __ATOMIC_ACQUIRE))
+  {
+    return _pedidoArmar ? CAPTURA_ARMADA : CAPTURA_PARADA;
+  }
+  return __atomic_load_n(&_estado, __ATOMIC_ACQUIRE);
+}
+
+size_t Captura::quadros() const
+{
+  return _quadros;
+}
+
+uint8_t Captura::canais() const
+{
+  return _canais;
+}
+
+uint8_t Captura::canalGatilho() const
+{
+  return _canal;
+}
+
+TipoGatilho Captura::tipoGatilho() const
+{
+  return _tipo;
+}
+
+int32_t Captura::limiar() const
+{
+  return _limiar;
+}
+
+size_t Captura::pre() const
+{
+  return _pre;
+}
+
+size_t Captura::pos() const
+{
+  return _pos;
+}
+
+const uint16_t *Captura::quadro(size_t i) const
+{
+  if (estado() != CAPTURA_CONGELADA || i >= _pre + _pos)
+  {
+    return NULL;
+  }
+  return _area + ((_inicio + i) % _quadros) * _canais;
+}
+
+size_t Captura::contiguos(size_t i) const
+{
+  if (estado() != CAPTURA_CONGELADA || i >= _pre + _pos)
+  {
+    return 0;
+  }
+  size_t restantes = _pre + _pos - i;
+  size_t ateVolta = _quadros - (_inicio + i) % _quadros;
+  return restantes < ateVolta ? restantes : ateVolta;
+}
@@ -0,0 +1,112 @@
+/*
+ * Captura disparada do ADC do controlador_FID
+ *
+ * A aquisição entrega cada quadro (uma leitura de todos os canais) ao
+ * adiciona(), que o copia num anel de tamanho fixo. Enquanto armada, a
+ * captura avalia o gatilho num canal a cada quadro; ao disparar, guarda
+ * mais pos quadros e congela, deixando no anel a janela com pre quadros
+ * antes do gatilho e pos a partir dele (o quadro do gatilho incluso).
+ * Congelada, o anel não é mais escrito e pode ser lido sem copia por
+ * quadro() enquanto a aquisição continua normalmente.
+ *
+ * adiciona() é chamada só pela task de aquisição; arma() e cancela() por
+ * uma unica outra task registram um pedido que a aquisição aplica no
+ * proximo quadro, de modo que o estado do anel tem um unico dono. um
+ * pedido ainda não aplicado é substituido pelo seguinte: vale o ultimo.
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef Captura_h
+#define Captura_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum TipoGatilho
+{
+  GATILHO_SUBIDA,    // amostra anterior abaixo do limiar e atual no limiar ou acima
+  GATILHO_DESCIDA,   // amostra anterior acima do limiar e atual no limiar ou abaixo
+  GATILHO_INCLINACAO // diferença entre amostras consecutivas >= limiar (limiar > 0) ou <= limiar (limiar < 0)
+};
+
+enum EstadoCaptura
+{
+  CAPTURA_PARADA,    // gravando no anel, sem gatilho
+  CAPTURA_ARMADA,    // gravando e avaliando o gatilho
+  CAPTURA_DISPARADA, // gatilho ocorreu, gravando os quadros pos-gatilho
+  CAPTURA_CONGELADA  // janela completa, anel disponivel para leitura
+};
+
+class Captura
+{
+public:
+  // area: memoria do anel, capacidade amostras (um quadro ocupa canais amostras)
+  Captura(uint16_t *area, size_t capacidade, uint8_t canais);
+
+  // Arma o gatilho no canal. a janela tem pre quadros antes do gatilho e pos a partir dele.
+  // devolve false se o canal não existe, pos é zero ou pre + pos não cabe no anel.
+  // o gatilho só é avaliado depois de gravados pre quadros desde o armar
+  bool arma(uint8_t canal, TipoGatilho tipo, int32_t limiar, size_t pre, size_t pos);
+
+  // Volta para parada, descartando a captura congelada
+  void cancela();
+
+  // Chamada pela aquisição a cada quadro de canais amostras
+  void adiciona(const uint16_t *quadro);
+
+  // inclui o pedido ainda não aplicado; chamada pela task que faz os pedidos
+  EstadoCaptura estado() const;
+  size_t quadros() const;  // capacidade do anel em quadros
+  uint8_t canais() const;
+
+  // parametros do ultimo armar
+  uint8_t canalGatilho() const;
+  TipoGatilho tipoGatilho() const;
+  int32_t limiar() const;
+  size_t pre() const;
+  size_t pos() const;
+
+  // Quadro i da janela congelada, em ordem cronologica (0 = mais antigo, pre() = gatilho).
+  // NULL se a captura não está congelada ou i >= pre() + pos()
+  const uint16_t *quadro(size_t i) const;
+
+  // Quadros consecutivos da janela a partir de i sem dar a volta no anel (para enviar em blocos sem copia)
+  size_t contiguos(size_t i) const;
+
+private:
+  bool dispara(uint16_t anterior, uint16_t atual) const;
+  void registraPedido(bool armar, uint8_t canal, TipoGatilho tipo, int32_t limiar, size_t pre, size_t pos);
+  void aplicaPedido();
+
+  uint16_t *_area;
+  size_t _quadros;
+  uint8_t _canais;
+
+  EstadoCaptura _estado;
+  size_t _escrita;  // proximo quadro do anel a gravar
+  size_t _gravados; // quadros gravados desde o armar (satura em _quadros)
+  size_t _inicio;   // quadro do anel onde começa a janela
+  size_t _faltam;   // quadros pos-gatilho ainda a gravar
+  uint16_t _anterior;
+
+  uint8_t _canal;
+  TipoGatilho _tipo;
+  int32_t _limiar;
+  size_t _pre;
+  size_t _pos;
+
+  // pedido de outra task, aplicado pela aquisição no inicio do proximo adiciona(). _sequencia fica impar
+  // enquanto registraPedido() escreve os campos; a aquisição só aplica um pedido copiado entre duas leituras
+  // iguais e pares dela, e guarda em _aplicada a sequencia do ultimo que aplicou
+  volatile uint32_t _sequencia;
+  volatile uint32_t _aplicada;
+  bool _pedidoArmar;
+  uint8_t _pedidoCanal;
+  TipoGatilho _pedidoTipo;
+  int32_t _pedidoLimiar;
+  size_t _pedidoPre;
+  size_t _pedidoPos;
+};
+
+#endif
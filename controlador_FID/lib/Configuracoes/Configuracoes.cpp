@@ -0,0 +1,125 @@
+/*
+ * Registro de configurações do controlador_FID
+ */
+
+#include <string.h>
+#include "Configuracoes.h"
+
+Configuracoes::Configuracoes(const Configuracao *tabela, size_t quantidade)
+{
+  _tabela = tabela;
+  _quantidade = quantidade;
+}
+
+const Configuracao *Configuracoes::busca(const char *nome, size_t len) const
+{
+  for (size_t i = 0; i < _quantidade; i++)
+  {
+    if (strlen(_tabela[i].nome) == len && strncmp(_tabela[i].nome, nome, len) == 0)
+    {
+      return &_tabela[i];
+    }
+  }
+  return NULL;
+}
+
+ResultadoConfig Configuracoes::altera(const char *texto, size_t len)
+{
+  const char *igual = (const char *)memchr(texto, '=', len);
+  if (igual == NULL)
+  {
+    return CONFIG_SINTAXE;
+  }
+
+  const Configuracao *cfg = busca(texto, igual - texto);
+  if (cfg == NULL)
+  {
+    return CONFIG_CHAVE_DESCONHECIDA;
+  }
+
+  const char *valorTexto = igual + 1;
+  size_t valorLen = len - (valorTexto - texto);
+  if (valorLen == 0)
+  {
+    return CONFIG_VALOR_INVALIDO;
+  }
+
+  int32_t novo = 0;
+  if (cfg->tipo == CONFIG_ENUM)
+  {
+    int32_t indice = -1;
+    for (int32_t i = 0; cfg->opcoes[i] != NULL; i++)
+    {
+      if (strlen(cfg->opcoes[i]) == valorLen && strncmp(cfg->opcoes[i], valorTexto, valorLen) == 0)
+      {
+        indice = i;
+        break;
+      }
+    }
+    if (indice < 0)
+    {
+      return CONFIG_VALOR_INVALIDO;
+    }
+    novo = indice;
+  }
+  else
+  {
+    bool negativo = valorTexto[0] == '-';
+    size_t inicio = negativo ? 1 : 0;
+    if (inicio == valorLen || valorLen - inicio > 9)
+    {
+      return CONFIG_VALOR_INVALIDO;
+    }
+    for (size_t i = inicio; i < valorLen; i++)
+    {
+      if (valorTexto[i] < '0' || valorTexto[i] > '9')
+      {
+        return CONFIG_VALOR_INVALIDO;
+      }
+      novo = novo * 10 + (valorTexto[i] - '0');
+    }
+    if (negativo)
+    {
+      novo = -novo;
+    }
+    int32_t minimo = cfg->tipo == CONFIG_BOOL ? 0 : cfg->minimo;
+    int32_t maximo = cfg->tipo == CONFIG_BOOL ? 1 : cfg->maximo;
+    if (novo < minimo || novo > maximo)
+    {
+      return CONFIG_FORA_DA_FAIXA;
+    }
+  }
+
+  *cfg->valor = novo;
+  if (cfg->aplicar != NULL)
+  {
+    cfg->aplicar();
+  }
+  return CONFIG_OK;
+}
+
+void Configuracoes::formata(const Configuracao &cfg, BufferSaida &saida) const
+{
+  saida.adiciona(cfg.nome);
+  saida.adiciona('=');
+  if (cfg.tipo == CONFIG_ENUM)
+  {
+    saida.adiciona(cfg.opcoes[*cfg.valor]);
+  }
+  else
+  {
+    saida.adicionaInteiro(*cfg.valor);
+  }
+}
+
+void Configuracoes::lista(BufferSaida &saida) const
+{
+  for (size_t i = 0; i < _quantidade; i++)
+  {
+    if (i > 0)
+    {
+      saida.adiciona(',');
+    }
+    formata(_tabela[i], saida);
+  }
+}
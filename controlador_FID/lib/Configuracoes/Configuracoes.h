@@ -0,0 +1,72 @@
+/*
+ * Registro de configurações do controlador_FID
+ *
+ * Tabela tipada de parametros que podem ser alterados em tempo de execução
+ * pelo comando C (ex: "Cecho=curto"). Cada entrada aponta para a variavel
+ * global que guarda o valor, os limites aceitos e, opcionalmente, uma função
+ * chamada depois de cada alteração para aplicar o novo valor (ex: mudar a
+ * prioridade de uma task que já está rodando).
+ *
+ * Não depende do Arduino, de modo que pode ser compilado também no host.
+ * As listagens são escritas direto num BufferSaida (lib/BufferSaida).
+ */
+
+#ifndef Configuracoes_h
+#define Configuracoes_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "BufferSaida.h"
+
+enum TipoConfig
+{
+  CONFIG_BOOL, // aceita 0/1
+  CONFIG_INT,  // inteiro decimal entre minimo e maximo
+  CONFIG_ENUM  // um dos nomes em opcoes, guardado como o indice
+};
+
+enum ResultadoConfig
+{
+  CONFIG_OK,
+  CONFIG_SINTAXE,             // faltou o '='
+  CONFIG_CHAVE_DESCONHECIDA,
+  CONFIG_VALOR_INVALIDO,      // não é numero ou não é uma das opções
+  CONFIG_FORA_DA_FAIXA
+};
+
+struct Configuracao
+{
+  const char *nome;
+  TipoConfig tipo;
+  int32_t *valor;
+  int32_t minimo;
+  int32_t maximo;
+  const char *const *opcoes; // nomes dos valores de um CONFIG_ENUM, na ordem dos indices
+  void (*aplicar)();         // chamada apos uma alteração valida. pode ser NULL
+};
+
+class Configuracoes
+{
+public:
+  // Recebe a tabela de configurações. a tabela deve existir enquanto o objeto existir
+  Configuracoes(const Configuracao *tabela, size_t quantidade);
+
+  // Interpreta "chave=valor" (len caracteres) e, se valido, altera a variavel e chama aplicar()
+  ResultadoConfig altera(const char *texto, size_t len);
+
+  // Procura uma configuração pelo nome. devolve NULL se não existir
+  const Configuracao *busca(const char *nome, size_t len) const;
+
+  // Escreve "chave=valor" de uma configuração no buffer de saida
+  void formata(const Configuracao &cfg, BufferSaida &saida) const;
+
+  // Escreve todas as configurações separadas por virgula no buffer de saida. o tamanho da lista não é limitado:
+  // o buffer descarrega sozinho se encher
+  void lista(BufferSaida &saida) const;
+
+private:
+  const Configuracao *_tabela;
+  size_t _quantidade;
+};
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Contagem das passadas pendentes dos workers dos DACs do controlador_FID
+ */
+
+#include "CoordenacaoDacs.h"
+
+CoordenacaoDacs::CoordenacaoDacs(int bancos)
+{
+  _ocupados = bancos;
+}
+
+void CoordenacaoDacs::iniciaNotificacao(int quantidade)
+{
+  __atomic_add_fetch(&_emCurso, 1, __ATOMIC_SEQ_CST);
+  __atomic_add_fetch(&_ocupados, quantidade, __ATOMIC_SEQ_CST);
+}
+
+void CoordenacaoDacs::terminaNotificacao()
+{
+  __atomic_sub_fetch(&_emCurso, 1, __ATOMIC_SEQ_CST);
+}
+
+bool CoordenacaoDacs::concluiPassada()
+{
+  return __atomic_sub_fetch(&_ocupados, 1, __ATOMIC_SEQ_CST) == 0;
+}
+
+uint32_t CoordenacaoDacs::repassa(const OperacoesTroca &operacoes, void *contexto)
+{
+  // o handle novo já foi publicado: quem entrar em iniciaNotificacao() daqui em diante acorda o substituto. os que
+  // já estavam dentro podem ter lido o antigo
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&_emCurso, __ATOMIC_SEQ_CST) != 0)
+  {
+    operacoes.cede(contexto);
+  }
+  uint32_t pendentes = operacoes.tomaNotificacoes(contexto);
+  for (uint32_t i = 0; i < pendentes; i++)
+  {
+    operacoes.acordaSubstituto(contexto);
+  }
+  return pendentes;
+}
@@ -0,0 +1,53 @@
+/*
+ * Contagem das passadas pendentes dos workers dos DACs do controlador_FID
+ *
+ * O changeDacs() soma uma passada por banco que vai acordar antes de notificar o primeiro, e cada worker desconta
+ * uma por notificação atendida: o que zerar a contagem foi o ultimo banco a terminar e baixa o LDAC. se uma
+ * notificação se perde, a contagem nunca mais zera e o LDAC fica alto.
+ *
+ * Na troca de core (core_dacs), o worker antigo cria o substituto e se apaga. um changeDacs() no outro core pode ter
+ * lido o handle antigo e ainda não ter notificado, e notificações que chegaram depois da ultima que o worker tomou
+ * morreriam com ele. repassa() espera os changeDacs() em curso e entrega ao substituto tudo o que ficou para o
+ * antigo. as operações do FreeRTOS vêm por funções, então a coordenação roda também no simulador (simula_fid).
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef CoordenacaoDacs_h
+#define CoordenacaoDacs_h
+
+#include <stdint.h>
+
+// o que repassa() precisa do worker antigo
+struct OperacoesTroca
+{
+  void (*cede)(void *contexto);                 // deixa rodar o changeDacs() em curso (vTaskDelay)
+  uint32_t (*tomaNotificacoes)(void *contexto); // zera e devolve as notificações do antigo (ulTaskNotifyTake)
+  void (*acordaSubstituto)(void *contexto);     // uma notificação ao worker novo (xTaskNotifyGive)
+};
+
+class CoordenacaoDacs
+{
+public:
+  // começa com uma passada por banco: a primeira de cada worker criado no boot
+  explicit CoordenacaoDacs(int bancos);
+
+  // changeDacs(): chamar antes de ler os handles dos workers, com o numero de bancos que vai acordar
+  void iniciaNotificacao(int quantidade);
+  // changeDacs(): depois da ultima notificação
+  void terminaNotificacao();
+
+  // worker: fim de uma passada notificada. true se foi a ultima pendente (baixa o LDAC)
+  bool concluiPassada();
+
+  // worker antigo, depois de publicar o handle do substituto e antes de se apagar. devolve as notificações repassadas
+  uint32_t repassa(const OperacoesTroca &operacoes, void *contexto);
+
+  int ocupados() const { return __atomic_load_n(&_ocupados, __ATOMIC_SEQ_CST); }
+
+private:
+  int _ocupados;
+  int _emCurso = 0; // changeDacs() entre iniciaNotificacao() e terminaNotificacao()
+};
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ * Limite de inclinação das saidas do controlador_FID
+ */
+
+#include "Inclinacao.h"
+
+bool LimitadorInclinacao::avanca(int canal, uint16_t alvo, uint16_t limite, uint32_t agora, uint16_t *saida)
+{
+  uint32_t bit = 1u << canal;
+  int diferenca = (int)alvo - *saida;
+  if (limite == 0 || diferenca == 0)
+  {
+    _emMovimento &= ~bit;
+    *saida = alvo;
+    return diferenca != 0;
+  }
+
+  // parado, o canal anda um periodo; em movimento, os periodos desde o ultimo passo
+  uint32_t decorrido = agora - _ultimoPasso[canal];
+  uint32_t periodos = (_emMovimento & bit) ? decorrido / PERIODO_INCLINACAO : decorrido >= PERIODO_INCLINACAO;
+  if (periodos == 0)
+  {
+    _emMovimento |= bit;
+    return false;
+  }
+  if (periodos > ATRASO_MAXIMO)
+  {
+    periodos = ATRASO_MAXIMO;
+  }
+  uint32_t maximo = (uint32_t)limite * PERIODO_INCLINACAO * periodos;
+  _ultimoPasso[canal] = agora;
+  if ((uint32_t)(diferenca < 0 ? -diferenca : diferenca) <= maximo)
+  {
+    _emMovimento &= ~bit;
+    *saida = alvo;
+  }
+  else
+  {
+    _emMovimento |= bit;
+    *saida += diferenca < 0 ? -(int)maximo : (int)maximo;
+  }
+  return true;
+}
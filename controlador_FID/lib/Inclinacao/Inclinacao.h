@@ -0,0 +1,39 @@
+/*
+ * Limite de inclinação das saidas do controlador_FID
+ *
+ * Cada canal pode ter um limite em codigos por ms (comando I). o W e o D mudam só o alvo do canal; o worker do
+ * banco leva a saida até ele com passos de no maximo limite codigos por ms, escrevendo no DAC só os codigos que
+ * mudaram. enquanto algum canal do banco está em movimento, o worker acorda a cada PERIODO_INCLINACAO ms além das
+ * notificações, então o host manda um unico comando por movimento em vez de muitos degraus pequenos.
+ *
+ * Um LimitadorInclinacao por banco, usado só pelo worker do banco. o instante do ultimo passo de cada canal fica
+ * guardado também depois de ele parar, para que um alvo novo no mesmo ms não some um segundo passo ao ultimo.
+ * se o worker atrasar, o passo seguinte cobre os ms perdidos, e a inclinação media continua a pedida.
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef Inclinacao_h
+#define Inclinacao_h
+
+#include <stdint.h>
+
+#define PERIODO_INCLINACAO 1     // ms entre passos de um canal em movimento
+#define INCLINACAO_MAXIMA 4095   // codigos por ms; acima disso o limite não muda nada
+#define ATRASO_MAXIMO 4096       // ms cobertos por um passo atrasado, para o produto caber em 32 bits
+
+class LimitadorInclinacao
+{
+public:
+  // canal: indice no banco (0 a 31). saida: codigo escrito no DAC, atualizado com o proximo. alvo: pedido pelo
+  // host. limite: codigos por ms, 0 sem limite. agora: relogio em ms. devolve true se a saida mudou
+  bool avanca(int canal, uint16_t alvo, uint16_t limite, uint32_t agora, uint16_t *saida);
+
+  uint32_t emMovimento() const { return _emMovimento; } // canais do banco que ainda não chegaram ao alvo
+
+private:
+  uint32_t _emMovimento = 0;
+  uint32_t _ultimoPasso[32] = {};
+};
+
+#endif
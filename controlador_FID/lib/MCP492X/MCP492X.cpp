@@ -25,15 +25,17 @@
 #include <SPI.h>
 #include "MCP492X.h"
 
-MCP492X::MCP492X(uint8_t pinChipSelect) {
+MCP492X::MCP492X(uint8_t pinChipSelect, uint32_t clockSPI, SPIClass *spi) {
   _pinChipSelect = pinChipSelect;
+  _clockSPI = clockSPI;
+  _spi = spi;
 }
 
 void MCP492X::begin() {
   ::pinMode(_pinChipSelect, OUTPUT);
   ::digitalWrite(_pinChipSelect, 1);
-  SPI.begin();
-  _spiSettings = SPISettings(20000000, MSBFIRST, SPI_MODE0);
+  _spi->begin();
+  _spiSettings = SPISettings(_clockSPI, MSBFIRST, SPI_MODE0);
 }
 
 void MCP492X::analogWrite(unsigned int value) {
@@ -55,26 +57,50 @@ void MCP492X::analogWrite(bool odd, unsigned int value) {
 void MCP492X::analogWrite(
   bool odd, bool buffered, bool gain, bool active, unsigned int value) {
   
-  byte configBits = odd << 3 | buffered << 2 | gain << 1 | active;
-
-  // Compose the first byte to send to the DAC:
-  // the 4 control bits, and the 4 most significant bits of the value
-  byte firstByte = configBits << 4 | (value & 0xF00) >> 8;
-  // Second byte is the lower 8 bits of the value
-  byte secondByte = value & 0xFF;
+  // First byte: the 4 control bits and the 4 most significant bits of the value
+  // Second byte: the lower 8 bits of the value
+  uint16_t word = commandWord(odd, buffered, gain, active, value);
+  byte firstByte = word >> 8;
+  byte secondByte = word & 0xFF;
 
   _beginTransmission();
-  SPI.transfer(firstByte);
-  SPI.transfer(secondByte);  
+  _spi->transfer(firstByte);
+  _spi->transfer(secondByte);  
   _endTransmission();
 }
 
+void MCP492X::writeMany(
+  const MCP492XWrite *writes, size_t count, MCP492XSelect select, void *context) {
+
+  uint16_t words[MCP492X_BATCH];
+
+  _spi->beginTransaction(_spiSettings);
+  for (size_t start = 0; start < count; start += MCP492X_BATCH) {
+    size_t n = count - start < MCP492X_BATCH ? count - start : MCP492X_BATCH;
+    const MCP492XWrite *batch = writes + start;
+
+    for (size_t i = 0; i < n; i++) {
+      words[i] = commandWord(
+        batch[i].odd, batch[i].buffered, batch[i].gain, batch[i].active, batch[i].value);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+      if (select) select(context, batch[i].device, true);
+      else ::digitalWrite(_pinChipSelect, 0);
+      _spi->transfer16(words[i]);
+      if (select) select(context, batch[i].device, false);
+      else ::digitalWrite(_pinChipSelect, 1);
+    }
+  }
+  _spi->endTransaction();
+}
+
 void MCP492X::_beginTransmission() {
   ::digitalWrite(_pinChipSelect, 0);
-  SPI.beginTransaction(_spiSettings);
+  _spi->beginTransaction(_spiSettings);
 }
 
 void MCP492X::_endTransmission() {
-  SPI.endTransaction();
+  _spi->endTransaction();
   ::digitalWrite(_pinChipSelect, 1);
 }
\ No newline at end of file
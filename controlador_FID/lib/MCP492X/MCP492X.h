@@ -29,12 +29,38 @@
 #ifndef MCP492X_h
 #define MCP492X_h
 
+// Maximum number of command words built at once by writeMany()
+#define MCP492X_BATCH 32
+
+// One write of a batch: which device (passed back to the select callback),
+// which output (0 = A, 1 = B, MCP4922 only), the config bits and the value
+struct MCP492XWrite {
+  uint8_t device;
+  bool odd;
+  bool buffered;
+  bool gain;   // 1 = 1x, 0 = 2x
+  bool active; // 1 = active, 0 = shutdown
+  uint16_t value;
+};
+
+// Selects (selected = true) or releases a device during writeMany()
+typedef void (*MCP492XSelect)(void *context, uint8_t device, bool selected);
+
 class MCP492X {
   public:
-    // Constructor, takes the chip select pin
+    // Constructor, takes the chip select pin and, optionally, the SPI clock
+    // in Hz (default 20 MHz, the maximum for the MCP492X) and the SPI bus
+    // (default SPI / VSPI on the ESP32)
     // Use outside any functions:
     // `MCP492X myDac(pinNumber);`
-    MCP492X(uint8_t);
+    MCP492X(uint8_t, uint32_t clockSPI = 20000000, SPIClass *spi = &SPI);
+
+    // Builds the 16 bit command word sent to the DAC (config bits + value).
+    // constexpr, so words for fixed channels/config are folded at compile time.
+    static constexpr uint16_t commandWord(
+      bool odd, bool buffered, bool gain, bool active, uint16_t value) {
+      return (uint16_t)(odd << 15 | buffered << 14 | gain << 13 | active << 12 | (value & 0xFFF));
+    }
 
     // Initilize, starts the SPI bus. Call in setup()
     // Example:
@@ -75,11 +101,29 @@ class MCP492X {
     // ```
     void analogWrite(bool, bool, bool, bool, unsigned int); // Full control over control bits
 
+    // Writes a batch to several devices sharing this bus. All command words
+    // are built up front, the bus is held for the whole batch and each word
+    // goes out as a single 16 bit transfer between select(device, true) and
+    // select(device, false). With select == NULL every write goes to the
+    // chip select passed in the constructor.
+    // Example:
+    // ```
+    // MCP492XWrite writes[] = {{0, 0, 0, 1, 1, 1000}, {1, 0, 0, 1, 1, 2000}};
+    // myDac.writeMany(writes, 2, selectChip, NULL);
+    // ```
+    void writeMany(const MCP492XWrite *, size_t, MCP492XSelect, void *context);
+
   private:
     // Internal fields/methods you should not need to worry about.
     // Holds onto the chip select pin number
     uint8_t _pinChipSelect;
 
+    // SPI clock in Hz, passed in the constructor
+    uint32_t _clockSPI;
+
+    // SPI bus the chip is wired to
+    SPIClass *_spi;
+
     // SPI settings for this chip, set up in begin()
     SPISettings _spiSettings;
 
@@ -253,6 +253,30 @@ public:
     execute(createCmd(ch), data, num, getSplDelay(ch, splFreq));
   }
 
+  /**
+   * Reads the supplied channel paced by an external sample clock and
+   * stores N values in the supplied data array. Before each conversion
+   * the pacer's wait() is called, which blocks until the next sample
+   * instant (e.g. a MCP320xTimer), so the rate does not depend on the
+   * calibration and the CPU is free between samples.
+   * The SPI interface must be initialized and put in a usable state
+   * before calling this function.
+   * @param [in] ch defines the channel to read from.
+   * @param [out] data array to store the values.
+   * @param [in] num number of reads. The data array needs to be
+   * at least that size.
+   * @param [in] pacer object providing wait().
+   */
+  template <typename T, typename Pacer>
+  void readn_paced(Channel ch, T *data, uint16_t num, Pacer &pacer) const
+  {
+    auto cmd = createCmd(ch);
+    for (decltype(num) i=0; i < num; i++) {
+      pacer.wait();
+      data[i] = static_cast<T>(execute(cmd));
+    }
+  }
+
   /**
    * Reads the supplied channel and stores N values in the supplied
    * data array after the predicate is true. As long as the predicate
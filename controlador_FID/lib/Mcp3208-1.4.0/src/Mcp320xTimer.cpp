@@ -0,0 +1,143 @@
+/**
+ * @file Mcp320xTimer.cpp
+ */
+#include "Mcp320xTimer.h"
+
+#if defined(ESP32)
+
+// timer clock is APB (80 MHz), divided down to 1 us ticks
+#define TIMER_DIVIDER 80
+
+MCP320xTimer *MCP320xTimer::sInstances[kTimers] = {};
+
+MCP320xTimer::MCP320xTimer(uint8_t timer)
+  : mTimer(timer)
+  , mHwTimer(nullptr)
+  , mTask(nullptr)
+  , mFreq(0)
+  , mPeriod(0)
+  , mReset(false)
+{
+  resetStats();
+}
+
+template <uint8_t N>
+void IRAM_ATTR MCP320xTimer::isr()
+{
+  sInstances[N]->onTick();
+}
+
+void IRAM_ATTR MCP320xTimer::onTick()
+{
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(mTask, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+bool MCP320xTimer::begin(uint32_t splFreq)
+{
+  static void (*const handlers[kTimers])() = {
+    isr<0>, isr<1>, isr<2>, isr<3>
+  };
+
+  if (mTimer >= kTimers || sInstances[mTimer] || splFreq == 0 || splFreq > 1000000)
+    return false;
+
+  mHwTimer = timerBegin(mTimer, TIMER_DIVIDER, true);
+  if (!mHwTimer) return false;
+
+  mTask = xTaskGetCurrentTaskHandle();
+  sInstances[mTimer] = this;
+  // level-triggered: the ESP32 timer group does not support edge interrupts
+  timerAttachInterrupt(mHwTimer, handlers[mTimer], false);
+  setFrequency(splFreq);
+  timerAlarmEnable(mHwTimer);
+  return true;
+}
+
+void MCP320xTimer::end()
+{
+  if (!mHwTimer) return;
+
+  timerAlarmDisable(mHwTimer);
+  timerDetachInterrupt(mHwTimer);
+  timerEnd(mHwTimer);
+  mHwTimer = nullptr;
+  sInstances[mTimer] = nullptr;
+}
+
+void MCP320xTimer::setFrequency(uint32_t splFreq)
+{
+  if (!mHwTimer || splFreq == 0 || splFreq > 1000000) return;
+
+  mFreq = splFreq;
+  mPeriod = (1000000 + splFreq / 2) / splFreq;
+  timerAlarmWrite(mHwTimer, mPeriod, true);
+  // the statistics belong to the waiting task, let it clear them
+  mReset = true;
+}
+
+void MCP320xTimer::wait()
+{
+  uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  uint32_t now = micros();
+
+  if (mReset) {
+    mReset = false;
+    resetStats();
+  }
+  if (ticks > 1) mOverruns += ticks - 1;
+
+  if (mCount == 0) {
+    mFirst = now;
+  } else {
+    uint32_t interval = now - mLast;
+    uint32_t deviation = interval > mPeriod ? interval - mPeriod : mPeriod - interval;
+    if (deviation > mJitterMax) mJitterMax = deviation;
+    mJitterSum += deviation;
+  }
+  mLast = now;
+  mCount++;
+}
+
+uint32_t MCP320xTimer::getFrequency() const
+{
+  return mFreq;
+}
+
+uint32_t MCP320xTimer::getRate() const
+{
+  uint32_t count = mCount;
+  uint32_t elapsed = mLast - mFirst;
+  if (count < 2 || elapsed == 0) return 0;
+  return static_cast<uint32_t>((static_cast<uint64_t>(count - 1) * 1000000000ULL) / elapsed);
+}
+
+uint32_t MCP320xTimer::getJitter() const
+{
+  return mJitterMax;
+}
+
+uint32_t MCP320xTimer::getMeanJitter() const
+{
+  uint32_t count = mCount;
+  if (count < 2) return 0;
+  return static_cast<uint32_t>(mJitterSum / (count - 1));
+}
+
+uint32_t MCP320xTimer::getOverruns() const
+{
+  return mOverruns;
+}
+
+void MCP320xTimer::resetStats()
+{
+  mCount = 0;
+  mFirst = 0;
+  mLast = 0;
+  mJitterMax = 0;
+  mJitterSum = 0;
+  mOverruns = 0;
+}
+
+#endif
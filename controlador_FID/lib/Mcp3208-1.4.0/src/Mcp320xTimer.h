@@ -0,0 +1,124 @@
+/**
+ * @file Mcp320xTimer.h
+ *
+ * Hardware timer based sample pacing for the MCP320x (ESP32 only).
+ * A general purpose timer fires at the requested sample rate and its
+ * interrupt wakes the sampling task, so the exact rate comes from the
+ * timer instead of a calibrated delayMicroseconds() busy-wait and the
+ * CPU is free between samples.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <Arduino.h>
+
+#if defined(ESP32)
+
+class MCP320xTimer {
+
+public:
+
+  /** Number of general purpose timers available for pacing. */
+  static const uint8_t kTimers = 4;
+
+  /**
+   * Initiates a pacer on the supplied hardware timer.
+   * @param [in] timer the hardware timer number (0 to kTimers - 1).
+   */
+  explicit MCP320xTimer(uint8_t timer);
+
+  /**
+   * Starts the timer at the supplied sample rate. Must be called from
+   * the task that will call wait(), which receives the timer ticks.
+   * @param [in] splFreq sample frequency in hz (1 to 1000000).
+   * @return false if the timer is invalid, in use or the rate is out of range.
+   */
+  bool begin(uint32_t splFreq);
+
+  /**
+   * Stops the timer and releases it.
+   */
+  void end();
+
+  /**
+   * Changes the sample rate of a running pacer and resets the statistics.
+   * May be called from any task.
+   * @param [in] splFreq sample frequency in hz (1 to 1000000).
+   */
+  void setFrequency(uint32_t splFreq);
+
+  /**
+   * Blocks the calling task until the next timer tick. Ticks that
+   * arrive while the task is busy are counted as overruns and
+   * collapsed into a single wake-up.
+   */
+  void wait();
+
+  /**
+   * Returns the configured sample rate.
+   * @return the sample frequency in hz.
+   */
+  uint32_t getFrequency() const;
+
+  /**
+   * Returns the achieved sample rate since the last frequency change
+   * or resetStats(), measured from the wake-up times.
+   * @return the achieved sample frequency in mHz.
+   */
+  uint32_t getRate() const;
+
+  /**
+   * Returns the worst deviation of a wake-up interval from the
+   * configured period since the last reset.
+   * @return the peak jitter in us.
+   */
+  uint32_t getJitter() const;
+
+  /**
+   * Returns the mean absolute deviation of the wake-up intervals from
+   * the configured period since the last reset.
+   * @return the mean jitter in us.
+   */
+  uint32_t getMeanJitter() const;
+
+  /**
+   * Returns the number of timer ticks missed because the task was still
+   * busy with the previous sample.
+   * @return the number of overruns since the last reset.
+   */
+  uint32_t getOverruns() const;
+
+  /**
+   * Clears the rate, jitter and overrun statistics. Must be called from
+   * the waiting task, other tasks should use setFrequency().
+   */
+  void resetStats();
+
+private:
+
+  /** Timer interrupt: wakes the waiting task. */
+  void onTick();
+
+  /** Per timer interrupt trampolines, the Arduino API takes no argument. */
+  template <uint8_t N>
+  static void isr();
+
+  static MCP320xTimer *sInstances[kTimers];
+
+  uint8_t mTimer;
+  hw_timer_t *mHwTimer;
+  TaskHandle_t mTask;
+  volatile uint32_t mFreq;
+  volatile uint32_t mPeriod;   // us
+  volatile bool mReset;
+
+  // statistics, written by the waiting task only
+  uint32_t mCount;
+  uint32_t mFirst;
+  uint32_t mLast;
+  uint32_t mJitterMax;
+  uint64_t mJitterSum;
+  uint32_t mOverruns;
+};
+
+#endif
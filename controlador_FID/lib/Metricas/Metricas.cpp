@@ -0,0 +1,243 @@
+/*
+ * Metricas do controlador_FID no formato texto do Prometheus
+ */
+
+#include <string.h>
+#include "Metricas.h"
+
+const uint32_t FAIXAS_LATENCIA_US[METRICAS_FAIXAS] = {10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Contadores e histogramas
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ContadorNucleos::ContadorNucleos()
+{
+  memset(_fatias, 0, sizeof(_fatias));
+}
+
+uint32_t ContadorNucleos::total() const
+{
+  uint32_t total = 0;
+  for (int nucleo = 0; nucleo < METRICAS_NUCLEOS; nucleo++)
+  {
+    total += __atomic_load_n(&_fatias[nucleo], __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+HistogramaNucleos::HistogramaNucleos(const uint32_t *limites, uint8_t faixas)
+{
+  _limites = limites;
+  _faixas = faixas > METRICAS_FAIXAS ? METRICAS_FAIXAS : faixas;
+  memset(_contagens, 0, sizeof(_contagens));
+  memset(_somas, 0, sizeof(_somas));
+}
+
+// conta só a faixa do valor; o acumulado do formato do Prometheus é montado na leitura
+void HistogramaNucleos::observa(uint8_t nucleo, uint32_t valor)
+{
+  uint8_t faixa = 0;
+  while (faixa < _faixas && valor > _limites[faixa])
+  {
+    faixa++;
+  }
+  __atomic_fetch_add(&_contagens[nucleo][faixa], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&_somas[nucleo], valor, __ATOMIC_RELAXED);
+}
+
+uint32_t HistogramaNucleos::acumulado(uint8_t faixa) const
+{
+  uint32_t total = 0;
+  for (int nucleo = 0; nucleo < METRICAS_NUCLEOS; nucleo++)
+  {
+    for (int f = 0; f <= faixa; f++)
+    {
+      total += __atomic_load_n(&_contagens[nucleo][f], __ATOMIC_RELAXED);
+    }
+  }
+  return total;
+}
+
+uint32_t HistogramaNucleos::soma() const
+{
+  uint32_t total = 0;
+  for (int nucleo = 0; nucleo < METRICAS_NUCLEOS; nucleo++)
+  {
+    total += __atomic_load_n(&_somas[nucleo], __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Exposição
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ExpositorMetricas::ExpositorMetricas(BufferSaida &saida) : _saida(saida) {}
+
+void ExpositorMetricas::familia(const char *nome, const char *tipo, const char *ajuda)
+{
+  _saida.adiciona("# HELP ");
+  _saida.adiciona(nome);
+  _saida.adiciona(' ');
+  _saida.adiciona(ajuda);
+  _saida.adiciona("\n# TYPE ");
+  _saida.adiciona(nome);
+  _saida.adiciona(' ');
+  _saida.adiciona(tipo);
+  _saida.adiciona('\n');
+}
+
+void ExpositorMetricas::contador(const char *nome, const char *ajuda, uint32_t valor)
+{
+  familia(nome, "counter", ajuda);
+  _saida.adiciona(nome);
+  _saida.adiciona(' ');
+  _saida.adicionaDecimal(valor);
+  _saida.adiciona('\n');
+}
+
+void ExpositorMetricas::medidor(const char *nome, const char *ajuda, int32_t valor)
+{
+  familia(nome, "gauge", ajuda);
+  _saida.adiciona(nome);
+  _saida.adiciona(' ');
+  _saida.adicionaInteiro(valor);
+  _saida.adiciona('\n');
+}
+
+void ExpositorMetricas::amostra(const char *nome, const char *rotulo, const char *valorRotulo, int32_t valor)
+{
+  _saida.adiciona(nome);
+  _saida.adiciona('{');
+  _saida.adiciona(rotulo);
+  _saida.adiciona("=\"");
+  _saida.adiciona(valorRotulo);
+  _saida.adiciona("\"} ");
+  _saida.adicionaInteiro(valor);
+  _saida.adiciona('\n');
+}
+
+void ExpositorMetricas::amostra(const char *nome, const char *rotulo, uint32_t valorRotulo, uint32_t valor)
+{
+  _saida.adiciona(nome);
+  _saida.adiciona('{');
+  _saida.adiciona(rotulo);
+  _saida.adiciona("=\"");
+  _saida.adicionaDecimal(valorRotulo);
+  _saida.adiciona("\"} ");
+  _saida.adicionaDecimal(valor);
+  _saida.adiciona('\n');
+}
+
+void ExpositorMetricas::histograma(const char *nome, const char *ajuda, const HistogramaNucleos &h)
+{
+  familia(nome, "histogram", ajuda);
+  for (uint8_t faixa = 0; faixa <= h.faixas(); faixa++)
+  {
+    _saida.adiciona(nome);
+    _saida.adiciona("_bucket{le=\"");
+    if (faixa < h.faixas())
+    {
+      _saida.adicionaDecimal(h.limite(faixa));
+    }
+    else
+    {
+      _saida.adiciona("+Inf");
+    }
+    _saida.adiciona("\"} ");
+    _saida.adicionaDecimal(h.acumulado(faixa));
+    _saida.adiciona('\n');
+  }
+  _saida.adiciona(nome);
+  _saida.adiciona("_sum ");
+  _saida.adicionaDecimal(h.soma());
+  _saida.adiciona('\n');
+  _saida.adiciona(nome);
+  _saida.adiciona("_count ");
+  _saida.adicionaDecimal(h.acumulado(h.faixas()));
+  _saida.adiciona('\n');
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Metricas do caminho de controle
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ContadoresFID::ContadoresFID()
+    : latenciaDac(FAIXAS_LATENCIA_US, METRICAS_FAIXAS), passadaDac(FAIXAS_LATENCIA_US, METRICAS_FAIXAS),
+      processamento(FAIXAS_LATENCIA_US, METRICAS_FAIXAS)
+{
+}
+
+void escreveContadoresFID(ExpositorMetricas &expositor, const ContadoresFID &contadores)
+{
+  expositor.contador("fid_comandos_total", "Comandos recebidos pelo socket.", contadores.comandos.total());
+  expositor.familia("fid_erros_total", "counter", "Respostas de erro por codigo (E1, E2...).");
+  for (uint32_t codigo = 1; codigo < METRICAS_CODIGOS; codigo++)
+  {
+    uint32_t total = contadores.erros[codigo].total();
+    if (total > 0)
+    {
+      expositor.amostra("fid_erros_total", "codigo", codigo, total);
+    }
+  }
+  expositor.contador("fid_dac_escritas_total", "Palavras escritas nos DACs.", contadores.escritasDac.total());
+  expositor.contador("fid_dac_passadas_total", "Atualizacoes completas dos DACs.", contadores.passadasDac.total());
+  expositor.contador("fid_adc_amostras_total", "Amostras lidas do ADC.", contadores.amostrasAdc.total());
+  expositor.histograma("fid_dac_latencia_us", "Do comando aceito ate o worker dos DACs acordar.",
+                       contadores.latenciaDac);
+  expositor.histograma("fid_dac_passada_us", "Do comando aceito ate o ultimo banco de DACs terminar.",
+                       contadores.passadaDac);
+  expositor.histograma("fid_processamento_us", "Interpretacao de um comando.", contadores.processamento);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// HTTP
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PedidoHTTP avaliaPedidoHTTP(const char *dados, size_t len)
+{
+  // o pedido termina na primeira linha vazia. aceita \r\n e \n
+  bool completo = false;
+  for (size_t i = 1; i < len && !completo; i++)
+  {
+    completo = dados[i] == '\n' && (dados[i - 1] == '\n' || (i >= 2 && dados[i - 1] == '\r' && dados[i - 2] == '\n'));
+  }
+  if (!completo)
+  {
+    return HTTP_INCOMPLETO;
+  }
+  if (len < 6 || strncmp(dados, "GET /", 5) != 0)
+  {
+    return HTTP_INVALIDO;
+  }
+  const char *caminho = dados + 4;
+  size_t fim = strcspn(caminho, " ?\r\n");
+  if (caminho[fim] != ' ' && caminho[fim] != '?')
+  {
+    return HTTP_INVALIDO; // sem a versão do HTTP
+  }
+  if (fim == 8 && strncmp(caminho, "/metrics", 8) == 0)
+  {
+    return HTTP_METRICAS;
+  }
+  return HTTP_NAO_ENCONTRADO;
+}
+
+void respondeHTTP(BufferSaida &saida, PedidoHTTP pedido)
+{
+  switch (pedido)
+  {
+  case HTTP_METRICAS:
+    saida.adiciona("HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                   "Connection: close\r\n\r\n");
+    break;
+  case HTTP_NAO_ENCONTRADO:
+    saida.adiciona("HTTP/1.0 404 Not Found\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n"
+                   "use /metrics\n");
+    break;
+  default:
+    saida.adiciona("HTTP/1.0 400 Bad Request\r\nContent-Type: text/plain\r\nConnection: close\r\n\r\n");
+    break;
+  }
+}
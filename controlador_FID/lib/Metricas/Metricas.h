@@ -0,0 +1,127 @@
+/*
+ * Metricas do controlador_FID no formato texto do Prometheus
+ *
+ * Contadores e histogramas com uma fatia por core: cada task incrementa só
+ * a fatia do core em que roda, com um add atomico relaxado (sem lock, sem
+ * disputa entre os cores), e a leitura soma as fatias na hora da coleta.
+ * Assim a coleta nunca segura o caminho de controle; o preço é que uma
+ * coleta pode ver um contador um incremento atrasado em relação a outro.
+ * Os valores são de 32 bits e dão a volta; o Prometheus trata a volta de
+ * um contador como um reinicio.
+ *
+ * O servidor é um respondedor HTTP minimo sobre memoria fixa: avaliaPedidoHTTP()
+ * reconhece "GET /metrics" no pedido já recebido e respondeHTTP() escreve a
+ * linha de status e os cabeçalhos num BufferSaida, seguidos do corpo gerado
+ * pelo ExpositorMetricas. A resposta é HTTP/1.0 com Connection: close, sem
+ * Content-Length, e sai em pedaços do tamanho do buffer.
+ *
+ * ContadoresFID reune as metricas do caminho de controle, comuns ao firmware
+ * e ao servidor de teste no host (tools/metricas_host.cpp), para que os dois
+ * exponham as mesmas familias. Não depende do Arduino.
+ */
+
+#ifndef Metricas_h
+#define Metricas_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <BufferSaida.h>
+
+#define METRICAS_NUCLEOS 2  // cores do ESP32. no host, uma fatia por thread
+#define METRICAS_FAIXAS 12  // faixas dos histogramas, sem contar a +Inf
+#define METRICAS_CODIGOS 16 // codigos de erro dos comandos (E1 a E15)
+
+// Contador monotonicamente crescente, uma fatia por core
+class ContadorNucleos
+{
+public:
+  ContadorNucleos();
+  void soma(uint8_t nucleo, uint32_t n = 1)
+  {
+    __atomic_fetch_add(&_fatias[nucleo], n, __ATOMIC_RELAXED);
+  }
+  uint32_t total() const;
+
+private:
+  uint32_t _fatias[METRICAS_NUCLEOS];
+};
+
+// Histograma de faixas fixas (limites crescentes, inclusivos), uma fatia por core.
+// valores acima do ultimo limite caem na faixa +Inf
+class HistogramaNucleos
+{
+public:
+  HistogramaNucleos(const uint32_t *limites, uint8_t faixas);
+  void observa(uint8_t nucleo, uint32_t valor);
+
+  uint8_t faixas() const { return _faixas; }
+  uint32_t limite(uint8_t faixa) const { return _limites[faixa]; }
+  uint32_t acumulado(uint8_t faixa) const; // observações <= limite(faixa). faixa == faixas(): todas
+  uint32_t soma() const;                   // soma dos valores observados
+
+private:
+  const uint32_t *_limites;
+  uint8_t _faixas;
+  uint32_t _contagens[METRICAS_NUCLEOS][METRICAS_FAIXAS + 1];
+  uint32_t _somas[METRICAS_NUCLEOS];
+};
+
+// limites em us usados nos histogramas de latencia do controlador
+extern const uint32_t FAIXAS_LATENCIA_US[METRICAS_FAIXAS];
+
+// Escreve familias de metricas no formato texto 0.0.4 do Prometheus. nomes e rotulos não são escapados:
+// o chamador usa só [a-z0-9_]
+class ExpositorMetricas
+{
+public:
+  ExpositorMetricas(BufferSaida &saida);
+
+  // metrica sem rotulos, com HELP e TYPE. contadores devem terminar em _total
+  void contador(const char *nome, const char *ajuda, uint32_t valor);
+  void medidor(const char *nome, const char *ajuda, int32_t valor);
+
+  // familia com rotulos: familia() uma vez e amostra() por serie
+  void familia(const char *nome, const char *tipo, const char *ajuda);
+  void amostra(const char *nome, const char *rotulo, const char *valorRotulo, int32_t valor);
+  void amostra(const char *nome, const char *rotulo, uint32_t valorRotulo, uint32_t valor);
+
+  // histograma completo: _bucket por faixa, _sum e _count
+  void histograma(const char *nome, const char *ajuda, const HistogramaNucleos &h);
+
+private:
+  void valor(int32_t v);
+  BufferSaida &_saida;
+};
+
+// metricas do caminho de controle, incrementadas pelas tasks e somadas na coleta
+struct ContadoresFID
+{
+  ContadorNucleos comandos;                  // comandos recebidos
+  ContadorNucleos erros[METRICAS_CODIGOS];   // respostas de erro por codigo
+  ContadorNucleos escritasDac;               // palavras escritas nos DACs
+  ContadorNucleos passadasDac;               // atualizações completas dos DACs
+  ContadorNucleos amostrasAdc;               // amostras lidas do ADC (canais x quadros)
+  HistogramaNucleos latenciaDac;             // changeDacs() até o worker acordar, em us
+  HistogramaNucleos passadaDac;              // changeDacs() até o ultimo banco terminar, em us
+  HistogramaNucleos processamento;           // interpretação de um comando, em us
+  ContadoresFID();
+};
+
+void escreveContadoresFID(ExpositorMetricas &expositor, const ContadoresFID &contadores);
+
+enum PedidoHTTP
+{
+  HTTP_INCOMPLETO,      // cabeçalhos ainda não terminaram
+  HTTP_METRICAS,        // GET /metrics
+  HTTP_NAO_ENCONTRADO,  // GET de outro caminho
+  HTTP_INVALIDO         // outro metodo ou linha de pedido malformada
+};
+
+// avalia os len bytes recebidos até agora
+PedidoHTTP avaliaPedidoHTTP(const char *dados, size_t len);
+
+// linha de status e cabeçalhos. para HTTP_METRICAS o corpo vem em seguida pelo ExpositorMetricas;
+// para os demais escreve também um corpo curto
+void respondeHTTP(BufferSaida &saida, PedidoHTTP pedido);
+
+#endif
@@ -0,0 +1,820 @@
+/*
+ * Protocolo de comandos do controlador_FID
+ */
+
+#include <string.h>
+#include "Protocolo.h"
+#include "Autenticacao.h"
+#include "Inclinacao.h"
+
+Enquadrador::Enquadrador(char *area, size_t tamanho) : _area(area), _tamanho(tamanho), _usado(0)
+{
+  _area[0] = '\0';
+}
+
+void Enquadrador::inicia()
+{
+  _usado = 0;
+}
+
+void Enquadrador::recebe(char z)
+{
+  if (_usado < _tamanho - 1)
+  {
+    _area[_usado++] = z;
+    if (z == '\r' && _usado < _tamanho - 1)
+    {
+      _area[_usado++] = '\0';
+    }
+  }
+}
+
+size_t Enquadrador::termina()
+{
+  _area[_usado] = '\0';
+  return _usado;
+}
+
+bool fimMensagem(char c)
+{
+  return c == '\0' || c == '\r' || c == '\n';
+}
+
+bool pedeEstado(const char *argumentos)
+{
+  return fimMensagem(argumentos[0]) || (argumentos[0] == '?' && fimMensagem(argumentos[1]));
+}
+
+Comando identificaComando(const char *mensagem)
+{
+  switch (mensagem[0])
+  {
+  case 'W':
+    return COMANDO_W;
+  case 'D':
+    return COMANDO_D;
+  case 'R':
+    return COMANDO_R;
+  case 'S':
+    return COMANDO_S;
+  case 'C':
+    return COMANDO_C;
+  case 'P':
+    return COMANDO_P;
+  case 'G':
+    return COMANDO_G;
+  case 'A':
+    return COMANDO_A;
+  case 'F':
+    return COMANDO_F;
+  case 'L':
+    return COMANDO_L;
+  case 'T':
+    return COMANDO_T;
+  case 'N':
+    return COMANDO_N;
+  case 'I':
+    return COMANDO_I;
+  default:
+    return COMANDO_DESCONHECIDO;
+  }
+}
+
+// até maximo digitos decimais a partir de *p, que avança. devolve quantos foram lidos
+static int leDecimal(const char **p, int maximo, uint32_t *valor)
+{
+  int digitos = 0;
+  *valor = 0;
+  while (**p >= '0' && **p <= '9' && digitos < maximo)
+  {
+    *valor = *valor * 10 + (*(*p)++ - '0');
+    digitos++;
+  }
+  return digitos;
+}
+
+// "cc=" do P, F e I: canal de 1 ou 2 digitos, menor que canais, e o '='. devolve false se fora do formato
+static bool leCanal(const char **p, int canais, uint8_t *canal)
+{
+  uint32_t valor;
+  if (leDecimal(p, 2, &valor) == 0 || valor >= (uint32_t)canais || *(*p)++ != '=')
+  {
+    return false;
+  }
+  *canal = valor;
+  return true;
+}
+
+int extraiCorrelacao(const char *mensagem, uint32_t *id, const char **comando)
+{
+  const char *p = mensagem + 1;
+  uint64_t valor = 0;
+  int digitos = 0;
+  while (*p >= '0' && *p <= '9' && digitos < 10)
+  {
+    valor = valor * 10 + (*p++ - '0');
+    digitos++;
+  }
+  if (digitos == 0 || valor == 0 || valor > UINT32_MAX || *p++ != ' ')
+  {
+    return 13;
+  }
+  *id = valor;
+  *comando = p;
+  return 0;
+}
+
+int interpretaW(const char *mensagem, int canais, uint16_t *valores, int *canalErro)
+{
+  for (int canal = 0; canal < canais; canal++)
+  {
+    *canalErro = canal;
+    const char *campo = mensagem + 5 * canal + 1;
+    if (campo[0] != letraCanal(canal))
+    {
+      return 2;
+    }
+    int valor = 0;
+    for (int digito = 1; digito <= 4; digito++)
+    {
+      if (campo[digito] < '0' || campo[digito] > '9')
+      {
+        return 3;
+      }
+      valor = valor * 10 + (campo[digito] - '0');
+    }
+    if (valor > 4095)
+    {
+      return 4;
+    }
+    valores[canal] = valor;
+  }
+  if (!fimMensagem(mensagem[5 * canais + 1]))
+  {
+    *canalErro = canais;
+    return 2;
+  }
+  return 0;
+}
+
+// canal em decimal a partir de 0 (A = 0) e valor de 0 a 4095. o tamanho da mensagem cresce com o numero de canais
+// alterados, não com o total de canais da placa
+int interpretaD(const char *mensagem, int canais, AlteracaoCanal *alteracoes, int *quantidade)
+{
+  const char *p = mensagem + 1;
+  int n = 0;
+  for (;;)
+  {
+    uint32_t canal;
+    uint32_t valor;
+    if (leDecimal(&p, 2, &canal) == 0 || *p++ != '=' || canal >= (uint32_t)canais || n == canais)
+    {
+      return 8;
+    }
+    if (leDecimal(&p, 4, &valor) == 0 || valor > 4095)
+    {
+      return 8;
+    }
+    alteracoes[n].canal = canal;
+    alteracoes[n].valor = valor;
+    n++;
+    if (*p != ',')
+    {
+      break;
+    }
+    p++;
+  }
+  if (!fimMensagem(*p))
+  {
+    return 8;
+  }
+  *quantidade = n;
+  return 0;
+}
+
+// ganho 1 ou 2, buffer da referencia 0 ou 1, saida ativa 0 ou 1
+int interpretaP(const char *mensagem, int canais, ConfiguracaoCanal *configuracao)
+{
+  const char *p = mensagem + 1;
+  if (!leCanal(&p, canais, &configuracao->canal) || (p[0] != '1' && p[0] != '2') || p[1] != ',' ||
+      (p[2] != '0' && p[2] != '1') || p[3] != ',' || (p[4] != '0' && p[4] != '1') || !fimMensagem(p[5]))
+  {
+    return 9;
+  }
+  configuracao->ganho = p[0] - '0';
+  configuracao->buffer = p[2] == '1';
+  configuracao->ativo = p[4] == '1';
+  return 0;
+}
+
+// limiar negativo só para o gatilho de inclinação de descida. os limites de pre e pos ficam com a Captura
+int interpretaG(const char *mensagem, int canais, PedidoCaptura *pedido)
+{
+  const char *p = mensagem + 1;
+  if ((p[0] == 'L' || p[0] == 'X') && fimMensagem(p[1]))
+  {
+    pedido->acao = p[0];
+    return 0;
+  }
+
+  // Gcc,t,limiar,pre,pos
+  int32_t campos[4] = {0, 0, 0, 0}; // canal, limiar, pre, pos
+  char tipo = 0;
+  for (int i = 0; i < 5; i++)
+  {
+    if (i == 1)
+    {
+      tipo = *p++;
+    }
+    else
+    {
+      bool negativo = i == 2 && *p == '-';
+      if (negativo)
+      {
+        p++;
+      }
+      uint32_t valor;
+      if (leDecimal(&p, 5, &valor) == 0)
+      {
+        return 10;
+      }
+      campos[i == 0 ? 0 : i - 1] = negativo ? -(int32_t)valor : (int32_t)valor;
+    }
+    if (i < 4 && *p++ != ',')
+    {
+      return 10;
+    }
+  }
+  if ((tipo != 'S' && tipo != 'D' && tipo != 'I') || !fimMensagem(*p) || campos[0] >= canais)
+  {
+    return 10;
+  }
+  pedido->acao = 'G';
+  pedido->canal = campos[0];
+  pedido->tipo = tipo;
+  pedido->limiar = campos[1];
+  pedido->pre = campos[2];
+  pedido->pos = campos[3];
+  return 0;
+}
+
+// bit 0 = canal 0. "A0" desliga o fluxo
+int interpretaA(const char *mensagem, int canais, uint64_t *mascara)
+{
+  const char *p = mensagem + 1;
+  uint64_t valor = 0;
+  int digitos = 0;
+  for (;; p++)
+  {
+    int digito;
+    if (*p >= '0' && *p <= '9')
+      digito = *p - '0';
+    else if (*p >= 'A' && *p <= 'F')
+      digito = *p - 'A' + 10;
+    else if (*p >= 'a' && *p <= 'f')
+      digito = *p - 'a' + 10;
+    else
+      break;
+    valor = valor << 4 | digito;
+    digitos++;
+  }
+  if (digitos == 0 || digitos > 16 || !fimMensagem(*p) || (canais < 64 && (valor >> canais) != 0))
+  {
+    return 11;
+  }
+  *mascara = valor;
+  return 0;
+}
+
+// rampa de 1 a 65535 codigos por segundo
+int interpretaF(const char *mensagem, int canais, SegurancaCanal *seguranca)
+{
+  const char *p = mensagem + 1;
+  if (!leCanal(&p, canais, &seguranca->canal))
+  {
+    return 12;
+  }
+  char modo = *p++;
+  uint32_t rampa = 0;
+  if (modo == 'R')
+  {
+    if (*p++ != ',' || leDecimal(&p, 5, &rampa) == 0 || rampa == 0 || rampa > 65535)
+    {
+      return 12;
+    }
+  }
+  if ((modo != 'M' && modo != 'Z' && modo != 'R') || !fimMensagem(*p))
+  {
+    return 12;
+  }
+  seguranca->modo = modo;
+  seguranca->rampa = rampa;
+  return 0;
+}
+
+// limite de 0 (sem limite) a INCLINACAO_MAXIMA codigos por ms
+int interpretaI(const char *mensagem, int canais, InclinacaoCanal *inclinacao)
+{
+  const char *p = mensagem + 1;
+  uint32_t limite;
+  if (!leCanal(&p, canais, &inclinacao->canal) || leDecimal(&p, 4, &limite) == 0 || limite > INCLINACAO_MAXIMA ||
+      !fimMensagem(*p))
+  {
+    return 15;
+  }
+  inclinacao->limite = limite;
+  return 0;
+}
+
+// "Nnnnnnnnnnnnnnnnn": nonce do host em hexadecimal e, depois dos digitos, só o fim da mensagem
+int interpretaN(const char *mensagem, uint64_t *nonce)
+{
+  if (!leHex(mensagem + 1, DIGITOS_NONCE, nonce) || !fimMensagem(mensagem[1 + DIGITOS_NONCE]))
+  {
+    return 14;
+  }
+  return 0;
+}
+
+const char *argumentosC(const char *mensagem, size_t *len)
+{
+  const char *texto = mensagem + 1;
+  if (*texto == ' ')
+  {
+    texto++;
+  }
+  *len = strcspn(texto, "\r\n");
+  return texto;
+}
+
+int erroConfig(ResultadoConfig resultado)
+{
+  switch (resultado)
+  {
+  case CONFIG_OK:
+    return 0;
+  case CONFIG_SINTAXE:
+    return 5;
+  case CONFIG_CHAVE_DESCONHECIDA:
+    return 6;
+  default:
+    return 7; // valor invalido ou fora da faixa
+  }
+}
+
+void escreveAceito(BufferSaida &saida, const FormatoResposta &formato, const char *mensagem)
+{
+  if (formato.modo == RESPOSTA_COMPACTA)
+  {
+    if (formato.eco != ECO_NENHUM)
+    {
+      escreveCompacto(saida, formato, "OK");
+    }
+  }
+  else if (formato.eco == ECO_COMPLETO)
+  {
+    saida.adiciona('\n');
+    saida.adiciona(mensagem);
+  }
+  else if (formato.eco == ECO_CURTO)
+  {
+    saida.adiciona("\nOK");
+  }
+}
+
+void escreveCompacto(BufferSaida &saida, const FormatoResposta &formato, const char *codigo)
+{
+  saida.adiciona(codigo);
+  saida.adiciona(',');
+  saida.adicionaDecimal(formato.sequencia);
+  if (formato.comTempo)
+  {
+    saida.adiciona(',');
+    saida.adicionaDecimal(formato.instante);
+  }
+  saida.adiciona('\n');
+}
+
+// o campo do canal no W, até 5 caracteres e sem passar do fim da mensagem
+static void adicionaCampoW(BufferSaida &saida, const char *mensagem, int canal)
+{
+  const char *campo = mensagem + (5 * canal + 1);
+  saida.adiciona(campo, strnlen(campo, 5));
+}
+
+void escreveErro(BufferSaida &saida, const FormatoResposta &formato, const ParametrosProtocolo &parametros, int codigo,
+                 int canal, const char *mensagem)
+{
+  if (formato.modo == RESPOSTA_COMPACTA)
+  {
+    char codigoSTR[] = "E00";
+    if (codigo < 10)
+    {
+      codigoSTR[1] = '0' + codigo;
+      codigoSTR[2] = '\0';
+    }
+    else
+    {
+      codigoSTR[1] = '0' + codigo / 10;
+      codigoSTR[2] = '0' + codigo % 10;
+    }
+    escreveCompacto(saida, formato, codigoSTR);
+    return;
+  }
+  switch (codigo)
+  {
+  case 1:
+    saida.adiciona("\ncomando não reconhecido\nA mensagem deve começar com W ou D para variar a corrente, R para leitura, S para status, C para configuração, P para configuração dos canais, G para captura do ADC, A para o fluxo binario do ADC, F para o estado seguro dos canais, I para o limite de inclinação das saidas, L para o registro de eventos, T para os rastros de latencia e N para iniciar a sessão autenticada. \"#id \" antes de qualquer comando o rastreia");
+    break;
+  case 2:
+    saida.adiciona("\nE2:mensagem fora do padrão. Erro nas letras\nRecebido: ");
+    saida.adiciona(mensagem);
+    saida.adiciona("\nFormato esperado: WA0000B0000... (uma letra e 4 digitos por canal, ");
+    saida.adicionaDecimal(parametros.canais);
+    saida.adiciona(" canais)\nAs letras devem começar em A e estar em ordem. as unicas variáveis são os números ");
+    break;
+  case 3:
+    saida.adiciona("\nE3:mensagem fora do padrão. valores de ajuste dos dacs precisam ser numeros\nRcebido: ");
+    saida.adiciona(mensagem);
+    saida.adiciona("\nErro na parte: ");
+    adicionaCampoW(saida, mensagem, canal);
+    break;
+  case 4:
+    saida.adiciona("\nE4:mensagem fora do padrão. valores precisam estar entre 0 e 4095\nRcebido: ");
+    saida.adiciona(mensagem);
+    saida.adiciona("\nErro na parte: ");
+    adicionaCampoW(saida, mensagem, canal);
+    break;
+  case 5:
+    saida.adiciona("\nE5:configuração fora do padrão. Formato esperado: Cchave=valor");
+    break;
+  case 6:
+    saida.adiciona("\nE6:configuração desconhecida. Envie C para listar as configurações");
+    break;
+  case 7:
+    saida.adiciona("\nE7:valor de configuração invalido ou fora da faixa");
+    break;
+  case 8:
+    saida.adiciona("\nE8:comando D fora do padrão. Formato esperado: Dcc=vvvv,cc=vvvv... com canal de 0 a ");
+    saida.adicionaDecimal(parametros.canais - 1);
+    saida.adiciona(" e valor de 0 a 4095\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  case 9:
+    saida.adiciona("\nE9:comando P fora do padrão. Formato esperado: Pcc=g,b,a com canal de 0 a ");
+    saida.adicionaDecimal(parametros.canais - 1);
+    saida.adiciona(", ganho 1 ou 2, buffer 0 ou 1 e ativo 0 ou 1\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  case 10:
+    saida.adiciona("\nE10:comando G fora do padrão. Formatos: G (estado), Gcc,t,limiar,pre,pos (arma, t = S subida, D descida ou I inclinação), GL (envia a captura congelada), GX (cancela). pre + pos até ");
+    saida.adicionaDecimal(parametros.quadrosCaptura);
+    saida.adiciona(" quadros\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  case 11:
+    saida.adiciona("\nE11:comando A fora do padrão. Formatos: A (estado), Ammmm (mascara hexadecimal dos canais a enviar, bit 0 = canal 0), A0 (desliga)\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  case 12:
+    saida.adiciona("\nE12:comando F fora do padrão. Formato esperado: Fcc=M (mantem), Fcc=Z (zera) ou Fcc=R,rrrr (rampa de rrrr codigos/s, 1 a 65535) com canal de 0 a ");
+    saida.adicionaDecimal(parametros.canais - 1);
+    saida.adiciona("\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  case 13:
+    saida.adiciona("\nE13:identificador de correlação fora do padrão. Formato esperado: #nnnn seguido de espaço e do comando, nnnn de 1 a 4294967295");
+    break;
+  case 14:
+    saida.adiciona(parametros.comChave ? "\nE14:comando não autenticado (" : "\nE14:autenticação indisponivel, sem CHAVE_COMANDOS (");
+    saida.adiciona(canal == QUADRO_SEM_SESSAO     ? "sem sessão"
+                   : canal == QUADRO_TAG_INVALIDA ? "tag invalida"
+                   : canal == QUADRO_REPETIDO     ? "sequencia repetida"
+                                                  : "formato");
+    saida.adiciona("). Inicie a sessão com Nnnnnnnnnnnnnnnnn (nonce de 16 digitos hexadecimais) e envie cada comando como @ssssssss,tttttttttttttttt comando, com sequencia crescente e a tag SipHash-2-4 da sessão");
+    break;
+  case 15:
+    saida.adiciona("\nE15:comando I fora do padrão. Formato esperado: Icc=llll (limite de llll codigos por ms, 0 a ");
+    saida.adicionaDecimal(INCLINACAO_MAXIMA);
+    saida.adiciona(", 0 sem limite) com canal de 0 a ");
+    saida.adicionaDecimal(parametros.canais - 1);
+    saida.adiciona("\nRecebido: ");
+    saida.adiciona(mensagem);
+    break;
+  }
+}
+
+void escreveSessao(BufferSaida &saida, uint64_t nonceControlador)
+{
+  char resposta[2 + DIGITOS_NONCE + 1] = "\nN";
+  escreveHex(nonceControlador, DIGITOS_NONCE, resposta + 2);
+  resposta[2 + DIGITOS_NONCE] = '\0';
+  saida.adiciona(resposta);
+}
+
+void escreveCanalP(BufferSaida &saida, const ConfiguracaoCanal &configuracao)
+{
+  saida.adiciona("\nP");
+  saida.adicionaDecimal(configuracao.canal, 2);
+  saida.adiciona('=');
+  saida.adicionaDecimal(configuracao.ganho);
+  saida.adiciona(',');
+  saida.adicionaDecimal(configuracao.buffer);
+  saida.adiciona(',');
+  saida.adicionaDecimal(configuracao.ativo);
+}
+
+// ",divergente": a leitura do ADC do canal não acompanha a saida
+void escreveCanalF(BufferSaida &saida, const SegurancaCanal &seguranca, bool divergente)
+{
+  saida.adiciona("\nF");
+  saida.adicionaDecimal(seguranca.canal, 2);
+  saida.adiciona('=');
+  saida.adiciona(seguranca.modo);
+  if (seguranca.modo == 'R')
+  {
+    saida.adiciona(',');
+    saida.adicionaDecimal(seguranca.rampa);
+  }
+  if (divergente)
+  {
+    saida.adiciona(",divergente");
+  }
+}
+
+void escreveCanalI(BufferSaida &saida, const InclinacaoCanal &inclinacao)
+{
+  saida.adiciona("\nI");
+  saida.adicionaDecimal(inclinacao.canal, 2);
+  saida.adiciona('=');
+  saida.adicionaDecimal(inclinacao.limite);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// despacho de uma mensagem
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void respondeErro(Controlador &controlador, BufferSaida &saida, int codigo, int canal, const char *mensagem)
+{
+  controlador.erro(codigo, canal);
+  escreveErro(saida, controlador.formato(), controlador.parametros(), codigo, canal, mensagem);
+}
+
+// a mensagem inteira é validada antes de alterar qualquer canal
+static void avaliaW(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  if (controlador.repeteW(mensagem))
+  {
+    FormatoResposta formato = controlador.formato();
+    if (formato.modo == RESPOSTA_COMPACTA && formato.eco != ECO_NENHUM)
+    {
+      escreveCompacto(saida, formato, "OK"); // nada a alterar, a saida já está no estado pedido
+    }
+    return;
+  }
+  uint16_t valores[CANAIS_PROTOCOLO_MAX];
+  int canalErro = 0;
+  int erro = interpretaW(mensagem, controlador.parametros().canais, valores, &canalErro);
+  if (erro != 0)
+  {
+    respondeErro(controlador, saida, erro, canalErro, mensagem);
+    return;
+  }
+  controlador.aplicaW(mensagem, valores);
+  escreveAceito(saida, controlador.formato(), mensagem);
+}
+
+static void avaliaD(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  AlteracaoCanal alteracoes[CANAIS_PROTOCOLO_MAX];
+  int quantidade = 0;
+  if (interpretaD(mensagem, controlador.parametros().canais, alteracoes, &quantidade) != 0)
+  {
+    respondeErro(controlador, saida, 8, 0, mensagem);
+    return;
+  }
+  controlador.aplicaD(alteracoes, quantidade);
+  escreveAceito(saida, controlador.formato(), mensagem);
+}
+
+// "C" ou "C?" lista as configurações, "Cchave=valor" (ou "C chave=valor") altera uma delas e devolve o novo valor
+static void avaliaC(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  Configuracoes &config = controlador.configuracoes();
+  size_t len;
+  const char *texto = argumentosC(mensagem, &len);
+  if (len == 0 || (len == 1 && texto[0] == '?'))
+  {
+    saida.adiciona('\n');
+    config.lista(saida);
+    return;
+  }
+  int erro = erroConfig(config.altera(texto, len));
+  if (erro != 0)
+  {
+    respondeErro(controlador, saida, erro, 0, mensagem);
+    return;
+  }
+  const Configuracao *alterada = config.busca(texto, strchr(texto, '=') - texto);
+  controlador.alterouConfiguracao(*alterada);
+  saida.adiciona('\n');
+  config.formata(*alterada, saida);
+}
+
+static void avaliaP(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  int canais = controlador.parametros().canais;
+  if (pedeEstado(mensagem + 1))
+  {
+    for (int canal = 0; canal < canais; canal++)
+    {
+      escreveCanalP(saida, controlador.canalP(canal));
+    }
+    return;
+  }
+  ConfiguracaoCanal configuracao;
+  if (interpretaP(mensagem, canais, &configuracao) != 0)
+  {
+    respondeErro(controlador, saida, 9, 0, mensagem);
+    return;
+  }
+  controlador.aplicaP(configuracao);
+  escreveCanalP(saida, controlador.canalP(configuracao.canal));
+}
+
+static void avaliaG(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    controlador.consulta(COMANDO_G, saida);
+    return;
+  }
+  PedidoCaptura pedido;
+  int erro = interpretaG(mensagem, controlador.parametros().canais, &pedido);
+  if (erro == 0)
+  {
+    erro = controlador.aplicaG(pedido, saida);
+  }
+  if (erro != 0)
+  {
+    respondeErro(controlador, saida, erro, 0, mensagem);
+    return;
+  }
+  if (pedido.acao != 'L') // o 'L' já respondeu com a captura
+  {
+    escreveAceito(saida, controlador.formato(), mensagem);
+  }
+}
+
+static void avaliaA(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    controlador.consulta(COMANDO_A, saida);
+    return;
+  }
+  uint64_t mascara;
+  if (interpretaA(mensagem, controlador.parametros().canais, &mascara) != 0)
+  {
+    respondeErro(controlador, saida, 11, 0, mensagem);
+    return;
+  }
+  controlador.aplicaA(mascara);
+  escreveAceito(saida, controlador.formato(), mensagem);
+}
+
+static void avaliaF(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  int canais = controlador.parametros().canais;
+  if (pedeEstado(mensagem + 1))
+  {
+    for (int canal = 0; canal < canais; canal++)
+    {
+      escreveCanalF(saida, controlador.canalF(canal), controlador.divergente(canal));
+    }
+    return;
+  }
+  SegurancaCanal seguranca;
+  if (interpretaF(mensagem, canais, &seguranca) != 0)
+  {
+    respondeErro(controlador, saida, 12, 0, mensagem);
+    return;
+  }
+  if (seguranca.modo != 'R')
+  {
+    seguranca.rampa = controlador.canalF(seguranca.canal).rampa; // M e Z guardam a rampa anterior
+  }
+  controlador.aplicaF(seguranca);
+  escreveCanalF(saida, controlador.canalF(seguranca.canal), controlador.divergente(seguranca.canal));
+}
+
+static void avaliaI(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  int canais = controlador.parametros().canais;
+  if (pedeEstado(mensagem + 1))
+  {
+    for (int canal = 0; canal < canais; canal++)
+    {
+      escreveCanalI(saida, controlador.canalI(canal));
+    }
+    return;
+  }
+  InclinacaoCanal inclinacao;
+  if (interpretaI(mensagem, canais, &inclinacao) != 0)
+  {
+    respondeErro(controlador, saida, 15, 0, mensagem);
+    return;
+  }
+  controlador.aplicaI(inclinacao);
+  escreveCanalI(saida, controlador.canalI(inclinacao.canal));
+}
+
+// sem CHAVE_COMANDOS o controlador recusa com 14, como um N fora do formato
+static void avaliaN(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  uint64_t nonceHost;
+  uint64_t nonceControlador;
+  if (interpretaN(mensagem, &nonceHost) != 0 || controlador.iniciaSessao(nonceHost, &nonceControlador) != 0)
+  {
+    respondeErro(controlador, saida, 14, QUADRO_SEM_SESSAO, mensagem);
+    return;
+  }
+  escreveSessao(saida, nonceControlador);
+}
+
+void avaliaMensagem(char *mensagem, Controlador &controlador, BufferSaida &saida)
+{
+  if (mensagem[0] == PREFIXO_QUADRO)
+  {
+    // a tag é conferida antes de qualquer interpretação e o comando segue sem o prefixo
+    const char *comando;
+    ResultadoQuadro resultado = controlador.verificaQuadro(mensagem, &comando);
+    if (resultado != QUADRO_OK)
+    {
+      respondeErro(controlador, saida, 14, resultado, mensagem);
+      return;
+    }
+    memmove(mensagem, comando, strlen(comando) + 1);
+  }
+  else if (controlador.autenticacaoObrigatoria() && mensagem[0] != 'N')
+  {
+    respondeErro(controlador, saida, 14, QUADRO_MAL_FORMADO, mensagem);
+    return;
+  }
+
+  // "#id comando": o identificador vai para o controlador e o comando segue sem o prefixo
+  uint32_t id = 0;
+  bool comId = mensagem[0] == '#';
+  if (comId)
+  {
+    const char *comando;
+    if (extraiCorrelacao(mensagem, &id, &comando) != 0)
+    {
+      respondeErro(controlador, saida, 13, 0, mensagem);
+      return;
+    }
+    memmove(mensagem, comando, strlen(comando) + 1);
+  }
+
+  Comando comando = identificaComando(mensagem);
+  controlador.comando(comando, comId, id);
+  switch (comando)
+  {
+  case COMANDO_W:
+    avaliaW(mensagem, controlador, saida);
+    break;
+  case COMANDO_D:
+    avaliaD(mensagem, controlador, saida);
+    break;
+  case COMANDO_C:
+    avaliaC(mensagem, controlador, saida);
+    break;
+  case COMANDO_P:
+    avaliaP(mensagem, controlador, saida);
+    break;
+  case COMANDO_G:
+    avaliaG(mensagem, controlador, saida);
+    break;
+  case COMANDO_A:
+    avaliaA(mensagem, controlador, saida);
+    break;
+  case COMANDO_F:
+    avaliaF(mensagem, controlador, saida);
+    break;
+  case COMANDO_N:
+    avaliaN(mensagem, controlador, saida);
+    break;
+  case COMANDO_I:
+    avaliaI(mensagem, controlador, saida);
+    break;
+  case COMANDO_R:
+  case COMANDO_S:
+  case COMANDO_L:
+  case COMANDO_T:
+    controlador.consulta(comando, saida);
+    break;
+  case COMANDO_DESCONHECIDO:
+    respondeErro(controlador, saida, 1, 0, mensagem);
+    break;
+  }
+}
@@ -0,0 +1,225 @@
+/*
+ * Protocolo de comandos do controlador_FID
+ *
+ * Enquadramento da mensagem recebida, interpretação dos argumentos de cada comando e as respostas que não dependem
+ * do estado do controlador: erros (verbosos e compactos), confirmação, nonce do N e a linha de um canal do P, F e I.
+ * as funções só leem a mensagem e escrevem nas estruturas e no BufferSaida recebidos.
+ *
+ * avaliaMensagem() é o despacho inteiro de uma mensagem (quadro "@seq,tag", autenticação obrigatoria, "#id ",
+ * comando, argumentos e resposta), usado pelo evaluate() do firmware e pela conformidade (tools/protocolo). o que
+ * depende do hardware e do estado (aplicar o comando, listar os canais, sessão, metricas) fica com a classe
+ * derivada de Controlador de cada um.
+ *
+ * Cada interpretaX devolve 0 ou o codigo do erro do comando (o numero do E), como o stageChanges. a mensagem
+ * termina em '\0', '\r' ou '\n' e nenhuma função le depois do terminador.
+ *
+ * Usada pelo firmware, pelo controlador nativo (tools/nativo) e pelas ferramentas de conformidade e fuzzing
+ * (tools/protocolo). Não depende do Arduino.
+ */
+
+#ifndef Protocolo_h
+#define Protocolo_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include "Autenticacao.h"
+#include "BufferSaida.h"
+#include "Configuracoes.h"
+
+#define CANAIS_PROTOCOLO_MAX 52 // letras do W: A a Z e a a z
+
+enum ModoEco
+{
+  ECO_COMPLETO, // devolve o comando W inteiro
+  ECO_CURTO,    // devolve só a confirmação
+  ECO_NENHUM    // não responde aos comandos W aceitos
+};
+
+enum ModoResposta
+{
+  RESPOSTA_VERBOSA, // textos de ajuda completos (padrão original)
+  RESPOSTA_COMPACTA // uma linha "<codigo>,<sequencia>[,<instante>]" por comando
+};
+
+// comando pela primeira letra. o que vem depois dela em R, S, L e T é ignorado
+enum Comando
+{
+  COMANDO_W,
+  COMANDO_D,
+  COMANDO_R,
+  COMANDO_S,
+  COMANDO_C,
+  COMANDO_P,
+  COMANDO_G,
+  COMANDO_A,
+  COMANDO_F,
+  COMANDO_L,
+  COMANDO_T,
+  COMANDO_N,
+  COMANDO_I,
+  COMANDO_DESCONHECIDO // E1
+};
+
+// letra do canal no comando W: A a Z e depois a a z
+constexpr char letraCanal(uint8_t canal) { return canal < 26 ? 'A' + canal : 'a' + (canal - 26); }
+
+// o que muda de uma placa para outra nas faixas aceitas e nos textos de erro
+struct ParametrosProtocolo
+{
+  int canais;              // 1 a CANAIS_PROTOCOLO_MAX
+  uint32_t quadrosCaptura; // pre + pos maximo do G
+  bool comChave;           // CHAVE_COMANDOS configurada
+};
+
+// modo das respostas (comando C) e campos da resposta compacta do comando atual
+struct FormatoResposta
+{
+  int32_t modo;       // ModoResposta
+  int32_t eco;        // ModoEco
+  bool comTempo;      // resposta compacta com o instante
+  uint32_t sequencia; // comandos recebidos na conexão, contando o atual
+  uint32_t instante;  // micros() em que a ultima atualização foi entregue aos DACs
+};
+
+struct AlteracaoCanal // um "cc=vvvv" do D
+{
+  uint8_t canal;
+  uint16_t valor;
+};
+
+struct ConfiguracaoCanal // "Pcc=g,b,a"
+{
+  uint8_t canal;
+  uint8_t ganho; // 1 ou 2
+  bool buffer;
+  bool ativo;
+};
+
+struct SegurancaCanal // "Fcc=M", "Fcc=Z" ou "Fcc=R,rrrr"
+{
+  uint8_t canal;
+  char modo;      // 'M', 'Z' ou 'R'
+  uint16_t rampa; // codigos por segundo, só no 'R'
+};
+
+struct InclinacaoCanal // "Icc=llll"
+{
+  uint8_t canal;
+  uint16_t limite; // codigos por ms, 0 sem limite
+};
+
+struct PedidoCaptura // "GL", "GX" ou "Gcc,t,limiar,pre,pos"
+{
+  char acao;      // 'L' envia, 'X' cancela, 'G' arma
+  uint8_t canal;
+  char tipo;      // 'S' subida, 'D' descida, 'I' inclinação
+  int32_t limiar;
+  int32_t pre;
+  int32_t pos;
+};
+
+// Monta a mensagem de um bloco recebido numa area de tamanho bytes: o '\r' fecha a mensagem e ganha um '\0'
+// depois dele, o que passar de tamanho - 1 bytes é descartado e a area termina sempre em '\0', mesmo sem '\r' ou
+// truncada, para que nada da mensagem anterior fique depois dela. só o primeiro comando de um bloco é interpretado
+class Enquadrador
+{
+public:
+  Enquadrador(char *area, size_t tamanho); // tamanho >= 1
+
+  void inicia();       // começa um bloco
+  void recebe(char z); // um byte lido do socket
+  size_t termina();    // fecha a area com '\0'. devolve os bytes guardados, sem o '\0' final
+
+private:
+  char *_area;
+  size_t _tamanho;
+  size_t _usado;
+};
+
+bool fimMensagem(char c);                 // '\0', '\r' ou '\n'
+bool pedeEstado(const char *argumentos);  // argumentos vazios ou "?": listagem ou estado do comando
+Comando identificaComando(const char *mensagem);
+
+// "#id comando": *comando aponta para o comando depois do espaço. 0 ou 13
+int extraiCorrelacao(const char *mensagem, uint32_t *id, const char **comando);
+
+// "WA0000B0000...": um valor por canal. 0, 2 (letras ou fim, *canalErro = canais), 3 (digitos) ou 4 (faixa)
+int interpretaW(const char *mensagem, int canais, uint16_t *valores, int *canalErro);
+
+// "Dcc=vvvv[,cc=vvvv...]": até canais alterações. 0 ou 8
+int interpretaD(const char *mensagem, int canais, AlteracaoCanal *alteracoes, int *quantidade);
+
+int interpretaP(const char *mensagem, int canais, ConfiguracaoCanal *configuracao); // 0 ou 9
+int interpretaG(const char *mensagem, int canais, PedidoCaptura *pedido);           // 0 ou 10
+int interpretaA(const char *mensagem, int canais, uint64_t *mascara);               // "Ammmm" em hexadecimal. 0 ou 11
+int interpretaF(const char *mensagem, int canais, SegurancaCanal *seguranca);       // 0 ou 12
+int interpretaI(const char *mensagem, int canais, InclinacaoCanal *inclinacao);     // 0 ou 15
+int interpretaN(const char *mensagem, uint64_t *nonce);                             // 0 ou 14
+
+// "Cchave=valor" ou "C chave=valor": inicio e tamanho do texto para Configuracoes::altera (len 0: listagem)
+const char *argumentosC(const char *mensagem, size_t *len);
+int erroConfig(ResultadoConfig resultado); // 0, 5, 6 ou 7
+
+// confirmação de um comando aceito, conforme o modo e o eco
+void escreveAceito(BufferSaida &saida, const FormatoResposta &formato, const char *mensagem);
+
+// "<codigo>,<sequencia>[,<instante>]\n"
+void escreveCompacto(BufferSaida &saida, const FormatoResposta &formato, const char *codigo);
+
+// erro no modo do formato: "E<codigo>" compacto ou o texto de ajuda. canal: o do E3/E4 ou o ResultadoQuadro do E14
+void escreveErro(BufferSaida &saida, const FormatoResposta &formato, const ParametrosProtocolo &parametros, int codigo,
+                 int canal, const char *mensagem);
+
+void escreveSessao(BufferSaida &saida, uint64_t nonceControlador); // "\nN" e o nonce em hexadecimal
+void escreveCanalP(BufferSaida &saida, const ConfiguracaoCanal &configuracao);
+void escreveCanalF(BufferSaida &saida, const SegurancaCanal &seguranca, bool divergente);
+void escreveCanalI(BufferSaida &saida, const InclinacaoCanal &inclinacao);
+
+// O lado de quem recebe os comandos. avaliaMensagem() interpreta e responde; cada função aqui só aplica o que já foi
+// validado, devolve o estado para as listagens ou é avisada de um passo (rastro, eventos, contadores). as que
+// devolvem int respondem 0 ou o codigo do erro do comando
+class Controlador
+{
+public:
+  virtual ~Controlador() {}
+
+  virtual FormatoResposta formato() = 0;          // modo das respostas e campos do comando atual
+  virtual ParametrosProtocolo parametros() = 0;
+  virtual Configuracoes &configuracoes() = 0;     // tabela do comando C
+
+  // autenticação: quadro "@seq,tag comando" da sessão atual e inicio de sessão pelo N
+  virtual bool autenticacaoObrigatoria() = 0;     // comandos sem quadro recusados (exceto o N)
+  virtual ResultadoQuadro verificaQuadro(const char *quadro, const char **comando) = 0;
+  virtual int iniciaSessao(uint64_t nonceHost, uint64_t *nonceControlador) = 0; // 0 ou 14
+
+  // avisos: comando identificado (depois do quadro e do "#id", com a mensagem já sem os prefixos) e erro
+  // respondido. canal como no escreveErro
+  virtual void comando(Comando comando, bool comId, uint32_t id) = 0;
+  virtual void erro(int codigo, int canal) = 0;
+
+  // W igual ao ultimo aplicado: nem é interpretado
+  virtual bool repeteW(const char *mensagem) = 0;
+  virtual void aplicaW(const char *mensagem, const uint16_t *valores) = 0; // um valor por canal
+  virtual void aplicaD(const AlteracaoCanal *alteracoes, int quantidade) = 0;
+  virtual void aplicaP(const ConfiguracaoCanal &configuracao) = 0;
+  virtual void aplicaF(const SegurancaCanal &seguranca) = 0; // M e Z chegam com a rampa atual do canal
+  virtual void aplicaI(const InclinacaoCanal &inclinacao) = 0;
+  virtual int aplicaG(const PedidoCaptura &pedido, BufferSaida &saida) = 0; // 0 ou 10. 'L' escreve a captura
+  virtual void aplicaA(uint64_t mascara) = 0;
+  virtual void alterouConfiguracao(const Configuracao &cfg) = 0;
+
+  // estado de cada canal, para as listagens do P, F e I
+  virtual ConfiguracaoCanal canalP(int canal) = 0;
+  virtual SegurancaCanal canalF(int canal) = 0;
+  virtual bool divergente(int canal) = 0; // marca ",divergente" na listagem do F
+  virtual InclinacaoCanal canalI(int canal) = 0;
+
+  // respostas que só o controlador sabe escrever: R, S, L, T e o estado do G ("G", "G?") e do A ("A", "A?")
+  virtual void consulta(Comando comando, BufferSaida &saida) = 0;
+};
+
+// uma mensagem terminada em '\0' (a do Enquadrador). os prefixos "@seq,tag " e "#id " são tirados da propria
+// mensagem, que segue só com o comando. só um comando é interpretado por mensagem
+void avaliaMensagem(char *mensagem, Controlador &controlador, BufferSaida &saida);
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * Formato binario dos registros de aquisição do ADC do controlador_FID
+ */
+
+#include "RegistroADC.h"
+
+static void escreve16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static void escreve32(uint8_t *p, uint32_t v)
+{
+  escreve16(p, v);
+  escreve16(p + 2, v >> 16);
+}
+
+static uint16_t le16(const uint8_t *p)
+{
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t le32(const uint8_t *p)
+{
+  return le16(p) | (uint32_t)le16(p + 2) << 16;
+}
+
+uint8_t canaisNaMascara(uint64_t mascara)
+{
+  uint8_t n = 0;
+  while (mascara != 0)
+  {
+    mascara &= mascara - 1;
+    n++;
+  }
+  return n;
+}
+
+void escreveCabecalho(uint8_t *destino, const CabecalhoRegistro &cabecalho)
+{
+  destino[0] = 'F';
+  destino[1] = 'A';
+  destino[2] = REGISTRO_VERSAO;
+  destino[3] = 0;
+  escreve16(destino + 4, cabecalho.quadros);
+  escreve16(destino + 6, tamanhoRegistro(canaisNaMascara(cabecalho.mascara), cabecalho.quadros));
+  escreve32(destino + 8, cabecalho.sequencia);
+  escreve32(destino + 12, cabecalho.instante);
+  escreve32(destino + 16, cabecalho.taxa);
+  escreve32(destino + 20, (uint32_t)cabecalho.mascara);
+  escreve32(destino + 24, (uint32_t)(cabecalho.mascara >> 32));
+}
+
+bool leCabecalho(const uint8_t *origem, CabecalhoRegistro *cabecalho)
+{
+  if (origem[0] != 'F' || origem[1] != 'A' || origem[2] != REGISTRO_VERSAO)
+  {
+    return false;
+  }
+  cabecalho->versao = origem[2];
+  cabecalho->quadros = le16(origem + 4);
+  cabecalho->tamanho = le16(origem + 6);
+  cabecalho->sequencia = le32(origem + 8);
+  cabecalho->instante = le32(origem + 12);
+  cabecalho->taxa = le32(origem + 16);
+  cabecalho->mascara = le32(origem + 20) | (uint64_t)le32(origem + 24) << 32;
+  return cabecalho->mascara != 0 &&
+         cabecalho->tamanho == tamanhoRegistro(canaisNaMascara(cabecalho->mascara), cabecalho->quadros);
+}
+
+void desempacota(const uint8_t *origem, uint16_t *amostras, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+  {
+    const uint8_t *p = origem + (i / 2) * 3;
+    amostras[i] = i % 2 == 0 ? (p[0] | (p[1] & 0x0F) << 8) : (p[1] >> 4 | p[2] << 4);
+  }
+}
+
+void EmpacotadorADC::inicia(uint8_t *destino)
+{
+  _destino = destino;
+  _amostras = 0;
+}
+
+void EmpacotadorADC::adiciona(uint16_t amostra)
+{
+  uint8_t *p = _destino + (_amostras / 2) * 3;
+  if (_amostras % 2 == 0)
+  {
+    p[0] = amostra;
+    p[1] = (amostra >> 8) & 0x0F;
+  }
+  else
+  {
+    p[1] |= amostra << 4;
+    p[2] = amostra >> 4;
+  }
+  _amostras++;
+}
+
+size_t EmpacotadorADC::bytes() const
+{
+  return bytesAmostras(_amostras);
+}
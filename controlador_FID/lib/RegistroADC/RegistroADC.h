@@ -0,0 +1,80 @@
+/*
+ * Formato binario dos registros de aquisição do ADC do controlador_FID
+ *
+ * Um registro leva varios quadros consecutivos da aquisição. cabeçalho de
+ * 28 bytes, inteiros little-endian:
+ *
+ *   0  'F' 'A'      marca
+ *   2  uint8        versao (REGISTRO_VERSAO)
+ *   3  uint8        reservado, 0
+ *   4  uint16       quadros no registro
+ *   6  uint16       tamanho do registro em bytes, cabeçalho incluso
+ *   8  uint32       sequencia do registro (registros descartados também contam)
+ *   12 uint32       instante do primeiro quadro em us (micros() do controlador)
+ *   16 uint32       taxa de aquisição em quadros por segundo
+ *   20 uint64       mascara dos canais presentes (bit 0 = canal 0)
+ *
+ * Em seguida as amostras de 12 bits, quadro a quadro e, em cada quadro, os
+ * canais da mascara em ordem crescente. duas amostras ocupam 3 bytes:
+ * a0[7:0], a1[3:0]a0[11:8], a1[11:4]. com numero impar de amostras o
+ * ultimo nibble é zero.
+ *
+ * O registro é montado direto na area que será entregue ao socket
+ * (EmpacotadorADC escreve cada amostra no lugar), sem copia intermediaria.
+ *
+ * Não depende do Arduino. o leitor do lado do host usa o mesmo arquivo.
+ */
+
+#ifndef RegistroADC_h
+#define RegistroADC_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REGISTRO_VERSAO 1
+#define REGISTRO_CABECALHO 28
+
+struct CabecalhoRegistro
+{
+  uint8_t versao;
+  uint16_t quadros;
+  uint16_t tamanho;
+  uint32_t sequencia;
+  uint32_t instante;
+  uint32_t taxa;
+  uint64_t mascara;
+};
+
+// numero de canais ligados na mascara
+uint8_t canaisNaMascara(uint64_t mascara);
+
+// bytes ocupados por n amostras empacotadas
+constexpr size_t bytesAmostras(size_t amostras) { return (amostras * 3 + 1) / 2; }
+
+// tamanho de um registro com quadros quadros de canais canais
+constexpr size_t tamanhoRegistro(size_t canais, size_t quadros) { return REGISTRO_CABECALHO + bytesAmostras(canais * quadros); }
+
+// Escreve o cabeçalho nos primeiros REGISTRO_CABECALHO bytes de destino. versao e tamanho são preenchidos aqui
+void escreveCabecalho(uint8_t *destino, const CabecalhoRegistro &cabecalho);
+
+// Interpreta um cabeçalho. devolve false se a marca, a versão ou o tamanho não batem com o formato
+bool leCabecalho(const uint8_t *origem, CabecalhoRegistro *cabecalho);
+
+// Desempacota n amostras de 12 bits
+void desempacota(const uint8_t *origem, uint16_t *amostras, size_t n);
+
+// Empacota amostras de 12 bits uma a uma, direto na area do registro
+class EmpacotadorADC
+{
+public:
+  // destino: inicio da area de amostras (logo depois do cabeçalho)
+  void inicia(uint8_t *destino);
+  void adiciona(uint16_t amostra);
+  size_t bytes() const; // bytes escritos até aqui, contando o nibble pendente
+
+private:
+  uint8_t *_destino;
+  size_t _amostras;
+};
+
+#endif
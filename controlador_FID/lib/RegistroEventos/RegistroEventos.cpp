@@ -0,0 +1,77 @@
+/*
+ * Registro de eventos binario do controlador_FID
+ */
+
+#include <string.h>
+#include "RegistroEventos.h"
+
+RegistroEventos::RegistroEventos(Evento *area, uint16_t capacidade)
+{
+  _area = area;
+  _capacidade = capacidade;
+  for (int i = 0; i < capacidade * EVENTOS_NUCLEOS; i++)
+  {
+    _area[i].sequencia = SEQUENCIA_GRAVANDO; // nenhuma posição valida antes da primeira volta
+  }
+  memset(_proxima, 0, sizeof(_proxima));
+}
+
+bool RegistroEventos::copia(uint8_t nucleo, uint32_t sequencia, Evento *evento) const
+{
+  const Evento &e = _area[nucleo * _capacidade + (sequencia & (_capacidade - 1))];
+  if (__atomic_load_n(&e.sequencia, __ATOMIC_ACQUIRE) != sequencia)
+  {
+    return false;
+  }
+  evento->ciclos = e.ciclos;
+  evento->id = e.id;
+  evento->a = e.a;
+  evento->b = e.b;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  evento->sequencia = sequencia;
+  return __atomic_load_n(&e.sequencia, __ATOMIC_RELAXED) == sequencia;
+}
+
+size_t RegistroEventos::tamanhoDump() const
+{
+  return EVENTOS_CABECALHO + EVENTOS_NUCLEOS * (EVENTOS_CABECALHO_NUCLEO + (size_t)_capacidade * sizeof(Evento));
+}
+
+void RegistroEventos::escreveCabecalho(uint8_t *destino, uint16_t mhz) const
+{
+  destino[0] = 'F';
+  destino[1] = 'E';
+  destino[2] = EVENTOS_VERSAO;
+  destino[3] = EVENTOS_NUCLEOS;
+  destino[4] = _capacidade;
+  destino[5] = _capacidade >> 8;
+  destino[6] = mhz;
+  destino[7] = mhz >> 8;
+}
+
+uint16_t RegistroEventos::escreveCabecalhoNucleo(uint8_t *destino, uint8_t nucleo, uint32_t *primeira) const
+{
+  uint32_t proximo = proxima(nucleo);
+  uint32_t quantidade = proximo < _capacidade ? proximo : _capacidade;
+  *primeira = proximo - quantidade;
+  destino[0] = nucleo;
+  destino[1] = 0;
+  destino[2] = quantidade;
+  destino[3] = quantidade >> 8;
+  memcpy(destino + 4, primeira, 4);
+  return quantidade;
+}
+
+bool leCabecalhoEventos(const uint8_t *origem, CabecalhoEventos *cabecalho)
+{
+  if (origem[0] != 'F' || origem[1] != 'E' || origem[2] != EVENTOS_VERSAO || origem[3] == 0 ||
+      origem[3] > EVENTOS_NUCLEOS)
+  {
+    return false;
+  }
+  cabecalho->versao = origem[2];
+  cabecalho->nucleos = origem[3];
+  cabecalho->capacidade = origem[4] | origem[5] << 8;
+  cabecalho->mhz = origem[6] | origem[7] << 8;
+  return cabecalho->capacidade > 0 && cabecalho->mhz > 0;
+}
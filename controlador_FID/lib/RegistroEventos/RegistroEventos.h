@@ -0,0 +1,98 @@
+/*
+ * Registro de eventos binario do controlador_FID
+ *
+ * Cada evento é um registro de 16 bytes (instante em ciclos de CPU, id e
+ * dois argumentos) gravado num anel em RAM com uma fatia por core. A task
+ * (ou ISR) reserva a posição com um add atomico no contador do seu core e
+ * grava o registro no lugar, sem lock e sem formatar texto: o custo é de
+ * algumas dezenas de ciclos, o que permite deixar o registro ligado em
+ * produção. Quando o anel enche, os eventos mais antigos são sobrescritos.
+ *
+ * Os textos ficam no host: o firmware só conhece os ids (include/Eventos.h)
+ * e o decodificador (tools/decodifica_eventos.cpp) aplica o formato de
+ * cada id aos argumentos.
+ *
+ * A sequencia do evento é escrita por ultimo, depois de invalidada no
+ * inicio da gravação, de modo que copia() detecta um registro sendo
+ * sobrescrito durante a leitura e o descarta em vez de devolver metade
+ * de cada evento.
+ *
+ * Formato do dump (little endian):
+ *   cabeçalho de 8 bytes: 'F','E', versao, nucleos, u16 capacidade por core, u16 MHz da CPU
+ *   por core: u8 nucleo, u8 reservado, u16 quantidade, u32 sequencia do primeiro, e quantidade registros
+ *   de 16 bytes em ordem de sequencia. registros perdidos durante a copia vão com id EVENTO_INVALIDO
+ *
+ * Não depende do Arduino.
+ */
+
+#ifndef RegistroEventos_h
+#define RegistroEventos_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define EVENTOS_VERSAO 1
+#define EVENTOS_NUCLEOS 2
+#define EVENTOS_CABECALHO 8
+#define EVENTOS_CABECALHO_NUCLEO 8
+#define EVENTO_INVALIDO 0xFFFF
+#define SEQUENCIA_GRAVANDO 0xFFFFFFFF
+
+struct Evento
+{
+  uint32_t ciclos;    // contador de ciclos do core que registrou
+  uint32_t sequencia; // posição no anel do core, crescente
+  uint16_t id;
+  uint16_t a;
+  uint32_t b;
+};
+static_assert(sizeof(Evento) == 16, "registro de evento deve ter 16 bytes");
+
+class RegistroEventos
+{
+public:
+  // area com capacidade * EVENTOS_NUCLEOS registros. capacidade por core, potencia de 2
+  RegistroEventos(Evento *area, uint16_t capacidade);
+
+  void registra(uint8_t nucleo, uint32_t ciclos, uint16_t id, uint16_t a, uint32_t b)
+  {
+    uint32_t sequencia = __atomic_fetch_add(&_proxima[nucleo], 1, __ATOMIC_RELAXED);
+    Evento &e = _area[nucleo * _capacidade + (sequencia & (_capacidade - 1))];
+    __atomic_store_n(&e.sequencia, SEQUENCIA_GRAVANDO, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e.ciclos = ciclos;
+    e.id = id;
+    e.a = a;
+    e.b = b;
+    __atomic_store_n(&e.sequencia, sequencia, __ATOMIC_RELEASE);
+  }
+
+  uint16_t capacidade() const { return _capacidade; }
+  uint32_t proxima(uint8_t nucleo) const { return __atomic_load_n(&_proxima[nucleo], __ATOMIC_ACQUIRE); }
+
+  // copia o evento de sequencia dada. false se ele ainda não foi escrito, já foi sobrescrito ou está sendo gravado
+  bool copia(uint8_t nucleo, uint32_t sequencia, Evento *evento) const;
+
+  // tamanho do dump completo e escrita em pedaços: cabeçalho geral, cabeçalho de cada core e os registros.
+  // o dump de um core cobre as sequencias [primeira, proxima) no momento em que o seu cabeçalho é escrito
+  size_t tamanhoDump() const;
+  void escreveCabecalho(uint8_t *destino, uint16_t mhz) const;
+  uint16_t escreveCabecalhoNucleo(uint8_t *destino, uint8_t nucleo, uint32_t *primeira) const;
+
+private:
+  Evento *_area;
+  uint16_t _capacidade;
+  uint32_t _proxima[EVENTOS_NUCLEOS];
+};
+
+// Leitura do dump no host. devolve false se o cabeçalho não for de um dump desta versão
+struct CabecalhoEventos
+{
+  uint8_t versao;
+  uint8_t nucleos;
+  uint16_t capacidade;
+  uint16_t mhz;
+};
+bool leCabecalhoEventos(const uint8_t *origem, CabecalhoEventos *cabecalho);
+
+#endif
@@ -4,88 +4,472 @@
 #include <ArduinoOTA.h>
 #include "credentials.h" // somente armazena SSID e PASS. rede e senha respectivamente.
 #include <MCP492X.h>     // biblioteca dos DACs
+#include <Configuracoes.h> // registro das configurações alteraveis pelo comando C
+#include <BufferSaida.h>   // acumula as respostas e envia uma vez por ciclo
+#include <Mcp320x.h>       // biblioteca dos ADCs
+#include <Mcp320xTimer.h>  // cadencia da aquisição por timer de hardware
+#include <Captura.h>       // captura disparada das leituras do ADC (comando G)
+#include <RegistroADC.h>   // formato binario do fluxo de aquisição (comando A)
+#include <Metricas.h>      // contadores por core e endpoint HTTP /metrics
+#include <RegistroEventos.h> // registro binario de eventos em RAM (comando L)
+#include <Autenticacao.h>   // sessão com chave pré-compartilhada e tag por comando (comandos N e @)
+#include <Inclinacao.h>     // limite de codigos por ms de cada saida (comando I)
+#include <CoordenacaoDacs.h> // passadas pendentes dos workers dos DACs e repasse na troca de core
+#include <Protocolo.h>       // enquadramento, interpretação dos argumentos e respostas dos comandos
+#include "Eventos.h"       // ids dos eventos. os textos ficam no decodificador do host
+#include "Placa.h"         // descrição da placa: canais, modelos e pinos
+#include "Memoria.h"       // tamanho de todos os buffers e pilhas (orçamento de RAM)
+#include <esp_task_wdt.h>  // watchdog das tasks, usado pelo supervisor
+#include <esp_ota_ops.h>   // particões A/B e rollback da imagem (autoteste)
+#include <sys/time.h>      // relogio do RTC, que continua contando num reinicio por software
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //   SETUP DE HARDWARE
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Lista de Chip Select do protocolo SPI, 8 para os DACs e 1 para o ADC
-#define CS1 13
-#define CS2 12
-#define CS3 14
-#define CS4 27
-#define CS5 26
-#define CS6 25
-#define CS7 33
-#define CS8 32
-#define CSA 22  // ADC
-#define Dummy 5 // pino para usar como chip select na biblioteca do MCP
+// Placa para a qual o firmware é compilado. as placas e seus pinos estão em include/Placa.h,
+// a escolha é feita no platformio.ini (-DPLACA=...). tudo abaixo é resolvido em tempo de compilação
+#ifndef PLACA
+#define PLACA PlacaFID8
+#endif
+using Placa = PLACA;
+using Mapa = MapaCanais<Placa>;
+static_assert(ValidaPlaca<Placa>::ok, "placa invalida");
 
-int CS_SPI[]{CSA, CS1, CS2, CS3, CS4, CS5, CS6, CS7, CS8};
+constexpr int CANAIS = Placa::canais;
+constexpr int BANCOS = Mapa::bancos; // um worker por banco de DACs
 
 // Pino de latch. Utilizado para alteração simultanea dos dacs. ativa as saídas quando low
-#define LDAC 15
+constexpr uint8_t LDAC = Placa::pinoLDAC;
 
-// Setup do DAC
-MCP492X myDac(Dummy);
+// Setup do DAC, um driver por barramento. o chip select da biblioteca é um pino livre,
+// o CS real de cada DAC é acionado pela selecionaChip() (GPIO direto ou 74HC595, conforme o banco)
+SPIClass spiHSPI(HSPI);
+MCP492X myDac(Placa::pinoDummy, Placa::clockSPI, &SPI);
+MCP492X myDacHSPI(Placa::pinoDummy, Placa::clockSPI, &spiHSPI);
+
+// Setup do ADC. tipo da biblioteca e comando de leitura simples (entrada contra o terra) do modelo da placa.
+// os ADCs ficam no VSPI junto com o primeiro banco de DACs; o SPI do Arduino serializa as transações
+template <ModeloADC M>
+struct DriverADC;
+template <>
+struct DriverADC<ModeloADC::MCP3201>
+{
+  using Tipo = MCP3201;
+  static constexpr uint8_t simples = 0b0;
+};
+template <>
+struct DriverADC<ModeloADC::MCP3202>
+{
+  using Tipo = MCP3202;
+  static constexpr uint8_t simples = 0b10;
+};
+template <>
+struct DriverADC<ModeloADC::MCP3204>
+{
+  using Tipo = MCP3204;
+  static constexpr uint8_t simples = 0b1000;
+};
+template <>
+struct DriverADC<ModeloADC::MCP3208>
+{
+  using Tipo = MCP3208;
+  static constexpr uint8_t simples = 0b1000;
+};
+using ADC = DriverADC<Placa::adc>::Tipo;
+#define VREF_ADC 3300 // tensão de referencia dos ADCs em mV
+#define TIMER_ADC 0    // timer de hardware que dá a cadencia da aquisição
+#define TAXA_ADC 1000  // quadros (leituras de todos os canais) por segundo
+constexpr int TAXA_ADC_MAX = 25000 / CANAIS; // ~40 us por canal a 1 MHz (24 bits, CS e montagem do quadro)
+MCP320xTimer relogioADC(TIMER_ADC);
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //   SETUP DE COMUNICAÇÃO
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// buffers
-#define BUFFERLEN 42 // tamanho em bytes do buffer que armazena a mensagem recebida
+// buffers. os tamanhos de todas as areas fixas estão em include/Memoria.h
+using Memoria = MemoriaFID<Placa>;
+static_assert(Memoria::total() <= ORCAMENTO_RAM, "areas fixas acima do orçamento de RAM");
+constexpr int TAM_W = Memoria::tamW;
+constexpr int BUFFERLEN = Memoria::bufferlen; // tamanho em bytes do buffer que armazena a mensagem recebida
+#define BLOCO_CAPTURA 64 // maximo de quadros por bloco binario enviado pelo GL
+constexpr int QUADROS_REGISTRO = Memoria::quadrosRegistro;
+constexpr size_t TAM_REGISTRO = Memoria::tamRegistro;
 
 // rede e socket. credenciais do wifi devem ser mantidas no arquivo credentials.h
 #define HOSTNAME "controlador_FID"    // wireless
 #define PORTA 6969                    // socket
-#define PERIODO 1000                  // periodo de reconexao e update em ms
+#define PERIODO 1000                  // intervalo entre verificações de novo cliente em ms
+#define PERIODO_OTA 20                // periodo da task de conexão (OTA e maquina de estados do wifi) em ms
+#define RECONEXAO_MIN 250             // primeiro intervalo entre tentativas de reconexão em ms
+#define RECONEXAO_MAX 30000           // intervalo maximo entre tentativas (backoff exponencial) em ms
+#define TIMEOUT_CONEXAO 10000         // tentativa sem resposta do driver é considerada falha apos esse tempo em ms
 IPAddress local_IP(192, 168, 0, 170); // wireless
 IPAddress gateway(192, 168, 0, 1);    // wireless
 IPAddress subnet(255, 255, 0, 0);     // wireless
 WiFiServer sv(PORTA);                 // socket
 WiFiClient cl;                        // socket
+#define PORTA_METRICAS 9100           // endpoint HTTP /metrics (formato do Prometheus)
+#define TIMEOUT_METRICAS 200          // espera maxima pelo pedido HTTP completo em ms
+WiFiServer svMetricas(PORTA_METRICAS);
+
+// autenticação dos comandos (ver lib/Autenticacao). CHAVE_COMANDOS, com 32 digitos hexadecimais, e SENHA_OTA ficam
+// opcionalmente no credentials.h. com a chave, o controlador já liga exigindo comandos autenticados
+#ifndef CHAVE_COMANDOS
+#define CHAVE_COMANDOS ""
+#endif
+constexpr bool COM_CHAVE = sizeof(CHAVE_COMANDOS) > 1;
+static_assert(!COM_CHAVE || (sizeof(CHAVE_COMANDOS) == 2 * TAM_CHAVE + 1 && digitosHex(CHAVE_COMANDOS, 2 * TAM_CHAVE)),
+              "CHAVE_COMANDOS deve ter 32 digitos hexadecimais");
+SessaoAutenticada sessao; // uma por conexão: encerrada quando o cliente sai
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // GERAL
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Configurações e modos
-int const coreTask = 0;     // core onde rodarão as tasks nao relacionadas a comunicação (DACs e ADCs)
-bool closeAfterRec = false; // o host fecha o socket apos receber a mensagem
-bool echo = true;           // a cada comando recebido devolve o comando
-bool use_LDAC = false;      // utiliza o LDAC para sincronizar as saidas
+// Divisão das tasks entre os cores. o driver do wifi e o lwIP rodam no core 0 (PRO_CPU), então as tasks de rede
+// ficam junto com eles e o core 1 (APP_CPU) fica livre para o que tem prazo: DACs, aquisição do ADC e malhas de controle.
+// as prioridades no core de tempo real ficam acima de qualquer task de rede para que uma rajada de comandos não atrase as saidas.
+#define NUCLEO_REDE 0       // wifi, lwIP, task TCP, task de conexão/OTA
+#define NUCLEO_TEMPO_REAL 1 // worker dos DACs e demais tasks de I/O
+
+// o tamanho das pilhas (PILHA_*) está em include/Memoria.h
+#define PERIODO_RELOGIO 1000 // ms entre eventos EVT_RELOGIO de cada core. o decodificador converte ciclos em tempo
+
+// Supervisor das saidas. roda a cada PERIODO_SUPERVISOR no core de tempo real e alimenta o watchdog das tasks
+#define PERIODO_SUPERVISOR 10      // ms
+#define TIMEOUT_WDT 10             // s sem alimentar o watchdog (supervisor, task TCP ou worker dos DACs) reinicia o ESP32
+#define VIGIA_DACS 1000            // ms. espera maxima do worker dos DACs parado, para alimentar o watchdog
+#define LIMITE_PASSADA 50000       // us. passada dos DACs mais longa que isso é considerada travada
+#define ACOMODACAO_ADC 50000       // us depois de uma alteração sem comparar a leitura do ADC com a saida
+#define LEITURAS_DIVERGENCIA 3     // ciclos seguidos fora da tolerancia para marcar o canal como divergente
 
+// Autoteste depois do boot. uma imagem nova (OTA) fica pendente até passar; se o prazo vencer antes, o bootloader
+// volta para a imagem anterior (rollback do ESP-IDF)
+#define PRAZO_AUTOTESTE 60000  // ms desde o boot para aprovar DACs, ADC, supervisor, laço DAC->ADC e rede
+#define TOLERANCIA_AUTOTESTE 0 // diferença maxima entre a leitura do ADC e a saida no laço de teste. 0 = placa sem o laço
+
+// Configurações e modos (ModoEco e ModoResposta em lib/Protocolo). valores iniciais, podem ser alterados em
+// execução pelo comando C (ver tabelaConfig)
+int32_t coreTask = NUCLEO_TEMPO_REAL;      // core onde rodarão as tasks nao relacionadas a comunicação (DACs e ADCs)
+int32_t closeAfterRec = 0;                 // o host fecha o socket apos receber a mensagem
+int32_t modoEco = ECO_COMPLETO;            // resposta a cada comando W aceito
+int32_t use_LDAC = 0;                      // utiliza o LDAC para sincronizar as saidas
+int32_t prioridadeDacs = 10;               // prioridade da task dos DACs
+int32_t prioridadeAdc = 5;                 // prioridade da task de aquisição do ADC. abaixo dos DACs
+int32_t prioridadeSupervisor = 8;          // prioridade do supervisor. abaixo dos DACs, acima do resto
+int32_t prioridadeTcp = 2;                 // prioridade da task do socket
+int32_t prioridadeConexao = 1;             // prioridade da task de conexão wifi/OTA
+int32_t periodoConexao = PERIODO_OTA;      // periodo da task de conexão em ms
+int32_t periodoTcp = PERIODO;              // espera por um novo cliente em ms
+int32_t modoResposta = RESPOSTA_VERBOSA;   // formato das confirmações e erros
+int32_t respostaComTempo = 0;              // inclui o instante de aplicação na resposta compacta
+int32_t taxaAdc = TAXA_ADC;                // quadros do ADC por segundo
+int32_t heartbeat = 0;                     // ms sem comandos do host para colocar as saidas no estado seguro. 0 = desligado
+int32_t toleranciaAdc = 0;                 // diferença maxima entre a leitura do ADC e a saida comandada. 0 = não compara
+int32_t amostragemRastro = 0;              // rastreia 1 a cada N comandos sem identificador de correlação. 0 = só os com id
+int32_t autenticacao = COM_CHAVE;          // recusa comandos sem tag (exceto o N). só pode ser ligada com CHAVE_COMANDOS
+
+char areaEntrada[BUFFERLEN];        // bytes lidos do socket num ciclo da task TCP
+Enquadrador enquadrador(areaEntrada, BUFFERLEN); // monta a mensagem de um bloco na areaEntrada
 char mensagemTcpIn[BUFFERLEN] = ""; // variavel global com a mensagem recebiada via TCP
 int valorRecebido = 1;              // armazena o valor recebido via TCP em um int
+uint32_t sequencia = 0;             // numero de comandos recebidos na conexão atual
+uint32_t bytesRecebidos = 0;        // bytes lidos do socket desde o boot
+uint32_t ciclosW = 0;               // ciclos de CPU do ultimo W aceito (comparação + interpretação)
+uint32_t ciclosD = 0;               // ciclos de CPU do ultimo D aceito
+uint32_t ciclosTag = 0;             // ciclos de CPU da verificação do ultimo quadro autenticado
+uint32_t ciclosInclinacao[BANCOS];  // ciclos de CPU do ultimo passo de inclinação de cada banco (lote, sem o SPI)
+uint32_t canaisEmMovimento[BANCOS]; // canais de cada banco ainda a caminho do alvo
+uint32_t instanteAplicado = 0;      // micros() da ultima atualização entregue aos DACs
+volatile uint32_t quadrosADC = 0;   // leituras completas do ADC desde o boot
+ContadoresFID contadores;           // contadores por core do caminho de controle. somados só na coleta (/metrics e S)
+Evento areaEventos[EVENTOS_NUCLEOS * EVENTOS_POR_NUCLEO];
+RegistroEventos eventos(areaEventos, EVENTOS_POR_NUCLEO); // escrito por qualquer task, lido pelo comando L
+volatile uint16_t leituraADC[CANAIS]; // ultima leitura de cada canal, escrita pela task de aquisição
+
+// captura disparada. o anel é preenchido pela task de aquisição e lido pela task TCP quando congelado
+uint16_t areaCaptura[AMOSTRAS_CAPTURA];
+Captura captura(areaCaptura, AMOSTRAS_CAPTURA, CANAIS);
+
+// fluxo binario do ADC (ver lib/RegistroADC). a task de aquisição empacota cada quadro direto no registro livre e,
+// quando ele enche, o entrega à task TCP, que o escreve no socket a partir da mesma area
+uint8_t areaRegistros[REGISTROS_ADC][TAM_REGISTRO];
+volatile uint64_t mascaraFluxo = 0;         // canais enviados (comando A). 0 = fluxo desligado
+volatile uint32_t registrosProduzidos = 0;  // registros completos, escritos pela aquisição
+volatile uint32_t registrosEnviados = 0;    // registros entregues ao socket, escritos pela task TCP
+uint32_t registrosDescartados = 0;          // registros perdidos por falta de area livre (socket lento)
+
+// respostas ao cliente. acumuladas em areaSaida e enviadas com um unico write por ciclo
+char areaSaida[TAM_SAIDA];
+size_t enviaCliente(void *contexto, const uint8_t *dados, size_t len);
+BufferSaida saida(areaSaida, TAM_SAIDA, enviaCliente, &cl);
+
+// pedido e resposta do /metrics, usados só pela task de conexão
+char areaPedidoMetricas[TAM_PEDIDO_METRICAS];
+char areaSaidaMetricas[TAM_SAIDA_METRICAS];
+
+// estado da conexão wifi. escrito pelo callback de eventos do wifi e pela task de conexão
+enum EstadoWiFi
+{
+  WIFI_DESCONECTADO, // aguardando o instante da proxima tentativa
+  WIFI_CONECTANDO,   // WiFi.begin() chamado, aguardando GOT_IP ou DISCONNECTED
+  WIFI_CONECTADO
+};
+volatile EstadoWiFi estadoWiFi = WIFI_DESCONECTADO;
+volatile bool eventoWiFiConectado = false;    // sinalizado pelo callback em GOT_IP
+volatile bool eventoWiFiDesconectado = false; // sinalizado pelo callback em DISCONNECTED/LOST_IP
+uint32_t intervaloReconexao = RECONEXAO_MIN;  // intervalo atual do backoff
+uint32_t proximaTentativa = 0;                // millis() da proxima chamada a WiFi.begin()
+uint32_t inicioTentativa = 0;                 // millis() da ultima chamada a WiFi.begin()
+uint32_t inicioQueda = 0;                     // millis() em que a conexão caiu
 
-// tasks
-TaskHandle_t taskTcp, taskCheckConn, taskDacs;
+// metricas do worker dos DACs. devolvidas pelo comando S
+struct MetricasDacs
+{
+  uint32_t latencia;      // changeDacs() até um worker acordar, ultima atualização, em us
+  uint32_t maiorLatencia; // pior latencia observada em us
+  uint32_t duracao;       // changeDacs() até o ultimo banco terminar (atualização completa) em us
+  uint32_t maiorDuracao;  // pior duração observada em us
+};
+MetricasDacs metricasDacs = {0, 0, 0, 0};
+volatile uint32_t instanteNotificacao = 0; // micros() do ultimo changeDacs()
+CoordenacaoDacs coordenacaoDacs(BANCOS);   // passadas pendentes dos workers. o ultimo a terminar baixa o LDAC
+
+// Rastreamento de latencia: instante (micros) de cada etapa de um comando, da recepção no socket até a borda do LDAC.
+// as etapas da task TCP são marcadas no rastroAtual; as dos workers dos DACs no rastroDacs, que o changeDacs() aponta
+// para o rastro do comando que o chamou
+enum EtapaRastro
+{
+  ETAPA_RECEBIDO,      // dados disponiveis no socket
+  ETAPA_INTERPRETACAO, // inicio do evaluate()
+  ETAPA_VALIDADO,      // stageChanges()/stageDelta() validaram e marcaram os canais
+  ETAPA_NOTIFICADO,    // changeDacs() acordou os workers
+  ETAPA_ACORDADO,      // primeiro worker começou a passada
+  ETAPA_ESCRITO,       // ultimo banco terminou o dacUpdate()
+  ETAPA_LDAC,          // LDAC baixo, saidas aplicadas
+  ETAPA_RESPONDIDO,    // resposta entregue ao socket
+  ETAPAS
+};
+struct Rastro
+{
+  uint32_t id;        // identificador de correlação ("#id " antes do comando). 0 se amostrado
+  uint32_t sequencia; // sequencia do comando na conexão
+  char comando;
+  volatile uint32_t instantes[ETAPAS]; // 0 = etapa não alcançada
+};
+static_assert(sizeof(Rastro) == TAM_RASTRO, "atualizar TAM_RASTRO em include/Memoria.h");
+Rastro rastros[RASTROS];
+uint32_t rastrosGravados = 0;     // rastros completados desde o boot. o proximo usa rastros[rastrosGravados % RASTROS]
+uint32_t rastrosLidos = 0;        // rastrosGravados no ultimo T
+Rastro *rastroAtual = NULL;       // comando em interpretação, só a task TCP escreve
+Rastro *volatile rastroDacs = NULL; // passada dos DACs em andamento
+uint32_t instanteRecepcao = 0;    // micros() em que a task TCP viu dados no socket
+
+// estado seguro de cada canal, aplicado pelo supervisor quando o host some (heartbeat)
+enum ModoSeguro
+{
+  SEGURO_MANTER, // mantem o ultimo valor
+  SEGURO_ZERAR,  // vai a zero de uma vez
+  SEGURO_RAMPA   // desce até zero com a inclinação do canal
+};
+
+// metricas do supervisor. devolvidas pelo comando S
+struct MetricasSupervisor
+{
+  uint32_t ciclos;        // execuções do supervisor
+  uint32_t disparos;      // entradas no estado seguro por falta de heartbeat
+  uint32_t latencia;      // do fim do prazo do heartbeat até o estado seguro entregue aos DACs, ultimo disparo, em us
+  uint32_t maiorLatencia; // pior latencia observada em us
+  uint32_t travamentos;   // passadas dos DACs que passaram de LIMITE_PASSADA
+  uint32_t divergencias;  // canais que passaram a divergir da leitura do ADC
+  uint32_t duracao;       // duração do ultimo ciclo em us
+  uint32_t maiorDuracao;  // pior duração observada em us
+};
+MetricasSupervisor metricasSupervisor = {0, 0, 0, 0, 0, 0, 0, 0};
+volatile bool estadoSeguro = false;       // saidas no estado seguro. sai com o proximo W ou D
+volatile uint32_t ultimoComando = 0;      // micros() do ultimo comando recebido
+uint64_t canaisDivergentes = 0;           // um bit por canal, leitura do ADC fora da tolerancia
+
+// metricas de conexão. devolvidas pelo comando S
+struct MetricasWiFi
+{
+  uint32_t quedas;          // numero de vezes que a conexão caiu
+  uint32_t tentativas;      // chamadas a WiFi.begin() desde o boot
+  uint32_t ultimaReconexao; // duração da ultima queda em ms
+  uint32_t maiorReconexao;  // maior queda observada em ms
+};
+MetricasWiFi metricasWiFi = {0, 0, 0, 0};
+
+// autoteste depois do boot (ver PRAZO_AUTOTESTE). as falhas são um bit por verificação
+enum EstadoAutoteste
+{
+  AUTOTESTE_PENDENTE,
+  AUTOTESTE_APROVADO,
+  AUTOTESTE_REPROVADO
+};
+enum FalhaAutoteste
+{
+  FALHA_DACS = 1,       // nenhuma passada completa ou passada travada
+  FALHA_ADC = 2,        // menos de um segundo de quadros
+  FALHA_SUPERVISOR = 4, // supervisor não rodou
+  FALHA_LACO = 8,       // leitura do ADC longe da saida (TOLERANCIA_AUTOTESTE)
+  FALHA_REDE = 16       // wifi não conectou
+};
+int32_t estadoAutoteste = AUTOTESTE_PENDENTE;
+uint32_t falhasAutoteste = 0;
+uint32_t bootMs = 0;     // millis() da primeira passada completa dos DACs: o laço parado durante o boot
+uint32_t paradaOtaMs = 0; // do fim da OTA à primeira passada na imagem nova, medido pelo relogio do RTC. 0 = boot sem OTA
+bool saidasRestauradas = false;
+
+// tasks. pilhas e TCBs estaticos (ver include/Memoria.h): criar ou recriar uma task não usa o heap
+TaskHandle_t taskTcp, taskCheckConn, taskDacs[BANCOS], taskAdc, taskSupervisor;
+StackType_t pilhaTcp[PILHA_TCP], pilhaConexao[PILHA_CONEXAO], pilhaAdc[PILHA_ADC], pilhaSupervisor[PILHA_SUPERVISOR];
+StaticTask_t tcbTcp, tcbConexao, tcbAdc, tcbSupervisor;
+StackType_t pilhasDacs[BANCOS][2][PILHA_DACS]; // o worker que troca de core cria o substituto na outra pilha
+StaticTask_t tcbsDacs[BANCOS][2];
+uint8_t pilhaDacsLivre[BANCOS];                // qual das duas pilhas do banco o proximo worker usa
 void taskTcpCode(void *parameter);        // faz a comunicação via socket
 void taskCheckConnCode(void *parameters); // checa periodicamente o wifi e verifica se tem atualização
-void taskUpdateDacs(void *parameters);    // task que faz a alteração nos dacs
+void taskUpdateDacs(void *parameters);    // worker que faz a alteração nos dacs de um banco. espera uma notificação do changeDacs()
+void taskAdcCode(void *parameters);       // aquisição periodica do ADC. alimenta a leitura do R e a captura do G
+void taskSupervisorCode(void *parameters); // heartbeat do host, estado seguro das saidas, DACs travados e leitura do ADC
 
 // funcoes
 void setupPins();                     // inicialização das saidas digitais e do SPI
+void setupEstado();                   // monta as strings de estado e marca todos os canais para zerar (ou restaurar)
+bool restauraSaidas();                // recupera as saidas persistidas se o reinicio foi por software
+void persisteCanal(int canal);        // copia valor e configuração do canal para a RAM do RTC
+void persisteSeguranca(int canal);    // copia estado seguro e inclinação do canal para a RAM do RTC
+int64_t instanteRtc();                // relogio do RTC em us
+void registraPrimeiraPassada();       // tempo de boot e parada da OTA, na primeira passada completa dos DACs
+void autoteste();                     // verificações depois do boot; aprova a imagem ou pede o rollback
 void setupWireless();                 // inicialização do wireless e do update OTA
 void setupOTA();                      // inicializa o serviço de upload OTA do codigo
 void launchTasks();                   // dispara as tasks.
-void connectWiFi();                   // conecta o wifi. é repetida via tasks.
-void changeDacs();                    // atualiza os valores dos dacs
+void connectWiFi();                   // dispara uma tentativa de conexão do wifi. não bloqueia
+void serviceWiFi();                   // maquina de estados da conexão, chamada periodicamente pela task de conexão
+void wifiEvento(WiFiEvent_t evento, WiFiEventInfo_t info); // callback de eventos do wifi
+void status();                        // devolve as metricas do controlador
+uint32_t menorPilhaDacs();            // menor folga entre as pilhas dos workers dos DACs
+void adicionaMetrica(const char *nome, uint32_t valor); // escreve uma metrica chave=valor no buffer de saida
+void atendeMetricas();                // responde um pedido pendente no endpoint /metrics
+void escreveMetricas(ExpositorMetricas &expositor); // todas as metricas no formato do Prometheus
+void registraEvento(IdEvento id, uint16_t a = 0, uint32_t b = 0); // grava um evento no anel do core atual
+void registraRelogio(uint32_t *ultimo); // EVT_RELOGIO a cada PERIODO_RELOGIO, para o decodificador alinhar os cores
+void enviaEventos();                  // comando L: dump binario do registro de eventos
+void iniciaRastro(bool comId, uint32_t id); // escolhe se o comando atual é rastreado
+void marcaEtapa(Rastro *rastro, EtapaRastro etapa); // instante de uma etapa, se o rastro existir e ela ainda não foi marcada
+void enviaRastros();                  // comando T: etapas dos comandos rastreados desde o ultimo T
+void changeDacs();                    // acorda o worker dos dacs para aplicar o estado_Canais
+void launchTaskDacs(int banco);       // cria o worker de um banco de dacs no core coreTask
+void cedeTroca(void *banco);          // OperacoesTroca do worker que troca de core (ver CoordenacaoDacs)
+uint32_t tomaNotificacoesTroca(void *banco);
+void acordaSubstituto(void *banco);
+void launchTasksDacs();               // cria os workers de todos os bancos
 void report();                        // devolve o valor do ADC
-void stageChanges();                  // verifica se a mensagem é consistente com o protocolo adotado e agenda atualizações nos dacs
-void printChanges();                  //
+void leQuadroADC(uint16_t *quadro);   // le todos os canais do ADC numa unica transação SPI
+int capturaADC(const PedidoCaptura &pedido); // aplica o comando G (captura disparada). 0 ou 10
+void estadoCaptura();                 // estado da captura ("G" ou "G?")
+void enviaCaptura();                  // envia a captura congelada em blocos binarios
+void montaRegistro(const uint16_t *quadro); // acrescenta o quadro ao registro do fluxo binario em montagem
+void enviaRegistros();                // escreve no socket os registros completos do fluxo
+void fluxoADC(uint64_t mascara);      // liga ou desliga o fluxo binario do ADC (comando A)
+void estadoFluxo();                   // estado do fluxo ("A" ou "A?")
+void configuraSeguranca(const SegurancaCanal &seguranca); // aplica o comando F (estado seguro de um canal)
+void configuraInclinacao(const InclinacaoCanal &inclinacao); // aplica o comando I (limite de inclinação de um canal)
+uint32_t contaEmMovimento();          // canais de todos os bancos ainda a caminho do alvo
+uint32_t maiorCiclosInclinacao();     // ciclos do ultimo passo de inclinação do banco mais lento
+void escreveEstadoDAC(int canal, int valor); // atualiza os 4 digitos do canal em estado_DACs
+void aplicaEstadoSeguro(uint32_t periodo); // um passo do estado seguro em todos os canais
+void verificaDacs();                  // detecta passada dos DACs travada
+void verificaLeituras();              // compara a leitura do ADC com a saida comandada
+void stageChanges(const uint16_t *valores); // agenda as atualizações dos dacs de um W já validado
+void stageDelta(const AlteracaoCanal *alteracoes, int n); // idem para o comando D, que endereça só os canais alterados
+ResultadoQuadro verificaQuadro(const char *quadro, const char **comando); // confere o prefixo "@seq,tag " de um comando autenticado
+int iniciaSessao(uint64_t nonceHost, uint64_t *nonceControlador); // inicio da sessão autenticada (comando N). 0 ou 14
 void evaluate();                      // identifica o comando, checa se houve mudança na string que armazena a entrada com relação ao estado atual
-void dacUpdate(int canal, int valor); // ajusta os dacs individualmente
+void dacUpdate(int banco, const MCP492XWrite *lote, int n); // escreve um lote de canais do banco de uma vez
+void selecionaChip(int banco, int chip, bool ativo); // aciona ou libera o chip select de um dac
+void selecionaChipLote(void *banco, uint8_t chip, bool ativo); // selecionaChip() no formato do writeMany()
+void marcaCanal(int canal);           // marca o canal para o worker do seu banco
+void configuraCanal(const ConfiguracaoCanal &configuracao); // aplica o comando P (ganho, buffer e shutdown de um canal)
+void aplicaLDAC();                    // coloca o pino LDAC no nivel de repouso do modo atual
+void aplicaPrioridades();             // aplica as prioridades nas tasks que já estão rodando
+void aplicaCoreDacs();                // pede aos workers dos dacs para se recriarem no core coreTask
+void aplicaTaxaAdc();                 // reprograma o timer da aquisição
+FormatoResposta formatoResposta();          // modo e campos da resposta do comando atual
+ParametrosProtocolo parametrosProtocolo();  // faixas e textos de erro desta placa
+
+char estado_DACs[BUFFERLEN] = ""; // ultimo comando W aplicado. montado em setupEstado(): "WA0000B0000..." (8 canais)
+char estado_ADC[5 * CANAIS + 2] = ""; // montado em setupEstado(): "0000,0000,...,,"
+
+// estado de cada canal, indice 0 = canal A
+struct EstadoCanal
+{
+  volatile uint16_t valor; // alvo pedido pelo host
+  volatile uint16_t saida; // codigo escrito no DAC pelo worker. difere do valor enquanto a inclinação limita
+  uint16_t inclinacao;     // limite em codigos por ms (comando I), 0 sem limite
+  volatile uint8_t ganho;  // 1 ou 2 (bit GA do MCP492X)
+  volatile bool buffer;    // entrada de referencia com buffer (bit BUF)
+  volatile bool ativo;     // false: saida desligada, em alta impedancia (bit SHDN)
+  uint8_t modoSeguro;      // ModoSeguro
+  uint16_t rampa;          // inclinação do SEGURO_RAMPA em codigos por segundo
+  uint8_t leiturasFora;    // ciclos seguidos do supervisor com a leitura do ADC fora da tolerancia
+};
+EstadoCanal estado_Canais[CANAIS];
+
+// Saidas persistidas na RAM do RTC, que sobrevive a um reinicio por software (OTA, rollback, watchdog, panico) mas
+// não a uma queda de energia. o worker de cada banco grava os canais que escreve; no boot, setupEstado() parte
+// desses valores em vez de zero, e a primeira passada reescreve nos DACs o que eles já estavam segurando.
+// a proteção das saidas vai junto (heartbeat, estado seguro e inclinação de cada canal): depois de um panico o
+// supervisor volta armado, e sem o host o canal vai para o seu estado seguro com o mesmo limite de antes
+#define MARCA_SAIDAS 0x46494432 // "FID2". muda com o formato da estrutura
+struct SaidasPersistidas
+{
+  uint32_t marca;
+  uint32_t canais;               // placa que gravou
+  uint16_t valores[CANAIS];
+  uint8_t configuracao[CANAIS];  // bit 0 ganho 2x, bit 1 buffer, bit 2 ativo
+  int64_t instanteParada;        // relogio do RTC em us no fim da ultima OTA, 0 se o reinicio não veio de uma OTA
+  int32_t heartbeat;             // configuração heartbeat (comando C)
+  uint8_t modoSeguro[CANAIS];    // ModoSeguro (comando F)
+  uint16_t rampa[CANAIS];
+  uint16_t inclinacao[CANAIS];   // comando I
+};
+RTC_NOINIT_ATTR SaidasPersistidas saidasPersistidas;
+
+// canais a escrever, um bit por canal a partir do primeiro canal de cada banco. marcados com marcaCanal() e
+// consumidos de uma vez pelo worker do banco, que percorre só os bits ligados
+volatile uint32_t canaisPendentes[BANCOS];
 
-char estado_DACs[] = "WA0000B0000C0000D0000E0000F0000G0000H0000"; // valor inicial só para referência e leitura do código
-char estado_ADC[] = "0000,0000,0000,0000,0000,0000,0000,0000,,";  // valor inicial só para referência e leitura do código
-int estado_Update[3][9] =
+const OperacoesTroca operacoesTroca = {cedeTroca, tomaNotificacoesTroca, acordaSubstituto};
+
+// tabela das configurações alteraveis pelo comando C
+const char *const opcoesEco[] = {"completo", "curto", "nenhum", NULL};
+const char *const opcoesResposta[] = {"verbosa", "compacta", NULL};
+const Configuracao tabelaConfig[] =
     {
-        {0, 1, 2, 3, 4, 5, 6, 7, 8},
-        {1, 1, 1, 1, 1, 1, 1, 1, 1},
-        {0, 0, 0, 0, 0, 0, 0, 0, 0}};
-// canal, update status (1 = update), valor
+        // nome, tipo, variavel, minimo, maximo, opções, aplicar
+        {"echo", CONFIG_ENUM, &modoEco, 0, 2, opcoesEco, NULL},
+        {"respostas", CONFIG_ENUM, &modoResposta, 0, 1, opcoesResposta, NULL},
+        {"timestamp", CONFIG_BOOL, &respostaComTempo, 0, 1, NULL, NULL},
+        {"close_after_rec", CONFIG_BOOL, &closeAfterRec, 0, 1, NULL, NULL},
+        {"ldac", CONFIG_BOOL, &use_LDAC, 0, 1, NULL, aplicaLDAC},
+        {"core_dacs", CONFIG_INT, &coreTask, 0, 1, NULL, aplicaCoreDacs},
+        {"prio_dacs", CONFIG_INT, &prioridadeDacs, 1, configMAX_PRIORITIES - 1, NULL, aplicaPrioridades},
+        {"prio_adc", CONFIG_INT, &prioridadeAdc, 1, configMAX_PRIORITIES - 1, NULL, aplicaPrioridades},
+        {"prio_supervisor", CONFIG_INT, &prioridadeSupervisor, 1, configMAX_PRIORITIES - 1, NULL, aplicaPrioridades},
+        {"prio_tcp", CONFIG_INT, &prioridadeTcp, 1, configMAX_PRIORITIES - 1, NULL, aplicaPrioridades},
+        {"prio_conexao", CONFIG_INT, &prioridadeConexao, 1, configMAX_PRIORITIES - 1, NULL, aplicaPrioridades},
+        {"periodo_conexao", CONFIG_INT, &periodoConexao, 1, 1000, NULL, NULL},
+        {"periodo_tcp", CONFIG_INT, &periodoTcp, 1, 5000, NULL, NULL},
+        {"taxa_adc", CONFIG_INT, &taxaAdc, 1, TAXA_ADC_MAX, NULL, aplicaTaxaAdc},
+        {"heartbeat", CONFIG_INT, &heartbeat, 0, 60000, NULL, NULL},
+        {"tolerancia_adc", CONFIG_INT, &toleranciaAdc, 0, 4095, NULL, NULL},
+        {"amostragem_rastro", CONFIG_INT, &amostragemRastro, 0, 100000, NULL, NULL},
+        {"autenticacao", CONFIG_INT, &autenticacao, 0, COM_CHAVE ? 1 : 0, NULL, NULL}};
+Configuracoes config(tabelaConfig, sizeof(tabelaConfig) / sizeof(tabelaConfig[0]));
 
 //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // SETUP e LOOP (arduino default)
@@ -95,8 +479,21 @@ void setup()
 {
   // Serial.begin(9600); //debug
   setupPins();     // Seta os pinos
+  setupEstado();   // Estado inicial: todos os canais em zero, ou as saidas de antes de um reinicio por software
+  if (COM_CHAVE)
+  {
+    uint8_t chave[TAM_CHAVE];
+    leChave(CHAVE_COMANDOS, chave);
+    sessao.defineChave(chave);
+  }
+  registraEvento(EVT_BOOT, CANAIS);
   myDac.begin();   // inicializa os dacs
-  changeDacs();    // Zera os dacs
+  if (Mapa::usaBarramento(Barramento::Hspi))
+  {
+    myDacHSPI.begin();
+  }
+  esp_task_wdt_init(TIMEOUT_WDT, true); // o watchdog reinicia o ESP32 se o supervisor, a task TCP ou um worker pararem
+  launchTasksDacs(); // primeira passada dos workers: zera os dacs ou reescreve as saidas restauradas
   setupWireless(); // Seta o WIreless
   setupOTA();      // Inicia os scripts para programar o esp32 via rede
   launchTasks();   // Inicia tudo que roda via task (checagem de coxexão, recebimento de menwsagem, atuação dos DACs e ADC)
@@ -111,19 +508,25 @@ void loop()
 // TASKS
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
-// Checa a conecção, mantem o serviço de upload por wifi. periodo definido em PERIODO
+// Mantem a conexão e o serviço de upload por wifi. periodo definido em PERIODO_OTA.
+// a queda é informada pelo callback de eventos, de modo que nenhuma chamada aqui bloqueia
 void taskCheckConnCode(void *parameters)
 {
+  uint32_t relogio = 0;
   for (;;)
   {
-    if (WiFi.status() == WL_CONNECTED)
+    registraRelogio(&relogio);
+    serviceWiFi();
+    if (estadoAutoteste == AUTOTESTE_PENDENTE)
+    {
+      autoteste();
+    }
+    if (estadoWiFi == WIFI_CONECTADO)
     {
-      vTaskDelay(PERIODO / portTICK_PERIOD_MS);
       ArduinoOTA.handle();
-      continue;
+      atendeMetricas();
     }
-    digitalWrite(LED_BUILTIN, LOW);
-    connectWiFi();
+    vTaskDelay(periodoConexao / portTICK_PERIOD_MS);
   }
 }
 
@@ -131,295 +534,1641 @@ void taskCheckConnCode(void *parameters)
 // contudo se o socket for fechado pode ser necessário ajustar o vtaskdelay no final da função
 void taskTcpCode(void *parameters)
 {
+  esp_task_wdt_add(NULL); // alimentado a cada volta do laço. periodo_tcp fica abaixo de TIMEOUT_WDT
+  bool clienteAtivo = false;
   for (;;)
   {
+    esp_task_wdt_reset();
     if (cl.connected())
     {
+      enviaRegistros(); // fluxo do ADC, se ligado
       if (cl.available() > 0)
       {
-        int i = 0;
-        char bufferEntrada[BUFFERLEN] = "";
+        instanteRecepcao = micros();
+        enquadrador.inicia();
         while (cl.available() > 0)
         {
-          if (i < BUFFERLEN - 1)
-          {
-            char z = cl.read();
-            bufferEntrada[i] = z;
-            i++;
-            if (z == '\r')
-            {
-              bufferEntrada[i] = '\0';
-              i++;
-            }
-          }
-          else
-          {
-            bufferEntrada[BUFFERLEN] = '\0';
-            while (cl.available() > 0)
-            {
-              char z = cl.read();
-            }
-          }
+          enquadrador.recebe(cl.read());
+        }
+        size_t i = enquadrador.termina();
+        memcpy(mensagemTcpIn, areaEntrada, i + 1);
+        bytesRecebidos += i;
+        uint32_t inicio = micros();
+        evaluate();
+        contadores.processamento.observa(xPortGetCoreID(), micros() - inicio);
+        saida.descarrega(); // uma unica escrita por ciclo
+        if (rastroAtual != NULL)
+        {
+          marcaEtapa(rastroAtual, ETAPA_RESPONDIDO);
+          rastrosGravados++;
+          rastroAtual = NULL;
         }
-        strncpy(mensagemTcpIn, bufferEntrada, i);
         if (closeAfterRec)
         {
           cl.stop();
         }
-        evaluate();
+      }
+      else
+      {
+        vTaskDelay(1); // sem dados: libera o core para o idle e para o driver do wifi
       }
     }
     else
     {
+      saida.limpa();
+      mascaraFluxo = 0; // o fluxo do ADC acaba com a conexão
+      registrosEnviados = registrosProduzidos;
+      if (clienteAtivo)
+      {
+        registraEvento(EVT_CLIENTE_DESCONECTADO, 0, sequencia);
+      }
       cl = sv.available(); // Disponabiliza o servidor para o cliente se conectar.
-      vTaskDelay(1000 / portTICK_PERIOD_MS);
+      clienteAtivo = cl;
+      if (clienteAtivo)
+      {
+        registraEvento(EVT_CLIENTE_CONECTADO);
+      }
+      sequencia = 0;
+      sessao.encerra(); // o proximo cliente precisa de um novo N
+      vTaskDelay(periodoTcp / portTICK_PERIOD_MS);
     }
   }
 }
 
+// Worker de um banco de DACs. fica bloqueado até o changeDacs() notificar, aplica os canais do banco marcados no
+// estado_Canais e volta a esperar. cada banco tem o seu barramento, então os bancos são escritos em paralelo.
+// os canais marcados viram um lote escrito numa unica transação SPI.
+// canais com inclinação limitada andam até o alvo em passos (lib/Inclinacao): enquanto algum está em movimento, o
+// worker também acorda a cada PERIODO_INCLINACAO ms e escreve só os canais cujo codigo mudou. essas passadas não
+// vêm de uma notificação e não contam nas passadas pendentes (coordenacaoDacs), nas metricas de latencia nem no registro de eventos.
+// o worker está no watchdog: parado, acorda a cada VIGIA_DACS ms só para alimentá-lo. um worker travado no meio de
+// uma passada (SPI, barramento) reinicia o ESP32 em TIMEOUT_WDT, e as saidas voltam da RAM do RTC.
+// roda no core de tempo real; se core_dacs mudar, cria o substituto no novo core e se encerra
 void taskUpdateDacs(void *parameters)
 {
-  if (use_LDAC)
+  const int banco = (int)(intptr_t)parameters;
+  const int primeiro = Mapa::primeiroCanal(banco);
+  MCP492XWrite lote[32]; // um banco tem no maximo 32 canais (ValidaPlaca)
+  LimitadorInclinacao limitador;
+  bool notificada = true; // a primeira passada conta pela notificação que criou o worker
+  esp_task_wdt_add(NULL);
+  for (;;)
   {
-    digitalWrite(LDAC, HIGH);
+    esp_task_wdt_reset();
+    bool passo = !notificada && limitador.emMovimento() != 0; // acordou pelo PERIODO_INCLINACAO, não pelo VIGIA_DACS
+    // pega e zera a mascara antes de ler os valores: uma alteração que chegar durante a escrita não se perde
+    uint32_t marcados = __atomic_exchange_n(&canaisPendentes[banco], 0, __ATOMIC_SEQ_CST);
+    uint32_t pendentes = marcados | limitador.emMovimento();
+    uint32_t agora = millis();
+    uint32_t inicio = ESP.getCycleCount();
+    int n = 0;
+    while (pendentes != 0)
+    {
+      int indice = __builtin_ctz(pendentes);
+      int canal = primeiro + indice;
+      pendentes &= pendentes - 1;
+      EstadoCanal &estado = estado_Canais[canal];
+      uint16_t codigo = estado.saida;
+      bool mudou = limitador.avanca(indice, estado.valor, estado.inclinacao, agora, &codigo);
+      if (!mudou && !((marcados >> indice) & 1))
+      {
+        continue; // em movimento, mas o passo ainda não venceu
+      }
+      estado.saida = codigo;
+      lote[n].device = Mapa::chip(canal);
+      lote[n].odd = Mapa::saida(canal);
+      lote[n].buffered = estado.buffer;
+      lote[n].gain = estado.ganho == 1; // GA = 1: ganho 1x
+      lote[n].active = estado.ativo;
+      lote[n].value = codigo;
+      persisteCanal(canal);
+      n++;
+    }
+    canaisEmMovimento[banco] = limitador.emMovimento();
+    if (passo)
+    {
+      ciclosInclinacao[banco] = ESP.getCycleCount() - inicio;
+    }
+    if (n > 0)
+    {
+      dacUpdate(banco, lote, n);
+      contadores.escritasDac.soma(xPortGetCoreID(), n);
+      if (notificada)
+      {
+        registraEvento(EVT_DACS_PASSADA, banco, n);
+      }
+    }
+    if (notificada && coordenacaoDacs.concluiPassada())
+    {
+      Rastro *rastro = rastroDacs;
+      marcaEtapa(rastro, ETAPA_ESCRITO);
+      if (use_LDAC)
+      {
+        digitalWrite(LDAC, LOW); // todos os bancos escritos: aplica as saidas juntas
+      }
+      marcaEtapa(rastro, ETAPA_LDAC);
+      metricasDacs.duracao = micros() - instanteNotificacao;
+      contadores.passadasDac.soma(xPortGetCoreID());
+      contadores.passadaDac.observa(xPortGetCoreID(), metricasDacs.duracao);
+      registraEvento(EVT_DACS_COMPLETO, 0, metricasDacs.duracao);
+      if (bootMs == 0)
+      {
+        registraPrimeiraPassada();
+      }
+      if (metricasDacs.duracao > metricasDacs.maiorDuracao)
+      {
+        metricasDacs.maiorDuracao = metricasDacs.duracao;
+      }
+    }
+
+    // uma passada por notificação, para manter a contagem de passadas pendentes coerente; com canais em movimento, também o passo
+    TickType_t espera = pdMS_TO_TICKS(limitador.emMovimento() != 0 ? PERIODO_INCLINACAO : VIGIA_DACS);
+    notificada = ulTaskNotifyTake(pdFALSE, espera > 0 ? espera : 1) != 0;
+    if (!notificada)
+    {
+      continue;
+    }
+    marcaEtapa(rastroDacs, ETAPA_ACORDADO);
+    uint32_t latencia = micros() - instanteNotificacao;
+    metricasDacs.latencia = latencia;
+    contadores.latenciaDac.observa(xPortGetCoreID(), latencia);
+    if (latencia > metricasDacs.maiorLatencia)
+    {
+      metricasDacs.maiorLatencia = latencia;
+    }
+
+    if (coreTask != xPortGetCoreID())
+    {
+      // o substituto começa com um limitador novo: os canais em movimento seguem como marcados
+      __atomic_fetch_or(&canaisPendentes[banco], limitador.emMovimento(), __ATOMIC_SEQ_CST);
+      launchTaskDacs(banco); // o novo worker começa com uma passada, que conta pela notificação recebida
+      // as notificações que chegaram depois desta, e as de um changeDacs() que leu o handle antigo, são passadas
+      // pendentes: seguem para o novo worker, senão a contagem não zera e o LDAC fica alto
+      coordenacaoDacs.repassa(operacoesTroca, (void *)(intptr_t)banco);
+      esp_task_wdt_delete(NULL); // o substituto já se inscreveu
+      vTaskDelete(NULL);
+    }
   }
-  else
+}
+
+// operações do FreeRTOS para o CoordenacaoDacs::repassa(), no worker antigo. contexto: o banco
+void cedeTroca(void *banco)
+{
+  vTaskDelay(1); // o changeDacs() em curso pode estar no mesmo core, com prioridade menor
+}
+
+uint32_t tomaNotificacoesTroca(void *banco)
+{
+  return ulTaskNotifyTake(pdTRUE, 0);
+}
+
+void acordaSubstituto(void *banco)
+{
+  xTaskNotifyGive(taskDacs[(int)(intptr_t)banco]);
+}
+
+// Aquisição do ADC: le todos os canais taxa_adc vezes por segundo, publica a leitura para o R e entrega o quadro à
+// captura. a cadencia vem do timer de hardware, que acorda a task a cada quadro; entre quadros o core fica livre.
+// a captura só copia o quadro no anel, então armar, disparar ou enviar não muda a cadencia
+void taskAdcCode(void *parameters)
+{
+  uint16_t quadro[CANAIS];
+  relogioADC.begin(taxaAdc); // as interrupções do timer notificam esta task
+  for (;;)
   {
-    digitalWrite(LDAC, LOW);
+    relogioADC.wait();
+    leQuadroADC(quadro);
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      leituraADC[canal] = quadro[canal];
+    }
+    captura.adiciona(quadro);
+    montaRegistro(quadro);
+    quadrosADC++;
+    contadores.amostrasAdc.soma(xPortGetCoreID(), CANAIS);
   }
-  for (int canal = 1; canal < 9; canal++)
+}
+
+// Supervisor: a cada PERIODO_SUPERVISOR alimenta o watchdog, coloca as saidas no estado seguro se o host passar
+// heartbeat ms sem enviar comandos, detecta passada dos DACs travada e compara a leitura do ADC com a saida.
+// tudo é leitura de variaveis em memoria; só o estado seguro escreve nos DACs
+void taskSupervisorCode(void *parameters)
+{
+  esp_task_wdt_add(NULL);
+  TickType_t ultimo = xTaskGetTickCount();
+  uint32_t relogio = 0;
+  for (;;)
   {
-    if (estado_Update[1][canal] == 1)
+    vTaskDelayUntil(&ultimo, pdMS_TO_TICKS(PERIODO_SUPERVISOR));
+    esp_task_wdt_reset();
+    registraRelogio(&relogio);
+    uint32_t inicio = micros();
+
+    if (heartbeat > 0 && !estadoSeguro && inicio - ultimoComando > (uint32_t)heartbeat * 1000)
+    {
+      estadoSeguro = true;
+      metricasSupervisor.disparos++;
+      aplicaEstadoSeguro(PERIODO_SUPERVISOR);
+      uint32_t latencia = micros() - ultimoComando - (uint32_t)heartbeat * 1000;
+      metricasSupervisor.latencia = latencia;
+      registraEvento(EVT_ESTADO_SEGURO, 0, latencia);
+      if (latencia > metricasSupervisor.maiorLatencia)
+      {
+        metricasSupervisor.maiorLatencia = latencia;
+      }
+    }
+    else if (estadoSeguro)
+    {
+      aplicaEstadoSeguro(PERIODO_SUPERVISOR); // continua as rampas
+    }
+    verificaDacs();
+    verificaLeituras();
+
+    metricasSupervisor.ciclos++;
+    metricasSupervisor.duracao = micros() - inicio;
+    if (metricasSupervisor.duracao > metricasSupervisor.maiorDuracao)
     {
-      dacUpdate(canal, estado_Update[2][canal]);
-      estado_Update[1][canal] = 0;
+      metricasSupervisor.maiorDuracao = metricasSupervisor.duracao;
     }
   }
-  if (use_LDAC)
-  {
-    digitalWrite(LDAC, LOW);
-  };
-  vTaskDelete(NULL);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Funções
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// um passo de periodo ms do estado seguro: zera os canais SEGURO_ZERAR e desce os SEGURO_RAMPA. se o host voltar
+// (estadoSeguro falso) no meio, para sem mexer nos canais restantes
+void aplicaEstadoSeguro(uint32_t periodo)
+{
+  bool alterou = false;
+  for (int canal = 0; canal < CANAIS && estadoSeguro; canal++)
+  {
+    EstadoCanal &estado = estado_Canais[canal];
+    int valor = estado.valor;
+    if (estado.modoSeguro == SEGURO_ZERAR)
+    {
+      valor = 0;
+    }
+    else if (estado.modoSeguro == SEGURO_RAMPA)
+    {
+      valor = estado.saida; // parte do que está na saida, mesmo que ela ainda esteja a caminho de um alvo mais alto
+      uint32_t passo = (uint32_t)estado.rampa * periodo / 1000;
+      valor -= passo > 0 ? passo : 1;
+      valor = valor < 0 ? 0 : valor;
+    }
+    if (valor != estado.valor)
+    {
+      estado.valor = valor;
+      escreveEstadoDAC(canal, valor);
+      marcaCanal(canal);
+      alterou = true;
+    }
+  }
+  if (alterou)
+  {
+    instanteAplicado = micros();
+    changeDacs();
+  }
+}
+
+// uma passada que não termina em LIMITE_PASSADA (task dos DACs atrasada ou travada no meio de um banco) deixa canais
+// meio aplicados. conta uma vez por atualização e marca todos os canais, para a proxima passada reescrever tudo.
+// um worker que não volta mais não alimenta o watchdog e reinicia o ESP32 (taskUpdateDacs)
+void verificaDacs()
+{
+  static uint32_t notificacaoVerificada = 0;
+  uint32_t notificacao = instanteNotificacao;
+  if (coordenacaoDacs.ocupados() > 0 && notificacao != notificacaoVerificada && micros() - notificacao > LIMITE_PASSADA)
+  {
+    notificacaoVerificada = notificacao;
+    metricasSupervisor.travamentos++;
+    registraEvento(EVT_DACS_TRAVADOS, 0, metricasSupervisor.travamentos);
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      marcaCanal(canal);
+    }
+  }
+}
+
+// codigo que o ADC deve ler com a saida ligada à entrada do mesmo canal
+int leituraEsperada(const EstadoCanal &estado)
+{
+  int esperado = estado.ativo ? estado.saida * estado.ganho : 0;
+  return esperado > 4095 ? 4095 : esperado;
+}
+
+// com tolerancia_adc > 0, a leitura de cada canal deve acompanhar o codigo comandado (vezes o ganho, zero com a
+// saida desligada). só compara depois de ACOMODACAO_ADC da ultima alteração e só marca depois de
+// LEITURAS_DIVERGENCIA ciclos seguidos fora, para não reagir a ruido ou à planta ainda se movendo
+void verificaLeituras()
+{
+  if (toleranciaAdc == 0 || micros() - instanteAplicado < ACOMODACAO_ADC)
+  {
+    return;
+  }
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    EstadoCanal &estado = estado_Canais[canal];
+    if (estado.saida != estado.valor)
+    {
+      continue; // em movimento pela inclinação: a leitura ainda segue a saida
+    }
+    int diferenca = (int)leituraADC[canal] - leituraEsperada(estado);
+    if (diferenca > toleranciaAdc || diferenca < -toleranciaAdc)
+    {
+      if (estado.leiturasFora < LEITURAS_DIVERGENCIA && ++estado.leiturasFora == LEITURAS_DIVERGENCIA)
+      {
+        canaisDivergentes |= 1ull << canal;
+        metricasSupervisor.divergencias++;
+        registraEvento(EVT_DIVERGENCIA, canal, leituraADC[canal]);
+      }
+    }
+    else
+    {
+      estado.leiturasFora = 0;
+      canaisDivergentes &= ~(1ull << canal);
+    }
+  }
+}
+
+// canal c é a entrada c % entradas do ADC c / entradas. o barramento fica reservado durante o quadro
+void leQuadroADC(uint16_t *quadro)
+{
+  constexpr int entradas = entradasPorADC(Placa::adc);
+  SPI.beginTransaction(SPISettings(Placa::clockSPIADC, MSBFIRST, SPI_MODE0));
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    ADC adc(VREF_ADC, Placa::pinosCSADC[canal / entradas], &SPI);
+    quadro[canal] = adc.read(static_cast<ADC::Channel>(DriverADC<Placa::adc>::simples | canal % entradas));
+  }
+  SPI.endTransaction();
+}
+
 // inicializa os pinos do microcontrolador
 void setupPins()
 {
   pinMode(LDAC, OUTPUT);
   pinMode(LED_BUILTIN, OUTPUT);
-  for (int i = 0; i < 9; i++)
+  aplicaLDAC();
+  for (int banco = 0; banco < BANCOS; banco++)
   {
-    pinMode(CS_SPI[i], OUTPUT);
+    if (!Mapa::csDireto(banco))
+    {
+      pinMode(Placa::bancos[banco].pinoDadosCS, OUTPUT);
+      pinMode(Placa::bancos[banco].pinoClockCS, OUTPUT);
+      pinMode(Placa::bancos[banco].pinoLatchCS, OUTPUT);
+      digitalWrite(Placa::bancos[banco].pinoClockCS, LOW);
+      digitalWrite(Placa::bancos[banco].pinoLatchCS, LOW);
+      selecionaChip(banco, Mapa::primeiroChip(banco), false); // todas as linhas do 595 em 1
+      continue;
+    }
+    for (int chip = Mapa::primeiroChip(banco); chip < Mapa::primeiroChip(banco) + Placa::bancos[banco].chips; chip++)
+    {
+      pinMode(Placa::pinosCS[chip], OUTPUT);
+      digitalWrite(Placa::pinosCS[chip], HIGH);
+    }
   }
-  if (use_LDAC)
+  for (uint8_t pino : Placa::pinosCSADC)
   {
-    digitalWrite(LDAC, HIGH);
+    pinMode(pino, OUTPUT);
+    digitalWrite(pino, HIGH);
   }
-  else
+}
+
+void setupEstado()
+{
+  estado_DACs[0] = 'W';
+  for (int canal = 0; canal < CANAIS; canal++)
   {
-    digitalWrite(LDAC, LOW);
+    memcpy(estado_DACs + 1 + 5 * canal, "A0000", 5);
+    estado_DACs[1 + 5 * canal] = letraCanal(canal);
+    memcpy(estado_ADC + 5 * canal, "0000,", 5);
+    estado_Canais[canal].valor = 0;
+    estado_Canais[canal].saida = 0;
+    estado_Canais[canal].inclinacao = 0;
+    estado_Canais[canal].ganho = 1;
+    estado_Canais[canal].buffer = false;
+    estado_Canais[canal].ativo = true;
+    estado_Canais[canal].modoSeguro = SEGURO_MANTER;
+    estado_Canais[canal].rampa = 1000;
+    marcaCanal(canal);
+  }
+  estado_DACs[TAM_W] = '\0';
+  estado_ADC[5 * CANAIS] = ',';
+  estado_ADC[5 * CANAIS + 1] = '\0';
+  saidasRestauradas = restauraSaidas();
+}
+
+// só depois de um reinicio por software: numa queda de energia a RAM do RTC vem com lixo e os DACs voltam em zero
+bool restauraSaidas()
+{
+  esp_reset_reason_t motivo = esp_reset_reason();
+  bool software = motivo == ESP_RST_SW || motivo == ESP_RST_PANIC || motivo == ESP_RST_INT_WDT ||
+                  motivo == ESP_RST_TASK_WDT || motivo == ESP_RST_WDT;
+  bool valido = software && saidasPersistidas.marca == MARCA_SAIDAS && saidasPersistidas.canais == CANAIS;
+  for (int canal = 0; valido && canal < CANAIS; canal++)
+  {
+    valido = saidasPersistidas.valores[canal] <= 4095 && saidasPersistidas.configuracao[canal] <= 7 &&
+             saidasPersistidas.modoSeguro[canal] <= SEGURO_RAMPA && saidasPersistidas.rampa[canal] >= 1 &&
+             saidasPersistidas.inclinacao[canal] <= INCLINACAO_MAXIMA;
+  }
+  valido = valido && saidasPersistidas.heartbeat >= 0 && saidasPersistidas.heartbeat <= 60000;
+  if (!valido)
+  {
+    saidasPersistidas.marca = MARCA_SAIDAS;
+    saidasPersistidas.canais = CANAIS;
+    saidasPersistidas.instanteParada = 0;
+    saidasPersistidas.heartbeat = heartbeat;
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      persisteCanal(canal);
+      persisteSeguranca(canal);
+    }
+    return false;
+  }
+  // o heartbeat conta do boot (ultimoComando = 0): se o host não voltar, o supervisor aplica o estado seguro
+  heartbeat = saidasPersistidas.heartbeat;
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    uint8_t configuracao = saidasPersistidas.configuracao[canal];
+    estado_Canais[canal].valor = saidasPersistidas.valores[canal];
+    estado_Canais[canal].saida = saidasPersistidas.valores[canal];
+    estado_Canais[canal].ganho = configuracao & 1 ? 2 : 1;
+    estado_Canais[canal].buffer = configuracao & 2;
+    estado_Canais[canal].ativo = configuracao & 4;
+    estado_Canais[canal].modoSeguro = saidasPersistidas.modoSeguro[canal];
+    estado_Canais[canal].rampa = saidasPersistidas.rampa[canal];
+    estado_Canais[canal].inclinacao = saidasPersistidas.inclinacao[canal];
+    escreveEstadoDAC(canal, saidasPersistidas.valores[canal]);
+  }
+  return true;
+}
+
+void persisteCanal(int canal)
+{
+  const EstadoCanal &estado = estado_Canais[canal];
+  saidasPersistidas.valores[canal] = estado.saida;
+  saidasPersistidas.configuracao[canal] = (estado.ganho == 2) | estado.buffer << 1 | estado.ativo << 2;
+}
+
+// chamado pela task TCP, que é quem altera esses campos (F e I)
+void persisteSeguranca(int canal)
+{
+  const EstadoCanal &estado = estado_Canais[canal];
+  saidasPersistidas.modoSeguro[canal] = estado.modoSeguro;
+  saidasPersistidas.rampa[canal] = estado.rampa;
+  saidasPersistidas.inclinacao[canal] = estado.inclinacao;
+}
+
+int64_t instanteRtc()
+{
+  timeval agora;
+  gettimeofday(&agora, NULL);
+  return (int64_t)agora.tv_sec * 1000000 + agora.tv_usec;
+}
+
+void registraPrimeiraPassada()
+{
+  bootMs = millis();
+  if (saidasPersistidas.instanteParada != 0)
+  {
+    paradaOtaMs = (instanteRtc() - saidasPersistidas.instanteParada) / 1000;
+    saidasPersistidas.instanteParada = 0;
+  }
+  registraEvento(EVT_SAIDAS_RESTAURADAS, saidasRestauradas, paradaOtaMs);
+}
+
+// Autoteste. chamado pela task de conexão até decidir: aprova assim que todas as verificações passam e reprova se
+// o PRAZO_AUTOTESTE vencer antes. numa imagem recem gravada (pendente de verificação) a aprovação a torna
+// definitiva e a reprovação reinicia na imagem anterior, com as saidas persistidas
+void autoteste()
+{
+  uint32_t falhas = 0;
+  if (bootMs == 0 || metricasSupervisor.travamentos != 0)
+  {
+    falhas |= FALHA_DACS;
+  }
+  if (quadrosADC < (uint32_t)taxaAdc)
+  {
+    falhas |= FALHA_ADC;
+  }
+  if (metricasSupervisor.ciclos == 0)
+  {
+    falhas |= FALHA_SUPERVISOR;
+  }
+  if (TOLERANCIA_AUTOTESTE > 0)
+  {
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      int diferenca = (int)leituraADC[canal] - leituraEsperada(estado_Canais[canal]);
+      if (micros() - instanteAplicado < ACOMODACAO_ADC || diferenca > TOLERANCIA_AUTOTESTE ||
+          diferenca < -TOLERANCIA_AUTOTESTE)
+      {
+        falhas |= FALHA_LACO;
+      }
+    }
+  }
+  if (estadoWiFi != WIFI_CONECTADO)
+  {
+    falhas |= FALHA_REDE;
+  }
+  falhasAutoteste = falhas;
+  if (falhas != 0 && millis() < PRAZO_AUTOTESTE)
+  {
+    return;
+  }
+
+  esp_ota_img_states_t estadoImagem;
+  bool pendente = esp_ota_get_state_partition(esp_ota_get_running_partition(), &estadoImagem) == ESP_OK &&
+                  estadoImagem == ESP_OTA_IMG_PENDING_VERIFY;
+  estadoAutoteste = falhas == 0 ? AUTOTESTE_APROVADO : AUTOTESTE_REPROVADO;
+  registraEvento(EVT_AUTOTESTE, estadoAutoteste, falhas);
+  if (!pendente)
+  {
+    return;
   }
-  for (int i = 0; i < 9; i++)
+  if (falhas == 0)
   {
-    digitalWrite(CS_SPI[i], HIGH);
+    esp_ota_mark_app_valid_cancel_rollback();
   }
+  else
+  {
+    saidasPersistidas.instanteParada = instanteRtc(); // a parada do rollback também é medida
+    esp_ota_mark_app_invalid_rollback_and_reboot();
+  }
+}
+
+// o Arduino aprovaria a imagem nova já no boot; a decisão fica para o autoteste
+extern "C" bool verifyRollbackLater()
+{
+  return true;
 }
 
 void setupWireless()
 {
+  WiFi.mode(WIFI_STA);
+  WiFi.setHostname(HOSTNAME);
+  WiFi.setAutoReconnect(false); // a reconexão é feita pela serviceWiFi() com backoff
+  WiFi.onEvent(wifiEvento);
   if (!WiFi.config(local_IP, gateway, subnet))
   { // configura o ip estatico
   }
   connectWiFi();
-  delay(100);
-  sv.begin(); // inicia o server para o socket
+  sv.begin(); // inicia o server para o socket. aceita clientes assim que o wifi subir
+  svMetricas.begin();
 }
 
 // esta função de atualização OTA provavelmente foi obtida e explicada no video do Andreas Spiess.
 void setupOTA()
 {
   ArduinoOTA.setHostname(HOSTNAME);
-  // No authentication by default
-  // ArduinoOTA.setPassword("admin");
+  // sem SENHA_OTA no credentials.h a atualização não pede senha
+#ifdef SENHA_OTA
+  ArduinoOTA.setPassword(SENHA_OTA);
+#endif
+  // NOTE: if updating SPIFFS, onStart would be the place to unmount SPIFFS using SPIFFS.end()
+  // o andamento vai para o registro de eventos (comando L) em vez da serial. erro: OTA_AUTH_ERROR (0) a OTA_END_ERROR (4)
   ArduinoOTA.onStart([]()
-                     {
-    String type;
-    if (ArduinoOTA.getCommand() == U_FLASH)
-      type = "sketch";
-    else // U_SPIFFS
-      type = "filesystem";
-
-    // NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-    Serial.println("Start updating " + type); });
+                     { registraEvento(EVT_OTA_INICIO, ArduinoOTA.getCommand()); });
+  // a imagem já foi conferida (cabeçalho, checksum e SHA-256) pelo Update antes do onEnd; o reinicio vem em seguida,
+  // e o instante marca o inicio da parada do laço, medida na primeira passada da imagem nova
   ArduinoOTA.onEnd([]()
-                   { Serial.println("\nEnd"); });
-  ArduinoOTA.onProgress([](unsigned int progress, unsigned int total)
-                        { Serial.printf("Progress: %u%%\r", (progress / (total / 100))); });
+                   {
+                     saidasPersistidas.instanteParada = instanteRtc();
+                     registraEvento(EVT_OTA_FIM);
+                   });
   ArduinoOTA.onError([](ota_error_t error)
-                     {
-    Serial.printf("Error[%u]: ", error);
-    if (error == OTA_AUTH_ERROR) Serial.println("Auth Failed");
-    else if (error == OTA_BEGIN_ERROR) Serial.println("Begin Failed");
-    else if (error == OTA_CONNECT_ERROR) Serial.println("Connect Failed");
-    else if (error == OTA_RECEIVE_ERROR) Serial.println("Receive Failed");
-    else if (error == OTA_END_ERROR) Serial.println("End Failed"); });
+                     { registraEvento(EVT_OTA_ERRO, error); });
   ArduinoOTA.begin();
 }
 
-// Inicia as tasks. As tasks de comunicação (Wifi) devem rodar no core que roda o arduino (CONFIG_ARDUINO_RUNNING_CORE)
+// Inicia as tasks de comunicação. rodam no core do driver do wifi (NUCLEO_REDE), ver divisão no inicio do arquivo.
+// a aquisição do ADC vai para o core das tasks de I/O
 void launchTasks()
 {
+  taskAdc = xTaskCreateStaticPinnedToCore(taskAdcCode, "task ADC", PILHA_ADC, NULL, prioridadeAdc, pilhaAdc, &tcbAdc, coreTask);
+  taskSupervisor = xTaskCreateStaticPinnedToCore(taskSupervisorCode, "supervisor", PILHA_SUPERVISOR, NULL,
+                                                 prioridadeSupervisor, pilhaSupervisor, &tcbSupervisor, coreTask);
   // delay(2000);
-  xTaskCreatePinnedToCore(taskCheckConnCode, "conexao wifi", 5000, NULL, 1, &taskCheckConn, CONFIG_ARDUINO_RUNNING_CORE);
-  xTaskCreatePinnedToCore(taskTcpCode, "task TCP", 2000, NULL, 1, &taskTcp, CONFIG_ARDUINO_RUNNING_CORE);
+  taskCheckConn = xTaskCreateStaticPinnedToCore(taskCheckConnCode, "conexao wifi", PILHA_CONEXAO, NULL, prioridadeConexao,
+                                                pilhaConexao, &tcbConexao, NUCLEO_REDE);
+  taskTcp = xTaskCreateStaticPinnedToCore(taskTcpCode, "task TCP", PILHA_TCP, NULL, prioridadeTcp, pilhaTcp, &tcbTcp, NUCLEO_REDE);
 }
 
 void connectWiFi()
 {
-  WiFi.mode(WIFI_STA);
-  WiFi.setHostname(HOSTNAME);
+  estadoWiFi = WIFI_CONECTANDO;
+  inicioTentativa = millis();
+  metricasWiFi.tentativas++;
   WiFi.begin(SSID, PASS);
-  while (WiFi.status() != WL_CONNECTED)
-  {
-    digitalWrite(LED_BUILTIN, LOW);
-    delay(500);
-    digitalWrite(LED_BUILTIN, HIGH);
-    delay(500);
-  }
 }
 
-// verifica se a mensagem é para atualizar os dacs ou fazer a leitura do adc.
-void evaluate()
+// roda no contexto do driver do wifi: só sinaliza, quem trata é a serviceWiFi(). o DISCONNECTED do WiFi.disconnect()
+// que encerra uma tentativa vencida vem com WIFI_REASON_ASSOC_LEAVE e pode chegar depois de a seguinte ter começado;
+// não é falha dela e é descartado aqui
+void wifiEvento(WiFiEvent_t evento, WiFiEventInfo_t info)
 {
-  if (strncmp(mensagemTcpIn, "W", 1) == 0)
+  switch (evento)
   {
-    if (strncmp(mensagemTcpIn, estado_DACs, BUFFERLEN) != 0)
+  case ARDUINO_EVENT_WIFI_STA_GOT_IP:
+    eventoWiFiConectado = true;
+    break;
+  case ARDUINO_EVENT_WIFI_STA_DISCONNECTED:
+    if (info.wifi_sta_disconnected.reason != WIFI_REASON_ASSOC_LEAVE)
     {
-      stageChanges();
-      if (echo)
-      {
-        cl.print("\n");
-        cl.print(mensagemTcpIn);
-      }
+      eventoWiFiDesconectado = true;
     }
-  }
-  else if (strncmp(mensagemTcpIn, "R", 1) == 0)
-  {
-    report();
-  }
-  else
-  {
-    cl.print("\ncomando não reconhecido\nA mensagem deve começar com W para variar a corrente e R para leitura"); //
+    break;
+  case ARDUINO_EVENT_WIFI_STA_LOST_IP:
+    eventoWiFiDesconectado = true;
+    break;
+  default:
+    break;
   }
 }
 
-// leitura do ADC ***falta implementar***
-void report()
+// Maquina de estados da conexão. em caso de falha as tentativas seguem um backoff exponencial
+// de RECONEXAO_MIN até RECONEXAO_MAX. o led pisca enquanto estiver desconectado.
+void serviceWiFi()
 {
-  cl.print(estado_ADC);
-}
+  uint32_t agora = millis();
 
-// distribui os valores de entrada na matriz de estado_Update para que posteriormente os dacs sejam ajustados
-void stageChanges()
-{
-  bool erro = false;
-  char letras[] = "ABCDEFGH";
-  char valorSTR[] = "A0000";
-  int valorInt = 0;
+  bool falhou = false;
+  if (estadoWiFi == WIFI_CONECTANDO && agora - inicioTentativa > TIMEOUT_CONEXAO)
+  {
+    WiFi.disconnect(); // encerra a tentativa no driver
+    falhou = true;
+  }
 
-  for (int canal = 0; canal <= 7; canal++)
+  // em WIFI_DESCONECTADO o evento é de uma tentativa já encerrada e não adia a proxima
+  if (eventoWiFiDesconectado)
   {
-    if (strncmp(mensagemTcpIn + (5 * canal + 1), letras + (canal), 1) != 0)
+    eventoWiFiDesconectado = false;
+    if (estadoWiFi == WIFI_CONECTADO)
     {
-      erro = true;
-      cl.print("\nE2:mensagem fora do padrão. Erro nas letras\nRecebido: ");
-      cl.print(mensagemTcpIn);
-      cl.print("\nFormato esperado: WA0000B0000C0000D0000E0000F0000G0000H0000\nAs letras devem ser de A a H e nessa ordem. as unicas variáveis são os números ");
-      break;
+      metricasWiFi.quedas++;
+      registraEvento(EVT_WIFI_QUEDA, metricasWiFi.quedas);
+      inicioQueda = agora;
+      intervaloReconexao = RECONEXAO_MIN;
+      estadoWiFi = WIFI_DESCONECTADO;
+      proximaTentativa = agora + intervaloReconexao;
     }
-    strncpy(valorSTR, mensagemTcpIn + (5 * canal + 1), 5);
-
-    valorInt = 0;
-    for (int digito = 0; digito < 4; digito++)
+    else if (estadoWiFi == WIFI_CONECTANDO)
     {
-      char valorSTRBuffer[] = "0";
-      strncpy(valorSTRBuffer, valorSTR + 1 + digito, 1);
-      if (isalpha(valorSTRBuffer[0]))
-      {
-        erro = true;
-        cl.print("\nE3:mensagem fora do padrão. valores de ajuste dos dacs precisam ser numeros\nRcebido: ");
-        cl.print(mensagemTcpIn);
-        cl.print("\nErro na parte: ");
-        cl.print(valorSTR);
-        break;
-      }
-      valorInt += atoi(valorSTRBuffer) * 1000 / pow(10, digito);
+      falhou = true;
     }
-    if (erro)
+  }
+
+  if (falhou)
+  {
+    intervaloReconexao = intervaloReconexao * 2;
+    if (intervaloReconexao > RECONEXAO_MAX)
     {
-      break;
+      intervaloReconexao = RECONEXAO_MAX;
     }
+    estadoWiFi = WIFI_DESCONECTADO;
+    proximaTentativa = agora + intervaloReconexao;
+  }
 
-    if (valorInt < 0 || valorInt > 4095)
+  if (eventoWiFiConectado)
+  {
+    eventoWiFiConectado = false;
+    if (estadoWiFi != WIFI_CONECTADO && metricasWiFi.quedas > 0)
     {
-      erro = true;
-      cl.print("\nE4:mensagem fora do padrão. valores precisam estar entre 0 e 4095\nRcebido: ");
-      cl.print(mensagemTcpIn);
-      cl.print("\nErro na parte: ");
-      cl.print(valorSTR);
+      metricasWiFi.ultimaReconexao = agora - inicioQueda;
+      if (metricasWiFi.ultimaReconexao > metricasWiFi.maiorReconexao)
+      {
+        metricasWiFi.maiorReconexao = metricasWiFi.ultimaReconexao;
+      }
+    }
+    if (estadoWiFi != WIFI_CONECTADO)
+    {
+      registraEvento(EVT_WIFI_CONECTADO, metricasWiFi.tentativas, metricasWiFi.ultimaReconexao);
+    }
+    estadoWiFi = WIFI_CONECTADO;
+    intervaloReconexao = RECONEXAO_MIN;
+  }
+
+  switch (estadoWiFi)
+  {
+  case WIFI_CONECTADO:
+    digitalWrite(LED_BUILTIN, HIGH);
+    break;
+  case WIFI_DESCONECTADO:
+    if ((int32_t)(agora - proximaTentativa) >= 0)
+    {
+      connectWiFi();
+    }
+    // fallthrough
+  case WIFI_CONECTANDO:
+    digitalWrite(LED_BUILTIN, (agora / 500) % 2);
+    break;
+  }
+}
+
+// o firmware do lado de lib/Protocolo: avaliaMensagem() interpreta e responde, e cada comando validado chega aqui
+// para ser aplicado no estado_Canais, na captura, no fluxo ou na sessão. as respostas que só o firmware sabe
+// escrever vão para o buffer de saida da conexão, o mesmo passado pelo evaluate()
+class ControladorFID : public Controlador
+{
+public:
+  FormatoResposta formato() override { return formatoResposta(); }
+  ParametrosProtocolo parametros() override { return parametrosProtocolo(); }
+  Configuracoes &configuracoes() override { return config; }
+
+  bool autenticacaoObrigatoria() override { return autenticacao != 0; }
+
+  ResultadoQuadro verificaQuadro(const char *quadro, const char **comando) override
+  {
+    return ::verificaQuadro(quadro, comando);
+  }
+
+  int iniciaSessao(uint64_t nonceHost, uint64_t *nonceControlador) override
+  {
+    return ::iniciaSessao(nonceHost, nonceControlador);
+  }
+
+  // o identificador vai para o rastro. qualquer comando conta como heartbeat; W e D tiram as saidas do estado seguro
+  void comando(Comando comando, bool comId, uint32_t id) override
+  {
+    iniciaRastro(comId, id);
+    registraEvento(EVT_COMANDO, mensagemTcpIn[0], sequencia);
+    ultimoComando = micros();
+    if (comando == COMANDO_W || comando == COMANDO_D)
+    {
+      estadoSeguro = false; // o host voltou a comandar as saidas
+    }
+    _inicio = ESP.getCycleCount();
+  }
+
+  void erro(int codigo, int canal) override
+  {
+    contadores.erros[codigo < METRICAS_CODIGOS ? codigo : 0].soma(xPortGetCoreID());
+    registraEvento(EVT_ERRO, codigo, canal);
+  }
+
+  bool repeteW(const char *mensagem) override
+  {
+    if (strncmp(mensagem, estado_DACs, BUFFERLEN) != 0)
+    {
+      return false;
+    }
+    if (modoResposta == RESPOSTA_COMPACTA && modoEco != ECO_NENHUM)
+    {
+      instanteAplicado = micros(); // nada a alterar, a saida já está no estado pedido
+    }
+    return true;
+  }
+
+  // ciclos_w e ciclos_d: da identificação do comando até a atualização entregue aos workers
+  void aplicaW(const char *, const uint16_t *valores) override
+  {
+    stageChanges(valores);
+    ciclosW = ESP.getCycleCount() - _inicio;
+    marcaEtapa(rastroAtual, ETAPA_VALIDADO);
+  }
+
+  void aplicaD(const AlteracaoCanal *alteracoes, int quantidade) override
+  {
+    stageDelta(alteracoes, quantidade);
+    ciclosD = ESP.getCycleCount() - _inicio;
+    marcaEtapa(rastroAtual, ETAPA_VALIDADO);
+  }
+
+  void aplicaP(const ConfiguracaoCanal &configuracao) override { configuraCanal(configuracao); }
+  void aplicaF(const SegurancaCanal &seguranca) override { configuraSeguranca(seguranca); }
+  void aplicaI(const InclinacaoCanal &inclinacao) override { configuraInclinacao(inclinacao); }
+  int aplicaG(const PedidoCaptura &pedido, BufferSaida &) override { return capturaADC(pedido); }
+  void aplicaA(uint64_t mascara) override { fluxoADC(mascara); }
+
+  void alterouConfiguracao(const Configuracao &cfg) override
+  {
+    registraEvento(EVT_CONFIG, &cfg - tabelaConfig, *cfg.valor); // indice na tabelaConfig
+    if (cfg.valor == &heartbeat)
+    {
+      saidasPersistidas.heartbeat = heartbeat; // volta com as saidas depois de um reinicio por software
+    }
+  }
+
+  ConfiguracaoCanal canalP(int canal) override
+  {
+    return {(uint8_t)canal, estado_Canais[canal].ganho, estado_Canais[canal].buffer, estado_Canais[canal].ativo};
+  }
+
+  SegurancaCanal canalF(int canal) override
+  {
+    const char letrasModo[] = {'M', 'Z', 'R'};
+    return {(uint8_t)canal, letrasModo[estado_Canais[canal].modoSeguro], estado_Canais[canal].rampa};
+  }
+
+  bool divergente(int canal) override { return (canaisDivergentes >> canal) & 1; }
+
+  InclinacaoCanal canalI(int canal) override { return {(uint8_t)canal, estado_Canais[canal].inclinacao}; }
+
+  void consulta(Comando comando, BufferSaida &) override
+  {
+    switch (comando)
+    {
+    case COMANDO_R:
+      report();
+      break;
+    case COMANDO_S:
+      status();
+      break;
+    case COMANDO_L:
+      enviaEventos();
+      break;
+    case COMANDO_T:
+      enviaRastros();
+      break;
+    case COMANDO_G:
+      estadoCaptura();
+      break;
+    case COMANDO_A:
+      estadoFluxo();
+      break;
+    default:
       break;
     }
+  }
+
+private:
+  uint32_t _inicio = 0; // ESP.getCycleCount() na identificação do comando atual
+};
+
+ControladorFID controladorFID;
+
+// interpreta a mensagem recebida e aplica o comando (lib/Protocolo e ControladorFID).
+// as respostas vão para o buffer de saida, que é enviado de uma vez no fim do ciclo da taskTcpCode
+void evaluate()
+{
+  sequencia++;
+  contadores.comandos.soma(xPortGetCoreID());
+  avaliaMensagem(mensagemTcpIn, controladorFID, saida);
+}
 
-    if (estado_Update[2][canal + 1] != valorInt)
+// devolve a ultima leitura de cada canal do ADC: "vvvv,vvvv,...,,"
+void report()
+{
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    char *campo = estado_ADC + 5 * canal;
+    int valor = leituraADC[canal];
+    for (int digito = 3; digito >= 0; digito--)
     {
-      estado_Update[2][canal + 1] = valorInt;
-      estado_Update[1][canal + 1] = 1;
+      campo[digito] = '0' + valor % 10;
+      valor /= 10;
     }
   }
-  if (!erro)
+  saida.adiciona(estado_ADC);
+}
+
+// Comando G. captura disparada das leituras do ADC, sem alterar a cadencia da aquisição.
+// "G" ou "G?" devolve o estado, "Gcc,t,limiar,pre,pos" arma o gatilho no canal cc (t: S subida, D descida,
+// I inclinação entre leituras consecutivas, limiar negativo para inclinação de descida), "GL" envia a captura
+// congelada e "GX" cancela. devolve 0 ou 10 (nada congelado no GL, janela fora dos limites da Captura)
+int capturaADC(const PedidoCaptura &pedido)
+{
+  if (pedido.acao == 'X')
   {
-    strncpy(estado_DACs, mensagemTcpIn, BUFFERLEN);
-    // printChanges();
-    changeDacs();
+    captura.cancela();
+    return 0;
+  }
+  if (pedido.acao == 'L')
+  {
+    if (captura.estado() != CAPTURA_CONGELADA)
+    {
+      return 10;
+    }
+    enviaCaptura();
+    return 0;
+  }
+  TipoGatilho tipoGatilho = pedido.tipo == 'S'   ? GATILHO_SUBIDA
+                            : pedido.tipo == 'D' ? GATILHO_DESCIDA
+                                                 : GATILHO_INCLINACAO;
+  if (!captura.arma(pedido.canal, tipoGatilho, pedido.limiar, pedido.pre, pedido.pos))
+  {
+    return 10;
+  }
+  registraEvento(EVT_CAPTURA_ARMADA, pedido.canal);
+  return 0;
+}
+
+void estadoCaptura()
+{
+  const char *const nomesEstado[] = {"parada", "armada", "disparada", "congelada"};
+  const char letrasTipo[] = {'S', 'D', 'I'};
+  saida.adiciona("\nGestado=");
+  saida.adiciona(nomesEstado[captura.estado()]);
+  adicionaMetrica("canal", captura.canalGatilho());
+  saida.adiciona(",tipo=");
+  saida.adiciona(letrasTipo[captura.tipoGatilho()]);
+  saida.adiciona(",limiar=");
+  saida.adicionaInteiro(captura.limiar());
+  adicionaMetrica("pre", captura.pre());
+  adicionaMetrica("pos", captura.pos());
+  adicionaMetrica("quadros", captura.quadros());
+}
+
+// Comando A. "A" ou "A?" devolve o estado do fluxo, "Ammmm" liga o fluxo binario dos canais da mascara (hexadecimal,
+// bit 0 = canal 0) e "A0" desliga. a mascara vale a partir do proximo registro. formato em lib/RegistroADC
+void fluxoADC(uint64_t mascara)
+{
+  mascaraFluxo = mascara;
+  registraEvento(EVT_FLUXO, 0, mascara); // mascara dos 32 primeiros canais
+}
+
+void estadoFluxo()
+{
+  saida.adiciona("\nAmascara=");
+  saida.adicionaHexadecimal(mascaraFluxo);
+  adicionaMetrica("versao", REGISTRO_VERSAO);
+  adicionaMetrica("quadros", QUADROS_REGISTRO);
+  adicionaMetrica("registros", registrosProduzidos);
+  adicionaMetrica("descartados", registrosDescartados);
+}
+
+// chamada pela task de aquisição a cada quadro. o cabeçalho é escrito quando o registro fecha; se todas as areas estão
+// aguardando envio, os quadros do registro são descartados, mas a sequencia avança para o host ver a falha
+void montaRegistro(const uint16_t *quadro)
+{
+  static int quadros = 0;        // quadros no registro em montagem
+  static uint8_t *registro = NULL; // area do registro em montagem, NULL se descartando
+  static CabecalhoRegistro cabecalho;
+  static uint32_t sequenciaRegistro = 0;
+  static EmpacotadorADC empacotador;
+
+  if (quadros == 0)
+  {
+    cabecalho.mascara = mascaraFluxo;
+    if (cabecalho.mascara == 0)
+    {
+      return;
+    }
+    cabecalho.sequencia = sequenciaRegistro++;
+    cabecalho.instante = micros();
+    cabecalho.taxa = taxaAdc;
+    uint32_t produzidos = registrosProduzidos;
+    if (produzidos - __atomic_load_n(&registrosEnviados, __ATOMIC_ACQUIRE) < REGISTROS_ADC)
+    {
+      registro = areaRegistros[produzidos % REGISTROS_ADC];
+      empacotador.inicia(registro + REGISTRO_CABECALHO);
+    }
+    else
+    {
+      registro = NULL;
+      registrosDescartados++;
+    }
+  }
+  if (registro != NULL)
+  {
+    for (uint64_t m = cabecalho.mascara; m != 0; m &= m - 1)
+    {
+      empacotador.adiciona(quadro[__builtin_ctzll(m)]);
+    }
+  }
+  if (++quadros == QUADROS_REGISTRO)
+  {
+    quadros = 0;
+    if (registro != NULL)
+    {
+      cabecalho.quadros = QUADROS_REGISTRO;
+      escreveCabecalho(registro, cabecalho);
+      __atomic_add_fetch(&registrosProduzidos, 1, __ATOMIC_RELEASE);
+    }
+  }
+}
+
+// escreve os registros completos direto da area onde foram montados. as respostas pendentes saem antes, na ordem
+void enviaRegistros()
+{
+  while (registrosEnviados != __atomic_load_n(&registrosProduzidos, __ATOMIC_ACQUIRE))
+  {
+    const uint8_t *registro = areaRegistros[registrosEnviados % REGISTROS_ADC];
+    saida.descarrega();
+    cl.write(registro, registro[6] | registro[7] << 8);
+    __atomic_add_fetch(&registrosEnviados, 1, __ATOMIC_RELEASE);
+  }
+}
+
+// GL: uma linha de texto "GLquadros=n,canais=c,gatilho=pre" seguida de blocos binarios. cada bloco tem o cabeçalho
+// 'G', 'B', primeiro quadro (uint16) e numero de quadros (uint16), seguido das amostras (uint16, canal 0 primeiro).
+// inteiros little-endian. um bloco com zero quadros encerra. os blocos são escritos direto do anel da captura
+void enviaCaptura()
+{
+  size_t total = captura.pre() + captura.pos();
+  saida.adiciona("\nGLquadros=");
+  saida.adicionaDecimal(total);
+  adicionaMetrica("canais", CANAIS);
+  adicionaMetrica("gatilho", captura.pre());
+  saida.adiciona('\n');
+  size_t i = 0;
+  for (;;)
+  {
+    size_t n = captura.contiguos(i);
+    if (n > BLOCO_CAPTURA)
+    {
+      n = BLOCO_CAPTURA;
+    }
+    uint8_t cabecalho[6] = {'G', 'B', (uint8_t)i, (uint8_t)(i >> 8), (uint8_t)n, (uint8_t)(n >> 8)};
+    saida.adiciona((const char *)cabecalho, sizeof(cabecalho));
+    if (n == 0)
+    {
+      break;
+    }
+    saida.adiciona((const char *)captura.quadro(i), n * CANAIS * sizeof(uint16_t));
+    i += n;
   }
 }
 
-// devolve os valores da matriz de estado dos dacs via tcp
-void printChanges()
+// Comando L: dump binario do registro de eventos (formato em lib/RegistroEventos), precedido de uma quebra de linha.
+// os eventos gravados durante o envio entram se a sua posição ainda não tiver sido copiada; os sobrescritos vão
+// marcados como invalidos. decodificar com tools/decodifica_eventos
+void enviaEventos()
 {
-  for (int i = 1; i < 9; i++)
+  registraEvento(EVT_EVENTOS_LIDOS);
+  uint8_t cabecalho[EVENTOS_CABECALHO];
+  eventos.escreveCabecalho(cabecalho, ESP.getCpuFreqMHz());
+  saida.adiciona('\n');
+  saida.adiciona((const char *)cabecalho, sizeof(cabecalho));
+  for (uint8_t nucleo = 0; nucleo < EVENTOS_NUCLEOS; nucleo++)
   {
-    char itoabuff[] = "0000";
-    cl.print("\nCanal: ");
-    cl.print(itoa(estado_Update[0][i], itoabuff, 10));
-    cl.print("     estado: ");
-    cl.print(itoa(estado_Update[1][i], itoabuff, 10));
-    cl.print("     Valor: ");
-    cl.print(itoa(estado_Update[2][i], itoabuff, 10));
-    int valor = estado_Update[2][i];
-    Serial.println("canal: ");
-    Serial.println(i);
-    Serial.println("valor: ");
-    Serial.println(valor);
+    uint32_t primeira;
+    uint16_t quantidade = eventos.escreveCabecalhoNucleo(cabecalho, nucleo, &primeira);
+    saida.adiciona((const char *)cabecalho, EVENTOS_CABECALHO_NUCLEO);
+    for (uint16_t i = 0; i < quantidade; i++)
+    {
+      Evento evento;
+      if (!eventos.copia(nucleo, primeira + i, &evento))
+      {
+        evento.id = EVENTO_INVALIDO;
+        evento.sequencia = primeira + i;
+      }
+      saida.adiciona((const char *)&evento, sizeof(evento));
+    }
+  }
+}
+
+// "@ssssssss,tttttttttttttttt comando": o custo da verificação da tag fica em ciclos_tag (S), para comparar com o
+// ciclos_w
+ResultadoQuadro verificaQuadro(const char *quadro, const char **comando)
+{
+  uint32_t inicio = ESP.getCycleCount();
+  ResultadoQuadro resultado = sessao.verifica(quadro, comando);
+  ciclosTag = ESP.getCycleCount() - inicio;
+  return resultado;
+}
+
+// "Nnnnnnnnnnnnnnnnn": nonce do host em hexadecimal. o nonce do controlador vem do gerador de numeros aleatorios do
+// ESP32, e a sessão passa a aceitar os quadros a partir da sequencia 1. sem CHAVE_COMANDOS, recusa com 14
+int iniciaSessao(uint64_t nonceHost, uint64_t *nonceControlador)
+{
+  if (!COM_CHAVE)
+  {
+    return 14;
   }
+  *nonceControlador = ((uint64_t)esp_random() << 32) | esp_random();
+  sessao.inicia(nonceHost, *nonceControlador);
+  registraEvento(EVT_SESSAO);
+  return 0;
 }
 
-// gera a task que atualiza os dacs.
+// comandos com identificador são sempre rastreados; os demais, 1 a cada amostragem_rastro
+void iniciaRastro(bool comId, uint32_t id)
+{
+  rastroAtual = NULL;
+  if (!comId && (amostragemRastro == 0 || sequencia % amostragemRastro != 0))
+  {
+    return;
+  }
+  Rastro *rastro = &rastros[rastrosGravados % RASTROS];
+  if (rastroDacs == rastro)
+  {
+    rastroDacs = NULL; // passada antiga ainda em andamento não escreve no rastro reaproveitado
+  }
+  rastro->id = id;
+  rastro->sequencia = sequencia;
+  rastro->comando = mensagemTcpIn[0];
+  for (int etapa = 0; etapa < ETAPAS; etapa++)
+  {
+    rastro->instantes[etapa] = 0;
+  }
+  rastro->instantes[ETAPA_RECEBIDO] = instanteRecepcao;
+  rastro->instantes[ETAPA_INTERPRETACAO] = micros();
+  rastroAtual = rastro;
+}
+
+void marcaEtapa(Rastro *rastro, EtapaRastro etapa)
+{
+  if (rastro != NULL && rastro->instantes[etapa] == 0)
+  {
+    uint32_t agora = micros();
+    rastro->instantes[etapa] = agora != 0 ? agora : 1;
+  }
+}
+
+// Comando T: uma linha por comando rastreado desde o ultimo T, com a duração de cada etapa em us contada da etapa
+// anterior do pipeline (a resposta conta do inicio da interpretação, porque corre em paralelo com os DACs).
+// etapas não alcançadas (comando sem alteração nos DACs, passada em andamento) são omitidas. a primeira linha é
+// "Trastros=n,perdidos=m", com os rastros sobrescritos antes de serem lidos, e a ultima é "Tfim"
+void enviaRastros()
+{
+  static const char *const nomes[ETAPAS] = {"recebido", "interpretacao", "validacao", "notificacao",
+                                            "acordar", "escrita", "ldac", "resposta"};
+  static const int8_t anterior[ETAPAS] = {-1, ETAPA_RECEBIDO, ETAPA_INTERPRETACAO, ETAPA_VALIDADO,
+                                          ETAPA_NOTIFICADO, ETAPA_ACORDADO, ETAPA_ESCRITO, ETAPA_INTERPRETACAO};
+  uint32_t gravados = rastrosGravados;
+  uint32_t perdidos = gravados - rastrosLidos > RASTROS ? gravados - rastrosLidos - RASTROS : 0;
+  saida.adiciona("\nTrastros=");
+  saida.adicionaDecimal(gravados - rastrosLidos - perdidos);
+  adicionaMetrica("perdidos", perdidos);
+  for (uint32_t n = rastrosLidos + perdidos; n != gravados; n++)
+  {
+    const Rastro &rastro = rastros[n % RASTROS];
+    saida.adiciona("\nTid=");
+    saida.adicionaDecimal(rastro.id);
+    adicionaMetrica("seq", rastro.sequencia);
+    saida.adiciona(",cmd=");
+    saida.adiciona(rastro.comando);
+    for (int etapa = ETAPA_INTERPRETACAO; etapa < ETAPAS; etapa++)
+    {
+      uint32_t fim = rastro.instantes[etapa];
+      uint32_t inicio = rastro.instantes[anterior[etapa]];
+      if (fim != 0 && inicio != 0)
+      {
+        adicionaMetrica(nomes[etapa], fim - inicio);
+      }
+    }
+  }
+  saida.adiciona("\nTfim");
+  rastrosLidos = gravados;
+}
+
+// Metricas do S, na ordem da resposta: cada linha é METRICA(nome, valor). a lista dá também o tamanho da maior
+// resposta possivel (todos os valores com 10 digitos), que tem que caber no buffer de saida para o S sair num
+// unico write
+#define LISTA_METRICAS_S(METRICA)                                                                                     \
+  METRICA("wifi_quedas", metricasWiFi.quedas)                                                                         \
+  METRICA("wifi_tentativas", metricasWiFi.tentativas)                                                                 \
+  METRICA("wifi_reconexao_ms", metricasWiFi.ultimaReconexao)                                                          \
+  METRICA("wifi_reconexao_max_ms", metricasWiFi.maiorReconexao)                                                       \
+  METRICA("comandos", contadores.comandos.total())                                                                    \
+  METRICA("entrada_bytes", bytesRecebidos)                                                                            \
+  METRICA("ciclos_w", ciclosW)                                                                                        \
+  METRICA("ciclos_d", ciclosD)                                                                                        \
+  METRICA("ciclos_tag", ciclosTag)                                                                                    \
+  METRICA("ciclos_inclinacao", maiorCiclosInclinacao()) /* pior banco; cada um no /metrics */                        \
+  METRICA("canais_em_movimento", contaEmMovimento())                                                                  \
+  METRICA("sessao_autenticada", sessao.ativa())                                                                       \
+  METRICA("dac_latencia_us", metricasDacs.latencia)                                                                   \
+  METRICA("dac_latencia_max_us", metricasDacs.maiorLatencia)                                                          \
+  METRICA("dac_passada_us", metricasDacs.duracao)                                                                     \
+  METRICA("dac_passada_max_us", metricasDacs.maiorDuracao)                                                            \
+  METRICA("pilha_conexao_livre", uxTaskGetStackHighWaterMark(taskCheckConn))                                          \
+  METRICA("pilha_tcp_livre", uxTaskGetStackHighWaterMark(taskTcp))                                                    \
+  METRICA("pilha_dacs_livre", menorPilhaDacs())                                                                       \
+  METRICA("pilha_adc_livre", uxTaskGetStackHighWaterMark(taskAdc))                                                    \
+  METRICA("autoteste", estadoAutoteste)                                                                               \
+  METRICA("autoteste_falhas", falhasAutoteste)                                                                        \
+  METRICA("particao", esp_ota_get_running_partition()->subtype - ESP_PARTITION_SUBTYPE_APP_OTA_MIN)                   \
+  METRICA("boot_ms", bootMs)                                                                                          \
+  METRICA("ota_parada_ms", paradaOtaMs)                                                                               \
+  METRICA("saidas_restauradas", saidasRestauradas)                                                                    \
+  METRICA("heap_livre", ESP.getFreeHeap())                                                                            \
+  METRICA("heap_livre_min", ESP.getMinFreeHeap()) /* igual ao heap_livre se nada além do wifi aloca */                \
+  METRICA("heap_maior_bloco", ESP.getMaxAllocHeap())                                                                  \
+  METRICA("ram_fixa", Memoria::total()) /* buffers e pilhas de include/Memoria.h */                                   \
+  METRICA("adc_quadros", quadrosADC)                                                                                  \
+  METRICA("adc_registros", registrosProduzidos)                                                                       \
+  METRICA("sup_estado_seguro", estadoSeguro)                                                                          \
+  METRICA("sup_ciclos", metricasSupervisor.ciclos)                                                                    \
+  METRICA("sup_disparos", metricasSupervisor.disparos)                                                                \
+  METRICA("sup_latencia_us", metricasSupervisor.latencia)                                                             \
+  METRICA("sup_latencia_max_us", metricasSupervisor.maiorLatencia)                                                    \
+  METRICA("sup_travamentos", metricasSupervisor.travamentos)                                                          \
+  METRICA("sup_divergencias", metricasSupervisor.divergencias)                                                        \
+  METRICA("sup_canais_divergentes", canaisDivergentes != 0) /* lista por canal no comando F */                        \
+  METRICA("sup_duracao_us", metricasSupervisor.duracao)                                                               \
+  METRICA("sup_duracao_max_us", metricasSupervisor.maiorDuracao)                                                      \
+  METRICA("pilha_supervisor_livre", uxTaskGetStackHighWaterMark(taskSupervisor))                                      \
+  METRICA("adc_registros_descartados", registrosDescartados)                                                          \
+  METRICA("adc_taxa_mhz", relogioADC.getRate()) /* taxa obtida desde a ultima mudança de taxa_adc */                  \
+  METRICA("adc_jitter_us", relogioADC.getJitter())                                                                    \
+  METRICA("adc_jitter_medio_us", relogioADC.getMeanJitter())                                                          \
+  METRICA("adc_atrasos", relogioADC.getOverruns()) /* quadros perdidos por a task ainda estar ocupada */              \
+  METRICA("saida_escritas", saida.escritas()) /* chamadas de escrita (um cl.print cada, sem o buffer) */              \
+  METRICA("saida_envios", saida.envios()) /* writes efetivos no socket */                                             \
+  METRICA("saida_bytes", saida.bytesEnviados())
+
+#define TAM_METRICA_S(nome, valor) +sizeof(nome) + 11 // ',' ou '\n', nome, '=' (no lugar do '\0') e 10 digitos
+constexpr size_t TAM_STATUS = 0 LISTA_METRICAS_S(TAM_METRICA_S);
+#undef TAM_METRICA_S
+static_assert(TAM_STATUS <= TAM_SAIDA, "a maior resposta do S não cabe em TAM_SAIDA (include/Memoria.h)");
+
+// devolve as metricas do controlador no formato chave=valor separados por virgula
+void status()
+{
+  saida.adiciona('\n');
+#define ADICIONA_METRICA(nome, valor) adicionaMetrica(nome, valor);
+  LISTA_METRICAS_S(ADICIONA_METRICA)
+#undef ADICIONA_METRICA
+}
+
+// menor folga entre as pilhas dos workers dos DACs
+uint32_t menorPilhaDacs()
+{
+  uint32_t menor = uxTaskGetStackHighWaterMark(taskDacs[0]);
+  for (int banco = 1; banco < BANCOS; banco++)
+  {
+    uint32_t pilha = uxTaskGetStackHighWaterMark(taskDacs[banco]);
+    if (pilha < menor)
+    {
+      menor = pilha;
+    }
+  }
+  return menor;
+}
+
+// escreve "nome=valor" no buffer de saida, precedido de virgula se não for o primeiro da linha
+void adicionaMetrica(const char *nome, uint32_t valor)
+{
+  if (saida.tamanho() > 0 && areaSaida[saida.tamanho() - 1] != '\n')
+  {
+    saida.adiciona(',');
+  }
+  saida.adiciona(nome);
+  saida.adiciona('=');
+  saida.adicionaDecimal(valor);
+}
+
+// Endpoint /metrics. chamado pela task de conexão, no core de rede e na menor prioridade: a coleta só le contadores
+// e nunca bloqueia quem os escreve. atende um cliente por chamada, com o pedido e a resposta em memoria fixa
+void atendeMetricas()
+{
+  WiFiClient cliente = svMetricas.available();
+  if (!cliente)
+  {
+    return;
+  }
+  char *pedido = areaPedidoMetricas;
+  size_t len = 0;
+  PedidoHTTP tipo = HTTP_INCOMPLETO;
+  uint32_t inicio = millis();
+  while (tipo == HTTP_INCOMPLETO && cliente.connected() && millis() - inicio < TIMEOUT_METRICAS)
+  {
+    if (cliente.available() > 0 && len < TAM_PEDIDO_METRICAS)
+    {
+      int lidos = cliente.read((uint8_t *)pedido + len, TAM_PEDIDO_METRICAS - len);
+      len += lidos > 0 ? lidos : 0;
+      tipo = avaliaPedidoHTTP(pedido, len);
+    }
+    else if (len == TAM_PEDIDO_METRICAS)
+    {
+      tipo = HTTP_INVALIDO; // pedido maior que o buffer
+    }
+    else
+    {
+      vTaskDelay(1);
+    }
+  }
+  if (tipo != HTTP_INCOMPLETO)
+  {
+    BufferSaida resposta(areaSaidaMetricas, TAM_SAIDA_METRICAS, enviaCliente, &cliente);
+    respondeHTTP(resposta, tipo);
+    if (tipo == HTTP_METRICAS)
+    {
+      ExpositorMetricas expositor(resposta);
+      escreveMetricas(expositor);
+    }
+    resposta.descarrega();
+  }
+  cliente.stop();
+}
+
+void escreveMetricas(ExpositorMetricas &expositor)
+{
+  escreveContadoresFID(expositor, contadores);
+
+  expositor.contador("fid_adc_quadros_total", "Leituras completas do ADC.", quadrosADC);
+  expositor.contador("fid_adc_atrasos_total", "Quadros do ADC perdidos com a task ocupada.", relogioADC.getOverruns());
+  expositor.contador("fid_adc_registros_descartados_total", "Registros do fluxo A perdidos.", registrosDescartados);
+  expositor.medidor("fid_adc_jitter_us", "Pior atraso do quadro do ADC.", relogioADC.getJitter());
+  expositor.medidor("fid_dac_bancos_ocupados", "Bancos de DACs com passada em andamento.", coordenacaoDacs.ocupados());
+  expositor.medidor("fid_dac_canais_em_movimento", "Canais a caminho do alvo pelo limite de inclinacao.",
+                    contaEmMovimento());
+  expositor.familia("fid_dac_ciclos_inclinacao", "gauge", "Ciclos de CPU do ultimo passo de inclinacao de cada banco.");
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    expositor.amostra("fid_dac_ciclos_inclinacao", "banco", banco, ciclosInclinacao[banco]);
+  }
+  expositor.medidor("fid_adc_registros_pendentes", "Registros do fluxo A aguardando o socket.",
+                    registrosProduzidos - registrosEnviados);
+
+  expositor.contador("fid_wifi_quedas_total", "Quedas da conexao wifi.", metricasWiFi.quedas);
+  expositor.contador("fid_wifi_tentativas_total", "Tentativas de conexao wifi.", metricasWiFi.tentativas);
+  expositor.medidor("fid_wifi_rssi_dbm", "Intensidade do sinal wifi.", WiFi.RSSI());
+  expositor.medidor("fid_wifi_reconexao_max_ms", "Pior tempo de reconexao.", metricasWiFi.maiorReconexao);
+
+  expositor.medidor("fid_heap_livre_bytes", "Heap livre.", ESP.getFreeHeap());
+  expositor.medidor("fid_heap_livre_min_bytes", "Menor heap livre desde o boot.", ESP.getMinFreeHeap());
+  expositor.medidor("fid_heap_maior_bloco_bytes", "Maior bloco livre do heap (fragmentacao).", ESP.getMaxAllocHeap());
+  expositor.familia("fid_ram_fixa_bytes", "gauge", "Buffers e pilhas de tamanho fixo por subsistema.");
+  for (const UsoMemoria &uso : Memoria::subsistemas)
+  {
+    expositor.amostra("fid_ram_fixa_bytes", "subsistema", uso.subsistema, uso.bytes);
+  }
+  expositor.familia("fid_pilha_livre_bytes", "gauge", "Minimo livre ja observado na pilha de cada task.");
+  expositor.amostra("fid_pilha_livre_bytes", "task", "conexao", uxTaskGetStackHighWaterMark(taskCheckConn));
+  expositor.amostra("fid_pilha_livre_bytes", "task", "tcp", uxTaskGetStackHighWaterMark(taskTcp));
+  expositor.amostra("fid_pilha_livre_bytes", "task", "adc", uxTaskGetStackHighWaterMark(taskAdc));
+  expositor.amostra("fid_pilha_livre_bytes", "task", "supervisor", uxTaskGetStackHighWaterMark(taskSupervisor));
+  expositor.familia("fid_pilha_dacs_livre_bytes", "gauge", "Minimo livre ja observado na pilha do worker de cada banco.");
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    expositor.amostra("fid_pilha_dacs_livre_bytes", "banco", banco, uxTaskGetStackHighWaterMark(taskDacs[banco]));
+  }
+
+  expositor.medidor("fid_estado_seguro", "Saidas no estado seguro por falta de heartbeat.", estadoSeguro);
+  expositor.contador("fid_supervisor_disparos_total", "Entradas no estado seguro.", metricasSupervisor.disparos);
+  expositor.contador("fid_supervisor_travamentos_total", "Passadas dos DACs travadas.", metricasSupervisor.travamentos);
+  expositor.contador("fid_supervisor_divergencias_total", "Canais com leitura do ADC fora da tolerancia.",
+                     metricasSupervisor.divergencias);
+}
+
+void aplicaLDAC()
+{
+  if (use_LDAC)
+  {
+    digitalWrite(LDAC, HIGH);
+  }
+  else
+  {
+    digitalWrite(LDAC, LOW);
+  }
+}
+
+void aplicaPrioridades()
+{
+  vTaskPrioritySet(taskTcp, prioridadeTcp);
+  vTaskPrioritySet(taskCheckConn, prioridadeConexao);
+  vTaskPrioritySet(taskAdc, prioridadeAdc);
+  vTaskPrioritySet(taskSupervisor, prioridadeSupervisor);
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    vTaskPrioritySet(taskDacs[banco], prioridadeDacs);
+  }
+}
+
+// uma task fixada não pode mudar de core, então o worker é acordado e se recria no core novo
+void aplicaCoreDacs()
+{
+  changeDacs();
+}
+
+// as estatisticas de taxa e jitter recomeçam com a nova taxa
+void aplicaTaxaAdc()
+{
+  relogioADC.setFrequency(taxaAdc);
+}
+
+// modo atual das respostas, para as funções de lib/Protocolo
+FormatoResposta formatoResposta()
+{
+  return {modoResposta, modoEco, respostaComTempo != 0, sequencia, instanteAplicado};
+}
+
+ParametrosProtocolo parametrosProtocolo()
+{
+  return {CANAIS, (uint32_t)captura.quadros(), COM_CHAVE};
+}
+
+// Comando P. "P" ou "P?" lista a configuração dos canais, "Pcc=g,b,a" altera a do canal cc: ganho (1 ou 2),
+// buffer da referencia (0 ou 1) e saida ativa (0 ou 1; 0 desliga a saida, que fica em alta impedancia).
+// o canal é reescrito com o valor atual, então a configuração vale imediatamente
+void configuraCanal(const ConfiguracaoCanal &configuracao)
+{
+  int canal = configuracao.canal;
+  estado_Canais[canal].ganho = configuracao.ganho;
+  estado_Canais[canal].buffer = configuracao.buffer;
+  estado_Canais[canal].ativo = configuracao.ativo;
+  marcaCanal(canal);
+  instanteAplicado = micros();
+  changeDacs();
+}
+
+// Comando F. "F" ou "F?" lista o estado seguro de cada canal, "Fcc=M" mantem o valor, "Fcc=Z" zera e "Fcc=R,rrrr"
+// desce em rampa de rrrr codigos por segundo quando o host passa heartbeat ms sem comandos. a listagem marca com
+// ",divergente" os canais cuja leitura do ADC não acompanha a saida
+void configuraSeguranca(const SegurancaCanal &seguranca)
+{
+  EstadoCanal &estado = estado_Canais[seguranca.canal];
+  estado.modoSeguro = seguranca.modo == 'M' ? SEGURO_MANTER : seguranca.modo == 'Z' ? SEGURO_ZERAR : SEGURO_RAMPA;
+  estado.rampa = seguranca.rampa; // M e Z chegam com a rampa anterior
+  persisteSeguranca(seguranca.canal);
+}
+
+// Comando I. "I" ou "I?" lista o limite de inclinação de cada canal, "Icc=llll" limita o canal cc a llll codigos por
+// ms (0 tira o limite). um W ou D depois disso só muda o alvo, e o worker do banco leva a saida até ele. um
+// movimento em andamento segue com o novo limite a partir do proximo passo. o estado seguro também respeita o limite
+void configuraInclinacao(const InclinacaoCanal &inclinacao)
+{
+  estado_Canais[inclinacao.canal].inclinacao = inclinacao.limite;
+  persisteSeguranca(inclinacao.canal);
+}
+
+uint32_t contaEmMovimento()
+{
+  uint32_t canais = 0;
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    canais += __builtin_popcount(canaisEmMovimento[banco]);
+  }
+  return canais;
+}
+
+// ciclos do ultimo passo de inclinação do banco mais lento
+uint32_t maiorCiclosInclinacao()
+{
+  uint32_t maior = ciclosInclinacao[0];
+  for (int banco = 1; banco < BANCOS; banco++)
+  {
+    if (ciclosInclinacao[banco] > maior)
+    {
+      maior = ciclosInclinacao[banco];
+    }
+  }
+  return maior;
+}
+
+// distribui os valores de um W já validado (lib/Protocolo) no estado_Canais para que posteriormente os dacs sejam
+// ajustados. só os canais que mudaram são marcados
+void stageChanges(const uint16_t *valores)
+{
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    if (estado_Canais[canal].valor != valores[canal])
+    {
+      estado_Canais[canal].valor = valores[canal];
+      marcaCanal(canal);
+      registraEvento(EVT_CANAL, canal, valores[canal]);
+    }
+  }
+  strncpy(estado_DACs, mensagemTcpIn, BUFFERLEN);
+  instanteAplicado = micros();
+  changeDacs();
+}
+
+// Comando D: "Dcc=vvvv[,cc=vvvv...]", canal em decimal a partir de 0 (A = 0) e valor de 0 a 4095, já validado
+// inteiro (lib/Protocolo). o tamanho da mensagem cresce com o numero de canais alterados, não com o total de canais
+void stageDelta(const AlteracaoCanal *alteracoes, int n)
+{
+  for (int i = 0; i < n; i++)
+  {
+    int canal = alteracoes[i].canal;
+    int valor = alteracoes[i].valor;
+    if (estado_Canais[canal].valor != valor)
+    {
+      estado_Canais[canal].valor = valor;
+      marcaCanal(canal);
+      registraEvento(EVT_CANAL, canal, valor);
+    }
+    escreveEstadoDAC(canal, valor);
+  }
+  instanteAplicado = micros();
+  changeDacs();
+}
+
+// mantem o estado_DACs coerente para a comparação de um W posterior
+void escreveEstadoDAC(int canal, int valor)
+{
+  char *campo = estado_DACs + 5 * canal + 2;
+  for (int digito = 3; digito >= 0; digito--)
+  {
+    campo[digito] = '0' + valor % 10;
+    valor /= 10;
+  }
+}
+
+// custo de algumas dezenas de ciclos: pode ser chamada de qualquer task, em qualquer core, sem lock
+void registraEvento(IdEvento id, uint16_t a, uint32_t b)
+{
+  eventos.registra(xPortGetCoreID(), ESP.getCycleCount(), id, a, b);
+}
+
+// os eventos levam o contador de ciclos do core, que não é sincronizado entre os cores e dá a volta em ~18 s.
+// um EVT_RELOGIO por segundo em cada core ancora os ciclos ao micros() comum
+void registraRelogio(uint32_t *ultimo)
+{
+  uint32_t agora = millis();
+  if (agora - *ultimo >= PERIODO_RELOGIO)
+  {
+    *ultimo = agora;
+    registraEvento(EVT_RELOGIO, 0, micros());
+  }
+}
+
+// entrega o buffer de saida ao cliente TCP
+size_t enviaCliente(void *contexto, const uint8_t *dados, size_t len)
+{
+  return ((WiFiClient *)contexto)->write(dados, len);
+}
+
+void marcaCanal(int canal)
+{
+  int banco = Mapa::banco(canal);
+  __atomic_fetch_or(&canaisPendentes[banco], 1u << (canal - Mapa::primeiroCanal(banco)), __ATOMIC_SEQ_CST);
+}
+
+// acorda os workers dos bancos com canais pendentes. não bloqueia: os workers rodam no outro core com prioridade maior.
+// mudança de core_dacs chama sem canais pendentes, então nesse caso acorda todos
 void changeDacs()
 {
-  xTaskCreatePinnedToCore(taskUpdateDacs, "taskDacs", 1000, NULL, 1, &taskDacs, coreTask);
+  bool acordar[BANCOS];
+  int quantidade = 0;
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    acordar[banco] = canaisPendentes[banco] != 0;
+    quantidade += acordar[banco];
+  }
+  if (quantidade == 0)
+  {
+    for (int banco = 0; banco < BANCOS; banco++)
+    {
+      acordar[banco] = true;
+    }
+    quantidade = BANCOS;
+  }
+  instanteNotificacao = micros();
+  // só a task TCP tem rastroAtual; o supervisor chamando daqui desliga o rastro da passada (e não o corrompe)
+  rastroDacs = xTaskGetCurrentTaskHandle() == taskTcp ? rastroAtual : NULL;
+  marcaEtapa(rastroDacs, ETAPA_NOTIFICADO);
+  registraEvento(EVT_DACS_NOTIFICADOS, quantidade);
+  if (use_LDAC)
+  {
+    digitalWrite(LDAC, HIGH); // segura as saidas até o ultimo banco terminar
+  }
+  // conta todos antes de acordar o primeiro, para que nenhum banco baixe o LDAC antes dos outros começarem
+  coordenacaoDacs.iniciaNotificacao(quantidade);
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    if (acordar[banco])
+    {
+      xTaskNotifyGive(taskDacs[banco]);
+    }
+  }
+  coordenacaoDacs.terminaNotificacao();
+}
+
+// alterna entre as duas pilhas do banco: na troca de core o worker antigo ainda roda na sua enquanto cria o novo,
+// e só se apaga depois. a troca seguinte exige outro comando C, muito depois de o idle ter liberado o TCB antigo
+void launchTaskDacs(int banco)
+{
+  uint8_t vez = pilhaDacsLivre[banco];
+  pilhaDacsLivre[banco] = vez ^ 1;
+  taskDacs[banco] = xTaskCreateStaticPinnedToCore(taskUpdateDacs, "taskDacs", PILHA_DACS, (void *)(intptr_t)banco,
+                                                  prioridadeDacs, pilhasDacs[banco][vez], &tcbsDacs[banco][vez], coreTask);
+}
+
+void launchTasksDacs()
+{
+  instanteNotificacao = micros();
+  for (int banco = 0; banco < BANCOS; banco++)
+  {
+    launchTaskDacs(banco);
+  }
+}
+
+// escreve os n canais do lote no barramento do banco. o barramento fica reservado durante todo o lote,
+// e cada chip é selecionado só durante a sua palavra de 16 bits
+void dacUpdate(int banco, const MCP492XWrite *lote, int n)
+{
+  MCP492X &dac = Placa::bancos[banco].barramento == Barramento::Hspi ? myDacHSPI : myDac;
+  dac.writeMany(lote, n, selecionaChipLote, (void *)(intptr_t)banco);
+}
+
+void selecionaChipLote(void *banco, uint8_t chip, bool ativo)
+{
+  selecionaChip((int)(intptr_t)banco, chip, ativo);
 }
 
-// função que recebe o canal e valor para atualizar um dac individual.
-void dacUpdate(int canal, int valor)
+// CS direto: o pino do chip. CS por 74HC595: desloca as 16 linhas (chip ativo em 0, demais em 1) e aplica no latch.
+// MSB primeiro, então a saida 0 do primeiro 595 recebe o ultimo bit
+void selecionaChip(int banco, int chip, bool ativo)
 {
-  digitalWrite(CS_SPI[canal], LOW);
-  delay(10);
-  myDac.analogWrite(valor);
-  digitalWrite(CS_SPI[canal], HIGH);
-  delay(10);
-}
\ No newline at end of file
+  if (Mapa::csDireto(banco))
+  {
+    digitalWrite(Placa::pinosCS[chip], ativo ? LOW : HIGH);
+    return;
+  }
+  const BancoDAC &b = Placa::bancos[banco];
+  uint16_t linhas = ativo ? ~(1u << Placa::pinosCS[chip]) : 0xFFFF;
+  for (int bit = 15; bit >= 0; bit--)
+  {
+    digitalWrite(b.pinoDadosCS, (linhas >> bit) & 1);
+    digitalWrite(b.pinoClockCS, HIGH);
+    digitalWrite(b.pinoClockCS, LOW);
+  }
+  digitalWrite(b.pinoLatchCS, HIGH);
+  digitalWrite(b.pinoLatchCS, LOW);
+}
@@ -0,0 +1,168 @@
+/*
+ * Cliente autenticado do controlador_FID, para rodar no host (Linux)
+ *
+ * Abre a sessão com o comando N (lib/Autenticacao), le comandos da entrada padrão, um por linha, envia cada um com
+ * o prefixo "@seq,tag " e escreve as respostas. serve de exemplo para os clientes de produção e para conferir a
+ * chave gravada no controlador. com -b, mede o custo de assinar e verificar quadros W de 8 e 32 canais no host
+ * (no ESP32, o mesmo custo aparece em ciclos_tag no S, ao lado do ciclos_w).
+ *
+ * uso:
+ *   autentica_fid [-k chave] host porta < comandos.txt   (chave em 32 digitos hexadecimais, ou em FID_CHAVE)
+ *   autentica_fid -b
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Autenticacao -Itools/cliente tools/autentica_fid.cpp tools/cliente/SessaoHost.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o autentica_fid
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include "SessaoHost.h"
+
+#define ESPERA_RESPOSTA 300 // ms sem dados para considerar a resposta completa
+
+static double agora()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int conecta(const char *host, const char *porta)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    freeaddrinfo(enderecos);
+    return -1;
+  }
+  freeaddrinfo(enderecos);
+  int um = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um));
+  return fd;
+}
+
+// tudo o que chegar até ESPERA_RESPOSTA ms de silencio
+static std::string recebe(int fd)
+{
+  std::string resposta;
+  pollfd p = {fd, POLLIN, 0};
+  char bloco[1024];
+  while (poll(&p, 1, ESPERA_RESPOSTA) > 0)
+  {
+    ssize_t lidos = read(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      break;
+    }
+    resposta.append(bloco, lidos);
+  }
+  return resposta;
+}
+
+static void mede(int canais)
+{
+  uint8_t chave[TAM_CHAVE] = {};
+  SessaoAutenticada host, controlador;
+  host.defineChave(chave);
+  controlador.defineChave(chave);
+  host.inicia(1, 2);
+  controlador.inicia(1, 2);
+
+  std::string comando = "W";
+  for (int canal = 0; canal < canais; canal++)
+  {
+    comando += (char)('A' + canal);
+    comando += "2048";
+  }
+  comando += '\r';
+  const int quadros = 200000;
+  std::string quadro(TAM_PREFIXO_QUADRO, ' ');
+  quadro += comando;
+
+  double inicio = agora();
+  int aceitos = 0;
+  for (int i = 0; i < quadros; i++)
+  {
+    host.assina(comando.data(), comando.size() - 1, &quadro[0]);
+    const char *texto;
+    aceitos += controlador.verifica(quadro.c_str(), &texto) == QUADRO_OK;
+  }
+  double ns = (agora() - inicio) * 1e9 / quadros / 2; // assinar e verificar custam o mesmo
+  printf("W de %2d canais (%3zu bytes): %.0f ns por verificação, %d/%d aceitos\n", canais, comando.size(), ns,
+         aceitos, quadros);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc == 2 && strcmp(argv[1], "-b") == 0)
+  {
+    mede(8);
+    mede(32);
+    return 0;
+  }
+  const char *textoChave = NULL;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "-k") == 0)
+  {
+    textoChave = argv[2];
+    arg = 3;
+  }
+  uint8_t chave[TAM_CHAVE];
+  if (argc - arg != 2 || leChaveHost(textoChave, chave) <= 0)
+  {
+    fprintf(stderr, "uso: %s [-k chave] host porta < comandos   (chave em 32 digitos hex, ou em FID_CHAVE)\n"
+                    "       %s -b\n",
+            argv[0], argv[0]);
+    return 1;
+  }
+  int fd = conecta(argv[arg], argv[arg + 1]);
+  if (fd < 0)
+  {
+    perror("conexão");
+    return 1;
+  }
+
+  SessaoAutenticada sessao;
+  std::string resposta;
+  if (!abreSessao(fd, chave, sessao, &resposta))
+  {
+    fprintf(stderr, "sessão recusada:%s\n", resposta.c_str());
+    return 1;
+  }
+
+  char linha[1024];
+  while (fgets(linha, sizeof(linha), stdin) != NULL)
+  {
+    size_t len = strcspn(linha, "\r\n");
+    if (len == 0)
+    {
+      continue;
+    }
+    if (!enviaComando(fd, sessao, linha, len))
+    {
+      perror("envio");
+      return 1;
+    }
+    printf("%.*s ->%s\n", (int)len, linha, recebe(fd).c_str());
+  }
+  close(fd);
+  return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * Conferencia de lib/Captura no host (Linux)
+ *
+ * Alimenta uma Captura de 2 canais e 8 quadros como a aquisição faria: o canal 0 leva o numero do quadro e o
+ * canal 1 o sinal do gatilho. confere os gatilhos de subida, descida e inclinação (limiar positivo e negativo),
+ * que o gatilho espera pre quadros depois do armar, a janela com pre + pos == quadros depois de o anel dar a
+ * volta (ordem de quadro(), soma de contiguos() e o anel parado depois de congelar), os limites de arma(),
+ * cancela() e o rearmar, e por fim uma task pedindo arma/cancela sem parar enquanto outra chama adiciona(): cada
+ * pedido aplicado tem que chegar inteiro e o ultimo (um cancela) não pode se perder.
+ *
+ * uso:
+ *   captura_fid
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -pthread -Ilib/Captura tools/captura_fid.cpp lib/Captura/Captura.cpp -o captura_fid
+ */
+
+#include <stdio.h>
+#include <atomic>
+#include <thread>
+#include "Captura.h"
+
+#define CANAIS 2
+#define QUADROS 8
+
+static uint16_t area[CANAIS * QUADROS];
+static uint16_t numero; // numero do proximo quadro, no canal 0
+
+static void alimenta(Captura &captura, uint16_t sinal)
+{
+  uint16_t quadro[CANAIS] = {numero++, sinal};
+  captura.adiciona(quadro);
+}
+
+static bool falha(const char *teste)
+{
+  printf("%s\n  FALHA\n", teste);
+  return false;
+}
+
+// a janela congelada tem que começar pre quadros antes do gatilho, em ordem, e contiguos() tem que cobri-la
+static bool confereJanela(const Captura &captura, uint16_t gatilho)
+{
+  size_t total = captura.pre() + captura.pos();
+  for (size_t i = 0; i < total; i++)
+  {
+    const uint16_t *quadro = captura.quadro(i);
+    if (quadro == NULL || quadro[0] != (uint16_t)(gatilho - captura.pre() + i))
+    {
+      return false;
+    }
+  }
+  if (captura.quadro(total) != NULL || captura.contiguos(total) != 0)
+  {
+    return false;
+  }
+  size_t i = 0;
+  int blocos = 0;
+  while (i < total)
+  {
+    size_t n = captura.contiguos(i);
+    if (n == 0 || captura.quadro(i) + (n - 1) * CANAIS != captura.quadro(i + n - 1))
+    {
+      return false;
+    }
+    i += n;
+    blocos++;
+  }
+  return blocos <= 2;
+}
+
+// arma, manda os sinais e devolve o numero do quadro que disparou, ou -1 se não congelou no fim deles
+static int dispara(Captura &captura, TipoGatilho tipo, int32_t limiar, size_t pre, size_t pos, const uint16_t *sinais,
+                   int n)
+{
+  if (!captura.arma(1, tipo, limiar, pre, pos))
+  {
+    return -1;
+  }
+  int gatilho = -1;
+  for (int i = 0; i < n; i++)
+  {
+    alimenta(captura, sinais[i]);
+    EstadoCaptura estado = captura.estado();
+    if (gatilho < 0 && (estado == CAPTURA_DISPARADA || estado == CAPTURA_CONGELADA))
+    {
+      gatilho = numero - 1;
+    }
+  }
+  return captura.estado() == CAPTURA_CONGELADA ? gatilho : -1;
+}
+
+static bool confereGatilhos()
+{
+  Captura captura(area, sizeof(area) / sizeof(area[0]), CANAIS);
+  for (int i = 0; i < 11; i++) // o anel da a volta antes do armar
+  {
+    alimenta(captura, 0);
+  }
+
+  // subida: 0 0 0 0 99 100 ... dispara no 100, janela com 3 antes e 5 a partir dele
+  uint16_t subida[] = {0, 0, 0, 0, 99, 100, 100, 100, 100, 100, 0, 0};
+  uint16_t base = numero;
+  int gatilho = dispara(captura, GATILHO_SUBIDA, 100, 3, 5, subida, 12);
+  if (gatilho != base + 5 || !confereJanela(captura, gatilho))
+  {
+    return falha("gatilho de subida");
+  }
+  // congelada, o anel não muda
+  alimenta(captura, 500);
+  if (!confereJanela(captura, gatilho))
+  {
+    return falha("anel congelado");
+  }
+
+  uint16_t descida[] = {200, 200, 101, 100, 0, 0, 0, 0, 0, 0, 0};
+  base = numero;
+  gatilho = dispara(captura, GATILHO_DESCIDA, 100, 2, 6, descida, 11);
+  if (gatilho != base + 3 || !confereJanela(captura, gatilho))
+  {
+    return falha("gatilho de descida");
+  }
+
+  uint16_t sobe[] = {0, 10, 20, 69, 119, 0, 0, 0, 0, 0, 0};
+  base = numero;
+  gatilho = dispara(captura, GATILHO_INCLINACAO, 50, 1, 7, sobe, 11);
+  if (gatilho != base + 4 || !confereJanela(captura, gatilho))
+  {
+    return falha("gatilho de inclinação positiva");
+  }
+
+  uint16_t desce[] = {500, 490, 441, 391, 0, 0, 0, 0, 0, 0, 0};
+  base = numero;
+  gatilho = dispara(captura, GATILHO_INCLINACAO, -50, 0, 8, desce, 11);
+  if (gatilho != base + 3 || !confereJanela(captura, gatilho))
+  {
+    return falha("gatilho de inclinação negativa");
+  }
+
+  // a subida no segundo quadro depois do armar não conta: pre = 4 quadros ainda não gravados
+  uint16_t cedo[] = {0, 200, 200, 200, 200, 200, 200, 200, 200};
+  if (dispara(captura, GATILHO_SUBIDA, 100, 4, 4, cedo, 9) != -1 || captura.estado() != CAPTURA_ARMADA)
+  {
+    return falha("gatilho antes de pre quadros");
+  }
+  return true;
+}
+
+static bool confereCancela()
+{
+  Captura captura(area, sizeof(area) / sizeof(area[0]), CANAIS);
+  if (captura.arma(CANAIS, GATILHO_SUBIDA, 1, 0, 1) || captura.arma(1, GATILHO_SUBIDA, 1, 0, 0) ||
+      captura.arma(1, GATILHO_SUBIDA, 1, 1, QUADROS) || !captura.arma(1, GATILHO_SUBIDA, 1, 0, QUADROS))
+  {
+    return falha("limites do armar");
+  }
+
+  // armar e cancelar antes do proximo quadro: vale o cancela
+  captura.cancela();
+  if (captura.estado() != CAPTURA_PARADA)
+  {
+    return falha("cancela pendente");
+  }
+  alimenta(captura, 0);
+  alimenta(captura, 200);
+  if (captura.estado() != CAPTURA_PARADA)
+  {
+    return falha("cancela depois de arma");
+  }
+
+  // cancelar e armar antes do proximo quadro: vale o arma
+  captura.cancela();
+  captura.arma(1, GATILHO_SUBIDA, 100, 0, 2);
+  if (captura.estado() != CAPTURA_ARMADA)
+  {
+    return falha("arma pendente");
+  }
+  alimenta(captura, 0);
+  alimenta(captura, 200);
+  alimenta(captura, 200);
+  if (captura.estado() != CAPTURA_CONGELADA)
+  {
+    return falha("arma depois de cancela");
+  }
+
+  // cancelar a congelada descarta a janela; rearmar com outros parametros dispara de novo
+  captura.cancela();
+  if (captura.quadro(0) != NULL || captura.contiguos(0) != 0)
+  {
+    return falha("janela depois de cancela");
+  }
+  uint16_t descida[] = {0, 0, 300, 300, 300, 50, 0, 0, 0, 0};
+  uint16_t base = numero;
+  int gatilho = dispara(captura, GATILHO_DESCIDA, 100, 5, 3, descida, 10);
+  if (gatilho != base + 5 || captura.tipoGatilho() != GATILHO_DESCIDA || !confereJanela(captura, gatilho))
+  {
+    return falha("rearmar");
+  }
+  return true;
+}
+
+// limiar, pre e pos de cada armar andam juntos; um pedido aplicado pela metade os desencontra
+static bool confereConcorrencia()
+{
+  Captura captura(area, sizeof(area) / sizeof(area[0]), CANAIS);
+  const int pedidos = 2000000;
+  std::atomic<bool> fim(false);
+  std::thread pedindo([&] {
+    for (int i = 0; i < pedidos; i++)
+    {
+      size_t pre = i % QUADROS;
+      if (i % 3 == 2)
+      {
+        captura.cancela();
+      }
+      else
+      {
+        captura.arma(1, GATILHO_INCLINACAO, 1000 + (int32_t)pre, pre, QUADROS - pre);
+      }
+    }
+    captura.cancela();
+    fim.store(true);
+  });
+
+  bool inteiro = true;
+  long quadros = 0;
+  while (!fim.load())
+  {
+    alimenta(captura, 0);
+    quadros++;
+    // limiar 0: nenhum armar aplicado ainda
+    if (captura.limiar() != 0 &&
+        (captura.pre() + captura.pos() != QUADROS || captura.limiar() != 1000 + (int32_t)captura.pre()))
+    {
+      inteiro = false;
+    }
+  }
+  pedindo.join();
+  alimenta(captura, 0);
+  if (!inteiro)
+  {
+    return falha("pedido aplicado pela metade");
+  }
+  if (captura.estado() != CAPTURA_PARADA)
+  {
+    return falha("ultimo cancela perdido");
+  }
+  printf("%d pedidos concorrentes em %ld quadros\n", pedidos, quadros);
+  return true;
+}
+
+int main()
+{
+  bool ok = confereGatilhos() && confereCancela() && confereConcorrencia();
+  if (ok)
+  {
+    printf("OK\n");
+  }
+  return ok ? 0 : 1;
+}
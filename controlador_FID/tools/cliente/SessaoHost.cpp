@@ -0,0 +1,119 @@
+/*
+ * Sessão autenticada do lado do host, compartilhada pelas ferramentas que falam com o controlador_FID
+ */
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "SessaoHost.h"
+
+int leChaveHost(const char *texto, uint8_t *chave)
+{
+  if (texto == NULL)
+  {
+    texto = getenv("FID_CHAVE");
+    if (texto == NULL)
+    {
+      return 0;
+    }
+  }
+  return strlen(texto) == 2 * TAM_CHAVE && leChave(texto, chave) ? 1 : -1;
+}
+
+static bool escreveTudo(int fd, const char *dados, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, dados, len);
+    if (n <= 0)
+    {
+      return false;
+    }
+    dados += n;
+    len -= n;
+  }
+  return true;
+}
+
+static int64_t agoraMs()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+bool abreSessao(int fd, const uint8_t *chave, SessaoAutenticada &sessao, std::string *resposta)
+{
+  resposta->clear();
+  uint64_t nonceHost = 0;
+  FILE *aleatorio = fopen("/dev/urandom", "rb");
+  bool sorteado = aleatorio != NULL && fread(&nonceHost, sizeof(nonceHost), 1, aleatorio) == 1;
+  if (aleatorio != NULL)
+  {
+    fclose(aleatorio);
+  }
+  if (!sorteado)
+  {
+    return false;
+  }
+  char pedido[2 + DIGITOS_NONCE] = "N";
+  escreveHex(nonceHost, DIGITOS_NONCE, pedido + 1);
+  pedido[1 + DIGITOS_NONCE] = '\r';
+  if (!escreveTudo(fd, pedido, sizeof(pedido)))
+  {
+    return false;
+  }
+
+  // "\nN" e o nonce; o resto da conexão fica para quem chamou
+  int64_t limite = agoraMs() + ESPERA_SESSAO;
+  while (resposta->size() < 2 + DIGITOS_NONCE)
+  {
+    int64_t espera = limite - agoraMs();
+    pollfd p = {fd, POLLIN, 0};
+    if (espera <= 0 || poll(&p, 1, (int)espera) <= 0)
+    {
+      return false;
+    }
+    char c;
+    if (read(fd, &c, 1) != 1)
+    {
+      return false;
+    }
+    *resposta += c;
+  }
+  uint64_t nonceControlador;
+  if (resposta->compare(0, 2, "\nN") != 0 || !leHex(resposta->c_str() + 2, DIGITOS_NONCE, &nonceControlador))
+  {
+    return false;
+  }
+  sessao.defineChave(chave);
+  sessao.inicia(nonceHost, nonceControlador);
+  return true;
+}
+
+std::string assina(SessaoAutenticada &sessao, const char *comando, size_t len)
+{
+  std::string quadro(TAM_PREFIXO_QUADRO, ' ');
+  sessao.assina(comando, len, &quadro[0]);
+  quadro.append(comando, len);
+  quadro += '\r';
+  return quadro;
+}
+
+bool enviaComando(int fd, SessaoAutenticada &sessao, const char *comando, size_t len)
+{
+  std::string quadro;
+  if (sessao.ativa())
+  {
+    quadro = assina(sessao, comando, len);
+  }
+  else
+  {
+    quadro.assign(comando, len);
+    quadro += '\r';
+  }
+  return escreveTudo(fd, quadro.data(), quadro.size());
+}
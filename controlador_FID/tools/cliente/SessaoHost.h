@@ -0,0 +1,34 @@
+/*
+ * Sessão autenticada do lado do host, compartilhada pelas ferramentas que falam com o controlador_FID (Linux)
+ *
+ * Com CHAVE_COMANDOS o controlador liga a autenticação no boot e recusa com E14 qualquer comando sem o quadro
+ * "@seq,tag " (exceto o N). aqui fica o que cada ferramenta precisa para passar por isso: a chave (opção -k ou a
+ * variavel FID_CHAVE), o N numa conexão aberta e a assinatura de cada comando. o formato está em lib/Autenticacao.
+ * sem chave, enviaComando() manda o comando como veio, para os controladores sem CHAVE_COMANDOS.
+ */
+
+#ifndef SessaoHost_h
+#define SessaoHost_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "Autenticacao.h"
+
+#define ESPERA_SESSAO 2000 // ms pela resposta do N
+
+// chave em 2 * TAM_CHAVE digitos hexadecimais: o texto da opção -k ou, se NULL, a variavel FID_CHAVE.
+// devolve 1 com a chave, 0 sem chave nenhuma e -1 se o texto não for uma chave
+int leChaveHost(const char *texto, uint8_t *chave);
+
+// envia "N" e um nonce de /dev/urandom e inicia a sessão com o nonce do controlador. false se a resposta não vier
+// em ESPERA_SESSAO ou não for o nonce; o que chegou fica em *resposta, para a mensagem de erro
+bool abreSessao(int fd, const uint8_t *chave, SessaoAutenticada &sessao, std::string *resposta);
+
+// "@seq,tag comando\r" com a proxima sequencia da sessão. comando sem o terminador
+std::string assina(SessaoAutenticada &sessao, const char *comando, size_t len);
+
+// um comando (sem o terminador) na conexão: assinado se a sessão estiver ativa. false se o envio falhar
+bool enviaComando(int fd, SessaoAutenticada &sessao, const char *comando, size_t len);
+
+#endif
@@ -0,0 +1,211 @@
+/*
+ * Leitor do fluxo binario do ADC do controlador_FID (comando A), para rodar no host (Linux)
+ *
+ * Converte os registros (formato em lib/RegistroADC/RegistroADC.h) em CSV na saida padrão, uma linha por quadro:
+ * sequencia,instante_us,c<canal>... (o cabeçalho do CSV é repetido quando a mascara muda). no fim, escreve na
+ * saida de erro a vazão obtida e os registros perdidos (saltos na sequencia). as respostas em texto que
+ * aparecerem entre os registros são ignoradas. com chave (-k ou FID_CHAVE), abre a sessão e assina o A
+ * (tools/cliente).
+ *
+ * uso:
+ *   decodifica_adc < captura.bin > adc.csv
+ *   decodifica_adc [-k chave] 192.168.0.170 6969 FF > adc.csv   (conecta, envia "AFF" e le até Ctrl+C ou a
+ *                                                                conexão cair)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/RegistroADC -Ilib/Autenticacao -Itools/cliente tools/decodifica_adc.cpp \
+ *       lib/RegistroADC/RegistroADC.cpp tools/cliente/SessaoHost.cpp lib/Autenticacao/Autenticacao.cpp \
+ *       -o decodifica_adc
+ */
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "RegistroADC.h"
+#include "SessaoHost.h"
+
+static volatile sig_atomic_t parar = 0;
+
+static void interrompe(int)
+{
+  parar = 1;
+}
+
+static double agora()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// conecta ao controlador, abre a sessão se houver chave e liga o fluxo com a mascara pedida. devolve o descritor
+// ou -1
+static int conecta(const char *host, const char *porta, const char *mascara, const uint8_t *chave)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    freeaddrinfo(enderecos);
+    return -1;
+  }
+  freeaddrinfo(enderecos);
+  SessaoAutenticada sessao;
+  std::string resposta;
+  if (chave != NULL && !abreSessao(fd, chave, sessao, &resposta))
+  {
+    fprintf(stderr, "sessão recusada:%s\n", resposta.c_str());
+    close(fd);
+    return -1;
+  }
+  char comando[32];
+  int n = snprintf(comando, sizeof(comando), "A%s", mascara);
+  if (!enviaComando(fd, sessao, comando, n))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int main(int argc, char **argv)
+{
+  int fd = 0;
+  const char *textoChave = NULL;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "-k") == 0)
+  {
+    textoChave = argv[2];
+    arg = 3;
+  }
+  if (argc - arg != 3 && argc != 1)
+  {
+    fprintf(stderr, "uso: %s [[-k chave] host porta mascara_hex] > adc.csv\n", argv[0]);
+    return 1;
+  }
+  if (argc - arg == 3)
+  {
+    uint8_t chave[TAM_CHAVE];
+    int comChave = leChaveHost(textoChave, chave);
+    if (comChave < 0)
+    {
+      fprintf(stderr, "chave invalida: %d digitos hexadecimais\n", 2 * TAM_CHAVE);
+      return 1;
+    }
+    fd = conecta(argv[arg], argv[arg + 1], argv[arg + 2], comChave > 0 ? chave : NULL);
+    if (fd < 0)
+    {
+      perror("conexão");
+      return 1;
+    }
+  }
+  signal(SIGINT, interrompe);
+
+  std::vector<uint8_t> dados;
+  std::vector<uint16_t> amostras;
+  uint8_t bloco[65536];
+  uint64_t mascaraAtual = 0;
+  uint64_t registros = 0, quadros = 0, bytes = 0, ignorados = 0, perdidos = 0;
+  uint32_t proximaSequencia = 0;
+  double inicio = 0, fim = 0;
+
+  while (!parar)
+  {
+    ssize_t lidos = read(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      break;
+    }
+    fim = agora();
+    if (bytes == 0)
+    {
+      inicio = fim;
+    }
+    bytes += lidos;
+    dados.insert(dados.end(), bloco, bloco + lidos);
+
+    size_t pos = 0;
+    while (dados.size() - pos >= REGISTRO_CABECALHO)
+    {
+      CabecalhoRegistro cabecalho;
+      if (!leCabecalho(&dados[pos], &cabecalho))
+      {
+        pos++; // texto ou lixo entre registros
+        ignorados++;
+        continue;
+      }
+      if (dados.size() - pos < cabecalho.tamanho)
+      {
+        break; // registro incompleto, espera o resto
+      }
+
+      uint8_t canais = canaisNaMascara(cabecalho.mascara);
+      if (cabecalho.mascara != mascaraAtual)
+      {
+        mascaraAtual = cabecalho.mascara;
+        printf("sequencia,instante_us");
+        for (int canal = 0; canal < 64; canal++)
+        {
+          if (mascaraAtual >> canal & 1)
+          {
+            printf(",c%d", canal);
+          }
+        }
+        printf("\n");
+      }
+      if (registros > 0 && cabecalho.sequencia != proximaSequencia)
+      {
+        perdidos += cabecalho.sequencia - proximaSequencia;
+      }
+      proximaSequencia = cabecalho.sequencia + 1;
+
+      amostras.resize((size_t)canais * cabecalho.quadros);
+      desempacota(&dados[pos + REGISTRO_CABECALHO], amostras.data(), amostras.size());
+      for (int q = 0; q < cabecalho.quadros; q++)
+      {
+        // instante de cada quadro a partir do primeiro e da taxa nominal
+        uint32_t instante = cabecalho.instante + (uint32_t)((uint64_t)q * 1000000 / cabecalho.taxa);
+        printf("%u,%u", cabecalho.sequencia, instante);
+        for (int c = 0; c < canais; c++)
+        {
+          printf(",%u", amostras[(size_t)q * canais + c]);
+        }
+        printf("\n");
+      }
+      registros++;
+      quadros += cabecalho.quadros;
+      pos += cabecalho.tamanho;
+    }
+    dados.erase(dados.begin(), dados.begin() + pos);
+  }
+
+  double segundos = fim - inicio;
+  fprintf(stderr, "registros=%llu quadros=%llu perdidos=%llu bytes=%llu ignorados=%llu segundos=%.3f\n",
+          (unsigned long long)registros, (unsigned long long)quadros, (unsigned long long)perdidos,
+          (unsigned long long)bytes, (unsigned long long)ignorados, segundos);
+  if (segundos > 0)
+  {
+    fprintf(stderr, "vazao=%.1f kB/s quadros=%.1f /s amostras=%.1f /s\n",
+            bytes / segundos / 1000, quadros / segundos, quadros * (double)canaisNaMascara(mascaraAtual) / segundos);
+  }
+  if (fd > 0)
+  {
+    close(fd);
+  }
+  return 0;
+}
@@ -0,0 +1,283 @@
+/*
+ * Decodificador do registro de eventos do controlador_FID (comando L), para rodar no host (Linux)
+ *
+ * Le o dump binario (formato em lib/RegistroEventos/RegistroEventos.h), aplica a cada evento o texto do seu id
+ * (include/Eventos.h) e escreve uma linha por evento, dos dois cores intercalados em ordem de tempo:
+ *   instante_us core sequencia texto
+ * o instante vem dos ciclos de CPU de cada core, ancorados ao micros() pelo EVT_RELOGIO mais proximo do mesmo core.
+ * um core sem EVT_RELOGIO no dump tem os instantes relativos ao seu primeiro evento, marcados com '~'.
+ * eventos sobrescritos durante o dump e ids desconhecidos (firmware mais novo) são contados na saida de erro.
+ *
+ * uso:
+ *   decodifica_eventos < eventos.bin
+ *   decodifica_eventos [-k chave] 192.168.0.170 6969   (conecta e envia "L"; com chave, ou FID_CHAVE, assinado)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Iinclude -Ilib/RegistroEventos -Ilib/Autenticacao -Itools/cliente \
+ *       tools/decodifica_eventos.cpp lib/RegistroEventos/RegistroEventos.cpp tools/cliente/SessaoHost.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o decodifica_eventos
+ */
+
+#include <netdb.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "Eventos.h"
+#include "RegistroEventos.h"
+#include "SessaoHost.h"
+
+#define FORMATO_EVENTO(id, formato) formato,
+static const char *const formatos[] = {LISTA_EVENTOS(FORMATO_EVENTO)};
+#undef FORMATO_EVENTO
+
+struct Linha
+{
+  double instante; // us
+  bool relativo;
+  uint8_t nucleo;
+  Evento evento;
+};
+
+// troca {a}, {b}, {a:c}, {b:x} e {b:d} pelos argumentos
+static std::string formata(const char *formato, const Evento &e)
+{
+  std::string texto;
+  char numero[16];
+  for (const char *p = formato; *p; p++)
+  {
+    if (*p != '{' || (p[1] != 'a' && p[1] != 'b'))
+    {
+      texto += *p;
+      continue;
+    }
+    uint32_t valor = p[1] == 'a' ? e.a : e.b;
+    char tipo = p[2] == ':' ? p[3] : 'u';
+    const char *fim = strchr(p, '}');
+    if (fim == nullptr)
+    {
+      texto += p;
+      break;
+    }
+    switch (tipo)
+    {
+    case 'c':
+      snprintf(numero, sizeof(numero), "%c", valor >= 32 && valor < 127 ? (char)valor : '?');
+      break;
+    case 'x':
+      snprintf(numero, sizeof(numero), "%X", valor);
+      break;
+    case 'd':
+      snprintf(numero, sizeof(numero), "%d", (int32_t)valor);
+      break;
+    default:
+      snprintf(numero, sizeof(numero), "%u", valor);
+      break;
+    }
+    texto += numero;
+    p = fim;
+  }
+  return texto;
+}
+
+// instantes de um core: cada evento usa o EVT_RELOGIO anterior mais proximo (ou o primeiro seguinte, para os
+// eventos antes dele). com ancoras a cada segundo, a diferença em ciclos cabe folgada em 32 bits com sinal
+static void calculaInstantes(std::vector<Linha> &linhas, uint16_t mhz)
+{
+  const Linha *ancora = nullptr;
+  for (const Linha &l : linhas)
+  {
+    if (l.evento.id == EVT_RELOGIO)
+    {
+      ancora = &l;
+      break;
+    }
+  }
+  if (ancora == nullptr)
+  {
+    // sem ancora: acumula as diferenças entre eventos consecutivos a partir do primeiro
+    double instante = 0;
+    for (size_t i = 0; i < linhas.size(); i++)
+    {
+      if (i > 0)
+      {
+        instante += (uint32_t)(linhas[i].evento.ciclos - linhas[i - 1].evento.ciclos) / (double)mhz;
+      }
+      linhas[i].instante = instante;
+      linhas[i].relativo = true;
+    }
+    return;
+  }
+  for (Linha &l : linhas)
+  {
+    if (l.evento.id == EVT_RELOGIO)
+    {
+      ancora = &l;
+    }
+    l.instante = ancora->evento.b + (int32_t)(l.evento.ciclos - ancora->evento.ciclos) / (double)mhz;
+    l.relativo = false;
+  }
+}
+
+// conecta, abre a sessão se houver chave e pede o dump com o L. devolve o descritor ou -1
+static int conecta(const char *host, const char *porta, const uint8_t *chave)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    freeaddrinfo(enderecos);
+    return -1;
+  }
+  freeaddrinfo(enderecos);
+  SessaoAutenticada sessao;
+  std::string resposta;
+  if (chave != NULL && !abreSessao(fd, chave, sessao, &resposta))
+  {
+    fprintf(stderr, "sessão recusada:%s\n", resposta.c_str());
+    close(fd);
+    return -1;
+  }
+  if (!enviaComando(fd, sessao, "L", 1))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// acrescenta bytes a dados até ter pelo menos n. false se a entrada acabar antes
+static bool garante(int fd, std::vector<uint8_t> &dados, size_t n)
+{
+  uint8_t bloco[4096];
+  while (dados.size() < n)
+  {
+    ssize_t lidos = read(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      return false;
+    }
+    dados.insert(dados.end(), bloco, bloco + lidos);
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  int fd = 0;
+  const char *textoChave = NULL;
+  int arg = 1;
+  if (argc > 2 && strcmp(argv[1], "-k") == 0)
+  {
+    textoChave = argv[2];
+    arg = 3;
+  }
+  if (argc - arg != 2 && argc != 1)
+  {
+    fprintf(stderr, "uso: %s [[-k chave] host porta] > eventos.txt\n", argv[0]);
+    return 1;
+  }
+  if (argc - arg == 2)
+  {
+    uint8_t chave[TAM_CHAVE];
+    int comChave = leChaveHost(textoChave, chave);
+    if (comChave < 0)
+    {
+      fprintf(stderr, "chave invalida: %d digitos hexadecimais\n", 2 * TAM_CHAVE);
+      return 1;
+    }
+    fd = conecta(argv[arg], argv[arg + 1], comChave > 0 ? chave : NULL);
+    if (fd < 0)
+    {
+      perror("conexão");
+      return 1;
+    }
+  }
+
+  // procura o cabeçalho, pulando a quebra de linha e qualquer resposta em texto antes dele
+  std::vector<uint8_t> dados;
+  CabecalhoEventos cabecalho;
+  size_t pos = 0;
+  for (;;)
+  {
+    if (!garante(fd, dados, pos + EVENTOS_CABECALHO))
+    {
+      fprintf(stderr, "dump de eventos não encontrado\n");
+      return 1;
+    }
+    if (leCabecalhoEventos(&dados[pos], &cabecalho))
+    {
+      break;
+    }
+    pos++;
+  }
+  pos += EVENTOS_CABECALHO;
+
+  std::vector<Linha> todas;
+  uint32_t invalidos = 0, desconhecidos = 0;
+  for (int n = 0; n < cabecalho.nucleos; n++)
+  {
+    if (!garante(fd, dados, pos + EVENTOS_CABECALHO_NUCLEO))
+    {
+      fprintf(stderr, "dump incompleto\n");
+      return 1;
+    }
+    uint8_t nucleo = dados[pos];
+    uint16_t quantidade = dados[pos + 2] | dados[pos + 3] << 8;
+    pos += EVENTOS_CABECALHO_NUCLEO;
+    if (!garante(fd, dados, pos + (size_t)quantidade * sizeof(Evento)))
+    {
+      fprintf(stderr, "dump incompleto\n");
+      return 1;
+    }
+    std::vector<Linha> linhas;
+    for (int i = 0; i < quantidade; i++, pos += sizeof(Evento))
+    {
+      Linha l = {};
+      l.nucleo = nucleo;
+      memcpy(&l.evento, &dados[pos], sizeof(Evento));
+      if (l.evento.id == EVENTO_INVALIDO)
+      {
+        invalidos++;
+        continue;
+      }
+      linhas.push_back(l);
+    }
+    calculaInstantes(linhas, cabecalho.mhz);
+    todas.insert(todas.end(), linhas.begin(), linhas.end());
+  }
+
+  std::stable_sort(todas.begin(), todas.end(), [](const Linha &x, const Linha &y) { return x.instante < y.instante; });
+  for (const Linha &l : todas)
+  {
+    const Evento &e = l.evento;
+    std::string texto;
+    if (e.id < EVENTOS_DEFINIDOS)
+    {
+      texto = formata(formatos[e.id], e);
+    }
+    else
+    {
+      desconhecidos++;
+      texto = "evento " + std::to_string(e.id) + " a=" + std::to_string(e.a) + " b=" + std::to_string(e.b);
+    }
+    printf("%c%.1f %u %u %s\n", l.relativo ? '~' : ' ', l.instante, l.nucleo, e.sequencia, texto.c_str());
+  }
+  fprintf(stderr, "eventos=%zu invalidos=%u desconhecidos=%u mhz=%u capacidade=%u\n", todas.size(), invalidos,
+          desconhecidos, cabecalho.mhz, cabecalho.capacidade);
+  if (fd > 0)
+  {
+    close(fd);
+  }
+  return 0;
+}
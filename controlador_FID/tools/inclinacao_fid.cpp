@@ -0,0 +1,140 @@
+/*
+ * Custo do passo de inclinação do worker dos DACs, medido no host (Linux)
+ *
+ * Repete a montagem do lote do taskUpdateDacs com lib/Inclinacao para um banco de 8 e um de 32 canais, todos em
+ * movimento (o pior caso de um passo), e escreve o tempo por passo e por canal. confere também que um degrau de
+ * fundo de escala com limite de 10 codigos/ms leva os 410 passos esperados e que nenhum passo passa do limite.
+ * no ESP32, o mesmo custo aparece por banco em fid_dac_ciclos_inclinacao no /metrics e o do banco mais lento em
+ * ciclos_inclinacao no S; o SPI do lote fica fora das duas medidas.
+ *
+ * uso:
+ *   inclinacao_fid
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Inclinacao tools/inclinacao_fid.cpp lib/Inclinacao/Inclinacao.cpp -o inclinacao_fid
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "Inclinacao.h"
+
+// campos do EstadoCanal e do MCP492XWrite que o passo le e escreve
+struct Canal
+{
+  volatile uint16_t valor;
+  volatile uint16_t saida;
+  uint16_t inclinacao;
+};
+
+struct Escrita
+{
+  uint8_t device;
+  bool odd;
+  uint16_t value;
+};
+
+static double agora()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// o laço do worker, sem o SPI. devolve o numero de canais no lote
+static int passo(LimitadorInclinacao &limitador, Canal *canais, uint32_t marcados, uint32_t ms, Escrita *lote)
+{
+  uint32_t pendentes = marcados | limitador.emMovimento();
+  int n = 0;
+  while (pendentes != 0)
+  {
+    int indice = __builtin_ctz(pendentes);
+    pendentes &= pendentes - 1;
+    Canal &canal = canais[indice];
+    uint16_t codigo = canal.saida;
+    bool mudou = limitador.avanca(indice, canal.valor, canal.inclinacao, ms, &codigo);
+    if (!mudou && !((marcados >> indice) & 1))
+    {
+      continue;
+    }
+    canal.saida = codigo;
+    lote[n].device = indice / 2;
+    lote[n].odd = indice & 1;
+    lote[n].value = codigo;
+    n++;
+  }
+  return n;
+}
+
+static void mede(int quantidade)
+{
+  Canal canais[32] = {};
+  Escrita lote[32];
+  LimitadorInclinacao limitador;
+  uint32_t todos = quantidade == 32 ? 0xFFFFFFFF : (1u << quantidade) - 1;
+  for (int i = 0; i < quantidade; i++)
+  {
+    canais[i].inclinacao = 1; // o movimento mais longo: todos os canais escrevem em todo passo
+  }
+
+  const int passos = 2000000;
+  uint32_t ms = 1;
+  long escritos = 0;
+  double inicio = agora();
+  for (int p = 0; p < passos; p++)
+  {
+    uint32_t marcados = 0;
+    if (limitador.emMovimento() == 0) // fim do movimento: o host manda o degrau oposto
+    {
+      for (int i = 0; i < quantidade; i++)
+      {
+        canais[i].valor = canais[i].saida == 0 ? 4095 : 0;
+      }
+      marcados = todos;
+    }
+    escritos += passo(limitador, canais, marcados, ms++, lote);
+  }
+  double ns = (agora() - inicio) * 1e9 / passos;
+  printf("%2d canais em movimento: %.0f ns por passo (%.1f ns por canal), %.2f canais escritos por passo\n", quantidade,
+         ns, ns / quantidade, (double)escritos / passos);
+}
+
+static bool confere()
+{
+  Canal canais[32] = {};
+  Escrita lote[32];
+  LimitadorInclinacao limitador;
+  canais[0].inclinacao = 10;
+  canais[0].valor = 4095;
+  int passos = 0;
+  uint32_t ms = 1000;
+  int anterior = 0;
+  do
+  {
+    passo(limitador, canais, passos == 0, ms++, lote);
+    passos++;
+    if (abs(canais[0].saida - anterior) > 10 || passos > 1000)
+    {
+      return false;
+    }
+    anterior = canais[0].saida;
+  } while (limitador.emMovimento() != 0);
+  if (canais[0].saida != canais[0].valor)
+  {
+    return false;
+  }
+  printf("degrau 0 -> 4095 a 10 codigos/ms: %d passos\n", passos);
+  return passos == 410;
+}
+
+int main()
+{
+  if (!confere())
+  {
+    fprintf(stderr, "inclinação fora do limite\n");
+    return 1;
+  }
+  mede(8);
+  mede(32);
+  return 0;
+}
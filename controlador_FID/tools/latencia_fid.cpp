@@ -0,0 +1,305 @@
+/*
+ * Distribuição de latencia por etapa dos comandos do controlador_FID, para rodar no host (Linux)
+ *
+ * Envia comandos D com identificador de correlação ("#id Dcc=vvvv") a uma taxa fixa, recolhe os rastros com o
+ * comando T a cada lote e, no fim, escreve por etapa do pipeline (interpretacao, validacao, notificacao, acordar,
+ * escrita, ldac, resposta) a media, p50, p90, p99 e o maximo em us, com uma barra proporcional à media, e o tempo
+ * de ida e volta medido no host. com -f, grava também as pilhas "comando;etapa us" somadas no formato do
+ * flamegraph.pl (uma linha por etapa), para ver onde vai o tempo de cada tipo de comando. com chave (-k ou
+ * FID_CHAVE), abre a sessão e assina cada comando (tools/cliente); o rastro inclui então a verificação da tag.
+ *
+ * uso:
+ *   latencia_fid [-k chave] [-f pilhas.txt] host porta [comandos [por_segundo [canais]]]   (padrão 1000, 100 e 8)
+ *   flamegraph.pl pilhas.txt > latencia.svg
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Autenticacao -Itools/cliente tools/latencia_fid.cpp tools/cliente/SessaoHost.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o latencia_fid
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "SessaoHost.h"
+
+#define LOTE 32 // comandos entre dois T. abaixo dos 64 rastros guardados no controlador
+
+static const char *const etapas[] = {"interpretacao", "validacao", "notificacao", "acordar",
+                                     "escrita", "ldac", "resposta"};
+static const int ETAPAS = sizeof(etapas) / sizeof(etapas[0]);
+
+static double agora()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int conecta(const char *host, const char *porta)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    freeaddrinfo(enderecos);
+    return -1;
+  }
+  freeaddrinfo(enderecos);
+  int sim = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &sim, sizeof(sim)); // cada comando sai na hora, sem esperar o ACK
+  return fd;
+}
+
+struct Coleta
+{
+  std::map<std::string, std::vector<uint32_t>> etapas;          // etapa -> duracões
+  std::map<std::string, std::map<std::string, uint64_t>> pilhas; // comando -> etapa -> soma
+  uint32_t rastros = 0, perdidos = 0;
+};
+
+// "Trastros=n,perdidos=m" ou "Tid=1,seq=2,cmd=D,interpretacao=12,..."
+static void interpretaLinha(const std::string &linha, Coleta &coleta)
+{
+  std::string comando = "?";
+  size_t inicio = 1;
+  while (inicio < linha.size())
+  {
+    size_t fim = linha.find(',', inicio);
+    if (fim == std::string::npos)
+    {
+      fim = linha.size();
+    }
+    std::string campo = linha.substr(inicio, fim - inicio);
+    size_t igual = campo.find('=');
+    if (igual != std::string::npos)
+    {
+      std::string chave = campo.substr(0, igual);
+      std::string valor = campo.substr(igual + 1);
+      if (chave == "cmd")
+      {
+        comando = valor;
+      }
+      else if (chave == "perdidos")
+      {
+        coleta.perdidos += atoi(valor.c_str());
+      }
+      else if (std::find(etapas, etapas + ETAPAS, chave) != etapas + ETAPAS)
+      {
+        uint32_t us = strtoul(valor.c_str(), nullptr, 10);
+        coleta.etapas[chave].push_back(us);
+        coleta.pilhas[comando][chave] += us;
+      }
+    }
+    inicio = fim + 1;
+  }
+  if (linha.compare(0, 4, "Tid=") == 0)
+  {
+    coleta.rastros++;
+  }
+}
+
+// envia T e le até a linha Tfim. as respostas dos comandos D no caminho são ignoradas
+static bool recolhe(int fd, SessaoAutenticada &sessao, Coleta &coleta)
+{
+  if (!enviaComando(fd, sessao, "T", 1))
+  {
+    return false;
+  }
+  std::string linha;
+  char bloco[4096];
+  for (;;)
+  {
+    ssize_t lidos = read(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      return false;
+    }
+    for (ssize_t i = 0; i < lidos; i++)
+    {
+      if (bloco[i] != '\n' && bloco[i] != '\r')
+      {
+        linha += bloco[i];
+        if (linha == "Tfim")
+        {
+          return true; // ultima linha, sem quebra depois dela
+        }
+        continue;
+      }
+      if (linha.compare(0, 1, "T") == 0)
+      {
+        interpretaLinha(linha, coleta);
+      }
+      linha.clear();
+    }
+  }
+}
+
+static uint32_t percentil(const std::vector<uint32_t> &ordenado, double p)
+{
+  return ordenado[std::min(ordenado.size() - 1, (size_t)(p * ordenado.size()))];
+}
+
+int main(int argc, char **argv)
+{
+  const char *arquivoPilhas = nullptr;
+  const char *textoChave = nullptr;
+  int arg = 1;
+  while (argc - arg > 2 && (strcmp(argv[arg], "-f") == 0 || strcmp(argv[arg], "-k") == 0))
+  {
+    if (argv[arg][1] == 'f')
+    {
+      arquivoPilhas = argv[arg + 1];
+    }
+    else
+    {
+      textoChave = argv[arg + 1];
+    }
+    arg += 2;
+  }
+  if (argc - arg < 2)
+  {
+    fprintf(stderr, "uso: %s [-k chave] [-f pilhas.txt] host porta [comandos [por_segundo [canais]]]\n", argv[0]);
+    return 1;
+  }
+  uint8_t chave[TAM_CHAVE];
+  int comChave = leChaveHost(textoChave, chave);
+  if (comChave < 0)
+  {
+    fprintf(stderr, "chave invalida: %d digitos hexadecimais\n", 2 * TAM_CHAVE);
+    return 1;
+  }
+  int fd = conecta(argv[arg], argv[arg + 1]);
+  if (fd < 0)
+  {
+    perror("conexão");
+    return 1;
+  }
+  SessaoAutenticada sessao;
+  std::string resposta;
+  if (comChave > 0 && !abreSessao(fd, chave, sessao, &resposta))
+  {
+    fprintf(stderr, "sessão recusada:%s\n", resposta.c_str());
+    return 1;
+  }
+  int comandos = argc - arg > 2 ? atoi(argv[arg + 2]) : 1000;
+  int taxa = argc - arg > 3 ? atoi(argv[arg + 3]) : 100;
+  int canais = argc - arg > 4 ? atoi(argv[arg + 4]) : 8;
+  if (comandos <= 0 || taxa <= 0 || canais <= 0 || canais > 64)
+  {
+    fprintf(stderr, "comandos, taxa e canais devem ser positivos (canais até 64)\n");
+    return 1;
+  }
+
+  Coleta coleta;
+  std::vector<uint32_t> idaVolta; // us, medido no host do envio do D até o fim do T do lote, por lote
+  srand(1);
+  double proximo = agora();
+  for (int n = 1; n <= comandos; n++)
+  {
+    char comando[48];
+    int len = snprintf(comando, sizeof(comando), "#%d D%02d=%04d", n, rand() % canais, rand() % 4096);
+    double envio = agora();
+    if (!enviaComando(fd, sessao, comando, len))
+    {
+      perror("envio");
+      return 1;
+    }
+    if (n % LOTE == 0 || n == comandos)
+    {
+      if (!recolhe(fd, sessao, coleta))
+      {
+        fprintf(stderr, "conexão encerrada\n");
+        return 1;
+      }
+      idaVolta.push_back((uint32_t)((agora() - envio) * 1e6));
+    }
+    proximo += 1.0 / taxa;
+    double espera = proximo - agora();
+    if (espera > 0)
+    {
+      usleep((useconds_t)(espera * 1e6));
+    }
+  }
+  close(fd);
+
+  printf("rastros=%u perdidos=%u\n", coleta.rastros, coleta.perdidos);
+  printf("%-14s %8s %8s %8s %8s %8s %8s\n", "etapa", "n", "media", "p50", "p90", "p99", "max");
+  double maiorMedia = 1;
+  for (int e = 0; e < ETAPAS; e++)
+  {
+    const std::vector<uint32_t> &v = coleta.etapas[etapas[e]];
+    if (!v.empty())
+    {
+      double soma = 0;
+      for (uint32_t us : v)
+      {
+        soma += us;
+      }
+      maiorMedia = std::max(maiorMedia, soma / v.size());
+    }
+  }
+  for (int e = 0; e < ETAPAS; e++)
+  {
+    std::vector<uint32_t> v = coleta.etapas[etapas[e]];
+    if (v.empty())
+    {
+      printf("%-14s %8d\n", etapas[e], 0);
+      continue;
+    }
+    std::sort(v.begin(), v.end());
+    double soma = 0;
+    for (uint32_t us : v)
+    {
+      soma += us;
+    }
+    double media = soma / v.size();
+    printf("%-14s %8zu %8.1f %8u %8u %8u %8u  %s\n", etapas[e], v.size(), media, percentil(v, 0.5),
+           percentil(v, 0.9), percentil(v, 0.99), v.back(), std::string((size_t)(40 * media / maiorMedia), '#').c_str());
+  }
+  if (!idaVolta.empty())
+  {
+    std::sort(idaVolta.begin(), idaVolta.end());
+    printf("ida e volta do lote no host (D + T): p50=%u p99=%u max=%u us\n", percentil(idaVolta, 0.5),
+           percentil(idaVolta, 0.99), idaVolta.back());
+  }
+
+  if (arquivoPilhas != nullptr)
+  {
+    FILE *f = fopen(arquivoPilhas, "w");
+    if (f == nullptr)
+    {
+      perror(arquivoPilhas);
+      return 1;
+    }
+    for (const auto &comando : coleta.pilhas)
+    {
+      for (int e = 0; e < ETAPAS; e++)
+      {
+        auto soma = comando.second.find(etapas[e]);
+        if (soma != comando.second.end())
+        {
+          fprintf(f, "%s;%d_%s %llu\n", comando.first.c_str(), e + 1, etapas[e], (unsigned long long)soma->second);
+        }
+      }
+    }
+    fclose(f);
+  }
+  return 0;
+}
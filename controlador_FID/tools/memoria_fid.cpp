@@ -0,0 +1,39 @@
+/*
+ * Relatorio do orçamento de RAM do controlador_FID, por placa e por subsistema
+ *
+ * Calculado pelas mesmas constantes que o firmware usa (include/Memoria.h), então não precisa do toolchain do
+ * ESP32: roda depois de alterar qualquer tamanho de buffer ou pilha, antes de gravar. o firmware não compila se
+ * o total passar de ORCAMENTO_RAM; aqui se vê quanto falta. não inclui os TCBs das tasks (~350 bytes cada) nem
+ * as variaveis de estado pequenas, que aparecem no .bss do mapa do linker.
+ *
+ * uso:
+ *   memoria_fid
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Iinclude -Ilib/Autenticacao -Ilib/RegistroADC -Ilib/RegistroEventos tools/memoria_fid.cpp -o memoria_fid
+ */
+
+#include <stdio.h>
+#include "Memoria.h"
+
+template <typename P>
+void relata(const char *nome)
+{
+  using M = MemoriaFID<P>;
+  printf("%s: %d canais, %d bancos, mensagem de %d bytes\n", nome, M::canais, M::bancos, M::bufferlen);
+  for (const UsoMemoria &uso : M::subsistemas)
+  {
+    printf("  %-10s %7zu bytes  %5.1f%%\n", uso.subsistema, uso.bytes, 100.0 * uso.bytes / M::total());
+  }
+  printf("  %-10s %7zu bytes  (orçamento %d, folga %ld)\n\n", "total", M::total(), ORCAMENTO_RAM,
+         (long)ORCAMENTO_RAM - (long)M::total());
+}
+
+int main()
+{
+  relata<PlacaFID4>("PlacaFID4");
+  relata<PlacaFID8>("PlacaFID8");
+  relata<PlacaFID16>("PlacaFID16");
+  relata<PlacaFID32>("PlacaFID32");
+  return 0;
+}
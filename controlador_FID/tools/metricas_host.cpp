@@ -0,0 +1,177 @@
+/*
+ * Endpoint /metrics do controlador_FID rodando no host (Linux), para testar coletores e painéis sem a placa
+ *
+ * Usa o mesmo codigo do firmware (lib/Metricas e lib/BufferSaida): o mesmo respondedor HTTP, o mesmo buffer fixo e
+ * as mesmas familias do caminho de controle (ContadoresFID). duas threads fazem o papel dos dois cores e incrementam
+ * os contadores por core como as tasks do firmware: a de "rede" conta comandos, erros E2/E3/E4 e o tempo de
+ * interpretação; a de "tempo real" conta escritas nos DACs, amostras do ADC e as latencias do worker. a coleta soma
+ * as fatias enquanto as threads escrevem, como no ESP32.
+ *
+ * uso:
+ *   metricas_host [porta [comandos_por_s]]      (padrão 9100 e 1000)
+ *   curl -s localhost:9100/metrics
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -pthread -Ilib/Metricas -Ilib/BufferSaida tools/metricas_host.cpp lib/Metricas/Metricas.cpp \
+ *       lib/BufferSaida/BufferSaida.cpp -o metricas_host
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <atomic>
+#include <random>
+#include <thread>
+#include "Metricas.h"
+
+#define NUCLEO_REDE 0
+#define NUCLEO_TEMPO_REAL 1
+#define CANAIS 8
+#define TAM_PEDIDO 512
+#define TAM_SAIDA 1024
+
+static ContadoresFID contadores;
+static std::atomic<bool> parar(false);
+static time_t inicio;
+
+static void dorme(uint32_t us)
+{
+  timespec t = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+  nanosleep(&t, nullptr);
+}
+
+// comandos a taxa pedida; 1 em 200 é um erro de letra, digito ou faixa (E2, E3, E4)
+static void rede(uint32_t taxa)
+{
+  std::mt19937 gerador(1);
+  std::exponential_distribution<double> processamento(1.0 / 40); // media de 40 us
+  while (!parar)
+  {
+    contadores.comandos.soma(NUCLEO_REDE);
+    contadores.processamento.observa(NUCLEO_REDE, (uint32_t)processamento(gerador));
+    if (gerador() % 200 == 0)
+    {
+      contadores.erros[2 + gerador() % 3].soma(NUCLEO_REDE);
+    }
+    dorme(1000000 / taxa);
+  }
+}
+
+// ADC a 1 kHz e uma passada dos DACs a cada 10 quadros
+static void tempoReal()
+{
+  std::mt19937 gerador(2);
+  std::gamma_distribution<double> latencia(4.0, 5.0); // media de 20 us com cauda
+  for (uint32_t quadro = 0; !parar; quadro++)
+  {
+    contadores.amostrasAdc.soma(NUCLEO_TEMPO_REAL, CANAIS);
+    if (quadro % 10 == 0)
+    {
+      uint32_t l = (uint32_t)latencia(gerador);
+      contadores.latenciaDac.observa(NUCLEO_TEMPO_REAL, l);
+      contadores.escritasDac.soma(NUCLEO_TEMPO_REAL, CANAIS);
+      contadores.passadasDac.soma(NUCLEO_TEMPO_REAL);
+      contadores.passadaDac.observa(NUCLEO_TEMPO_REAL, l + CANAIS * 4);
+    }
+    dorme(1000);
+  }
+}
+
+static size_t enviaSocket(void *contexto, const uint8_t *dados, size_t len)
+{
+  ssize_t n = send(*(int *)contexto, dados, len, MSG_NOSIGNAL);
+  return n > 0 ? n : 0;
+}
+
+// mesmo fluxo do atendeMetricas() do firmware
+static void atende(int fd)
+{
+  char pedido[TAM_PEDIDO];
+  size_t len = 0;
+  PedidoHTTP tipo = HTTP_INCOMPLETO;
+  while (tipo == HTTP_INCOMPLETO && len < sizeof(pedido))
+  {
+    ssize_t lidos = recv(fd, pedido + len, sizeof(pedido) - len, 0);
+    if (lidos <= 0)
+    {
+      return;
+    }
+    len += lidos;
+    tipo = avaliaPedidoHTTP(pedido, len);
+  }
+  if (tipo == HTTP_INCOMPLETO)
+  {
+    tipo = HTTP_INVALIDO;
+  }
+  char area[TAM_SAIDA];
+  BufferSaida resposta(area, sizeof(area), enviaSocket, &fd);
+  respondeHTTP(resposta, tipo);
+  if (tipo == HTTP_METRICAS)
+  {
+    ExpositorMetricas expositor(resposta);
+    escreveContadoresFID(expositor, contadores);
+    expositor.medidor("fid_host_uptime_s", "Tempo desde o inicio do metricas_host.", (int32_t)(time(nullptr) - inicio));
+  }
+  resposta.descarrega();
+}
+
+static void interrompe(int)
+{
+  parar = true;
+}
+
+int main(int argc, char **argv)
+{
+  int porta = argc > 1 ? atoi(argv[1]) : 9100;
+  uint32_t taxa = argc > 2 ? atoi(argv[2]) : 1000;
+  if (porta <= 0 || porta > 65535 || taxa == 0 || taxa > 100000)
+  {
+    fprintf(stderr, "uso: %s [porta [comandos_por_s]]\n", argv[0]);
+    return 1;
+  }
+
+  int servidor = socket(AF_INET, SOCK_STREAM, 0);
+  int sim = 1;
+  setsockopt(servidor, SOL_SOCKET, SO_REUSEADDR, &sim, sizeof(sim));
+  sockaddr_in endereco = {};
+  endereco.sin_family = AF_INET;
+  endereco.sin_addr.s_addr = htonl(INADDR_ANY);
+  endereco.sin_port = htons(porta);
+  if (bind(servidor, (sockaddr *)&endereco, sizeof(endereco)) != 0 || listen(servidor, 4) != 0)
+  {
+    perror("servidor");
+    return 1;
+  }
+
+  struct sigaction acao = {};
+  acao.sa_handler = interrompe; // sem SA_RESTART: o accept() volta com EINTR
+  sigaction(SIGINT, &acao, nullptr);
+  inicio = time(nullptr);
+  std::thread threadRede(rede, taxa);
+  std::thread threadTempoReal(tempoReal);
+  fprintf(stderr, "http://localhost:%d/metrics\n", porta);
+
+  while (!parar)
+  {
+    int cliente = accept(servidor, nullptr, nullptr);
+    if (cliente < 0)
+    {
+      continue;
+    }
+    timeval limite = {0, 200000}; // TIMEOUT_METRICAS do firmware
+    setsockopt(cliente, SOL_SOCKET, SO_RCVTIMEO, &limite, sizeof(limite));
+    atende(cliente);
+    close(cliente);
+  }
+
+  threadRede.join();
+  threadTempoReal.join();
+  close(servidor);
+  return 0;
+}
@@ -0,0 +1,420 @@
+/*
+ * Controlador_FID nativo (Linux): o protocolo do firmware servido por corrotinas de um Executor
+ */
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ControladorNativo.h"
+#include "Protocolo.h"
+
+#define FILA_CONEXOES 4
+
+static const char *const opcoesEco[] = {"completo", "curto", "nenhum", NULL}; // como no firmware
+
+static int abreSocket(int tipo, const char *endereco, uint16_t porta)
+{
+  int fd = socket(AF_INET, tipo | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+  {
+    return -1;
+  }
+  int sim = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &sim, sizeof(sim));
+  sockaddr_in local = {};
+  local.sin_family = AF_INET;
+  local.sin_port = htons(porta);
+  if (inet_pton(AF_INET, endereco, &local.sin_addr) != 1 || bind(fd, (sockaddr *)&local, sizeof(local)) != 0 ||
+      (tipo == SOCK_STREAM && listen(fd, FILA_CONEXOES) != 0))
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+ControladorNativo::ControladorNativo(Executor &ex, PoolBuffers &pool, const ConfiguracaoNativo &configuracao)
+    : _ex(ex), _pool(pool), _configuracao(configuracao),
+      _planta(configuracao.canais, [this](int canal) { return _valores[canal] * _configuracao.vref / 4096; },
+              configuracao.semente),
+      _tabelaConfig{{"echo", CONFIG_ENUM, &_modoEco, 0, 2, opcoesEco, NULL}}, _config(_tabelaConfig, 1)
+{
+  int canais = _configuracao.canais;
+  int tamMax = 1 + 5 * canais > 8 * canais ? 1 + 5 * canais : 8 * canais;
+  _tamMensagem = tamMax + 1 > 42 ? tamMax + 1 : 42;
+  _estadoDACs = "W";
+  for (int canal = 0; canal < canais; canal++)
+  {
+    _estadoDACs += letraCanal(canal);
+    _estadoDACs += "0000";
+    _planta.parametros(canal) = _configuracao.laco;
+  }
+}
+
+ControladorNativo::~ControladorNativo()
+{
+  if (_servidor >= 0)
+  {
+    close(_servidor);
+  }
+  if (_socketUdp >= 0)
+  {
+    close(_socketUdp);
+  }
+}
+
+bool ControladorNativo::inicia(const char *endereco, uint16_t porta)
+{
+  _servidor = abreSocket(SOCK_STREAM, endereco, porta);
+  _socketUdp = abreSocket(SOCK_DGRAM, endereco, porta);
+  if (_servidor < 0 || _socketUdp < 0)
+  {
+    return false;
+  }
+  _porta = porta;
+  _ex.inicia(servidor());
+  _ex.inicia(udp());
+  if (_configuracao.taxaAdc > 0)
+  {
+    _ex.inicia(aquisicao());
+  }
+  return true;
+}
+
+size_t ControladorNativo::acumula(void *contexto, const uint8_t *dados, size_t len)
+{
+  Resposta *resposta = (Resposta *)contexto;
+  if (resposta->fd >= 0)
+  {
+    // o socket não bloqueia: o que o kernel não aceitar agora segue no transbordo, depois da resposta
+    ssize_t enviados = resposta->transbordo->empty() ? send(resposta->fd, dados, len, MSG_NOSIGNAL) : 0;
+    enviados = enviados < 0 ? 0 : enviados;
+    resposta->transbordo->append((const char *)dados + enviados, len - enviados);
+    return len;
+  }
+  size_t cabe = resposta->capacidade - resposta->usado;
+  cabe = len < cabe ? len : cabe;
+  memcpy(resposta->dados + resposta->usado, dados, cabe);
+  resposta->usado += cabe;
+  if (cabe < len && resposta->transbordo != nullptr)
+  {
+    resposta->transbordo->append((const char *)dados + cabe, len - cabe);
+  }
+  return len;
+}
+
+void ControladorNativo::contaSaida(const BufferSaida &saida)
+{
+  _escritas += saida.escritas();
+  _envios += saida.envios();
+  _bytesEnviados += saida.bytesEnviados();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// corrotinas
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// um cliente por vez, como o firmware. os comandos de um bloco lido são respondidos juntos, numa unica escrita.
+// entre dois blocos a conexão só guarda o comando incompleto
+Tarefa ControladorNativo::servidor()
+{
+  std::vector<char> linha(_tamMensagem + 1);
+  for (;;)
+  {
+    ssize_t cliente = co_await _ex.aceita(_servidor);
+    if (cliente < 0)
+    {
+      co_await _ex.dorme(10000000); // EMFILE e afins: tenta de novo em 10 ms
+      continue;
+    }
+    _clientes++;
+    int fd = (int)cliente;
+    if (_configuracao.semNagle)
+    {
+      int sim = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &sim, sizeof(sim));
+    }
+    int usado = 0;
+    while (co_await _ex.aguardaDados(fd) == 0)
+    {
+      Emprestimo emprestimo(_pool);
+      char *bloco = emprestimo.bloco();
+      ssize_t lidos = co_await _ex.le(fd, bloco + BLOCO_ENTRADA, TAM_ENTRADA);
+      if (lidos <= 0)
+      {
+        break;
+      }
+      uint64_t inicio = Executor::agora();
+      _bytesRecebidos += lidos;
+      Resposta resposta = {bloco + BLOCO_RESPOSTA, 0, TAM_RESPOSTA, &_transbordo, _configuracao.semAcumular ? fd : -1};
+      BufferSaida saida(bloco + BLOCO_AREA_SAIDA, TAM_AREA_SAIDA, acumula, &resposta);
+      saida.semAcumular(_configuracao.semAcumular);
+      interpreta(bloco + BLOCO_ENTRADA, lidos, linha.data(), &usado, saida);
+      saida.descarrega();
+      contaSaida(saida);
+      ssize_t escritos = 0;
+      if (resposta.usado > 0)
+      {
+        escritos = co_await _ex.escreve(fd, resposta.dados, resposta.usado);
+      }
+      if (escritos >= 0 && !_transbordo.empty())
+      {
+        escritos = co_await _ex.escreve(fd, _transbordo.data(), _transbordo.size());
+      }
+      _transbordo.clear();
+      _atendimento.observa((uint32_t)((Executor::agora() - inicio) / 1000));
+      if (escritos < 0)
+      {
+        break;
+      }
+    }
+    _ex.fecha(fd);
+  }
+}
+
+Tarefa ControladorNativo::udp()
+{
+  std::vector<char> linha(_tamMensagem + 1);
+  sockaddr_in origem;
+  for (;;)
+  {
+    co_await _ex.aguardaDados(_socketUdp);
+    Emprestimo emprestimo(_pool);
+    char *bloco = emprestimo.bloco();
+    ssize_t lidos = co_await _ex.recebe(_socketUdp, bloco + BLOCO_ENTRADA, TAM_DATAGRAMA, &origem);
+    if (lidos <= 0)
+    {
+      continue;
+    }
+    uint64_t inicio = Executor::agora();
+    _bytesRecebidos += lidos;
+    bloco[BLOCO_ENTRADA + lidos] = '\r'; // o ultimo comando pode vir sem terminador
+    Resposta resposta = {bloco + BLOCO_RESPOSTA, 0, TAM_DATAGRAMA, nullptr, -1};
+    BufferSaida saida(bloco + BLOCO_AREA_SAIDA, TAM_AREA_SAIDA, acumula, &resposta);
+    int usado = 0;
+    interpreta(bloco + BLOCO_ENTRADA, lidos + 1, linha.data(), &usado, saida);
+    saida.descarrega();
+    contaSaida(saida);
+    if (resposta.usado > 0)
+    {
+      co_await _ex.envia(_socketUdp, resposta.dados, resposta.usado, &origem);
+    }
+    _atendimento.observa((uint32_t)((Executor::agora() - inicio) / 1000));
+  }
+}
+
+// a cada quadro a planta avança um periodo com a tensão atual dos DACs e cada canal é convertido pelo ADC.
+// um prazo perdido (executor ocupado) é pulado e contado em adc_atrasos, como no firmware
+Tarefa ControladorNativo::aquisicao()
+{
+  uint64_t periodo = 1000000000ull / _configuracao.taxaAdc;
+  double segundos = 1.0 / _configuracao.taxaAdc;
+  uint64_t proximo = Executor::agora() + periodo;
+  for (;;)
+  {
+    co_await _ex.ate(proximo);
+    _planta.avanca(segundos);
+    for (int canal = 0; canal < _configuracao.canais; canal++)
+    {
+      double codigo = _planta.leitura(canal) * 4096 / _configuracao.vref + 0.5;
+      _leituras[canal] = codigo < 0 ? 0 : codigo > 4095 ? 4095 : (uint16_t)codigo;
+    }
+    _quadros++;
+    proximo += periodo;
+    uint64_t agora = Executor::agora();
+    if (proximo <= agora)
+    {
+      uint64_t perdidos = (agora - proximo) / periodo + 1;
+      _atrasos += perdidos;
+      proximo += perdidos * periodo;
+    }
+  }
+}
+
+void ControladorNativo::interpreta(const char *dados, size_t len, char *linha, int *usado, BufferSaida &saida)
+{
+  int i = *usado;
+  for (size_t n = 0; n < len; n++)
+  {
+    char z = dados[n];
+    if (z == '\n' && i == 0)
+    {
+      continue; // "\r\n": o '\n' sobra da linha anterior
+    }
+    if (i < _tamMensagem - 1)
+    {
+      linha[i++] = z; // o excesso de uma linha longa é descartado, como no firmware
+    }
+    if (z == '\r')
+    {
+      linha[i] = '\0';
+      if (i > 1)
+      {
+        avalia(linha, saida);
+      }
+      i = 0;
+    }
+  }
+  *usado = i;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// protocolo
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void ControladorNativo::avalia(const char *mensagem, BufferSaida &saida)
+{
+  _comandos++;
+  int canalErro = 0;
+  int erro = 0;
+  switch (mensagem[0])
+  {
+  case 'W':
+    if (strncmp(mensagem, _estadoDACs.c_str(), _estadoDACs.size()) == 0)
+    {
+      break; // já está no estado pedido
+    }
+    erro = stageChanges(mensagem, &canalErro);
+    if (erro == 0)
+    {
+      respondeAceito(mensagem, saida);
+    }
+    break;
+  case 'D':
+    erro = stageDelta(mensagem, &canalErro);
+    if (erro == 0)
+    {
+      respondeAceito(mensagem, saida);
+    }
+    break;
+  case 'R':
+    report(saida);
+    break;
+  case 'S':
+    status(saida);
+    break;
+  case 'C':
+    configure(mensagem, saida);
+    break;
+  default:
+    erro = 1;
+    break;
+  }
+  if (erro != 0)
+  {
+    respondeErro(erro, canalErro, mensagem, saida);
+  }
+}
+
+void ControladorNativo::respondeAceito(const char *mensagem, BufferSaida &saida)
+{
+  escreveAceito(saida, {RESPOSTA_VERBOSA, _modoEco, false, _comandos, 0}, mensagem);
+}
+
+int ControladorNativo::stageChanges(const char *mensagem, int *canalErro)
+{
+  int canais = _configuracao.canais;
+  uint16_t valores[CANAIS_NATIVO_MAX];
+  int erro = interpretaW(mensagem, canais, valores, canalErro);
+  if (erro != 0)
+  {
+    return erro;
+  }
+  memcpy(_valores, valores, canais * sizeof(uint16_t));
+  _estadoDACs.assign(mensagem, 1 + 5 * canais);
+  return 0;
+}
+
+int ControladorNativo::stageDelta(const char *mensagem, int *canalErro)
+{
+  AlteracaoCanal alteracoes[CANAIS_NATIVO_MAX];
+  int n = 0;
+  *canalErro = 0;
+  if (interpretaD(mensagem, _configuracao.canais, alteracoes, &n) != 0)
+  {
+    return 8;
+  }
+  for (int i = 0; i < n; i++)
+  {
+    _valores[alteracoes[i].canal] = alteracoes[i].valor;
+    escreveEstadoDAC(alteracoes[i].canal, alteracoes[i].valor);
+  }
+  return 0;
+}
+
+void ControladorNativo::escreveEstadoDAC(int canal, int valor)
+{
+  char *campo = &_estadoDACs[5 * canal + 2];
+  for (int digito = 3; digito >= 0; digito--)
+  {
+    campo[digito] = '0' + valor % 10;
+    valor /= 10;
+  }
+}
+
+// "vvvv,vvvv,...,,", como o estado_ADC do firmware
+void ControladorNativo::report(BufferSaida &saida)
+{
+  for (int canal = 0; canal < _configuracao.canais; canal++)
+  {
+    saida.adicionaDecimal(_leituras[canal], 4);
+    saida.adiciona(',');
+  }
+  saida.adiciona(',');
+}
+
+void ControladorNativo::status(BufferSaida &saida)
+{
+  saida.adiciona("\ncomandos=");
+  saida.adicionaDecimal(_comandos);
+  saida.adiciona(",entrada_bytes=");
+  saida.adicionaDecimal(_bytesRecebidos);
+  saida.adiciona(",adc_quadros=");
+  saida.adicionaDecimal(_quadros);
+  saida.adiciona(",adc_atrasos=");
+  saida.adicionaDecimal(_atrasos);
+  saida.adiciona(",saida_escritas=");
+  saida.adicionaDecimal(_escritas + saida.escritas());
+  saida.adiciona(",saida_envios=");
+  saida.adicionaDecimal(_envios + saida.envios());
+  saida.adiciona(",saida_bytes=");
+  saida.adicionaDecimal(_bytesEnviados + saida.bytesEnviados());
+}
+
+// "C" ou "C?" lista as configurações, "Cchave=valor" (ou "C chave=valor") altera uma delas, como o configure()
+void ControladorNativo::configure(const char *mensagem, BufferSaida &saida)
+{
+  size_t len;
+  const char *texto = argumentosC(mensagem, &len);
+  if (len == 0 || (len == 1 && texto[0] == '?'))
+  {
+    saida.adiciona('\n');
+    _config.lista(saida);
+    return;
+  }
+  int erro = erroConfig(_config.altera(texto, len));
+  if (erro != 0)
+  {
+    respondeErro(erro, 0, mensagem, saida);
+    return;
+  }
+  saida.adiciona('\n');
+  _config.formata(*_config.busca(texto, strchr(texto, '=') - texto), saida);
+}
+
+// os textos do firmware (lib/Protocolo), menos o do comando não reconhecido, que lista só os comandos daqui
+void ControladorNativo::respondeErro(int codigo, int canal, const char *mensagem, BufferSaida &saida)
+{
+  if (codigo == 1)
+  {
+    saida.adiciona("\ncomando não reconhecido\nO controlador nativo atende W ou D para variar a corrente, R para leitura, S para status e C para configuração");
+    return;
+  }
+  escreveErro(saida, {RESPOSTA_VERBOSA, _modoEco, false, _comandos, 0}, {_configuracao.canais, 0, false}, codigo, canal,
+              mensagem);
+}
@@ -0,0 +1,141 @@
+/*
+ * Controlador_FID nativo (Linux): o protocolo do firmware servido por corrotinas de um Executor
+ *
+ * Cada instancia tem o estado de um controlador (valores dos canais, estado_DACs e leituras), os seus DACs, ADC e
+ * planta simulados, e três corrotinas no executor em que foi criada, no lugar das tasks do firmware:
+ *   servidor:  aceita um cliente TCP por vez na porta, como o taskTcpCode, e responde a cada comando terminado em
+ *              '\r' com uma unica escrita por bloco recebido (BufferSaida)
+ *   udp:       o mesmo protocolo em datagramas na mesma porta: cada datagrama traz um ou mais comandos e recebe as
+ *              respostas num unico datagrama, para clientes que fazem varredura sem manter conexão
+ *   aquisição: timer a taxa do ADC que integra a planta (PlantaLaco de tools/simulacao) com a tensão dos DACs e
+ *              converte a saida de cada canal num codigo de 12 bits, no lugar da taskAdcCode
+ * Nenhuma delas faz espera ativa: sem comandos e sem timer vencido, a instancia não custa CPU. os buffers de
+ * entrada e saida vêm do PoolBuffers do executor só durante o atendimento de um bloco recebido.
+ *
+ * Os DACs e o ADC são modelados pela função de transferencia (codigo * VREF / 4096 e o inverso, saturando), sem
+ * os bits do SPI: os modelos bit a bit do Simulador ficam para a bancada (simula_fid), caros demais por instancia.
+ *
+ * Comandos atendidos: W, D, R, S e C, interpretados e respondidos por lib/Protocolo como no firmware, no modo
+ * verboso. o C conhece só o echo (completo, curto ou nenhum, como no firmware). os demais respondem como comando não
+ * reconhecido.
+ */
+
+#ifndef ControladorNativo_h
+#define ControladorNativo_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "BufferSaida.h"
+#include "Configuracoes.h"
+#include "Executor.h"
+#include "Latencia.h"
+#include "PoolBuffers.h"
+#include "Simulador.h"
+
+#define CANAIS_NATIVO_MAX 64
+#define TAM_DATAGRAMA 1472 // maior datagrama sem fragmentar num enlace de 1500 bytes
+
+// divisão de um bloco do pool: entrada (bloco lido ou datagrama), area do BufferSaida e a resposta montada
+#define BLOCO_ENTRADA 0
+#define TAM_ENTRADA 1536
+#define BLOCO_AREA_SAIDA 1536
+#define TAM_AREA_SAIDA 512 // o S daqui é curto; o firmware usa TAM_SAIDA, do tamanho do S completo
+#define BLOCO_RESPOSTA 2048
+#define TAM_RESPOSTA 2048
+#define TAM_BLOCO_NATIVO 4096
+
+struct ConfiguracaoNativo
+{
+  int canais = 8;          // 1 a CANAIS_NATIVO_MAX
+  uint32_t taxaAdc = 1000; // quadros por segundo; 0 desliga a aquisição (as leituras ficam paradas)
+  double vref = 3.3;       // V, DACs e ADC
+  ParametrosLaco laco;     // planta de cada canal
+  uint32_t semente = 1;    // ruido da planta
+  bool semAcumular = false; // TCP: cada adiciona* numa escrita no socket, como os cl.print antes do BufferSaida
+  bool semNagle = false;    // TCP_NODELAY no cliente aceito: cada escrita sai no seu segmento, sem esperar o ACK
+};
+
+class ControladorNativo
+{
+public:
+  // pool com blocos de TAM_BLOCO_NATIVO bytes, do mesmo executor
+  ControladorNativo(Executor &ex, PoolBuffers &pool, const ConfiguracaoNativo &configuracao);
+  ~ControladorNativo();
+
+  // abre o servidor TCP e o endpoint UDP em endereco:porta (ex. "127.0.0.1") e dispara as corrotinas.
+  // false se a porta não pode ser aberta
+  bool inicia(const char *endereco, uint16_t porta);
+
+  uint16_t porta() const { return _porta; }
+  uint32_t comandos() const { return _comandos; }
+  uint32_t quadros() const { return _quadros; }
+  uint32_t atrasos() const { return _atrasos; }
+  uint32_t clientes() const { return _clientes; }
+  uint32_t escritas() const { return _escritas; } // chamadas de adiciona* nas respostas
+  uint32_t envios() const { return _envios; }     // escritas no socket
+  // do fim da leitura de um bloco ao fim da escrita da resposta, em us
+  const HistogramaLatencia &atendimento() const { return _atendimento; }
+
+private:
+  // resposta montada num bloco do pool. o que não couber vai para transbordo (TCP) ou é descartado (UDP)
+  struct Resposta
+  {
+    char *dados;
+    size_t usado;
+    size_t capacidade;
+    std::string *transbordo;
+    int fd; // >= 0: semAcumular, cada descarga vai direto para o socket
+  };
+
+  Tarefa servidor();
+  Tarefa udp();
+  Tarefa aquisicao();
+
+  // separa os comandos terminados em '\r' e responde cada um em saida. linha guarda o comando incompleto
+  void interpreta(const char *dados, size_t len, char *linha, int *usado, BufferSaida &saida);
+
+  // interpreta um comando (terminado em '\r' ou '\0') e escreve a resposta em saida, como o evaluate()
+  void avalia(const char *mensagem, BufferSaida &saida);
+  int stageChanges(const char *mensagem, int *canalErro);
+  int stageDelta(const char *mensagem, int *canalErro);
+  void report(BufferSaida &saida);
+  void status(BufferSaida &saida);
+  void configure(const char *mensagem, BufferSaida &saida);
+  void respondeAceito(const char *mensagem, BufferSaida &saida);
+  void respondeErro(int codigo, int canal, const char *mensagem, BufferSaida &saida);
+  void escreveEstadoDAC(int canal, int valor);
+  void contaSaida(const BufferSaida &saida);
+
+  static size_t acumula(void *contexto, const uint8_t *dados, size_t len); // FuncaoEnvio para uma Resposta
+
+  Executor &_ex;
+  PoolBuffers &_pool;
+  ConfiguracaoNativo _configuracao;
+  int _tamMensagem; // BUFFERLEN do firmware para o numero de canais
+  uint16_t _porta = 0;
+  int _servidor = -1;
+  int _socketUdp = -1;
+
+  uint16_t _valores[CANAIS_NATIVO_MAX] = {};
+  uint16_t _leituras[CANAIS_NATIVO_MAX] = {};
+  std::string _estadoDACs; // ultimo W aplicado: "WA0000B0000..."
+  PlantaLaco _planta;
+  std::string _transbordo;
+  int32_t _modoEco = 0; // indice em opcoesEco
+  Configuracao _tabelaConfig[1];
+  Configuracoes _config;
+
+  uint32_t _comandos = 0;
+  uint32_t _bytesRecebidos = 0;
+  uint32_t _quadros = 0;
+  uint32_t _atrasos = 0;
+  uint32_t _clientes = 0;
+  uint32_t _escritas = 0;
+  uint32_t _envios = 0;
+  uint32_t _bytesEnviados = 0;
+  HistogramaLatencia _atendimento;
+};
+
+#endif
@@ -0,0 +1,338 @@
+/*
+ * Executor de corrotinas sobre epoll, para a versão nativa (Linux) do controlador_FID
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <exception>
+#include "Executor.h"
+
+#define EVENTOS_POR_VOLTA 256
+
+void Tarefa::promise_type::unhandled_exception()
+{
+  fprintf(stderr, "excecao não tratada numa corrotina\n");
+  std::terminate();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// operações
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void Operacao::await_suspend(std::coroutine_handle<> h)
+{
+  _h = h;
+  _ex.aguarda(this, _fd, _escrita);
+}
+
+bool Operacao::conclui(ssize_t r)
+{
+  if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+  {
+    return false;
+  }
+  if (r < 0 && errno == EINTR)
+  {
+    return tenta();
+  }
+  _resultado = r < 0 ? -errno : r;
+  return true;
+}
+
+bool Leitura::tenta()
+{
+  return conclui(read(_fd, _destino, _len));
+}
+
+bool Escrita::tenta()
+{
+  while (_enviados < _len)
+  {
+    ssize_t r = send(_fd, (const char *)_dados + _enviados, _len - _enviados, MSG_NOSIGNAL);
+    if (r < 0)
+    {
+      if (!conclui(r))
+      {
+        return false;
+      }
+      return true; // erro em _resultado
+    }
+    _enviados += r;
+  }
+  _resultado = _enviados;
+  return true;
+}
+
+bool Aceitacao::tenta()
+{
+  return conclui(accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC));
+}
+
+bool Conexao::tenta()
+{
+  if (!_iniciada)
+  {
+    _iniciada = true;
+    if (connect(_fd, (const sockaddr *)_destino, sizeof(*_destino)) == 0)
+    {
+      _resultado = 0;
+      return true;
+    }
+    if (errno != EINPROGRESS)
+    {
+      _resultado = -errno;
+      return true;
+    }
+    return false;
+  }
+  int erro = 0;
+  socklen_t tamanho = sizeof(erro);
+  if (getsockopt(_fd, SOL_SOCKET, SO_ERROR, &erro, &tamanho) != 0)
+  {
+    erro = errno;
+  }
+  _resultado = -erro;
+  return true;
+}
+
+bool AguardaDados::tenta()
+{
+  char c;
+  ssize_t r = recv(_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+  return conclui(r < 0 ? r : 0);
+}
+
+bool RecepcaoUDP::tenta()
+{
+  socklen_t tamanho = sizeof(*_origem);
+  return conclui(recvfrom(_fd, _destino, _len, 0, (sockaddr *)_origem, &tamanho));
+}
+
+bool EnvioUDP::tenta()
+{
+  return conclui(sendto(_fd, _dados, _len, 0, (const sockaddr *)_destino, sizeof(*_destino)));
+}
+
+bool Prazo::await_ready() const
+{
+  return _instante <= Executor::agora();
+}
+
+void Prazo::await_suspend(std::coroutine_handle<> h)
+{
+  _ex.agenda(_instante, h);
+}
+
+void Cessao::await_suspend(std::coroutine_handle<> h)
+{
+  ex.pronta(h);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// executor
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Executor::Executor()
+{
+  _epoll = epoll_create1(EPOLL_CLOEXEC);
+  _timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  _aviso = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (_epoll < 0 || _timer < 0 || _aviso < 0)
+  {
+    perror("executor");
+    abort();
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.fd = _timer;
+  epoll_ctl(_epoll, EPOLL_CTL_ADD, _timer, &ev);
+  ev.data.fd = _aviso;
+  epoll_ctl(_epoll, EPOLL_CTL_ADD, _aviso, &ev);
+}
+
+Executor::~Executor()
+{
+  // cada corrotina suspensa está em exatamente um lugar: fila de prontas, heap de prazos ou esperando um fd
+  for (std::coroutine_handle<> h : _prontas)
+  {
+    h.destroy();
+  }
+  while (!_prazos.empty())
+  {
+    _prazos.top().h.destroy();
+    _prazos.pop();
+  }
+  for (RegistroFd &r : _fds)
+  {
+    if (r.leitura != nullptr)
+    {
+      r.leitura->corrotina().destroy();
+    }
+    if (r.escrita != nullptr)
+    {
+      r.escrita->corrotina().destroy();
+    }
+  }
+  close(_epoll);
+  close(_timer);
+  close(_aviso);
+}
+
+uint64_t Executor::agora()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+void Executor::inicia(Tarefa tarefa)
+{
+  pronta(tarefa.h);
+}
+
+void Executor::para()
+{
+  __atomic_store_n(&_parar, true, __ATOMIC_RELEASE);
+  uint64_t um = 1;
+  ssize_t r = write(_aviso, &um, sizeof(um)); // só acorda o epoll_wait
+  (void)r;
+}
+
+void Executor::aguarda(Operacao *operacao, int fd, bool escrita)
+{
+  if (fd >= (int)_fds.size())
+  {
+    _fds.resize(fd + 1);
+  }
+  RegistroFd &r = _fds[fd];
+  if (!r.registrado)
+  {
+    // edge-triggered, nos dois sentidos, uma vez por fd: toda operação tenta antes de esperar, então uma borda
+    // sem ninguem esperando não se perde
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.fd = fd;
+    if (epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev) != 0)
+    {
+      perror("epoll_ctl");
+      abort();
+    }
+    r.registrado = true;
+  }
+  (escrita ? r.escrita : r.leitura) = operacao;
+  _pendentes++;
+  _esperas++;
+}
+
+void Executor::fecha(int fd)
+{
+  if (fd < (int)_fds.size())
+  {
+    _fds[fd] = RegistroFd();
+  }
+  close(fd); // o close tira o fd do epoll
+}
+
+void Executor::agenda(uint64_t instante, std::coroutine_handle<> h)
+{
+  _prazos.push({instante, _ordem++, h});
+  if (_timerArmado == 0 || instante < _timerArmado)
+  {
+    armaTimer();
+  }
+}
+
+void Executor::armaTimer()
+{
+  itimerspec t = {};
+  _timerArmado = _prazos.empty() ? 0 : _prazos.top().instante;
+  if (_timerArmado != 0)
+  {
+    t.it_value.tv_sec = _timerArmado / 1000000000ull;
+    t.it_value.tv_nsec = _timerArmado % 1000000000ull;
+  }
+  timerfd_settime(_timer, TFD_TIMER_ABSTIME, &t, nullptr); // it_value zerado desarma
+}
+
+void Executor::atendeFd(int fd, uint32_t eventos)
+{
+  if (fd >= (int)_fds.size())
+  {
+    return;
+  }
+  RegistroFd &r = _fds[fd];
+  bool falha = eventos & (EPOLLERR | EPOLLHUP);
+  if (r.leitura != nullptr && (eventos & (EPOLLIN | EPOLLRDHUP) || falha) && r.leitura->tenta())
+  {
+    pronta(r.leitura->corrotina());
+    r.leitura = nullptr;
+    _pendentes--;
+  }
+  if (r.escrita != nullptr && (eventos & EPOLLOUT || falha) && r.escrita->tenta())
+  {
+    pronta(r.escrita->corrotina());
+    r.escrita = nullptr;
+    _pendentes--;
+  }
+}
+
+void Executor::roda()
+{
+  epoll_event eventos[EVENTOS_POR_VOLTA];
+  while (!__atomic_load_n(&_parar, __ATOMIC_ACQUIRE))
+  {
+    // as prontas de agora; as que elas acordarem ficam para depois do proximo epoll_wait
+    size_t n = _prontas.size();
+    for (size_t i = 0; i < n && !__atomic_load_n(&_parar, __ATOMIC_RELAXED); i++)
+    {
+      std::coroutine_handle<> h = _prontas.front();
+      _prontas.pop_front();
+      _retomadas++;
+      h.resume();
+    }
+    if (__atomic_load_n(&_parar, __ATOMIC_RELAXED) || (_prontas.empty() && _prazos.empty() && _pendentes == 0))
+    {
+      break;
+    }
+    int prontos = epoll_wait(_epoll, eventos, EVENTOS_POR_VOLTA, _prontas.empty() ? -1 : 0);
+    _voltas++;
+    for (int i = 0; i < prontos; i++)
+    {
+      int fd = eventos[i].data.fd;
+      if (fd == _timer)
+      {
+        uint64_t expiracoes;
+        ssize_t r = read(_timer, &expiracoes, sizeof(expiracoes));
+        (void)r;
+      }
+      else if (fd == _aviso)
+      {
+        uint64_t avisos;
+        ssize_t r = read(_aviso, &avisos, sizeof(avisos));
+        (void)r;
+      }
+      else
+      {
+        atendeFd(fd, eventos[i].events);
+      }
+    }
+    if (!_prazos.empty() && _prazos.top().instante <= agora())
+    {
+      uint64_t instante = agora();
+      while (!_prazos.empty() && _prazos.top().instante <= instante)
+      {
+        pronta(_prazos.top().h);
+        _prazos.pop();
+      }
+      armaTimer();
+    }
+  }
+}
@@ -0,0 +1,270 @@
+/*
+ * Executor de corrotinas sobre epoll, para a versão nativa (Linux) do controlador_FID
+ *
+ * Cada tarefa do firmware (servidor TCP, aquisição, supervisor) vira uma corrotina C++20 que, em vez de um laço com
+ * vTaskDelay, suspende até o socket ficar pronto ou o prazo do timer vencer. um unico thread atende milhares dessas
+ * corrotinas: as esperas de I/O são feitas num epoll (edge-triggered, um registro por fd) e as de tempo num heap de
+ * prazos servido por um unico timerfd. para usar mais de um thread, cria-se um Executor por thread e se divide os
+ * controladores entre eles; um Executor e as suas corrotinas nunca são tocados por outro thread, exceto para().
+ *
+ * As operações de I/O (le, escreve, aceita, conecta, recebe, envia, aguardaDados) tentam a chamada de sistema na hora e só suspendem com
+ * EAGAIN. quando o fd fica pronto, o proprio executor repete a chamada e só retoma a corrotina quando ela completa,
+ * de modo que quem faz co_await nunca ve EAGAIN. o resultado é o da chamada (bytes, fd) ou -errno.
+ *
+ * Os fds usados com o executor são não bloqueantes e fechados com fecha(), que também esquece o registro no epoll.
+ *
+ * uso:
+ *   Tarefa eco(Executor &ex, int fd)
+ *   {
+ *     char bloco[256];
+ *     ssize_t n;
+ *     while ((n = co_await ex.le(fd, bloco, sizeof(bloco))) > 0)
+ *       co_await ex.escreve(fd, bloco, n);
+ *     ex.fecha(fd);
+ *   }
+ *   ex.inicia(eco(ex, fd));
+ *   ex.roda();
+ */
+
+#ifndef Executor_h
+#define Executor_h
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <coroutine>
+#include <deque>
+#include <queue>
+#include <vector>
+
+// Corrotina destacada: começa suspensa, roda quando o executor a tira da fila e libera o proprio frame ao terminar
+struct Tarefa
+{
+  struct promise_type
+  {
+    Tarefa get_return_object() { return Tarefa{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception();
+  };
+  std::coroutine_handle<promise_type> h;
+};
+
+class Executor;
+
+// Operação de I/O pendente: tenta() faz a chamada de sistema e devolve false com EAGAIN
+class Operacao
+{
+public:
+  Operacao(Executor &ex, int fd, bool escrita) : _ex(ex), _fd(fd), _escrita(escrita) {}
+  virtual ~Operacao() {}
+
+  bool await_ready() { return tenta(); }
+  void await_suspend(std::coroutine_handle<> h);
+  ssize_t await_resume() const { return _resultado; }
+
+  virtual bool tenta() = 0;
+  std::coroutine_handle<> corrotina() const { return _h; }
+
+protected:
+  // guarda o resultado de uma chamada. false se ela deve ser repetida quando o fd ficar pronto
+  bool conclui(ssize_t r);
+
+  Executor &_ex;
+  int _fd;
+  bool _escrita;
+  ssize_t _resultado = 0;
+  std::coroutine_handle<> _h;
+};
+
+class Leitura : public Operacao
+{
+public:
+  Leitura(Executor &ex, int fd, void *destino, size_t len) : Operacao(ex, fd, false), _destino(destino), _len(len) {}
+  bool tenta() override;
+
+private:
+  void *_destino;
+  size_t _len;
+};
+
+// escreve todos os len bytes (em quantas chamadas forem precisas) ou para no primeiro erro
+class Escrita : public Operacao
+{
+public:
+  Escrita(Executor &ex, int fd, const void *dados, size_t len) : Operacao(ex, fd, true), _dados(dados), _len(len) {}
+  bool tenta() override;
+
+private:
+  const void *_dados;
+  size_t _len;
+  size_t _enviados = 0;
+};
+
+class Aceitacao : public Operacao
+{
+public:
+  Aceitacao(Executor &ex, int fd) : Operacao(ex, fd, false) {}
+  bool tenta() override;
+};
+
+// conexão TCP não bloqueante: connect() e, com EINPROGRESS, espera o fd ficar gravavel e le o SO_ERROR
+class Conexao : public Operacao
+{
+public:
+  Conexao(Executor &ex, int fd, const sockaddr_in *destino) : Operacao(ex, fd, true), _destino(destino) {}
+  bool tenta() override;
+
+private:
+  const sockaddr_in *_destino;
+  bool _iniciada = false;
+};
+
+// espera haver dados (ou fim de conexão) no socket sem consumir nada, para só então pegar um buffer do pool
+class AguardaDados : public Operacao
+{
+public:
+  AguardaDados(Executor &ex, int fd) : Operacao(ex, fd, false) {}
+  bool tenta() override;
+};
+
+class RecepcaoUDP : public Operacao
+{
+public:
+  RecepcaoUDP(Executor &ex, int fd, void *destino, size_t len, sockaddr_in *origem)
+      : Operacao(ex, fd, false), _destino(destino), _len(len), _origem(origem) {}
+  bool tenta() override;
+
+private:
+  void *_destino;
+  size_t _len;
+  sockaddr_in *_origem;
+};
+
+class EnvioUDP : public Operacao
+{
+public:
+  EnvioUDP(Executor &ex, int fd, const void *dados, size_t len, const sockaddr_in *destino)
+      : Operacao(ex, fd, true), _dados(dados), _len(len), _destino(destino) {}
+  bool tenta() override;
+
+private:
+  const void *_dados;
+  size_t _len;
+  const sockaddr_in *_destino;
+};
+
+// Espera até o instante (ns, CLOCK_MONOTONIC)
+class Prazo
+{
+public:
+  Prazo(Executor &ex, uint64_t instante) : _ex(ex), _instante(instante) {}
+  bool await_ready() const;
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const {}
+
+private:
+  Executor &_ex;
+  uint64_t _instante;
+};
+
+// Devolve a vez: a corrotina volta para o fim da fila de prontas
+struct Cessao
+{
+  Executor &ex;
+  bool await_ready() const { return false; }
+  void await_suspend(std::coroutine_handle<> h);
+  void await_resume() const {}
+};
+
+class Executor
+{
+public:
+  Executor();
+  ~Executor(); // destroi as corrotinas que ainda estão esperando
+  Executor(const Executor &) = delete;
+  Executor &operator=(const Executor &) = delete;
+
+  // agenda uma corrotina nova. ela começa a rodar na proxima volta de roda()
+  void inicia(Tarefa tarefa);
+
+  // atende as corrotinas até não sobrar nenhuma esperando ou até para()
+  void roda();
+
+  // encerra roda() na proxima volta. pode ser chamada de outro thread ou de um tratador de sinal
+  void para();
+
+  static uint64_t agora(); // ns, CLOCK_MONOTONIC
+
+  Leitura le(int fd, void *destino, size_t len) { return Leitura(*this, fd, destino, len); }
+  Escrita escreve(int fd, const void *dados, size_t len) { return Escrita(*this, fd, dados, len); }
+  Aceitacao aceita(int fd) { return Aceitacao(*this, fd); }
+  Conexao conecta(int fd, const sockaddr_in *destino) { return Conexao(*this, fd, destino); }
+  AguardaDados aguardaDados(int fd) { return AguardaDados(*this, fd); }
+  RecepcaoUDP recebe(int fd, void *destino, size_t len, sockaddr_in *origem)
+  {
+    return RecepcaoUDP(*this, fd, destino, len, origem);
+  }
+  EnvioUDP envia(int fd, const void *dados, size_t len, const sockaddr_in *destino)
+  {
+    return EnvioUDP(*this, fd, dados, len, destino);
+  }
+  Prazo ate(uint64_t instante) { return Prazo(*this, instante); }
+  Prazo dorme(uint64_t ns) { return Prazo(*this, agora() + ns); }
+  Cessao cede() { return Cessao{*this}; }
+
+  // fecha o fd e esquece o seu registro. não pode haver operação pendente nele
+  void fecha(int fd);
+
+  // contadores desde a criação
+  uint64_t voltas() const { return _voltas; }       // chamadas ao epoll_wait
+  uint64_t retomadas() const { return _retomadas; } // corrotinas retomadas
+  uint64_t esperas() const { return _esperas; }     // operações que precisaram suspender
+
+private:
+  friend class Operacao;
+  friend class Prazo;
+  friend struct Cessao;
+
+  struct RegistroFd
+  {
+    Operacao *leitura = nullptr;
+    Operacao *escrita = nullptr;
+    bool registrado = false;
+  };
+
+  struct Despertar
+  {
+    uint64_t instante;
+    uint64_t ordem; // desempate: prazos iguais acordam na ordem em que foram pedidos
+    std::coroutine_handle<> h;
+    bool operator>(const Despertar &outro) const
+    {
+      return instante != outro.instante ? instante > outro.instante : ordem > outro.ordem;
+    }
+  };
+
+  void aguarda(Operacao *operacao, int fd, bool escrita);
+  void agenda(uint64_t instante, std::coroutine_handle<> h);
+  void pronta(std::coroutine_handle<> h) { _prontas.push_back(h); }
+  void armaTimer();
+  void atendeFd(int fd, uint32_t eventos);
+
+  int _epoll;
+  int _timer;  // timerfd armado no prazo mais proximo do heap
+  int _aviso;  // eventfd de para()
+  uint64_t _timerArmado = 0;
+  bool _parar = false; // escrito por para(), de qualquer thread
+  std::vector<RegistroFd> _fds; // indexado pelo fd
+  std::priority_queue<Despertar, std::vector<Despertar>, std::greater<Despertar>> _prazos;
+  std::deque<std::coroutine_handle<>> _prontas;
+  size_t _pendentes = 0; // operações de I/O suspensas
+  uint64_t _ordem = 0;
+  uint64_t _voltas = 0;
+  uint64_t _retomadas = 0;
+  uint64_t _esperas = 0;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+ * Histograma de latencia compacto, um por controlador nativo
+ *
+ * Faixas log-lineares em us: exatas até 7 us e, a partir dai, 4 faixas por oitava (erro de até 25% no valor
+ * devolvido pelos percentis), até ~1 s. 320 bytes por histograma, sem alocação: cabe um por instancia mesmo com
+ * milhares delas, e os de varias instancias se somam para o agregado.
+ */
+
+#ifndef Latencia_h
+#define Latencia_h
+
+#include <stdint.h>
+
+#define FAIXAS_LATENCIA 80
+
+struct HistogramaLatencia
+{
+  uint32_t contagens[FAIXAS_LATENCIA] = {};
+  uint32_t total = 0;
+  uint32_t maximo = 0;
+  uint64_t soma = 0;
+
+  static int faixa(uint32_t us)
+  {
+    if (us < 4)
+    {
+      return us;
+    }
+    int oitava = 31 - __builtin_clz(us);
+    int indice = 4 * (oitava - 1) + ((us >> (oitava - 2)) & 3);
+    return indice < FAIXAS_LATENCIA ? indice : FAIXAS_LATENCIA - 1;
+  }
+
+  // maior valor que cai na faixa
+  static uint32_t limite(int indice)
+  {
+    if (indice < 4)
+    {
+      return indice;
+    }
+    int oitava = indice / 4 + 1;
+    return ((4u + indice % 4) << (oitava - 2)) + (1u << (oitava - 2)) - 1;
+  }
+
+  void observa(uint32_t us)
+  {
+    contagens[faixa(us)]++;
+    total++;
+    soma += us;
+    maximo = us > maximo ? us : maximo;
+  }
+
+  // limite da faixa que contem o percentil p (0 a 1). 0 sem observações
+  uint32_t percentil(double p) const
+  {
+    uint64_t alvo = (uint64_t)(p * total);
+    uint64_t acumulado = 0;
+    for (int i = 0; i < FAIXAS_LATENCIA; i++)
+    {
+      acumulado += contagens[i];
+      if (acumulado > alvo)
+      {
+        uint32_t valor = limite(i);
+        return valor < maximo ? valor : maximo;
+      }
+    }
+    return maximo;
+  }
+
+  void acrescenta(const HistogramaLatencia &outro)
+  {
+    for (int i = 0; i < FAIXAS_LATENCIA; i++)
+    {
+      contagens[i] += outro.contagens[i];
+    }
+    total += outro.total;
+    soma += outro.soma;
+    maximo = outro.maximo > maximo ? outro.maximo : maximo;
+  }
+};
+
+#endif
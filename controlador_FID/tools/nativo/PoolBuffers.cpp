@@ -0,0 +1,35 @@
+/*
+ * Pool de buffers de tamanho fixo, compartilhado pelos controladores nativos de um Executor
+ */
+
+#include "PoolBuffers.h"
+
+PoolBuffers::~PoolBuffers()
+{
+  for (char *bloco : _criados)
+  {
+    delete[] bloco;
+  }
+}
+
+char *PoolBuffers::pega()
+{
+  if (_livres.empty())
+  {
+    _criados.push_back(new char[_tamanho]);
+    _livres.reserve(_criados.capacity()); // devolve() não aloca
+    _livres.push_back(_criados.back());
+  }
+  char *bloco = _livres.back();
+  _livres.pop_back();
+  if (emUso() > _maximoEmUso)
+  {
+    _maximoEmUso = emUso();
+  }
+  return bloco;
+}
+
+void PoolBuffers::devolve(char *bloco)
+{
+  _livres.push_back(bloco);
+}
@@ -0,0 +1,57 @@
+/*
+ * Pool de buffers de tamanho fixo, compartilhado pelos controladores nativos de um Executor
+ *
+ * Um controlador parado não precisa de buffer: as corrotinas esperam dados com aguardaDados() e só então pegam um
+ * bloco para a leitura, a interpretação e a resposta, devolvendo-o ao fim do ciclo. com centenas de instancias e
+ * poucas ativas ao mesmo tempo, a memoria de buffers acompanha o numero de comandos em andamento, não o de
+ * instancias. os blocos são criados sob demanda e nunca liberados antes do pool, como num pool estatico.
+ *
+ * Sem lock: cada Executor (thread) tem o seu pool.
+ */
+
+#ifndef PoolBuffers_h
+#define PoolBuffers_h
+
+#include <stddef.h>
+#include <vector>
+
+class PoolBuffers
+{
+public:
+  explicit PoolBuffers(size_t tamanho) : _tamanho(tamanho) {}
+  ~PoolBuffers();
+  PoolBuffers(const PoolBuffers &) = delete;
+  PoolBuffers &operator=(const PoolBuffers &) = delete;
+
+  char *pega();
+  void devolve(char *bloco);
+
+  size_t tamanho() const { return _tamanho; }
+  size_t criados() const { return _criados.size(); }
+  size_t emUso() const { return _criados.size() - _livres.size(); }
+  size_t maximoEmUso() const { return _maximoEmUso; }
+
+private:
+  size_t _tamanho;
+  std::vector<char *> _criados;
+  std::vector<char *> _livres;
+  size_t _maximoEmUso = 0;
+};
+
+// Bloco emprestado enquanto o objeto existir. numa corrotina, volta ao pool também se o frame for destruido
+class Emprestimo
+{
+public:
+  explicit Emprestimo(PoolBuffers &pool) : _pool(pool), _bloco(pool.pega()) {}
+  ~Emprestimo() { _pool.devolve(_bloco); }
+  Emprestimo(const Emprestimo &) = delete;
+  Emprestimo &operator=(const Emprestimo &) = delete;
+
+  char *bloco() const { return _bloco; }
+
+private:
+  PoolBuffers &_pool;
+  char *_bloco;
+};
+
+#endif
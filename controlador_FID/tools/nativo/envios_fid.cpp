@@ -0,0 +1,195 @@
+/*
+ * Escritas no socket e segmentos TCP por comando, com e sem o BufferSaida, medidos no controlador nativo (Linux)
+ *
+ * Sobe dois ControladorNativo no loopback, um com semAcumular (cada adiciona* vai para o socket na hora, como os
+ * cl.print de antes do BufferSaida) e um como o firmware (uma escrita por bloco recebido), os dois com TCP_NODELAY,
+ * o pior caso: nenhuma escrita espera o ACK da anterior para sair junto. para cada comando, um cliente envia o
+ * comando, lê a resposta até a conexão ficar quieta e conta as escritas do controlador e os segmentos com dados
+ * que chegaram (tcpi_data_segs_in do TCP_INFO do cliente). o ultimo caso manda 8 W num unico bloco, como um host
+ * que enfileira comandos.
+ *
+ * Confere que as respostas são as mesmas nos dois modos e que, com o buffer, cada bloco recebido sai numa unica
+ * escrita. devolve 1 se não.
+ *
+ * uso:
+ *   envios_fid [porta]   (padrão 6990; usa porta e porta + 1 em 127.0.0.1)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++20 -O2 -pthread -Ilib/BufferSaida -Ilib/Configuracoes -Ilib/Protocolo -Ilib/Autenticacao \
+ *       -Ilib/Inclinacao -Itools/nativo -Itools/simulacao tools/nativo/envios_fid.cpp tools/nativo/Executor.cpp \
+ *       tools/nativo/ControladorNativo.cpp tools/nativo/PoolBuffers.cpp tools/simulacao/Simulador.cpp \
+ *       lib/BufferSaida/BufferSaida.cpp lib/Configuracoes/Configuracoes.cpp lib/Protocolo/Protocolo.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o envios_fid
+ */
+
+#include <arpa/inet.h>
+#include <linux/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <memory>
+#include <string>
+#include <thread>
+#include "ControladorNativo.h"
+#include "Executor.h"
+#include "PoolBuffers.h"
+
+#define QUIETO_MS 100 // sem dados por este tempo, a resposta terminou
+
+struct Caso
+{
+  const char *nome;
+  std::string comando;
+};
+
+struct Medida
+{
+  uint32_t escritas;
+  uint32_t envios;
+  uint32_t segmentos;
+  std::string resposta;
+};
+
+struct Modo
+{
+  Executor ex;
+  PoolBuffers pool{TAM_BLOCO_NATIVO};
+  std::unique_ptr<ControladorNativo> controlador;
+  std::thread executor;
+  int fd = -1;
+};
+
+static uint32_t segmentosRecebidos(int fd)
+{
+  tcp_info info = {};
+  socklen_t len = sizeof(info);
+  getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len);
+  return info.tcpi_data_segs_in;
+}
+
+static bool inicia(Modo &modo, bool semAcumular, uint16_t porta)
+{
+  ConfiguracaoNativo configuracao;
+  configuracao.taxaAdc = 0; // leituras paradas: o R e o S respondem sempre o mesmo
+  configuracao.semAcumular = semAcumular;
+  configuracao.semNagle = true;
+  modo.controlador = std::make_unique<ControladorNativo>(modo.ex, modo.pool, configuracao);
+  if (!modo.controlador->inicia("127.0.0.1", porta))
+  {
+    return false;
+  }
+  modo.executor = std::thread([&modo]() { modo.ex.roda(); });
+
+  modo.fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in destino = {};
+  destino.sin_family = AF_INET;
+  destino.sin_port = htons(porta);
+  inet_pton(AF_INET, "127.0.0.1", &destino.sin_addr);
+  int sim = 1;
+  setsockopt(modo.fd, IPPROTO_TCP, TCP_NODELAY, &sim, sizeof(sim));
+  return connect(modo.fd, (sockaddr *)&destino, sizeof(destino)) == 0;
+}
+
+static void encerra(Modo &modo)
+{
+  close(modo.fd);
+  modo.ex.para();
+  modo.executor.join();
+}
+
+// os contadores do controlador são lidos de outro thread sem sincronizar: depois de QUIETO_MS sem dados, o
+// executor já terminou o bloco
+static Medida mede(Modo &modo, const std::string &comando)
+{
+  Medida medida;
+  uint32_t escritas = modo.controlador->escritas();
+  uint32_t envios = modo.controlador->envios();
+  uint32_t segmentos = segmentosRecebidos(modo.fd);
+  send(modo.fd, comando.data(), comando.size(), MSG_NOSIGNAL);
+  pollfd espera = {modo.fd, POLLIN, 0};
+  char bloco[4096];
+  while (poll(&espera, 1, QUIETO_MS) > 0)
+  {
+    ssize_t lidos = recv(modo.fd, bloco, sizeof(bloco), 0);
+    if (lidos <= 0)
+    {
+      break;
+    }
+    medida.resposta.append(bloco, lidos);
+  }
+  medida.escritas = modo.controlador->escritas() - escritas;
+  medida.envios = modo.controlador->envios() - envios;
+  medida.segmentos = segmentosRecebidos(modo.fd) - segmentos;
+  return medida;
+}
+
+// W de 8 canais com todos os canais em valor
+static std::string comandoW(int valor)
+{
+  char comando[64];
+  int n = 0;
+  comando[n++] = 'W';
+  for (int canal = 0; canal < 8; canal++)
+  {
+    n += snprintf(comando + n, sizeof(comando) - n, "%c%04d", 'A' + canal, valor);
+  }
+  comando[n++] = '\r';
+  return std::string(comando, n);
+}
+
+int main(int argc, char **argv)
+{
+  uint16_t porta = argc > 1 ? atoi(argv[1]) : 6990;
+  Modo antes;
+  Modo depois;
+  if (!inicia(antes, true, porta) || !inicia(depois, false, porta + 1))
+  {
+    fprintf(stderr, "não foi possivel abrir as portas %u e %u\n", porta, porta + 1);
+    return 1;
+  }
+
+  std::string rajada;
+  for (int i = 0; i < 8; i++)
+  {
+    rajada += comandoW(100 * (i + 2));
+  }
+  const Caso casos[] = {
+      {"W eco completo", comandoW(1)},
+      {"W com erro (E3)", "WA0001B0X01C0001D0001E0001F0001G0001H0001\r"},
+      {"D", "D03=1234\r"},
+      {"R", "R\r"},
+      {"S", "S\r"},
+      {"C (lista)", "C\r"},
+      {"Cecho=curto", "Cecho=curto\r"},
+      {"W eco curto", comandoW(2)},
+      {"Cecho=completo", "Cecho=completo\r"},
+      {"8 W num bloco", rajada},
+  };
+
+  bool ok = true;
+  printf("%-16s %8s %6s | %18s | %18s\n", "", "", "", "antes (cl.print)", "depois (buffer)");
+  printf("%-16s %8s %6s | %8s %9s | %8s %9s\n", "comando", "escritas", "bytes", "envios", "segmentos", "envios",
+         "segmentos");
+  for (const Caso &caso : casos)
+  {
+    Medida a = mede(antes, caso.comando);
+    Medida d = mede(depois, caso.comando);
+    // o S difere só nos contadores de saida, que são justamente o que muda entre os modos
+    bool mesma = a.resposta == d.resposta || caso.comando[0] == 'S';
+    printf("%-16s %8u %6zu | %8u %9u | %8u %9u%s\n", caso.nome, d.escritas, d.resposta.size(), a.envios, a.segmentos,
+           d.envios, d.segmentos, mesma ? "" : "  respostas diferentes");
+    ok = ok && mesma && a.escritas == d.escritas && d.envios == 1;
+  }
+
+  encerra(antes);
+  encerra(depois);
+  if (!ok)
+  {
+    fprintf(stderr, "respostas diferentes entre os modos ou mais de uma escrita por bloco com o buffer\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,408 @@
+/*
+ * Frota simulada de controladores_FID, para rodar no host (Linux): N controladores num unico processo
+ *
+ * Cada controlador (ControladorNativo) tem o seu estado, os seus DACs, ADC e planta simulados e atende o protocolo
+ * do firmware em TCP e UDP no seu proprio endereço: por padrão um alias de IP por instancia, todos na mesma porta,
+ * como as placas na rede da planta (no 127.0.0.0/8 qualquer endereço já responde no loopback; fora dele os aliases
+ * devem existir na interface, ex. "ip addr add 10.0.1.5/16 dev eth0"). com -p, um endereço e portas consecutivas.
+ * os controladores são divididos entre poucos threads, cada um com o seu Executor (epoll) e o seu PoolBuffers, de
+ * modo que uma instancia ociosa só ocupa o seu estado e os frames das corrotinas.
+ *
+ * Com -g, cada instancia recebe também um cliente no mesmo executor que envia comandos D à taxa pedida e mede o
+ * tempo de ida e volta de cada um, para testar a frota sem o software de supervisão. a cada periodo de relatorio
+ * escreve a vazão agregada de comandos, a memoria (RSS e blocos do pool) e as latencias: a do atendimento dentro
+ * das instancias e, com -g, a de ida e volta, no agregado e na distribuição entre instancias (p99 da mediana e da
+ * pior). no fim escreve as instancias com o maior p99.
+ *
+ * uso:
+ *   frota_fid [opções] endereco_inicial porta controladores
+ *     -t threads      executores (padrão 1)
+ *     -c canais       canais por controlador (padrão 8)
+ *     -a taxa_adc     quadros por segundo da aquisição de cada controlador (padrão 100; 0 desliga)
+ *     -p              portas consecutivas no endereço inicial em vez de aliases de IP
+ *     -g por_segundo  comandos D por segundo do cliente de carga de cada instancia (padrão 0, sem carga)
+ *     -d segundos     duração (padrão 0, até Ctrl+C)
+ *     -r segundos     periodo do relatorio (padrão 10)
+ *     -l arquivo      grava "endereco porta" de cada instancia, para configurar o software de supervisão
+ *   frota_fid -t 2 -g 20 -d 60 127.0.1.1 6969 500
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++20 -O2 -pthread -Ilib/BufferSaida -Ilib/Configuracoes -Ilib/Protocolo -Ilib/Autenticacao \
+ *       -Ilib/Inclinacao -Itools/nativo -Itools/simulacao tools/nativo/frota_fid.cpp tools/nativo/Executor.cpp \
+ *       tools/nativo/ControladorNativo.cpp tools/nativo/PoolBuffers.cpp tools/simulacao/Simulador.cpp \
+ *       lib/BufferSaida/BufferSaida.cpp lib/Configuracoes/Configuracoes.cpp lib/Protocolo/Protocolo.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o frota_fid
+ */
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ControladorNativo.h"
+#include "Executor.h"
+#include "Latencia.h"
+#include "PoolBuffers.h"
+
+#define PIORES 10 // instancias listadas no fim
+
+struct Instancia
+{
+  std::string endereco;
+  uint16_t porta;
+  int executor;
+  std::unique_ptr<ControladorNativo> controlador;
+  HistogramaLatencia idaVolta; // do cliente de carga
+  uint32_t enviados = 0;
+  uint32_t falhas = 0;  // conexão recusada ou encerrada
+  uint32_t atrasos = 0; // envios que sairam depois do instante previsto por falta de resposta
+};
+
+static std::vector<std::unique_ptr<Executor>> executores;
+static std::vector<std::unique_ptr<PoolBuffers>> pools;
+static std::vector<Instancia> instancias;
+
+static void encerra(int)
+{
+  for (auto &ex : executores)
+  {
+    ex->para();
+  }
+}
+
+static size_t memoriaResidente()
+{
+  FILE *f = fopen("/proc/self/statm", "r");
+  unsigned long total = 0, residentes = 0;
+  if (f != nullptr)
+  {
+    if (fscanf(f, "%lu %lu", &total, &residentes) != 2)
+    {
+      residentes = 0;
+    }
+    fclose(f);
+  }
+  return residentes * sysconf(_SC_PAGESIZE);
+}
+
+// cliente de carga de uma instancia: um comando D por periodo, esperando a resposta antes do proximo.
+// a resposta do D (eco completo) termina em '\r'
+static Tarefa carga(Executor &ex, Instancia &instancia, uint32_t taxa, int canais, uint32_t semente)
+{
+  sockaddr_in destino = {};
+  destino.sin_family = AF_INET;
+  destino.sin_port = htons(instancia.porta);
+  inet_pton(AF_INET, instancia.endereco.c_str(), &destino.sin_addr);
+  uint64_t periodo = 1000000000ull / taxa;
+  uint64_t proximo = Executor::agora() + (semente * 2654435761u) % periodo; // espalha as instancias no periodo
+  char comando[16];
+  char resposta[128];
+  for (;;)
+  {
+    co_await ex.ate(proximo);
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0 || co_await ex.conecta(fd, &destino) != 0)
+    {
+      instancia.falhas++;
+      if (fd >= 0)
+      {
+        ex.fecha(fd);
+      }
+      proximo = Executor::agora() + 1000000000ull; // tenta de novo em 1 s
+      continue;
+    }
+    for (;;)
+    {
+      semente = semente * 1103515245 + 12345;
+      int len = snprintf(comando, sizeof(comando), "D%02d=%04d\r", (semente >> 8) % canais, (semente >> 16) % 4096);
+      uint64_t envio = Executor::agora();
+      if (co_await ex.escreve(fd, comando, len) != len)
+      {
+        break;
+      }
+      bool completa = false;
+      while (!completa)
+      {
+        ssize_t lidos = co_await ex.le(fd, resposta, sizeof(resposta));
+        if (lidos <= 0)
+        {
+          break;
+        }
+        completa = memchr(resposta, '\r', lidos) != nullptr;
+      }
+      if (!completa)
+      {
+        break;
+      }
+      uint64_t agora = Executor::agora();
+      instancia.idaVolta.observa((uint32_t)((agora - envio) / 1000));
+      instancia.enviados++;
+      proximo += periodo;
+      if (proximo < agora)
+      {
+        instancia.atrasos++;
+        proximo = agora;
+      }
+      co_await ex.ate(proximo);
+    }
+    instancia.falhas++;
+    ex.fecha(fd);
+  }
+}
+
+struct Relatorio
+{
+  uint64_t comandos = 0;
+  uint64_t instante = 0;
+};
+
+// lido de outros threads sem sincronizar: os contadores só crescem e o relatorio tolera uma leitura atrasada
+static void relata(Relatorio &anterior, uint64_t inicio, size_t memoriaBase, bool carga, bool final)
+{
+  uint64_t comandos = 0, quadros = 0, atrasosAdc = 0, clientes = 0, enviados = 0, falhas = 0, atrasos = 0;
+  HistogramaLatencia atendimento, idaVolta;
+  std::vector<std::pair<uint32_t, size_t>> p99; // (p99, instancia)
+  for (size_t i = 0; i < instancias.size(); i++)
+  {
+    const Instancia &inst = instancias[i];
+    const ControladorNativo &c = *inst.controlador;
+    comandos += c.comandos();
+    quadros += c.quadros();
+    atrasosAdc += c.atrasos();
+    clientes += c.clientes();
+    enviados += inst.enviados;
+    falhas += inst.falhas;
+    atrasos += inst.atrasos;
+    atendimento.acrescenta(c.atendimento());
+    idaVolta.acrescenta(inst.idaVolta);
+    const HistogramaLatencia &h = carga ? inst.idaVolta : c.atendimento();
+    if (h.total > 0)
+    {
+      p99.push_back({h.percentil(0.99), i});
+    }
+  }
+  uint64_t agora = Executor::agora();
+  double intervalo = (agora - anterior.instante) * 1e-9;
+  size_t blocos = 0, maximoBlocos = 0;
+  for (auto &pool : pools)
+  {
+    blocos += pool->criados();
+    maximoBlocos += pool->maximoEmUso();
+  }
+  size_t memoria = memoriaResidente();
+  printf("%.0f s: %.0f comandos/s (total %llu), clientes=%llu adc_quadros=%llu adc_atrasos=%llu\n",
+         (agora - inicio) * 1e-9, intervalo > 0 ? (comandos - anterior.comandos) / intervalo : 0.0,
+         (unsigned long long)comandos, (unsigned long long)clientes, (unsigned long long)quadros,
+         (unsigned long long)atrasosAdc);
+  printf("  memoria: rss=%zu kB, %zu B por instancia, pool=%zu blocos de %d B (maximo em uso %zu)\n", memoria / 1024,
+         memoria > memoriaBase ? (memoria - memoriaBase) / instancias.size() : 0, blocos, TAM_BLOCO_NATIVO,
+         maximoBlocos);
+  printf("  atendimento: p50=%u p99=%u max=%u us\n", atendimento.percentil(0.5), atendimento.percentil(0.99),
+         atendimento.maximo);
+  if (carga)
+  {
+    printf("  ida e volta: enviados=%llu falhas=%llu atrasos=%llu p50=%u p99=%u max=%u us\n",
+           (unsigned long long)enviados, (unsigned long long)falhas, (unsigned long long)atrasos,
+           idaVolta.percentil(0.5), idaVolta.percentil(0.99), idaVolta.maximo);
+  }
+  std::sort(p99.begin(), p99.end());
+  if (!p99.empty())
+  {
+    const Instancia &pior = instancias[p99.back().second];
+    printf("  p99 por instancia (%s): mediana=%u pior=%u us (%s:%u)\n", carga ? "ida e volta" : "atendimento",
+           p99[p99.size() / 2].first, p99.back().first, pior.endereco.c_str(), pior.porta);
+  }
+  if (final)
+  {
+    printf("instancias com maior p99:\n%-16s %6s %10s %8s %8s %8s\n", "endereco", "porta", "comandos", "p50", "p99",
+           "max");
+    for (size_t n = 0; n < PIORES && n < p99.size(); n++)
+    {
+      const Instancia &inst = instancias[p99[p99.size() - 1 - n].second];
+      const HistogramaLatencia &h = carga ? inst.idaVolta : inst.controlador->atendimento();
+      printf("%-16s %6u %10u %8u %8u %8u\n", inst.endereco.c_str(), inst.porta, inst.controlador->comandos(),
+             h.percentil(0.5), h.percentil(0.99), h.maximo);
+    }
+  }
+  fflush(stdout);
+  anterior.comandos = comandos;
+  anterior.instante = agora;
+}
+
+static Tarefa relatorio(Executor &ex, uint64_t periodo, uint64_t inicio, size_t memoriaBase, bool carga)
+{
+  Relatorio anterior;
+  anterior.instante = inicio;
+  for (;;)
+  {
+    co_await ex.dorme(periodo);
+    relata(anterior, inicio, memoriaBase, carga, false);
+  }
+}
+
+static Tarefa duracao(uint64_t ns)
+{
+  co_await executores[0]->dorme(ns);
+  encerra(0);
+}
+
+int main(int argc, char **argv)
+{
+  int threads = 1;
+  bool portas = false;
+  uint32_t taxaCarga = 0;
+  uint32_t segundos = 0;
+  uint32_t periodoRelatorio = 10;
+  const char *arquivoLista = nullptr;
+  ConfiguracaoNativo configuracao;
+  configuracao.taxaAdc = 100;
+  configuracao.laco.tau = 0.020;
+  configuracao.laco.ruido = 0.001;
+  int opcao;
+  while ((opcao = getopt(argc, argv, "t:c:a:pg:d:r:l:")) != -1)
+  {
+    switch (opcao)
+    {
+    case 't':
+      threads = atoi(optarg);
+      break;
+    case 'c':
+      configuracao.canais = atoi(optarg);
+      break;
+    case 'a':
+      configuracao.taxaAdc = atoi(optarg);
+      break;
+    case 'p':
+      portas = true;
+      break;
+    case 'g':
+      taxaCarga = atoi(optarg);
+      break;
+    case 'd':
+      segundos = atoi(optarg);
+      break;
+    case 'r':
+      periodoRelatorio = atoi(optarg);
+      break;
+    case 'l':
+      arquivoLista = optarg;
+      break;
+    default:
+      optind = argc + 1;
+      break;
+    }
+  }
+  if (argc - optind != 3)
+  {
+    fprintf(stderr, "uso: %s [-t threads] [-c canais] [-a taxa_adc] [-p] [-g por_segundo] [-d segundos] "
+                    "[-r segundos] [-l arquivo] endereco_inicial porta controladores\n",
+            argv[0]);
+    return 1;
+  }
+  in_addr base;
+  int porta = atoi(argv[optind + 1]);
+  int quantidade = atoi(argv[optind + 2]);
+  if (inet_pton(AF_INET, argv[optind], &base) != 1 || threads < 1 || quantidade < 1 || porta < 1 ||
+      (portas && porta + quantidade > 65536) || porta > 65535 || configuracao.canais < 1 ||
+      configuracao.canais > CANAIS_NATIVO_MAX || periodoRelatorio < 1)
+  {
+    fprintf(stderr, "endereço IPv4, threads e controladores positivos, portas até 65535 e canais de 1 a %d\n",
+            CANAIS_NATIVO_MAX);
+    return 1;
+  }
+
+  // por instancia: TCP e UDP de escuta, a conexão atendida e, com carga, o lado do cliente
+  rlimit limite;
+  if (getrlimit(RLIMIT_NOFILE, &limite) == 0 && limite.rlim_cur < limite.rlim_max)
+  {
+    limite.rlim_cur = limite.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limite);
+  }
+
+  size_t memoriaBase = memoriaResidente();
+  for (int t = 0; t < threads; t++)
+  {
+    executores.emplace_back(new Executor());
+    pools.emplace_back(new PoolBuffers(TAM_BLOCO_NATIVO));
+  }
+  instancias.resize(quantidade);
+  FILE *lista = arquivoLista != nullptr ? fopen(arquivoLista, "w") : nullptr;
+  for (int i = 0; i < quantidade; i++)
+  {
+    Instancia &inst = instancias[i];
+    char endereco[INET_ADDRSTRLEN];
+    in_addr alias = base;
+    if (!portas)
+    {
+      alias.s_addr = htonl(ntohl(base.s_addr) + i);
+    }
+    inet_ntop(AF_INET, &alias, endereco, sizeof(endereco));
+    inst.endereco = endereco;
+    inst.porta = portas ? porta + i : porta;
+    inst.executor = i % threads;
+    configuracao.semente = i + 1;
+    inst.controlador.reset(new ControladorNativo(*executores[inst.executor], *pools[inst.executor], configuracao));
+    if (!inst.controlador->inicia(endereco, inst.porta))
+    {
+      fprintf(stderr, "não foi possivel abrir %s:%u (%s)\n", endereco, inst.porta,
+              portas ? "porta ocupada?" : "alias de IP inexistente?");
+      return 1;
+    }
+    if (lista != nullptr)
+    {
+      fprintf(lista, "%s %u\n", endereco, inst.porta);
+    }
+  }
+  if (lista != nullptr)
+  {
+    fclose(lista);
+  }
+  if (taxaCarga > 0)
+  {
+    for (int i = 0; i < quantidade; i++)
+    {
+      Executor &ex = *executores[instancias[i].executor];
+      ex.inicia(carga(ex, instancias[i], taxaCarga, configuracao.canais, i + 1));
+    }
+  }
+  uint64_t inicio = Executor::agora();
+  executores[0]->inicia(relatorio(*executores[0], periodoRelatorio * 1000000000ull, inicio, memoriaBase,
+                                  taxaCarga > 0));
+  if (segundos > 0)
+  {
+    executores[0]->inicia(duracao(segundos * 1000000000ull));
+  }
+  signal(SIGINT, encerra);
+  signal(SIGTERM, encerra);
+  printf("%d controladores de %s:%u a %s:%u, %d threads, adc a %u quadros/s, carga de %u comandos/s por instancia\n",
+         quantidade, instancias.front().endereco.c_str(), instancias.front().porta, instancias.back().endereco.c_str(),
+         instancias.back().porta, threads, configuracao.taxaAdc, taxaCarga);
+  fflush(stdout);
+
+  std::vector<std::thread> trabalhadores;
+  for (int t = 1; t < threads; t++)
+  {
+    trabalhadores.emplace_back([t]() { executores[t]->roda(); });
+  }
+  executores[0]->roda();
+  encerra(0); // os outros executores param junto com o primeiro (duração ou sinal)
+  for (std::thread &t : trabalhadores)
+  {
+    t.join();
+  }
+  Relatorio anterior;
+  anterior.instante = inicio;
+  relata(anterior, inicio, memoriaBase, taxaCarga > 0, true);
+  executores.clear(); // destroi as corrotinas (e devolve os blocos emprestados) antes dos controladores e pools
+  instancias.clear();
+  pools.clear();
+  return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * Jitter das atualizações dos DACs com e sem o worker dedicado, medido no host (Linux)
+ *
+ * Reproduz as duas organizações das tasks com threads SCHED_FIFO num unico CPU: um gerador manda um W por ms num
+ * socket e a "rede" (um Executor, no lugar da task TCP) interpreta cada bloco recebido e depois segue com o resto do
+ * ciclo (resposta, lwIP), um trecho de trabalho sorteado entre 0 e CARGA_MAXIMA.
+ *   antes:  como o firmware antes da divisão dos cores: cada W cria uma task (thread) de atualização na mesma
+ *           prioridade da task TCP e no mesmo core, que só roda quando a rede cede o CPU
+ *   depois: como hoje: um worker permanente com prioridade acima da rede, acordado por notificação (eventfd). no
+ *           ESP32 ele fica também no outro core; aqui, no mesmo CPU, só a prioridade o separa da rede, então a
+ *           medida é conservadora
+ * O instante de cada atualização é marcado no thread que a aplica. escreve o histograma dos intervalos entre
+ * atualizações consecutivas (o ideal é 1000 us) e os percentis do intervalo e da latencia desde o envio do W.
+ * com 2 ou mais CPUs os threads ficam todos no CPU 0, para a comparação ser a mesma.
+ *
+ * uso:
+ *   jitter_fid [segundos]   (padrão 5 por modo; precisa de permissão para SCHED_FIFO)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++20 -O2 -pthread -Itools/nativo tools/nativo/jitter_fid.cpp tools/nativo/Executor.cpp -o jitter_fid
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Executor.h"
+
+#define PERIODO_W 1000000     // ns entre comandos W
+#define CARGA_MAXIMA 1500000  // ns, maior trecho de trabalho da rede depois de um bloco (sorteado entre 0 e isso)
+#define PRIO_GERADOR 30
+#define PRIO_WORKER 20        // prioridadeDacs acima da rede
+#define PRIO_REDE 10          // a task de atualização de antes usa a mesma
+
+struct Medicao
+{
+  std::mutex trava;
+  std::vector<uint64_t> enviado; // instante do envio de cada W, indexado pela sequencia
+  std::vector<uint32_t> intervalos; // us
+  std::vector<uint32_t> latencias;  // us
+  uint64_t anterior = 0;
+
+  // no thread que aplica a atualização
+  void aplica(uint32_t seq)
+  {
+    uint64_t agora = Executor::agora();
+    std::lock_guard<std::mutex> guarda(trava);
+    if (anterior != 0)
+    {
+      intervalos.push_back((uint32_t)((agora - anterior) / 1000));
+    }
+    anterior = agora;
+    if (seq < enviado.size())
+    {
+      latencias.push_back((uint32_t)((agora - __atomic_load_n(&enviado[seq], __ATOMIC_ACQUIRE)) / 1000));
+    }
+  }
+};
+
+static bool prioridadesOk = true;
+
+static void fixa(int prioridade)
+{
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(0, &cpus);
+  sched_setaffinity(0, sizeof(cpus), &cpus);
+  sched_param p = {};
+  p.sched_priority = prioridade;
+  if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &p) != 0)
+  {
+    prioridadesOk = false;
+  }
+}
+
+struct Contexto
+{
+  bool dedicado;
+  int aviso;                  // eventfd do worker
+  volatile uint32_t ultimo;   // sequencia do ultimo W, lida pelo worker
+  Medicao *medicao;
+};
+
+static Contexto *contextoAtual;
+
+// antes: uma task por atualização
+static void *atualizacao(void *seq)
+{
+  contextoAtual->medicao->aplica((uint32_t)(uintptr_t)seq);
+  return NULL;
+}
+
+static void comando(Contexto &contexto, uint32_t seq)
+{
+  if (contexto.dedicado)
+  {
+    contexto.ultimo = seq;
+    uint64_t um = 1;
+    ssize_t r = write(contexto.aviso, &um, sizeof(um));
+    (void)r;
+    return;
+  }
+  pthread_attr_t atributos;
+  pthread_attr_init(&atributos);
+  pthread_attr_setdetachstate(&atributos, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setinheritsched(&atributos, PTHREAD_INHERIT_SCHED); // mesma prioridade da rede
+  pthread_t t;
+  pthread_create(&t, &atributos, atualizacao, (void *)(uintptr_t)seq);
+  pthread_attr_destroy(&atributos);
+}
+
+static Tarefa rede(Executor &ex, int fd, Contexto &contexto)
+{
+  uint32_t semente = 1;
+  char bloco[256];
+  char linha[32];
+  int usado = 0;
+  for (;;)
+  {
+    ssize_t lidos = co_await ex.le(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      break;
+    }
+    for (ssize_t i = 0; i < lidos; i++)
+    {
+      if (bloco[i] != '\r')
+      {
+        linha[usado < (int)sizeof(linha) - 1 ? usado++ : usado] = bloco[i];
+        continue;
+      }
+      linha[usado] = '\0';
+      usado = 0;
+      comando(contexto, (uint32_t)strtoul(linha + 1, NULL, 10));
+    }
+    semente = semente * 1103515245 + 12345;
+    uint64_t fim = Executor::agora() + (semente >> 8) % CARGA_MAXIMA;
+    while (Executor::agora() < fim)
+    {
+    }
+  }
+}
+
+static uint32_t percentil(std::vector<uint32_t> v, double p)
+{
+  if (v.empty())
+  {
+    return 0;
+  }
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static bool mede(bool dedicado, int segundos)
+{
+  Medicao medicao;
+  uint32_t total = segundos * (1000000000 / PERIODO_W);
+  medicao.enviado.assign(total, 0);
+  int par[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, par) != 0)
+  {
+    return false;
+  }
+  Contexto contexto = {dedicado, eventfd(0, EFD_CLOEXEC), 0, &medicao};
+  contextoAtual = &contexto;
+
+  bool fim = false;
+  std::thread worker;
+  if (dedicado)
+  {
+    worker = std::thread([&]() {
+      fixa(PRIO_WORKER);
+      uint64_t n;
+      while (read(contexto.aviso, &n, sizeof(n)) == sizeof(n) && !__atomic_load_n(&fim, __ATOMIC_ACQUIRE))
+      {
+        medicao.aplica(contexto.ultimo);
+      }
+    });
+  }
+  Executor ex;
+  std::thread executor([&]() {
+    fixa(PRIO_REDE);
+    ex.inicia(rede(ex, par[1], contexto));
+    ex.roda();
+  });
+
+  std::thread gerador([&]() {
+    fixa(PRIO_GERADOR);
+    timespec proximo;
+    clock_gettime(CLOCK_MONOTONIC, &proximo);
+    char w[16];
+    for (uint32_t seq = 0; seq < total; seq++)
+    {
+      proximo.tv_nsec += PERIODO_W;
+      if (proximo.tv_nsec >= 1000000000)
+      {
+        proximo.tv_nsec -= 1000000000;
+        proximo.tv_sec++;
+      }
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &proximo, NULL);
+      int len = snprintf(w, sizeof(w), "W%u\r", seq);
+      __atomic_store_n(&medicao.enviado[seq], Executor::agora(), __ATOMIC_RELEASE);
+      ssize_t r = send(par[0], w, len, MSG_NOSIGNAL);
+      (void)r;
+    }
+  });
+  gerador.join();
+  usleep(100000); // as ultimas atualizações
+  ex.para();
+  executor.join();
+  if (dedicado)
+  {
+    __atomic_store_n(&fim, true, __ATOMIC_RELEASE);
+    uint64_t um = 1;
+    ssize_t r = write(contexto.aviso, &um, sizeof(um));
+    (void)r;
+    worker.join();
+  }
+  close(par[0]);
+  close(par[1]);
+  close(contexto.aviso);
+
+  std::lock_guard<std::mutex> guarda(medicao.trava);
+  const uint32_t faixas[] = {250, 500, 750, 900, 1100, 1250, 1500, 2000, 3000, 5000};
+  const int nFaixas = sizeof(faixas) / sizeof(faixas[0]);
+  uint32_t contagens[nFaixas + 1] = {};
+  for (uint32_t us : medicao.intervalos)
+  {
+    int i = 0;
+    while (i < nFaixas && us >= faixas[i])
+    {
+      i++;
+    }
+    contagens[i]++;
+  }
+  printf("%s: %zu atualizações de %u W\n", dedicado ? "depois (worker dedicado, prioridade acima da rede)"
+                                                    : "antes (uma task por W, prioridade da rede)",
+         medicao.latencias.size(), total);
+  printf("  intervalo (us)      atualizações\n");
+  for (int i = 0; i <= nFaixas; i++)
+  {
+    char faixa[24];
+    if (i == 0)
+    {
+      snprintf(faixa, sizeof(faixa), "< %u", faixas[0]);
+    }
+    else if (i == nFaixas)
+    {
+      snprintf(faixa, sizeof(faixa), ">= %u", faixas[nFaixas - 1]);
+    }
+    else
+    {
+      snprintf(faixa, sizeof(faixa), "%u - %u", faixas[i - 1], faixas[i] - 1);
+    }
+    printf("  %-16s %8u %6.2f%%\n", faixa, contagens[i],
+           medicao.intervalos.empty() ? 0.0 : 100.0 * contagens[i] / medicao.intervalos.size());
+  }
+  printf("  intervalo p50 %u us, p99 %u us, p99.9 %u us, max %u us\n", percentil(medicao.intervalos, 0.5),
+         percentil(medicao.intervalos, 0.99), percentil(medicao.intervalos, 0.999), percentil(medicao.intervalos, 1));
+  printf("  latencia do envio p50 %u us, p99 %u us, max %u us\n", percentil(medicao.latencias, 0.5),
+         percentil(medicao.latencias, 0.99), percentil(medicao.latencias, 1));
+  return medicao.latencias.size() >= total * 9 / 10;
+}
+
+int main(int argc, char **argv)
+{
+  int segundos = argc > 1 ? atoi(argv[1]) : 5;
+  if (segundos < 1)
+  {
+    fprintf(stderr, "uso: %s [segundos]\n", argv[0]);
+    return 1;
+  }
+  printf("W a cada %d us; rede com 0 a %d us de trabalho depois de cada bloco, tudo no CPU 0\n", PERIODO_W / 1000,
+         CARGA_MAXIMA / 1000);
+  bool ok = mede(false, segundos);
+  ok = mede(true, segundos) && ok;
+  if (!prioridadesOk)
+  {
+    fprintf(stderr, "sem permissão para SCHED_FIFO: as prioridades não valeram e a comparação não vale\n");
+    return 1;
+  }
+  if (!ok)
+  {
+    fprintf(stderr, "atualizações perdidas\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,529 @@
+/*
+ * Conformidade do protocolo de comandos com um arquivo de referencia, verificada no host (Linux)
+ *
+ * Passa uma lista fixa de blocos pelo Enquadrador e pelo avaliaMensagem() de lib/Protocolo, o mesmo despacho do
+ * evaluate() do firmware (quadro "@seq,tag", autenticação obrigatoria, "#id ", comando), e grava, para cada bloco,
+ * o que foi interpretado e a resposta nos modos verboso e compacto (com timestamp). o que depende do hardware fica
+ * de fora: R, S, L, T e o estado do G e do A aparecem só como interpretados, sem resposta; P, F e I guardam a
+ * configuração de cada canal aqui, para a listagem sair igual à do firmware. a placa é a de 8 canais e o bloco
+ * passa pelo Enquadrador com o BUFFERLEN dela (Memoria.h).
+ *
+ * A lista cobre todos os comandos (W D R S C P G A F L T N I, #id e @seq,tag), o enquadramento (dois comandos num
+ * bloco, "\r\n", sem terminador, mensagem longa) e todos os erros, E1 a E15, nos dois modos; isso é conferido
+ * também fora do arquivo. compara com tools/protocolo/conformidade_fid.txt e devolve 1 na primeira diferença. com
+ * -g, regrava o arquivo: depois de uma mudança intencional no protocolo, revise o diff dele no commit.
+ *
+ * uso:
+ *   conformidade_fid [-g] [arquivo]   (padrão tools/protocolo/conformidade_fid.txt)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Protocolo -Ilib/BufferSaida -Ilib/Configuracoes -Ilib/Autenticacao -Ilib/Inclinacao \
+ *       tools/protocolo/conformidade_fid.cpp lib/Protocolo/Protocolo.cpp lib/BufferSaida/BufferSaida.cpp \
+ *       lib/Configuracoes/Configuracoes.cpp lib/Autenticacao/Autenticacao.cpp -o conformidade_fid
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Autenticacao.h"
+#include "Protocolo.h"
+
+#define CANAIS 8
+#define QUADROS_CAPTURA 512
+#define INSTANTE 123456 // instanteAplicado fixo, para a resposta compacta com timestamp ser sempre a mesma
+#define NONCE_HOST 0x0123456789abcdefULL
+#define NONCE_CONTROLADOR 0xfedcba9876543210ULL // no firmware vem do esp_random()
+
+constexpr int TAM_W = 1 + 5 * CANAIS;
+constexpr int TAM_D = 8 * CANAIS;
+constexpr int BUFFERLEN = TAM_PREFIXO_QUADRO + (TAM_W > TAM_D ? TAM_W : TAM_D) + 1; // Memoria::bufferlen
+
+static const uint8_t chave[TAM_CHAVE] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const char *const opcoesEco[] = {"completo", "curto", "nenhum", NULL};
+static const char *const opcoesResposta[] = {"verbosa", "compacta", NULL};
+
+struct Caso
+{
+  const char *nome;
+  std::string bloco;
+};
+
+static void escapa(std::string &destino, const char *dados, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    unsigned char c = dados[i];
+    if (c == '\r')
+      destino += "\\r";
+    else if (c == '\n')
+      destino += "\\n";
+    else if (c == '\\')
+      destino += "\\\\";
+    else if (c == 0 || c < 0x20 || c == 0x7f)
+    {
+      char hex[5];
+      snprintf(hex, sizeof(hex), "\\x%02x", c);
+      destino += hex;
+    }
+    else
+      destino += (char)c;
+  }
+}
+
+static size_t acumula(void *contexto, const uint8_t *dados, size_t len)
+{
+  ((std::string *)contexto)->append((const char *)dados, len);
+  return len;
+}
+
+// o lado do firmware para o avaliaMensagem() de lib/Protocolo, com o estado que as respostas precisam. cada
+// passo anota o que foi interpretado
+class Espelho : public Controlador
+{
+public:
+  explicit Espelho(int32_t modo)
+      : _modoResposta(modo), _comTempo(modo == RESPOSTA_COMPACTA),
+        _tabela{{"echo", CONFIG_ENUM, &_modoEco, 0, 2, opcoesEco, NULL},
+                {"respostas", CONFIG_ENUM, &_modoResposta, 0, 1, opcoesResposta, NULL},
+                {"timestamp", CONFIG_BOOL, &_comTempo, 0, 1, NULL, NULL},
+                {"heartbeat", CONFIG_INT, &_heartbeat, 0, 60000, NULL, NULL},
+                {"autenticacao", CONFIG_INT, &_autenticacao, 0, 1, NULL, NULL}},
+        _config(_tabela, sizeof(_tabela) / sizeof(_tabela[0])), _enquadrador(_area, BUFFERLEN),
+        _saida(_areaSaida, sizeof(_areaSaida), acumula, &_resposta)
+  {
+    _sessao.defineChave(chave);
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      _p[canal] = {(uint8_t)canal, 1, false, true};
+      _f[canal] = {(uint8_t)canal, 'M', 100};
+      _i[canal] = {(uint8_t)canal, 0};
+    }
+  }
+
+  // o bloco inteiro, como lido do socket num ciclo da task TCP. interpretado recebe o que foi entendido
+  std::string recebe(const std::string &bloco, std::string *interpretado)
+  {
+    _enquadrador.inicia();
+    for (char z : bloco)
+    {
+      _enquadrador.recebe(z);
+    }
+    size_t len = _enquadrador.termina();
+    memcpy(_mensagem, _area, len + 1);
+    _resposta.clear();
+    _interpretado.clear();
+    _sequencia++;
+    avaliaMensagem(_mensagem, *this, _saida);
+    _saida.descarrega();
+    *interpretado = _interpretado;
+    return _resposta;
+  }
+
+  bool respondeuErro(int codigo) const { return _erros[codigo]; }
+  bool recebeuComando(Comando comando) const { return _comandos[comando]; }
+
+  FormatoResposta formato() override { return {_modoResposta, _modoEco, _comTempo != 0, _sequencia, INSTANTE}; }
+  ParametrosProtocolo parametros() override { return {CANAIS, QUADROS_CAPTURA, true}; }
+  Configuracoes &configuracoes() override { return _config; }
+
+  bool autenticacaoObrigatoria() override { return _autenticacao != 0; }
+
+  ResultadoQuadro verificaQuadro(const char *quadro, const char **comando) override
+  {
+    ResultadoQuadro resultado = _sessao.verifica(quadro, comando);
+    if (resultado == QUADRO_OK)
+    {
+      anota("quadro");
+    }
+    return resultado;
+  }
+
+  int iniciaSessao(uint64_t nonceHost, uint64_t *nonceControlador) override
+  {
+    anota("nonce=%016llx", (unsigned long long)nonceHost);
+    *nonceControlador = NONCE_CONTROLADOR;
+    _sessao.inicia(nonceHost, NONCE_CONTROLADOR);
+    return 0;
+  }
+
+  void comando(Comando comando, bool comId, uint32_t id) override
+  {
+    if (comId)
+    {
+      anota("id=%u", id);
+    }
+    _comandos[comando] = true;
+    anota("%c", comando == COMANDO_DESCONHECIDO ? '?' : _mensagem[0]);
+  }
+
+  void erro(int codigo, int) override
+  {
+    _erros[codigo < 16 ? codigo : 0] = true;
+    anota("E%d", codigo);
+  }
+
+  bool repeteW(const char *mensagem) override
+  {
+    if (_estadoW != mensagem)
+    {
+      return false;
+    }
+    anota("sem mudança");
+    return true;
+  }
+
+  void aplicaW(const char *mensagem, const uint16_t *valores) override
+  {
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      anota("%u", valores[canal]);
+    }
+    _estadoW = mensagem;
+  }
+
+  void aplicaD(const AlteracaoCanal *alteracoes, int quantidade) override
+  {
+    for (int i = 0; i < quantidade; i++)
+    {
+      anota("%u=%u", alteracoes[i].canal, alteracoes[i].valor);
+    }
+    _estadoW.clear(); // o firmware reescreve o canal no estado_DACs; aqui basta o proximo W não ser repetido
+  }
+
+  void aplicaP(const ConfiguracaoCanal &configuracao) override
+  {
+    anota("canal=%u ganho=%u buffer=%d ativo=%d", configuracao.canal, configuracao.ganho, configuracao.buffer,
+          configuracao.ativo);
+    _p[configuracao.canal] = configuracao;
+  }
+
+  void aplicaF(const SegurancaCanal &seguranca) override
+  {
+    anota("canal=%u modo=%c rampa=%u", seguranca.canal, seguranca.modo, seguranca.rampa);
+    _f[seguranca.canal] = seguranca;
+  }
+
+  void aplicaI(const InclinacaoCanal &inclinacao) override
+  {
+    anota("canal=%u limite=%u", inclinacao.canal, inclinacao.limite);
+    _i[inclinacao.canal] = inclinacao;
+  }
+
+  int aplicaG(const PedidoCaptura &pedido, BufferSaida &) override
+  {
+    if (pedido.acao == 'L')
+    {
+      anota("envia");
+      return 10; // nenhuma captura congelada
+    }
+    if (pedido.acao == 'X')
+    {
+      anota("cancela");
+    }
+    else
+    {
+      anota("canal=%u tipo=%c limiar=%d pre=%d pos=%d", pedido.canal, pedido.tipo, pedido.limiar, pedido.pre,
+            pedido.pos);
+    }
+    return 0;
+  }
+
+  void aplicaA(uint64_t mascara) override { anota("mascara=%llx", (unsigned long long)mascara); }
+
+  void alterouConfiguracao(const Configuracao &cfg) override
+  {
+    char texto[32];
+    std::string formatada;
+    BufferSaida linha(texto, sizeof(texto), acumula, &formatada);
+    _config.formata(cfg, linha);
+    linha.descarrega();
+    anota("%s", formatada.c_str());
+  }
+
+  ConfiguracaoCanal canalP(int canal) override { return _p[canal]; }
+  SegurancaCanal canalF(int canal) override { return _f[canal]; }
+  bool divergente(int canal) override { return canal == 5; } // um canal divergente, para a marca aparecer
+  InclinacaoCanal canalI(int canal) override { return _i[canal]; }
+
+  // leituras, metricas, eventos, rastros e o estado do G e do A: só no firmware
+  void consulta(Comando comando, BufferSaida &) override
+  {
+    if (comando == COMANDO_G || comando == COMANDO_A)
+    {
+      anota("estado");
+    }
+  }
+
+private:
+  __attribute__((format(printf, 2, 3))) void anota(const char *formatoTexto, ...)
+  {
+    char texto[96];
+    va_list argumentos;
+    va_start(argumentos, formatoTexto);
+    vsnprintf(texto, sizeof(texto), formatoTexto, argumentos);
+    va_end(argumentos);
+    _interpretado += _interpretado.empty() ? "" : " ";
+    _interpretado += texto;
+  }
+
+  int32_t _modoEco = ECO_COMPLETO;
+  int32_t _modoResposta;
+  int32_t _comTempo;
+  int32_t _heartbeat = 0;
+  int32_t _autenticacao = 0;
+  Configuracao _tabela[5];
+  Configuracoes _config;
+  SessaoAutenticada _sessao;
+  ConfiguracaoCanal _p[CANAIS];
+  SegurancaCanal _f[CANAIS];
+  InclinacaoCanal _i[CANAIS];
+  std::string _estadoW;
+  uint32_t _sequencia = 0;
+
+  char _area[BUFFERLEN];
+  Enquadrador _enquadrador;
+  char _mensagem[BUFFERLEN];
+  char _areaSaida[256]; // menor que as listagens: a descarga no meio da resposta também passa pelo teste
+  BufferSaida _saida;
+  std::string _resposta;
+  std::string _interpretado;
+
+  bool _erros[16] = {};
+  bool _comandos[COMANDO_DESCONHECIDO + 1] = {};
+};
+
+// quadro "@seq,tag comando\r" da sessão do host
+static std::string assina(SessaoAutenticada &host, const char *comando)
+{
+  char prefixo[TAM_PREFIXO_QUADRO];
+  host.assina(comando, strcspn(comando, "\r"), prefixo);
+  return std::string(prefixo, TAM_PREFIXO_QUADRO) + comando;
+}
+
+static std::vector<Caso> casos()
+{
+  SessaoAutenticada host;
+  host.defineChave(chave);
+  std::string dLongo = "D";
+  for (int i = 0; i < 30; i++)
+  {
+    dLongo += i == 0 ? "1=1" : ",1=1";
+  }
+  dLongo += "\r";
+
+  std::vector<Caso> lista = {
+      // W
+      {"W aceito", "WA0001B0002C0003D0004E0005F0006G0007H0008\r"},
+      {"W igual ao anterior", "WA0001B0002C0003D0004E0005F0006G0007H0008\r"},
+      {"W com \\r\\n", "WA4095B0000C0000D0000E0000F0000G0000H0000\r\n"},
+      {"W letra fora de ordem (E2)", "WA0001B0002C0003X0004E0005F0006G0007H0008\r"},
+      {"W com canais a menos (E2)", "WA0001B0002\r"},
+      {"W com sobra depois do ultimo canal (E2)", "WA0001B0002C0003D0004E0005F0006G0007H0008I0009\r"},
+      {"W digito invalido (E3)", "WA0001B00x2C0003D0004E0005F0006G0007H0008\r"},
+      {"W valor acima de 4095 (E4)", "WA0001B0002C0003D0004E0005F0006G0007H4096\r"},
+      // D
+      {"D aceito", "D03=1234,07=0001\r"},
+      {"D canal fora da placa (E8)", "D08=1\r"},
+      {"D valor acima de 4095 (E8)", "D1=4096\r"},
+      {"D separador invalido (E8)", "D1=1;2=2\r"},
+      {"D com mais alterações que canais (E8)", "D0=1,1=1,2=1,3=1,4=1,5=1,6=1,7=1,0=2\r"},
+      // enquadramento
+      {"dois comandos num bloco: só o primeiro", "D1=10\rD2=20\r"},
+      {"sem terminador", "D1=11"},
+      {"mensagem maior que o BUFFERLEN, truncada (E8)", dLongo},
+      {"mensagem vazia (E1)", "\r"},
+      // R, S, L, T
+      {"R", "R\r"},
+      {"R com sobra", "Rxyz\r"},
+      {"S", "S\r"},
+      {"L", "L\r"},
+      {"T", "T\r"},
+      // C
+      {"C lista", "C\r"},
+      {"C? lista", "C?\r"},
+      {"C altera", "Cecho=curto\r"},
+      {"W com eco curto", "WA0000B0000C0000D0000E0000F0000G0000H0001\r"},
+      {"C com espaço", "C echo=completo\r"},
+      {"C sem '=' (E5)", "Cecho\r"},
+      {"C chave desconhecida (E6)", "Cfoo=1\r"},
+      {"C opção invalida (E7)", "Cecho=talvez\r"},
+      {"C fora da faixa (E7)", "Cheartbeat=70000\r"},
+      // P
+      {"P altera", "P03=2,1,0\r"},
+      {"P lista", "P\r"},
+      {"P ganho invalido (E9)", "P03=3,1,0\r"},
+      {"P canal fora da placa (E9)", "P08=1,0,1\r"},
+      {"P com sobra (E9)", "P3=1,0,1x\r"},
+      // G
+      {"G estado", "G\r"},
+      {"G arma", "G2,S,100,10,20\r"},
+      {"G arma inclinação negativa", "G3,I,-5,1,1\r"},
+      {"G cancela", "GX\r"},
+      {"G envia sem captura congelada (E10)", "GL\r"},
+      {"G canal fora da placa (E10)", "G8,S,1,1,1\r"},
+      {"G tipo invalido (E10)", "G2,Q,1,1,1\r"},
+      {"G campos a menos (E10)", "G2,S,1,1\r"},
+      // A
+      {"A estado", "A?\r"},
+      {"A liga", "A1F\r"},
+      {"A desliga", "A0\r"},
+      {"A canal fora da placa (E11)", "A100\r"},
+      {"A digito invalido (E11)", "AG\r"},
+      {"A com 17 digitos (E11)", "A00000000000000001\r"},
+      // F
+      {"F rampa", "F02=R,1000\r"},
+      {"F mantem", "F01=M\r"},
+      {"F zera", "F00=Z\r"},
+      {"F lista", "F\r"},
+      {"F rampa zero (E12)", "F02=R,0\r"},
+      {"F rampa acima de 65535 (E12)", "F02=R,70000\r"},
+      {"F modo invalido (E12)", "F02=Q\r"},
+      {"F canal fora da placa (E12)", "F08=M\r"},
+      // I
+      {"I altera", "I05=0100\r"},
+      {"I sem limite", "I05=0\r"},
+      {"I lista", "I?\r"},
+      {"I acima do maximo (E15)", "I05=4096\r"},
+      {"I canal fora da placa (E15)", "I08=1\r"},
+      {"I sem valor (E15)", "I05=\r"},
+      // #id
+      {"#id", "#42 D1=12\r"},
+      {"#id maximo", "#4294967295 R\r"},
+      {"#id com comando desconhecido (E1)", "#7 Q\r"},
+      {"#id zero (E13)", "#0 R\r"},
+      {"#id acima de 32 bits (E13)", "#4294967296 R\r"},
+      {"#id sem espaço (E13)", "#42R\r"},
+      // N e @seq,tag
+      {"quadro sem sessão (E14)", "@00000001,0000000000000000 R\r"},
+      {"N curto (E14)", "N0123\r"},
+      {"N com sobra (E14)", "N0123456789abcdefX\r"},
+      {"N aceito", "N0123456789abcdef\r"},
+  };
+  host.inicia(NONCE_HOST, NONCE_CONTROLADOR);
+  std::string primeiro = assina(host, "D4=44\r");
+  std::string comTag = assina(host, "#9 D5=55\r");
+  std::string invalido = assina(host, "D6=66\r");
+  invalido[TAM_PREFIXO_QUADRO - 2] ^= 1; // ultimo digito da tag
+  std::vector<Caso> autenticados = {
+      {"quadro aceito", primeiro},
+      {"quadro com #id", comTag},
+      {"quadro repetido (E14)", primeiro},
+      {"quadro com tag invalida (E14)", invalido},
+      {"quadro mal formado (E14)", "@zz D1=1\r"},
+      {"liga a autenticação", assina(host, "Cautenticacao=1\r")},
+      {"comando sem quadro com autenticação (E14)", "D1=1\r"},
+      {"N sem quadro com autenticação", "N0123456789abcdef\r"},
+  };
+  lista.insert(lista.end(), autenticados.begin(), autenticados.end());
+  // o N acima começou outra sessão no controlador
+  host.inicia(NONCE_HOST, NONCE_CONTROLADOR);
+  lista.push_back({"desliga a autenticação na nova sessão", assina(host, "Cautenticacao=0\r")});
+  lista.push_back({"comando desconhecido (E1)", "Z\r"});
+  return lista;
+}
+
+static std::vector<std::string> linhas(const std::string &texto)
+{
+  std::vector<std::string> resultado;
+  std::istringstream entrada(texto);
+  std::string linha;
+  while (std::getline(entrada, linha))
+  {
+    resultado.push_back(linha);
+  }
+  return resultado;
+}
+
+int main(int argc, char **argv)
+{
+  bool grava = false;
+  const char *arquivo = "tools/protocolo/conformidade_fid.txt";
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "-g") == 0)
+      grava = true;
+    else
+      arquivo = argv[i];
+  }
+
+  std::vector<Caso> lista = casos();
+  Espelho verboso(RESPOSTA_VERBOSA);
+  Espelho compacto(RESPOSTA_COMPACTA);
+  std::string texto;
+  for (const Caso &caso : lista)
+  {
+    std::string interpretado;
+    std::string respostaVerbosa = verboso.recebe(caso.bloco, &interpretado);
+    std::string semUso;
+    std::string respostaCompacta = compacto.recebe(caso.bloco, &semUso);
+    texto += "# ";
+    texto += caso.nome;
+    texto += "\n> ";
+    escapa(texto, caso.bloco.data(), caso.bloco.size());
+    texto += "\n= " + interpretado + "\nverboso: ";
+    escapa(texto, respostaVerbosa.data(), respostaVerbosa.size());
+    texto += "\ncompacto: ";
+    escapa(texto, respostaCompacta.data(), respostaCompacta.size());
+    texto += "\n\n";
+  }
+
+  int falhas = 0;
+  const char *nomes = "WDRSCPGAFLTNI?";
+  for (int comando = 0; comando <= COMANDO_DESCONHECIDO; comando++)
+  {
+    if (!verboso.recebeuComando((Comando)comando))
+    {
+      printf("  FALHA nenhum caso com o comando %c\n", nomes[comando]);
+      falhas++;
+    }
+  }
+  for (int codigo = 1; codigo <= 15; codigo++)
+  {
+    if (!verboso.respondeuErro(codigo) || !compacto.respondeuErro(codigo))
+    {
+      printf("  FALHA nenhum caso com o erro E%d nos dois modos\n", codigo);
+      falhas++;
+    }
+  }
+
+  if (grava)
+  {
+    std::ofstream saida(arquivo, std::ios::binary);
+    saida << texto;
+    printf("%zu casos gravados em %s\n", lista.size(), arquivo);
+    return falhas == 0 && saida.good() ? 0 : 1;
+  }
+  std::ifstream entrada(arquivo, std::ios::binary);
+  if (!entrada)
+  {
+    fprintf(stderr, "não foi possivel ler %s\n", arquivo);
+    return 1;
+  }
+  std::stringstream referencia;
+  referencia << entrada.rdbuf();
+  std::vector<std::string> esperado = linhas(referencia.str());
+  std::vector<std::string> obtido = linhas(texto);
+  for (size_t i = 0; i < esperado.size() || i < obtido.size(); i++)
+  {
+    const char *linhaObtida = i < obtido.size() ? obtido[i].c_str() : "(fim da saida)";
+    const char *linhaEsperada = i < esperado.size() ? esperado[i].c_str() : "(fim do arquivo)";
+    if (strcmp(linhaObtida, linhaEsperada) != 0)
+    {
+      printf("  FALHA linha %zu\n    obtido:   %s\n    esperado: %s\n", i + 1, linhaObtida, linhaEsperada);
+      falhas++;
+      break;
+    }
+  }
+  if (falhas != 0)
+  {
+    printf("%d falhas\n", falhas);
+    return 1;
+  }
+  printf("OK, %zu casos\n", lista.size());
+  return 0;
+}
@@ -0,0 +1,859 @@
+/*
+ * Fuzzing do enquadramento e dos interpretadores de comandos de lib/Protocolo, no host (Linux)
+ *
+ * Um alvo por função que lê o que veio da rede: o Enquadrador (com a mensagem seguindo para o "#id" e o
+ * interpretador do comando, como no evaluate()), o "#id" (extraiCorrelacao), o quadro "@seq,tag"
+ * (SessaoAutenticada::verifica) e os interpretadores do W, D, P, G, A, F, I, N e C. o primeiro byte da entrada
+ * escolhe a placa (4, 8, 16 ou 32 canais), o eco e o timestamp; o resto vai, depois da letra do comando, numa copia
+ * no heap do tamanho exato e terminada em '\0', para o ASan pegar qualquer leitura depois do fim (o Enquadrador
+ * recebe uma area de BUFFERLEN bytes, também no heap). cada alvo confere o que foi interpretado (valores até 4095,
+ * canal menor que canais, area terminada em '\0'...) e escreve o erro ou a confirmação nos modos verboso e compacto.
+ *
+ * Duas formas de compilar:
+ *   - clang com libFuzzer, um executavel por alvo (-DALVO_FUZZ=<alvo>), guiado por cobertura:
+ *       clang++ -std=c++17 -g -O1 -fsanitize=fuzzer,address,undefined -DALVO_FUZZ=w <mesmos -I e fontes> -o fuzz_w
+ *       ./fuzz_w -timeout=1 corpus_w/
+ *   - g++, sem libFuzzer: o main daqui muta as sementes de cada alvo ao acaso, guarda no corpus as entradas que
+ *     chegam a um resultado novo (codigo de erro ou placa) e limita cada entrada a TEMPO_MAXIMO_MS (setitimer). a
+ *     entrada que estoura o tempo, falha numa conferencia ou derruba o ASan/UBSan é gravada em falha-<alvo>.bin
+ *     no diretorio atual
+ *
+ * Nos dois, cada entrada também é cronometrada: o -timeout só pega travamentos, e uma entrada que custa 100 vezes
+ * o normal no interpretador já atrasa a task TCP sem travar nada. a entrada é lenta se passar do orçamento do
+ * alvo (orcamentoUs, medido com os sanitizers ligados) ou de FATOR_MEDIANA vezes a mediana do tempo por byte do
+ * alvo. antes de acusar, ela roda de novo REPETICOES_LENTA vezes e vale o menor tempo, para uma preempção do
+ * processo não virar falha. a entrada lenta aborta como uma conferencia (libFuzzer grava crash-*, o driver do g++
+ * grava falha-<alvo>.bin)
+ *
+ * uso (g++):
+ *   fuzz_fid [alvo|todos] [iterações] [semente]   (padrão todos, 100000 por alvo, semente 1)
+ *   fuzz_fid -r alvo arquivo...                     repete entradas gravadas (com o orçamento de tempo do alvo)
+ *
+ * alvos: enquadrador correlacao quadro w d p g a f i n c
+ *
+ * compilar com g++ (de controlador_FID):
+ *   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -fno-sanitize-recover=all -Ilib/Protocolo -Ilib/BufferSaida \
+ *       -Ilib/Configuracoes -Ilib/Autenticacao -Ilib/Inclinacao tools/protocolo/fuzz_fid.cpp \
+ *       lib/Protocolo/Protocolo.cpp lib/BufferSaida/BufferSaida.cpp lib/Configuracoes/Configuracoes.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o fuzz_fid
+ */
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include "Autenticacao.h"
+#include "Inclinacao.h"
+#include "Protocolo.h"
+
+#define QUADROS_CAPTURA 512
+#define TEMPO_MAXIMO_MS 1000 // por entrada, no driver do g++
+#define FATOR_MEDIANA 50     // tempo por byte acima de FATOR_MEDIANA vezes a mediana do alvo é lento
+#define AMOSTRAS_MEDIANA 1000 // entradas medidas antes de a mediana valer
+#define TEMPO_MINIMO_NS 5000  // abaixo disso a entrada nunca é lenta: o custo fixo domina o tempo por byte
+#define REPETICOES_LENTA 3
+#define TAM_MAXIMO_ENTRADA 512
+#define NONCE_HOST 0x0123456789abcdefULL
+#define NONCE_CONTROLADOR 0xfedcba9876543210ULL
+
+static const int placas[] = {4, 8, 16, 32};
+static const uint8_t chave[TAM_CHAVE] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+                                         0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f};
+static const char *const opcoesEco[] = {"completo", "curto", "nenhum", NULL};
+static const char *const opcoesResposta[] = {"verbosa", "compacta", NULL};
+
+// o resultado da entrada atual (codigo de erro e placa), para o driver do g++ guardar as que chegam a um novo
+static int resultado;
+
+static void falhou(const char *condicao, int linha)
+{
+  fprintf(stderr, "conferencia falhou (linha %d): %s\n", linha, condicao);
+  abort();
+}
+
+#define CONFERE(condicao) ((condicao) ? (void)0 : falhou(#condicao, __LINE__))
+
+// a resposta vai para lugar nenhum; a area pequena faz o BufferSaida descarregar no meio das mensagens longas
+static size_t descarta(void *, const uint8_t *, size_t len)
+{
+  return len;
+}
+
+// placa e modos tirados do primeiro byte da entrada
+struct Entrada
+{
+  int canais;
+  int32_t eco;
+  bool comTempo;
+  bool marca; // bit livre: quadro assinado, canal divergente no F
+  bool semSessao;
+};
+
+static Entrada leEntrada(uint8_t b)
+{
+  return {placas[b & 3], (int32_t)((b >> 2 & 3) % 3), (b & 0x10) != 0, (b & 0x20) != 0, (b & 0x40) != 0};
+}
+
+// a letra do comando e os dados, numa copia do tamanho exato terminada em '\0'
+static char *copia(char letra, const uint8_t *dados, size_t len)
+{
+  char *mensagem = (char *)malloc(len + 2);
+  mensagem[0] = letra;
+  if (len > 0)
+  {
+    memcpy(mensagem + 1, dados, len);
+  }
+  mensagem[len + 1] = '\0';
+  return mensagem;
+}
+
+static void escreve(const Entrada &e, int codigo, int canal, const char *mensagem)
+{
+  char area[64];
+  BufferSaida saida(area, sizeof(area), descarta, NULL);
+  ParametrosProtocolo parametros = {e.canais, QUADROS_CAPTURA, true};
+  for (int32_t modo : {RESPOSTA_VERBOSA, RESPOSTA_COMPACTA})
+  {
+    FormatoResposta formato = {modo, e.eco, e.comTempo, 1, 123456};
+    if (codigo == 0)
+    {
+      escreveAceito(saida, formato, mensagem);
+    }
+    else
+    {
+      escreveErro(saida, formato, parametros, codigo, canal, mensagem);
+    }
+    saida.descarrega();
+    CONFERE(saida.tamanho() == 0);
+  }
+  resultado = codigo * 64 + e.canais;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// interpretadores: mensagem começando pela letra do comando
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void avaliaW(const Entrada &e, const char *mensagem)
+{
+  uint16_t valores[CANAIS_PROTOCOLO_MAX];
+  int canal = -1;
+  int codigo = interpretaW(mensagem, e.canais, valores, &canal);
+  CONFERE(codigo == 0 || codigo == 2 || codigo == 3 || codigo == 4);
+  CONFERE(canal >= 0 && canal <= e.canais);
+  CONFERE(codigo == 2 || canal < e.canais);
+  for (int i = 0; codigo == 0 && i < e.canais; i++)
+  {
+    CONFERE(valores[i] <= 4095);
+  }
+  escreve(e, codigo, canal, mensagem);
+}
+
+static void avaliaD(const Entrada &e, const char *mensagem)
+{
+  AlteracaoCanal alteracoes[CANAIS_PROTOCOLO_MAX];
+  int quantidade = 0;
+  int codigo = interpretaD(mensagem, e.canais, alteracoes, &quantidade);
+  CONFERE(codigo == 0 || codigo == 8);
+  CONFERE(codigo != 0 || (quantidade >= 1 && quantidade <= e.canais));
+  for (int i = 0; codigo == 0 && i < quantidade; i++)
+  {
+    CONFERE(alteracoes[i].canal < e.canais && alteracoes[i].valor <= 4095);
+  }
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaP(const Entrada &e, const char *mensagem)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    return;
+  }
+  ConfiguracaoCanal configuracao;
+  int codigo = interpretaP(mensagem, e.canais, &configuracao);
+  CONFERE(codigo == 0 || codigo == 9);
+  if (codigo == 0)
+  {
+    CONFERE(configuracao.canal < e.canais && (configuracao.ganho == 1 || configuracao.ganho == 2));
+    char area[32];
+    BufferSaida saida(area, sizeof(area), descarta, NULL);
+    escreveCanalP(saida, configuracao);
+  }
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaG(const Entrada &e, const char *mensagem)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    return;
+  }
+  PedidoCaptura pedido;
+  int codigo = interpretaG(mensagem, e.canais, &pedido);
+  CONFERE(codigo == 0 || codigo == 10);
+  if (codigo == 0)
+  {
+    CONFERE(pedido.acao == 'L' || pedido.acao == 'X' || pedido.acao == 'G');
+    CONFERE(pedido.acao != 'G' || (pedido.canal < e.canais && (pedido.tipo == 'S' || pedido.tipo == 'D' ||
+                                                               pedido.tipo == 'I')));
+    CONFERE(pedido.acao != 'G' || (pedido.limiar >= -99999 && pedido.limiar <= 99999 && pedido.pre >= 0 &&
+                                   pedido.pre <= 99999 && pedido.pos >= 0 && pedido.pos <= 99999));
+  }
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaA(const Entrada &e, const char *mensagem)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    return;
+  }
+  uint64_t mascara = 0;
+  int codigo = interpretaA(mensagem, e.canais, &mascara);
+  CONFERE(codigo == 0 || codigo == 11);
+  CONFERE(codigo != 0 || (mascara >> e.canais) == 0);
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaF(const Entrada &e, const char *mensagem)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    return;
+  }
+  SegurancaCanal seguranca;
+  int codigo = interpretaF(mensagem, e.canais, &seguranca);
+  CONFERE(codigo == 0 || codigo == 12);
+  if (codigo == 0)
+  {
+    CONFERE(seguranca.canal < e.canais);
+    CONFERE(seguranca.modo == 'R' ? seguranca.rampa >= 1
+                                  : (seguranca.modo == 'M' || seguranca.modo == 'Z') && seguranca.rampa == 0);
+    char area[32];
+    BufferSaida saida(area, sizeof(area), descarta, NULL);
+    escreveCanalF(saida, seguranca, e.marca);
+  }
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaI(const Entrada &e, const char *mensagem)
+{
+  if (pedeEstado(mensagem + 1))
+  {
+    return;
+  }
+  InclinacaoCanal inclinacao;
+  int codigo = interpretaI(mensagem, e.canais, &inclinacao);
+  CONFERE(codigo == 0 || codigo == 15);
+  if (codigo == 0)
+  {
+    CONFERE(inclinacao.canal < e.canais && inclinacao.limite <= INCLINACAO_MAXIMA);
+    char area[32];
+    BufferSaida saida(area, sizeof(area), descarta, NULL);
+    escreveCanalI(saida, inclinacao);
+  }
+  escreve(e, codigo, 0, mensagem);
+}
+
+static void avaliaN(const Entrada &e, const char *mensagem)
+{
+  uint64_t nonce = 0;
+  int codigo = interpretaN(mensagem, &nonce);
+  CONFERE(codigo == 0 || codigo == 14);
+  if (codigo == 0)
+  {
+    char area[32];
+    BufferSaida saida(area, sizeof(area), descarta, NULL);
+    escreveSessao(saida, nonce);
+  }
+  escreve(e, codigo, QUADRO_MAL_FORMADO, mensagem);
+}
+
+static void avaliaC(const Entrada &e, const char *mensagem)
+{
+  int32_t modoEco = ECO_COMPLETO, modoResposta = RESPOSTA_VERBOSA, comTempo = 0, heartbeat = 0, autenticacao = 0;
+  const Configuracao tabela[] = {{"echo", CONFIG_ENUM, &modoEco, 0, 2, opcoesEco, NULL},
+                                 {"respostas", CONFIG_ENUM, &modoResposta, 0, 1, opcoesResposta, NULL},
+                                 {"timestamp", CONFIG_BOOL, &comTempo, 0, 1, NULL, NULL},
+                                 {"heartbeat", CONFIG_INT, &heartbeat, 0, 60000, NULL, NULL},
+                                 {"autenticacao", CONFIG_INT, &autenticacao, 0, 1, NULL, NULL}};
+  Configuracoes config(tabela, sizeof(tabela) / sizeof(tabela[0]));
+  size_t len;
+  const char *texto = argumentosC(mensagem, &len);
+  CONFERE(texto > mensagem && texto + len <= mensagem + strlen(mensagem));
+  if (len == 0 || (len == 1 && texto[0] == '?'))
+  {
+    char area[32];
+    BufferSaida saida(area, sizeof(area), descarta, NULL);
+    config.lista(saida);
+    saida.descarrega();
+    return;
+  }
+  int codigo = erroConfig(config.altera(texto, len));
+  CONFERE(codigo == 0 || codigo == 5 || codigo == 6 || codigo == 7);
+  CONFERE(modoEco >= 0 && modoEco <= 2 && modoResposta >= 0 && modoResposta <= 1 && comTempo >= 0 &&
+          comTempo <= 1 && heartbeat >= 0 && heartbeat <= 60000 && autenticacao >= 0 && autenticacao <= 1);
+  escreve(e, codigo, 0, mensagem);
+}
+
+// o comando pela primeira letra, como o switch do evaluate()
+static void avaliaComando(const Entrada &e, const char *mensagem)
+{
+  Comando comando = identificaComando(mensagem);
+  CONFERE(comando >= COMANDO_W && comando <= COMANDO_DESCONHECIDO);
+  switch (comando)
+  {
+  case COMANDO_W:
+    avaliaW(e, mensagem);
+    break;
+  case COMANDO_D:
+    avaliaD(e, mensagem);
+    break;
+  case COMANDO_C:
+    avaliaC(e, mensagem);
+    break;
+  case COMANDO_P:
+    avaliaP(e, mensagem);
+    break;
+  case COMANDO_G:
+    avaliaG(e, mensagem);
+    break;
+  case COMANDO_A:
+    avaliaA(e, mensagem);
+    break;
+  case COMANDO_F:
+    avaliaF(e, mensagem);
+    break;
+  case COMANDO_N:
+    avaliaN(e, mensagem);
+    break;
+  case COMANDO_I:
+    avaliaI(e, mensagem);
+    break;
+  case COMANDO_DESCONHECIDO:
+    escreve(e, 1, 0, mensagem);
+    break;
+  default: // R, S, L e T não têm argumentos
+    break;
+  }
+}
+
+// "#id comando" e depois o comando
+static void avaliaCorrelacao(const Entrada &e, const char *mensagem)
+{
+  uint32_t id = 0;
+  const char *comando = NULL;
+  int codigo = extraiCorrelacao(mensagem, &id, &comando);
+  CONFERE(codigo == 0 || codigo == 13);
+  if (codigo != 0)
+  {
+    escreve(e, codigo, 0, mensagem);
+    return;
+  }
+  CONFERE(id >= 1 && comando > mensagem && comando <= mensagem + strlen(mensagem));
+  avaliaComando(e, comando);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// alvos
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void alvoEnquadrador(const uint8_t *dados, size_t len)
+{
+  Entrada e = leEntrada(len > 0 ? dados[0] : 0);
+  const uint8_t *bloco = len > 0 ? dados + 1 : dados;
+  size_t tamBloco = len > 0 ? len - 1 : 0;
+
+  int tamMax = 1 + 5 * e.canais > 8 * e.canais ? 1 + 5 * e.canais : 8 * e.canais;
+  size_t bufferlen = TAM_PREFIXO_QUADRO + tamMax + 1 > 42 ? TAM_PREFIXO_QUADRO + tamMax + 1 : 42; // Memoria.h
+  char *area = (char *)malloc(bufferlen);
+  Enquadrador enquadrador(area, bufferlen);
+  CONFERE(area[0] == '\0');
+
+  // dois blocos seguidos na mesma area: o segundo é a segunda metade do primeiro, e nada do primeiro pode sobrar
+  // depois do fim dele
+  for (size_t inicio : {(size_t)0, tamBloco / 2})
+  {
+    enquadrador.inicia();
+    size_t primeiroCR = SIZE_MAX;
+    for (size_t i = inicio; i < tamBloco; i++)
+    {
+      if (bloco[i] == '\r' && primeiroCR == SIZE_MAX)
+      {
+        primeiroCR = i - inicio;
+      }
+      enquadrador.recebe((char)bloco[i]);
+    }
+    size_t usado = enquadrador.termina();
+    CONFERE(usado < bufferlen && area[usado] == '\0');
+    CONFERE(usado <= 2 * (tamBloco - inicio));
+    CONFERE(primeiroCR == SIZE_MAX || primeiroCR + 1 >= bufferlen - 1 || area[primeiroCR + 1] == '\0');
+    CONFERE(tamBloco - inicio == 0 || area[0] == (char)bloco[inicio]);
+
+    // a mensagem segue como no evaluate(); o quadro "@" tem o seu alvo
+    if (area[0] == '#')
+    {
+      avaliaCorrelacao(e, area);
+    }
+    else if (area[0] != PREFIXO_QUADRO)
+    {
+      avaliaComando(e, area);
+    }
+  }
+  free(area);
+}
+
+static void alvoQuadro(const uint8_t *dados, size_t len)
+{
+  Entrada e = leEntrada(len > 0 ? dados[0] : 0);
+  const uint8_t *comando = len > 0 ? dados + 1 : dados;
+  size_t tamComando = len > 0 ? len - 1 : 0;
+
+  SessaoAutenticada controlador;
+  controlador.defineChave(chave);
+  if (!e.semSessao)
+  {
+    controlador.inicia(NONCE_HOST, NONCE_CONTROLADOR);
+  }
+
+  // marca: o quadro sai assinado pelo host, para chegar à tag e à sequencia; sem ela, os bytes vão depois do '@'
+  char *quadro;
+  if (e.marca)
+  {
+    SessaoAutenticada host;
+    host.defineChave(chave);
+    host.inicia(NONCE_HOST, NONCE_CONTROLADOR);
+    quadro = (char *)malloc(TAM_PREFIXO_QUADRO + tamComando + 1);
+    host.assina((const char *)comando, tamComando, quadro);
+    memcpy(quadro + TAM_PREFIXO_QUADRO, comando, tamComando);
+    quadro[TAM_PREFIXO_QUADRO + tamComando] = '\0';
+  }
+  else
+  {
+    quadro = copia(PREFIXO_QUADRO, comando, tamComando);
+  }
+
+  const char *texto = NULL;
+  ResultadoQuadro r = controlador.verifica(quadro, &texto);
+  CONFERE(r >= QUADRO_OK && r <= QUADRO_REPETIDO);
+  bool limpo = memchr(comando, '\r', tamComando) == NULL && memchr(comando, '\0', tamComando) == NULL;
+  CONFERE(!e.marca || (e.semSessao ? r == QUADRO_SEM_SESSAO : !limpo || r == QUADRO_OK));
+  if (r == QUADRO_OK)
+  {
+    CONFERE(texto == quadro + TAM_PREFIXO_QUADRO);
+    // o mesmo quadro de novo é repetido
+    const char *outro = NULL;
+    CONFERE(controlador.verifica(quadro, &outro) == QUADRO_REPETIDO);
+    if (texto[0] == '#')
+    {
+      avaliaCorrelacao(e, texto);
+    }
+    else
+    {
+      avaliaComando(e, texto);
+    }
+  }
+  else
+  {
+    escreve(e, 14, r, quadro);
+  }
+  free(quadro);
+}
+
+// os outros alvos: a letra do comando e os bytes depois do primeiro
+template <char letra, void (*avalia)(const Entrada &, const char *)>
+static void alvoComando(const uint8_t *dados, size_t len)
+{
+  Entrada e = leEntrada(len > 0 ? dados[0] : 0);
+  char *mensagem = len > 0 ? copia(letra, dados + 1, len - 1) : copia(letra, dados, 0);
+  avalia(e, mensagem);
+  free(mensagem);
+}
+
+struct Alvo
+{
+  const char *nome;
+  void (*roda)(const uint8_t *dados, size_t len);
+  uint32_t orcamentoUs; // tempo maximo de uma entrada, com ASan e UBSan
+  std::vector<std::string> sementes; // sem o byte da placa, que o driver acrescenta
+};
+
+static const std::vector<Alvo> alvos = {
+    {"enquadrador", alvoEnquadrador, 50,
+     {"WA0001B0002C0003D0004\r", "D1=10\rD2=20\r", "#42 D1=12\r\n", "P03=2,1,0\r", "G2,S,100,10,20\r", "Cecho=curto\r",
+      "A1F\r", "F02=R,1000\r", "I05=0100\r", "N0123456789abcdef\r", "R\r", "Q\r", "\r"}},
+    {"correlacao", alvoComando<'#', avaliaCorrelacao>, 50,
+     {"42 D1=12\r", "4294967295 R\r", "0 R\r", "4294967296 W\r", "7 Q\r", "1 F01=M"}},
+    {"quadro", alvoQuadro, 50, {"D4=44\r", "#9 D5=55\r", "00000001,eed36e3a2bc0a15c D4=44\r", "zz D1=1\r", "Cautenticacao=1"}},
+    {"w", alvoComando<'W', avaliaW>, 50,
+     {"A0001B0002C0003D0004\r", "A4095B0000C0000D0000E0000F0000G0000H0000\r\n", "A0001B00x2C0003D0004\r",
+      "A0001B0002C0003D4096\r"}},
+    {"d", alvoComando<'D', avaliaD>, 50, {"03=1234,07=0001\r", "1=4096\r", "1=1;2=2\r", "0=1,1=1,2=1,3=1,0=2\r"}},
+    {"p", alvoComando<'P', avaliaP>, 50, {"03=2,1,0\r", "03=3,1,0\r", "3=1,0,1x\r"}},
+    {"g", alvoComando<'G', avaliaG>, 50, {"2,S,100,10,20\r", "3,I,-5,1,1\r", "X\r", "L", "2,Q,1,1,1\r", "2,S,1,1\r"}},
+    {"a", alvoComando<'A', avaliaA>, 50, {"1F\r", "0\r", "100\r", "G\r", "00000000000000001\r", "ffffffff"}},
+    {"f", alvoComando<'F', avaliaF>, 50, {"02=R,1000\r", "01=M\r", "00=Z\r", "02=R,0\r", "02=R,70000\r", "02=Q\r"}},
+    {"i", alvoComando<'I', avaliaI>, 50, {"05=0100\r", "05=0\r", "05=4096\r", "05=\r", "?\r"}},
+    {"n", alvoComando<'N', avaliaN>, 50, {"0123456789abcdef\r", "0123\r", "0123456789abcdefX\r", "0123456789ABCDEF"}},
+    {"c", alvoComando<'C', avaliaC>, 50,
+     {"echo=curto\r", " echo=completo\r", "echo\r", "foo=1\r", "echo=talvez\r", "heartbeat=70000\r", "?\r", "\r"}},
+};
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// tempo de cada entrada
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static uint64_t agoraNs()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+static uint64_t cronometra(const Alvo &alvo, const uint8_t *dados, size_t len)
+{
+  uint64_t inicio = agoraNs();
+  alvo.roda(dados, len);
+  return agoraNs() - inicio;
+}
+
+// tempo por byte das primeiras AMOSTRAS_MEDIANA entradas do alvo; depois disso, só a mediana
+struct Tempos
+{
+  std::vector<double> amostras;
+  double mediana = 0;
+};
+
+// true se a entrada, que acabou de rodar em ns, ainda passa do orçamento ou da mediana depois das repetições
+static bool lenta(const Alvo &alvo, Tempos &tempos, const uint8_t *dados, size_t len, uint64_t ns)
+{
+  double porByte = (double)ns / (len > 0 ? len : 1);
+  if (tempos.mediana == 0)
+  {
+    tempos.amostras.push_back(porByte);
+    if (tempos.amostras.size() == AMOSTRAS_MEDIANA)
+    {
+      std::nth_element(tempos.amostras.begin(), tempos.amostras.begin() + AMOSTRAS_MEDIANA / 2, tempos.amostras.end());
+      tempos.mediana = tempos.amostras[AMOSTRAS_MEDIANA / 2];
+      tempos.amostras.clear();
+    }
+  }
+  for (int i = 0;; i++)
+  {
+    bool acimaOrcamento = ns > (uint64_t)alvo.orcamentoUs * 1000;
+    bool acimaMediana = tempos.mediana > 0 && ns > TEMPO_MINIMO_NS &&
+                        (double)ns / (len > 0 ? len : 1) > FATOR_MEDIANA * tempos.mediana;
+    if (!acimaOrcamento && !acimaMediana)
+    {
+      return false;
+    }
+    if (i == REPETICOES_LENTA)
+    {
+      break;
+    }
+    ns = std::min(ns, cronometra(alvo, dados, len));
+  }
+  fprintf(stderr, "\nentrada lenta no alvo %s: %llu ns para %zu bytes (orçamento %u us, mediana %.0f ns por byte)\n",
+          alvo.nome, (unsigned long long)ns, len, alvo.orcamentoUs, tempos.mediana);
+  return true;
+}
+
+#ifdef ALVO_FUZZ
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// libFuzzer: um alvo por executavel
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define TEXTO_(x) #x
+#define TEXTO(x) TEXTO_(x)
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *dados, size_t len)
+{
+  static const Alvo *alvo = NULL;
+  if (alvo == NULL)
+  {
+    for (const Alvo &a : alvos)
+    {
+      if (strcmp(a.nome, TEXTO(ALVO_FUZZ)) == 0)
+      {
+        alvo = &a;
+      }
+    }
+    if (alvo == NULL)
+    {
+      fprintf(stderr, "alvo desconhecido: %s\n", TEXTO(ALVO_FUZZ));
+      abort();
+    }
+  }
+  static Tempos tempos;
+  if (lenta(*alvo, tempos, dados, len, cronometra(*alvo, dados, len)))
+  {
+    abort();
+  }
+  return 0;
+}
+
+#else
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// driver do g++: mutação das sementes, tempo maximo por entrada e gravação da entrada que falhou
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+extern "C" void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+// no g++ o runtime do UBSan é separado do ASan e não chama o callback de morte: com abort_on_error, o erro chega
+// como SIGABRT, como as conferencias
+extern "C" const char *__ubsan_default_options()
+{
+  return "print_stacktrace=1:abort_on_error=1";
+}
+
+static const char *alvoAtual = "";
+static const uint8_t *entradaAtual = NULL;
+static size_t tamanhoAtual = 0;
+
+// só funções seguras dentro de um sinal
+static void gravaEntrada(const char *motivo)
+{
+  char nome[64] = "falha-";
+  strncat(nome, alvoAtual, 40);
+  strcat(nome, ".bin");
+  int fd = open(nome, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0)
+  {
+    ssize_t r = write(fd, entradaAtual, tamanhoAtual);
+    (void)r;
+    close(fd);
+  }
+  const char *partes[] = {"\n", motivo, " no alvo ", alvoAtual, ", entrada gravada em ", nome, "\n"};
+  for (const char *parte : partes)
+  {
+    ssize_t r = write(STDERR_FILENO, parte, strlen(parte));
+    (void)r;
+  }
+}
+
+static void aoMorrer()
+{
+  gravaEntrada("sanitizer");
+}
+
+static void aoEstourar(int)
+{
+  gravaEntrada("tempo esgotado");
+  _exit(1);
+}
+
+static void aoAbortar(int sinal)
+{
+  gravaEntrada("abort");
+  signal(sinal, SIG_DFL);
+  raise(sinal);
+}
+
+static void rodaUma(const Alvo &alvo, Tempos &tempos, const uint8_t *dados, size_t len)
+{
+  alvoAtual = alvo.nome;
+  entradaAtual = dados;
+  tamanhoAtual = len;
+  itimerval tempo = {};
+  tempo.it_value.tv_sec = TEMPO_MAXIMO_MS / 1000;
+  tempo.it_value.tv_usec = TEMPO_MAXIMO_MS % 1000 * 1000;
+  setitimer(ITIMER_REAL, &tempo, NULL);
+  bool foiLenta = lenta(alvo, tempos, dados, len, cronometra(alvo, dados, len));
+  tempo.it_value = {};
+  setitimer(ITIMER_REAL, &tempo, NULL);
+  if (foiLenta)
+  {
+    gravaEntrada("entrada lenta");
+    exit(1);
+  }
+}
+
+static uint32_t estado;
+
+static uint32_t sorteia(uint32_t n)
+{
+  estado ^= estado << 13;
+  estado ^= estado >> 17;
+  estado ^= estado << 5;
+  return estado % n;
+}
+
+// bytes que mudam o caminho dos interpretadores
+static const char dicionario[] = "0123456789ABCDEFabcdefWDRSCPGAFLTNIMZRXLSDI=,#@? -\r\n";
+
+static void muta(std::vector<uint8_t> &v, const std::vector<std::vector<uint8_t>> &corpus)
+{
+  int mutacoes = 1 + sorteia(4);
+  for (int m = 0; m < mutacoes; m++)
+  {
+    size_t pos = v.empty() ? 0 : sorteia(v.size());
+    switch (sorteia(8))
+    {
+    case 0: // troca um bit
+      if (!v.empty())
+        v[pos] ^= 1 << sorteia(8);
+      break;
+    case 1: // troca um byte por um qualquer
+      if (!v.empty())
+        v[pos] = sorteia(256);
+      break;
+    case 2: // troca um byte por um do dicionario
+      if (!v.empty())
+        v[pos] = dicionario[sorteia(sizeof(dicionario) - 1)];
+      break;
+    case 3: // insere
+      if (v.size() < TAM_MAXIMO_ENTRADA)
+        v.insert(v.begin() + pos, dicionario[sorteia(sizeof(dicionario) - 1)]);
+      break;
+    case 4: // apaga um trecho
+      if (v.size() > 1)
+        v.erase(v.begin() + pos, v.begin() + pos + 1 + sorteia(v.size() - pos < 8 ? v.size() - pos : 8));
+      break;
+    case 5: // repete um trecho
+      if (!v.empty() && v.size() < TAM_MAXIMO_ENTRADA)
+      {
+        size_t n = 1 + sorteia(v.size() - pos < 16 ? v.size() - pos : 16);
+        std::vector<uint8_t> trecho(v.begin() + pos, v.begin() + pos + n);
+        v.insert(v.begin() + pos, trecho.begin(), trecho.end());
+      }
+      break;
+    case 6: // corta o fim
+      v.resize(pos);
+      break;
+    default: // junta com o fim de outra entrada do corpus
+    {
+      const std::vector<uint8_t> &outra = corpus[sorteia(corpus.size())];
+      size_t de = outra.empty() ? 0 : sorteia(outra.size());
+      v.resize(pos);
+      v.insert(v.end(), outra.begin() + de, outra.end());
+      break;
+    }
+    }
+  }
+  if (v.size() > TAM_MAXIMO_ENTRADA)
+  {
+    v.resize(TAM_MAXIMO_ENTRADA);
+  }
+}
+
+static void fuzz(const Alvo &alvo, uint32_t iteracoes)
+{
+  std::vector<std::vector<uint8_t>> corpus;
+  std::set<int> resultados;
+  Tempos tempos;
+  for (const std::string &semente : alvo.sementes)
+  {
+    for (int placa = 0; placa < 4; placa++)
+    {
+      std::vector<uint8_t> v(1, (uint8_t)(placa | (corpus.size() % 8) << 2 | (corpus.size() % 3 == 0 ? 0x20 : 0)));
+      v.insert(v.end(), semente.begin(), semente.end());
+      resultado = 0;
+      rodaUma(alvo, tempos, v.data(), v.size());
+      resultados.insert(resultado);
+      corpus.push_back(v);
+    }
+  }
+  for (uint32_t i = 0; i < iteracoes; i++)
+  {
+    std::vector<uint8_t> v = corpus[sorteia(corpus.size())];
+    muta(v, corpus);
+    resultado = 0;
+    rodaUma(alvo, tempos, v.data(), v.size());
+    if (resultados.insert(resultado).second)
+    {
+      corpus.push_back(v);
+    }
+  }
+  printf("%-12s %u entradas, %zu no corpus, %zu resultados distintos\n", alvo.nome, iteracoes, corpus.size(),
+         resultados.size());
+}
+
+static const Alvo *buscaAlvo(const char *nome)
+{
+  for (const Alvo &alvo : alvos)
+  {
+    if (strcmp(alvo.nome, nome) == 0)
+    {
+      return &alvo;
+    }
+  }
+  fprintf(stderr, "alvo desconhecido: %s\n", nome);
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  if (__sanitizer_set_death_callback != NULL)
+  {
+    __sanitizer_set_death_callback(aoMorrer);
+  }
+  signal(SIGALRM, aoEstourar);
+  signal(SIGABRT, aoAbortar);
+  setvbuf(stdout, NULL, _IONBF, 0);
+
+  if (argc >= 3 && strcmp(argv[1], "-r") == 0)
+  {
+    const Alvo *alvo = buscaAlvo(argv[2]);
+    if (alvo == NULL)
+    {
+      return 1;
+    }
+    Tempos tempos; // poucas entradas: só o orçamento do alvo vale
+    for (int i = 3; i < argc; i++)
+    {
+      FILE *f = fopen(argv[i], "rb");
+      if (f == NULL)
+      {
+        fprintf(stderr, "não abriu %s\n", argv[i]);
+        return 1;
+      }
+      std::vector<uint8_t> v;
+      int c;
+      while ((c = fgetc(f)) != EOF)
+      {
+        v.push_back(c);
+      }
+      fclose(f);
+      rodaUma(*alvo, tempos, v.data(), v.size());
+      printf("%s: OK\n", argv[i]);
+    }
+    return 0;
+  }
+
+  const char *nome = argc > 1 ? argv[1] : "todos";
+  uint32_t iteracoes = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+  estado = argc > 3 ? strtoul(argv[3], NULL, 10) : 1;
+  if (estado == 0)
+  {
+    estado = 1;
+  }
+  if (strcmp(nome, "todos") == 0)
+  {
+    for (const Alvo &alvo : alvos)
+    {
+      fuzz(alvo, iteracoes);
+    }
+  }
+  else
+  {
+    const Alvo *alvo = buscaAlvo(nome);
+    if (alvo == NULL)
+    {
+      return 1;
+    }
+    fuzz(*alvo, iteracoes);
+  }
+  printf("OK\n");
+  return 0;
+}
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Verificação de saude do controlador_FID depois de uma OTA, para a implantação em etapas (Linux)
+ *
+ * Consulta o S até o autoteste do controlador decidir (ou o prazo acabar), reconectando enquanto ele reinicia, e
+ * escreve a partição em execução, o resultado do autoteste, o tempo de boot e a parada do laço na OTA. sai com 0
+ * só se o autoteste aprovou e, com -e, se a partição em execução não é mais a anterior (uma imagem que voltou por
+ * rollback também aparece aprovada, mas na partição antiga). com chave (-k ou FID_CHAVE), abre a sessão
+ * autenticada antes do S (tools/cliente).
+ *
+ * implantação em etapas: um canario primeiro e a frota só se ele aprovar; para no primeiro que reprovar
+ *   for h in canario $(cat frota.txt); do
+ *     antes=$(saude_fid -t 5 $h 6969 | cut -d' ' -f1 | cut -d= -f2)
+ *     espota.py -i $h -f .pio/build/fid8/firmware.bin && saude_fid -e $antes $h 6969 || break
+ *   done
+ *
+ * uso:
+ *   saude_fid [-k chave] [-e particao_anterior] [-t segundos] host porta
+ *   (prazo padrão 90 s, acima do PRAZO_AUTOTESTE; chave em 32 digitos hexadecimais, ou em FID_CHAVE)
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Autenticacao -Itools/cliente tools/saude_fid.cpp tools/cliente/SessaoHost.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o saude_fid
+ */
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include "SessaoHost.h"
+
+#define ESPERA_RESPOSTA 500 // ms sem dados para considerar a resposta completa
+#define INTERVALO 1         // s entre consultas
+
+static int conecta(const char *host, const char *porta)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(enderecos);
+  return fd;
+}
+
+static std::string recebe(int fd)
+{
+  std::string resposta;
+  pollfd p = {fd, POLLIN, 0};
+  char bloco[1024];
+  while (poll(&p, 1, ESPERA_RESPOSTA) > 0)
+  {
+    ssize_t lidos = read(fd, bloco, sizeof(bloco));
+    if (lidos <= 0)
+    {
+      break;
+    }
+    resposta.append(bloco, lidos);
+  }
+  return resposta;
+}
+
+// envia o comando, assinado se houver chave (uma sessão por conexão). vazio se a conexão ou a sessão falharem
+static std::string consulta(const char *host, const char *porta, const uint8_t *chave, const char *comando)
+{
+  int fd = conecta(host, porta);
+  if (fd < 0)
+  {
+    return "";
+  }
+  SessaoAutenticada sessao;
+  std::string resposta;
+  if ((chave != NULL && !abreSessao(fd, chave, sessao, &resposta)) ||
+      !enviaComando(fd, sessao, comando, strlen(comando)))
+  {
+    close(fd);
+    return "";
+  }
+  resposta = recebe(fd);
+  close(fd);
+  return resposta;
+}
+
+// valor de "nome=" na resposta do S. -1 se ausente
+static long metrica(const std::string &resposta, const char *nome)
+{
+  std::string chave = std::string(nome) + "=";
+  size_t pos = 0;
+  while ((pos = resposta.find(chave, pos)) != std::string::npos)
+  {
+    if (pos == 0 || resposta[pos - 1] == ',' || resposta[pos - 1] == '\n')
+    {
+      return strtol(resposta.c_str() + pos + chave.size(), NULL, 10);
+    }
+    pos++;
+  }
+  return -1;
+}
+
+int main(int argc, char **argv)
+{
+  long anterior = -1;
+  int prazo = 90;
+  int opcao;
+  const char *textoChave = NULL;
+  while ((opcao = getopt(argc, argv, "k:e:t:")) != -1)
+  {
+    switch (opcao)
+    {
+    case 'e':
+      anterior = atol(optarg);
+      break;
+    case 't':
+      prazo = atoi(optarg);
+      break;
+    case 'k':
+      textoChave = optarg;
+      break;
+    default:
+      fprintf(stderr, "uso: %s [-k chave] [-e particao_anterior] [-t segundos] host porta\n", argv[0]);
+      return 1;
+    }
+  }
+  if (argc - optind != 2)
+  {
+    fprintf(stderr, "uso: %s [-k chave] [-e particao_anterior] [-t segundos] host porta\n", argv[0]);
+    return 1;
+  }
+  const char *host = argv[optind];
+  const char *porta = argv[optind + 1];
+  uint8_t chave[TAM_CHAVE];
+  int comChave = leChaveHost(textoChave, chave);
+  if (comChave < 0)
+  {
+    fprintf(stderr, "chave invalida: %d digitos hexadecimais\n", 2 * TAM_CHAVE);
+    return 1;
+  }
+
+  time_t limite = time(NULL) + prazo;
+  long autoteste = -1;
+  std::string resposta;
+  do
+  {
+    resposta = consulta(host, porta, comChave > 0 ? chave : NULL, "S");
+    autoteste = metrica(resposta, "autoteste");
+    if (autoteste > 0)
+    {
+      break;
+    }
+    sleep(INTERVALO);
+  } while (time(NULL) < limite);
+
+  long particao = metrica(resposta, "particao");
+  printf("particao=%ld autoteste=%ld falhas=%ld boot_ms=%ld ota_parada_ms=%ld saidas_restauradas=%ld\n", particao,
+         autoteste, metrica(resposta, "autoteste_falhas"), metrica(resposta, "boot_ms"),
+         metrica(resposta, "ota_parada_ms"), metrica(resposta, "saidas_restauradas"));
+  if (autoteste != 1)
+  {
+    fprintf(stderr, autoteste == 2 ? "autoteste reprovado\n" : "autoteste sem resultado no prazo\n");
+    return 1;
+  }
+  if (anterior >= 0 && particao == anterior)
+  {
+    fprintf(stderr, "imagem nova não está rodando (rollback?)\n");
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,493 @@
+/*
+ * Gravação e reprodução de sessões do controlador_FID, para rodar no host (Linux)
+ *
+ * grava: fica entre o cliente e o controlador (proxy TCP) e registra, com instante, tudo o que o cliente envia e
+ * tudo o que o controlador responde (texto, blocos da captura e registros do ADC), sem alterar o trafego.
+ * reproduz: envia os comandos de um log ao controlador respeitando os intervalos originais, divididos pela
+ * velocidade (0 = sem espera, o mais rapido possivel), e mede a vazão e o tempo até a primeira resposta de cada
+ * envio. serve para reproduzir uma falha de campo e como carga de benchmark. com chave (-k ou FID_CHAVE), abre
+ * uma sessão nova (tools/cliente) e reenvia cada comando assinado nela: o prefixo "@seq,tag " gravado é da sessão
+ * original e seria recusado, então é retirado, e os N gravados são pulados. sem chave os blocos vão como foram
+ * gravados.
+ * mostra: lista as entradas de um log.
+ *
+ * uso:
+ *   sessao_fid grava 6969 192.168.0.170 6969 sessao.log   (o cliente conecta em localhost:6969)
+ *   sessao_fid reproduz [-k chave] 192.168.0.170 6969 sessao.log [velocidade]
+ *   sessao_fid mostra sessao.log
+ *
+ * Formato do log (little-endian, pode ser mapeado com mmap e percorrido sem copia):
+ *   cabeçalho de 32 bytes: "FIDLOG\0\0", uint32 versao (1), uint32 reservado, uint64 inicio (CLOCK_REALTIME, ns),
+ *   uint64 reservado
+ *   entradas: uint64 instante (ns desde o inicio), uint8 direcao (0 = cliente -> controlador,
+ *   1 = controlador -> cliente), 3 bytes reservados, uint32 len, len bytes de dados, completados com zeros até
+ *   multiplo de 8 para manter as entradas alinhadas
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Ilib/Autenticacao -Itools/cliente tools/sessao_fid.cpp tools/cliente/SessaoHost.cpp \
+ *       lib/Autenticacao/Autenticacao.cpp -o sessao_fid
+ */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include "SessaoHost.h"
+
+#define LOG_VERSAO 1
+#define PARA_CONTROLADOR 0
+#define DO_CONTROLADOR 1
+
+struct CabecalhoLog
+{
+  char marca[8];
+  uint32_t versao;
+  uint32_t reservado;
+  uint64_t inicio;
+  uint64_t reservado2;
+};
+
+struct EntradaLog
+{
+  uint64_t instante;
+  uint8_t direcao;
+  uint8_t reservado[3];
+  uint32_t len;
+};
+
+static_assert(sizeof(CabecalhoLog) == 32, "cabeçalho do log deve ter 32 bytes");
+static_assert(sizeof(EntradaLog) == 16, "entrada do log deve ter 16 bytes");
+
+static volatile sig_atomic_t parar = 0;
+
+static void interrompe(int)
+{
+  parar = 1;
+}
+
+static uint64_t relogio(clockid_t tipo)
+{
+  timespec t;
+  clock_gettime(tipo, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static int conecta(const char *host, const char *porta)
+{
+  addrinfo dicas = {};
+  dicas.ai_family = AF_INET;
+  dicas.ai_socktype = SOCK_STREAM;
+  addrinfo *enderecos;
+  if (getaddrinfo(host, porta, &dicas, &enderecos) != 0)
+  {
+    return -1;
+  }
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd >= 0 && connect(fd, enderecos->ai_addr, enderecos->ai_addrlen) != 0)
+  {
+    close(fd);
+    fd = -1;
+  }
+  freeaddrinfo(enderecos);
+  if (fd >= 0)
+  {
+    int um = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &um, sizeof(um)); // comandos saem como foram gravados
+  }
+  return fd;
+}
+
+static int escuta(const char *porta)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  int um = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &um, sizeof(um));
+  sockaddr_in endereco = {};
+  endereco.sin_family = AF_INET;
+  endereco.sin_port = htons(atoi(porta));
+  endereco.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (bind(fd, (sockaddr *)&endereco, sizeof(endereco)) != 0 || listen(fd, 1) != 0)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool escreveTudo(int fd, const uint8_t *dados, size_t len)
+{
+  while (len > 0)
+  {
+    ssize_t n = write(fd, dados, len);
+    if (n <= 0)
+    {
+      return false;
+    }
+    dados += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void gravaEntrada(FILE *log, uint64_t instante, uint8_t direcao, const uint8_t *dados, uint32_t len)
+{
+  static const uint8_t zeros[8] = {};
+  EntradaLog entrada = {instante, direcao, {0, 0, 0}, len};
+  fwrite(&entrada, sizeof(entrada), 1, log);
+  fwrite(dados, 1, len, log);
+  fwrite(zeros, 1, (8 - len % 8) % 8, log);
+}
+
+// log mapeado em memoria, somente leitura
+struct Log
+{
+  const uint8_t *base;
+  size_t tamanho;
+};
+
+static bool abreLog(const char *nome, Log *log)
+{
+  int fd = open(nome, O_RDONLY);
+  struct stat info;
+  if (fd < 0 || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(CabecalhoLog))
+  {
+    return false;
+  }
+  void *base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+  {
+    return false;
+  }
+  const CabecalhoLog *cabecalho = (const CabecalhoLog *)base;
+  if (memcmp(cabecalho->marca, "FIDLOG\0\0", 8) != 0 || cabecalho->versao != LOG_VERSAO)
+  {
+    munmap(base, info.st_size);
+    return false;
+  }
+  log->base = (const uint8_t *)base;
+  log->tamanho = info.st_size;
+  return true;
+}
+
+// devolve a entrada na posição pos e avança pos, ou NULL no fim do log
+static const EntradaLog *proximaEntrada(const Log &log, size_t *pos)
+{
+  if (*pos + sizeof(EntradaLog) > log.tamanho)
+  {
+    return NULL;
+  }
+  const EntradaLog *entrada = (const EntradaLog *)(log.base + *pos);
+  size_t tamanho = sizeof(EntradaLog) + ((entrada->len + 7) & ~7u);
+  if (*pos + sizeof(EntradaLog) + entrada->len > log.tamanho)
+  {
+    return NULL; // log truncado (gravação interrompida)
+  }
+  *pos += tamanho;
+  return entrada;
+}
+
+static int grava(const char *portaLocal, const char *host, const char *porta, const char *nome)
+{
+  FILE *log = fopen(nome, "wb");
+  int servidor = escuta(portaLocal);
+  if (!log || servidor < 0)
+  {
+    perror("grava");
+    return 1;
+  }
+  fprintf(stderr, "aguardando o cliente na porta %s\n", portaLocal);
+  int cliente = accept(servidor, NULL, NULL);
+  int controlador = conecta(host, porta);
+  if (cliente < 0 || controlador < 0)
+  {
+    perror("conexão");
+    return 1;
+  }
+
+  CabecalhoLog cabecalho = {{'F', 'I', 'D', 'L', 'O', 'G', 0, 0}, LOG_VERSAO, 0, relogio(CLOCK_REALTIME), 0};
+  fwrite(&cabecalho, sizeof(cabecalho), 1, log);
+  uint64_t inicio = relogio(CLOCK_MONOTONIC);
+
+  uint8_t bloco[65536];
+  uint64_t bytes[2] = {0, 0};
+  pollfd fds[2] = {{cliente, POLLIN, 0}, {controlador, POLLIN, 0}};
+  while (!parar)
+  {
+    if (poll(fds, 2, 200) < 0)
+    {
+      break;
+    }
+    bool fim = false;
+    for (int lado = 0; lado < 2; lado++)
+    {
+      if (!(fds[lado].revents & (POLLIN | POLLHUP | POLLERR)))
+      {
+        continue;
+      }
+      ssize_t n = read(fds[lado].fd, bloco, sizeof(bloco));
+      if (n <= 0)
+      {
+        fim = true;
+        break;
+      }
+      // lado 0 é o cliente: o que chega dele vai para o controlador
+      uint8_t direcao = lado == 0 ? PARA_CONTROLADOR : DO_CONTROLADOR;
+      gravaEntrada(log, relogio(CLOCK_MONOTONIC) - inicio, direcao, bloco, n);
+      bytes[direcao] += n;
+      if (!escreveTudo(fds[1 - lado].fd, bloco, n))
+      {
+        fim = true;
+        break;
+      }
+    }
+    if (fim)
+    {
+      break;
+    }
+  }
+  fclose(log);
+  close(cliente);
+  close(controlador);
+  close(servidor);
+  fprintf(stderr, "gravados: %llu bytes enviados, %llu recebidos em %.3f s\n", (unsigned long long)bytes[0],
+          (unsigned long long)bytes[1], (relogio(CLOCK_MONOTONIC) - inicio) * 1e-9);
+  return 0;
+}
+
+// com a sessão nova: separa os comandos do bloco gravado (um comando pode vir em mais de um bloco, por isso o
+// pendente), tira o quadro da sessão original e envia cada um assinado. devolve os bytes enviados ou -1
+static long reenviaAssinado(int fd, SessaoAutenticada &sessao, std::string &pendente, const uint8_t *dados, size_t len)
+{
+  pendente.append((const char *)dados, len);
+  long enviados = 0;
+  size_t fim;
+  while ((fim = pendente.find('\r')) != std::string::npos)
+  {
+    size_t inicio = pendente.find_first_not_of('\n'); // o '\n' de um "\r\n" fica no começo do proximo
+    std::string comando = inicio < fim ? pendente.substr(inicio, fim - inicio) : "";
+    pendente.erase(0, fim + 1);
+    if (!comando.empty() && comando[0] == PREFIXO_QUADRO)
+    {
+      comando.erase(0, comando.size() < TAM_PREFIXO_QUADRO ? comando.size() : TAM_PREFIXO_QUADRO);
+    }
+    if (comando.empty() || comando[0] == 'N')
+    {
+      continue; // a sessão desta conexão já foi aberta
+    }
+    if (!enviaComando(fd, sessao, comando.data(), comando.size()))
+    {
+      return -1;
+    }
+    enviados += TAM_PREFIXO_QUADRO + comando.size() + 1;
+  }
+  return enviados;
+}
+
+static int reproduz(const char *host, const char *porta, const char *nome, double velocidade, const uint8_t *chave)
+{
+  Log log;
+  if (!abreLog(nome, &log))
+  {
+    fprintf(stderr, "log invalido: %s\n", nome);
+    return 1;
+  }
+  int controlador = conecta(host, porta);
+  if (controlador < 0)
+  {
+    perror("conexão");
+    return 1;
+  }
+  SessaoAutenticada sessao;
+  std::string pendente; // comando gravado ainda sem o '\r', com a sessão nova
+  if (chave != NULL)
+  {
+    std::string resposta;
+    if (!abreSessao(controlador, chave, sessao, &resposta))
+    {
+      fprintf(stderr, "sessão recusada:%s\n", resposta.c_str());
+      close(controlador);
+      return 1;
+    }
+  }
+
+  uint8_t bloco[65536];
+  uint64_t enviados = 0, bytesEnviados = 0, bytesRecebidos = 0, bytesOriginais = 0;
+  uint64_t respondidos = 0, somaLatencia = 0, maiorLatencia = 0, duracaoOriginal = 0;
+  uint64_t ultimoEnvio = 0; // instante do envio ainda sem resposta, 0 se nenhum
+  uint64_t inicio = relogio(CLOCK_MONOTONIC);
+  size_t pos = sizeof(CabecalhoLog);
+  const EntradaLog *entrada = proximaEntrada(log, &pos);
+
+  // as respostas são lidas enquanto se espera o instante do proximo envio. depois do ultimo envio, espera
+  // um segundo sem trafego para recolher as respostas finais
+  uint64_t ultimoTrafego = inicio;
+  while (!parar)
+  {
+    while (entrada && entrada->direcao != PARA_CONTROLADOR)
+    {
+      bytesOriginais += entrada->len;
+      entrada = proximaEntrada(log, &pos);
+    }
+    uint64_t agora = relogio(CLOCK_MONOTONIC);
+    if (!entrada && agora - ultimoTrafego > 1000000000ull)
+    {
+      break;
+    }
+    int espera = 100;
+    if (entrada)
+    {
+      duracaoOriginal = entrada->instante;
+      uint64_t alvo = velocidade > 0 ? inicio + (uint64_t)(entrada->instante / velocidade) : agora;
+      if (alvo <= agora)
+      {
+        const uint8_t *dados = (const uint8_t *)(entrada + 1);
+        long bytes = entrada->len;
+        if (sessao.ativa())
+        {
+          bytes = reenviaAssinado(controlador, sessao, pendente, dados, entrada->len);
+        }
+        else if (!escreveTudo(controlador, dados, entrada->len))
+        {
+          bytes = -1;
+        }
+        if (bytes < 0)
+        {
+          break;
+        }
+        enviados++;
+        bytesEnviados += bytes;
+        if (ultimoEnvio == 0)
+        {
+          ultimoEnvio = agora;
+        }
+        ultimoTrafego = agora;
+        entrada = proximaEntrada(log, &pos);
+        espera = 0;
+      }
+      else
+      {
+        espera = (int)((alvo - agora) / 1000000);
+      }
+    }
+
+    pollfd fd = {controlador, POLLIN, 0};
+    if (poll(&fd, 1, espera) > 0)
+    {
+      ssize_t n = read(controlador, bloco, sizeof(bloco));
+      if (n <= 0)
+      {
+        break;
+      }
+      uint64_t chegada = relogio(CLOCK_MONOTONIC);
+      bytesRecebidos += n;
+      ultimoTrafego = chegada;
+      if (ultimoEnvio != 0)
+      {
+        uint64_t latencia = chegada - ultimoEnvio;
+        somaLatencia += latencia;
+        if (latencia > maiorLatencia)
+        {
+          maiorLatencia = latencia;
+        }
+        respondidos++;
+        ultimoEnvio = 0;
+      }
+    }
+  }
+  double segundos = (ultimoTrafego - inicio) * 1e-9; // até a ultima resposta, sem a espera final
+  close(controlador);
+  munmap((void *)log.base, log.tamanho);
+
+  printf("envios=%llu bytes_enviados=%llu bytes_recebidos=%llu (gravados: %llu) segundos=%.3f (original: %.3f)\n",
+         (unsigned long long)enviados, (unsigned long long)bytesEnviados, (unsigned long long)bytesRecebidos,
+         (unsigned long long)bytesOriginais, segundos, duracaoOriginal * 1e-9);
+  if (segundos > 0)
+  {
+    printf("comandos=%.1f /s recebido=%.1f kB/s\n", enviados / segundos, bytesRecebidos / segundos / 1000);
+  }
+  if (respondidos > 0)
+  {
+    printf("primeira_resposta: media=%.3f ms max=%.3f ms (%llu envios respondidos)\n",
+           somaLatencia * 1e-6 / respondidos, maiorLatencia * 1e-6, (unsigned long long)respondidos);
+  }
+  return 0;
+}
+
+static int mostra(const char *nome)
+{
+  Log log;
+  if (!abreLog(nome, &log))
+  {
+    fprintf(stderr, "log invalido: %s\n", nome);
+    return 1;
+  }
+  size_t pos = sizeof(CabecalhoLog);
+  while (const EntradaLog *entrada = proximaEntrada(log, &pos))
+  {
+    const uint8_t *dados = (const uint8_t *)(entrada + 1);
+    printf("%12.6f %s %5u ", entrada->instante * 1e-9, entrada->direcao == PARA_CONTROLADOR ? ">" : "<", entrada->len);
+    for (uint32_t i = 0; i < entrada->len && i < 60; i++)
+    {
+      putchar(dados[i] >= 32 && dados[i] < 127 ? dados[i] : '.');
+    }
+    putchar('\n');
+  }
+  munmap((void *)log.base, log.tamanho);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  signal(SIGINT, interrompe);
+  signal(SIGPIPE, SIG_IGN);
+  if (argc == 6 && strcmp(argv[1], "grava") == 0)
+  {
+    return grava(argv[2], argv[3], argv[4], argv[5]);
+  }
+  if (argc >= 2 && strcmp(argv[1], "reproduz") == 0)
+  {
+    const char *textoChave = NULL;
+    int arg = 2;
+    if (argc > 3 && strcmp(argv[2], "-k") == 0)
+    {
+      textoChave = argv[3];
+      arg = 4;
+    }
+    uint8_t chave[TAM_CHAVE];
+    int comChave = leChaveHost(textoChave, chave);
+    if (comChave < 0)
+    {
+      fprintf(stderr, "chave invalida: %d digitos hexadecimais\n", 2 * TAM_CHAVE);
+      return 1;
+    }
+    if (argc - arg == 3 || argc - arg == 4)
+    {
+      return reproduz(argv[arg], argv[arg + 1], argv[arg + 2], argc - arg == 4 ? atof(argv[arg + 3]) : 1.0,
+                      comChave > 0 ? chave : NULL);
+    }
+  }
+  if (argc == 3 && strcmp(argv[1], "mostra") == 0)
+  {
+    return mostra(argv[2]);
+  }
+  fprintf(stderr, "uso:\n"
+                  "  %s grava porta_local host porta arquivo.log\n"
+                  "  %s reproduz [-k chave] host porta arquivo.log [velocidade, 0 = sem espera]\n"
+                  "  %s mostra arquivo.log\n",
+          argv[0], argv[0], argv[0]);
+  return 1;
+}
@@ -0,0 +1,387 @@
+/*
+ * Simulador do hardware do controlador_FID
+ */
+
+#include <math.h>
+#include "Simulador.h"
+#include "arduino/Arduino.h"
+#include "arduino/SPI.h"
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MCP4921/MCP4922
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ModeloMCP492X::ModeloMCP492X(uint8_t saidas, double vref, double vdd) : _saidas(saidas), _vref(vref), _vdd(vdd) {}
+
+void ModeloMCP492X::seleciona(bool ativo)
+{
+  if (ativo && !_selecionado)
+  {
+    _bits = 0;
+    _deslocamento = 0;
+  }
+  else if (!ativo && _selecionado)
+  {
+    // subida do CS: a palavra só vale com exatamente 16 clocks
+    uint8_t saida = _deslocamento >> 15 & 1;
+    if (_bits != 16 || saida >= _saidas)
+    {
+      _erros++;
+    }
+    else
+    {
+      Registro &r = _entrada[saida];
+      r.buffer = _deslocamento >> 14 & 1;
+      r.ganho1x = _deslocamento >> 13 & 1;
+      r.ativa = _deslocamento >> 12 & 1;
+      r.valor = _deslocamento & 0x0FFF;
+      _escritas++;
+      if (_ldacBaixo)
+      {
+        _saida[saida] = r;
+      }
+    }
+  }
+  _selecionado = ativo;
+}
+
+bool ModeloMCP492X::bit(bool mosi)
+{
+  if (_selecionado)
+  {
+    _deslocamento = (_deslocamento << 1 | mosi) & 0xFFFF;
+    _bits++;
+  }
+  return true; // sem saida de dados
+}
+
+void ModeloMCP492X::ldac(bool nivel)
+{
+  if (!nivel && !_ldacBaixo)
+  {
+    _saida[0] = _entrada[0];
+    _saida[1] = _entrada[1];
+  }
+  _ldacBaixo = !nivel;
+}
+
+double ModeloMCP492X::tensao(uint8_t saida) const
+{
+  const Registro &r = _saida[saida];
+  if (!r.ativa)
+  {
+    return 0;
+  }
+  double v = _vref * r.valor / 4096 * (r.ganho1x ? 1 : 2);
+  return v > _vdd ? _vdd : v;
+}
+
+uint16_t ModeloMCP492X::valor(uint8_t saida) const
+{
+  return _saida[saida].valor;
+}
+
+bool ModeloMCP492X::ganho2x(uint8_t saida) const
+{
+  return !_saida[saida].ganho1x;
+}
+
+bool ModeloMCP492X::buffer(uint8_t saida) const
+{
+  return _saida[saida].buffer;
+}
+
+bool ModeloMCP492X::ativa(uint8_t saida) const
+{
+  return _saida[saida].ativa;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// MCP3208
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+ModeloMCP3208::ModeloMCP3208(std::function<double(int)> entrada, double vref) : _entrada(entrada), _vref(vref) {}
+
+void ModeloMCP3208::seleciona(bool ativo)
+{
+  if (ativo != _selecionado)
+  {
+    _posicao = -1;
+    _config = 0;
+  }
+  _selecionado = ativo;
+}
+
+bool ModeloMCP3208::bit(bool mosi)
+{
+  if (!_selecionado)
+  {
+    return true;
+  }
+  if (_posicao < 0)
+  {
+    if (mosi)
+    {
+      _posicao = 0; // start bit
+    }
+    return true;
+  }
+  _posicao++;
+  if (_posicao <= 4)
+  {
+    _config = _config << 1 | mosi; // SGL/DIFF, D2, D1, D0
+    return true;
+  }
+  if (_posicao == 5)
+  {
+    // amostragem. diferencial: pares (0,1), (2,3)... com D0 invertendo a polaridade
+    int canal = _config & 0x7;
+    double v;
+    if (_config & 0x8)
+    {
+      v = _entrada(canal);
+    }
+    else
+    {
+      int par = canal & 0x6;
+      v = canal & 1 ? _entrada(par + 1) - _entrada(par) : _entrada(par) - _entrada(par + 1);
+    }
+    double codigo = floor(v / _vref * 4096);
+    _amostra = codigo < 0 ? 0 : codigo > 4095 ? 4095 : (uint16_t)codigo;
+    _conversoes++;
+    return true;
+  }
+  if (_posicao == 6)
+  {
+    return false; // bit nulo
+  }
+  if (_posicao <= 18)
+  {
+    return _amostra >> (18 - _posicao) & 1;
+  }
+  return false;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Planta
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PlantaLaco::PlantaLaco(int canais, std::function<double(int)> comando, uint32_t semente)
+    : _comando(comando), _parametros(canais), _estado(canais, 0.0), _gerador(semente)
+{
+}
+
+void PlantaLaco::avanca(double segundos)
+{
+  for (size_t canal = 0; canal < _estado.size(); canal++)
+  {
+    const ParametrosLaco &p = _parametros[canal];
+    double alvo = p.ganho * _comando(canal);
+    alvo = alvo < p.minimo ? p.minimo : alvo > p.maximo ? p.maximo : alvo;
+    _estado[canal] += (alvo - _estado[canal]) * (1 - exp(-segundos / p.tau));
+  }
+}
+
+double PlantaLaco::leitura(int canal)
+{
+  const ParametrosLaco &p = _parametros[canal];
+  if (p.ruido <= 0)
+  {
+    return _estado[canal];
+  }
+  std::normal_distribution<double> ruido(0.0, p.ruido);
+  return _estado[canal] + ruido(_gerador);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// 74HC595
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Modelo74HC595::Modelo74HC595(uint8_t pinoDados, uint8_t pinoClock, uint8_t pinoLatch) : _pinoDados(pinoDados)
+{
+  Simulador::atual().aoEscrever(pinoClock, [this](bool nivel) { clock(nivel); });
+  Simulador::atual().aoEscrever(pinoLatch, [this](bool nivel) { latch(nivel); });
+}
+
+void Modelo74HC595::conecta(uint8_t saida, DispositivoSPI *dispositivo)
+{
+  _dispositivos[saida] = dispositivo;
+}
+
+void Modelo74HC595::clock(bool nivel)
+{
+  if (nivel)
+  {
+    _registro = _registro << 1 | Simulador::atual().le(_pinoDados);
+  }
+}
+
+void Modelo74HC595::latch(bool nivel)
+{
+  if (!nivel)
+  {
+    return;
+  }
+  uint32_t mudaram = _saidas ^ _registro;
+  _saidas = _registro;
+  for (int saida = 0; saida < 32; saida++)
+  {
+    if ((mudaram >> saida & 1) && _dispositivos[saida])
+    {
+      _dispositivos[saida]->seleciona(!(_saidas >> saida & 1));
+    }
+  }
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Simulador
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+Simulador *Simulador::_atual = nullptr;
+
+Simulador::Simulador()
+{
+  for (bool &nivel : _niveis)
+  {
+    nivel = true;
+  }
+  for (uint32_t &clock : _clock)
+  {
+    clock = 1000000;
+  }
+  _atual = this;
+}
+
+Simulador::~Simulador()
+{
+  if (_atual == this)
+  {
+    _atual = nullptr;
+  }
+}
+
+Simulador &Simulador::atual()
+{
+  return *_atual;
+}
+
+void Simulador::avanca(uint64_t ns)
+{
+  _agora += ns;
+  // integra em passos de até 100 us, para a planta ver o comando nos instantes em que ele muda
+  if (_planta && _agora - _integrado >= 100000)
+  {
+    _planta->avanca((_agora - _integrado) * 1e-9);
+    _integrado = _agora;
+  }
+}
+
+void Simulador::escreve(uint8_t pino, bool nivel)
+{
+  _niveis[pino] = nivel;
+  for (auto &funcao : _aoEscrever[pino])
+  {
+    funcao(nivel);
+  }
+}
+
+void Simulador::aoEscrever(uint8_t pino, std::function<void(bool)> funcao)
+{
+  _aoEscrever[pino].push_back(funcao);
+}
+
+void Simulador::conectaCS(uint8_t pino, DispositivoSPI *dispositivo)
+{
+  aoEscrever(pino, [dispositivo](bool nivel) { dispositivo->seleciona(!nivel); });
+}
+
+void Simulador::conectaSPI(uint8_t barramento, DispositivoSPI *dispositivo)
+{
+  _barramentos[barramento].push_back(dispositivo);
+}
+
+void Simulador::configuraSPI(uint8_t barramento, uint32_t clock)
+{
+  _clock[barramento] = clock;
+}
+
+// MSB primeiro. o MISO é o E logico dos selecionados (alta impedancia = 1)
+uint8_t Simulador::transfere(uint8_t barramento, uint8_t dado)
+{
+  uint8_t recebido = 0;
+  for (int i = 7; i >= 0; i--)
+  {
+    bool miso = true;
+    for (DispositivoSPI *dispositivo : _barramentos[barramento])
+    {
+      if (dispositivo->selecionado())
+      {
+        miso &= dispositivo->bit(dado >> i & 1);
+      }
+    }
+    recebido = recebido << 1 | miso;
+  }
+  _bytesSPI++;
+  avanca(8000000000ull / _clock[barramento]);
+  return recebido;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arduino.h e SPI.h do simulador
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pino, uint8_t nivel)
+{
+  Simulador::atual().avanca(50); // uma escrita de GPIO no ESP32 leva algumas dezenas de ns
+  Simulador::atual().escreve(pino, nivel);
+}
+
+int digitalRead(uint8_t pino)
+{
+  return Simulador::atual().le(pino);
+}
+
+unsigned long micros()
+{
+  return Simulador::atual().agora() / 1000;
+}
+
+unsigned long millis()
+{
+  return Simulador::atual().agora() / 1000000;
+}
+
+void delay(unsigned long ms)
+{
+  Simulador::atual().avanca(ms * 1000000ull);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  Simulador::atual().avanca(us * 1000ull);
+}
+
+SPIClass SPI(VSPI);
+
+SPIClass::SPIClass(uint8_t barramento) : _barramento(barramento) {}
+
+void SPIClass::beginTransaction(SPISettings configuracao)
+{
+  Simulador::atual().configuraSPI(_barramento, configuracao.clock);
+  Simulador::atual().contaTransacao();
+}
+
+void SPIClass::endTransaction() {}
+
+uint8_t SPIClass::transfer(uint8_t dado)
+{
+  return Simulador::atual().transfere(_barramento, dado);
+}
+
+uint16_t SPIClass::transfer16(uint16_t dado)
+{
+  uint16_t alto = transfer(dado >> 8);
+  return alto << 8 | transfer(dado & 0xFF);
+}
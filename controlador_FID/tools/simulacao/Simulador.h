@@ -0,0 +1,177 @@
+/*
+ * Simulador do hardware do controlador_FID, para rodar no host (Linux)
+ *
+ * Modelos bit a bit dos DACs MCP4921/MCP4922, do ADC MCP3208 e dos 74HC595 dos chip selects, ligados por pinos e
+ * barramentos SPI virtuais, e uma planta de laço de corrente (atraso de primeira ordem, ruido e saturação) que leva a
+ * tensão de cada DAC à entrada correspondente do ADC. as bibliotecas do firmware (MCP492X, Mcp320x) compilam sem
+ * alteração contra o Arduino.h/SPI.h de arduino/, e cada byte que elas enviam é decodificado pelos modelos como o
+ * chip real faria: bits a mais ou a menos, CS fora de hora ou LDAC esquecido aparecem no estado dos modelos.
+ *
+ * Todo o tempo é virtual: micros(), delay() e o clock do SPI avançam o relogio do simulador, e a planta é integrada
+ * nesses avanços. o resultado é deterministico (ruido com semente fixa) e roda bem mais rapido que o tempo real.
+ */
+
+#ifndef Simulador_h
+#define Simulador_h
+
+#include <stdint.h>
+#include <functional>
+#include <random>
+#include <vector>
+
+// Dispositivo num barramento SPI. seleciona() recebe o CS (ativo = nivel baixo) e bit() um pulso de clock
+// (modo 0): recebe o MOSI e devolve o MISO. um dispositivo sem saida devolve 1 (alta impedancia, pull-up)
+class DispositivoSPI
+{
+public:
+  virtual ~DispositivoSPI() {}
+  virtual void seleciona(bool ativo) = 0;
+  virtual bool bit(bool mosi) = 0;
+  bool selecionado() const { return _selecionado; }
+
+protected:
+  bool _selecionado = false;
+};
+
+// MCP4921 (1 saida) ou MCP4922 (2 saidas). palavra de 16 bits: A/B, BUF, GA (1 = 1x), SHDN (1 = ativa), D11..D0.
+// a palavra vale na subida do CS se vieram exatamente 16 clocks; qualquer outro numero é descartado e contado.
+// o registrador de entrada passa para a saida com o LDAC baixo (ou na descida dele)
+class ModeloMCP492X : public DispositivoSPI
+{
+public:
+  ModeloMCP492X(uint8_t saidas, double vref = 3.3, double vdd = 3.3);
+  void seleciona(bool ativo) override;
+  bool bit(bool mosi) override;
+  void ldac(bool nivel);
+
+  double tensao(uint8_t saida) const; // tensão na saida, 0 se desligada
+  uint16_t valor(uint8_t saida) const;
+  bool ganho2x(uint8_t saida) const;
+  bool buffer(uint8_t saida) const;
+  bool ativa(uint8_t saida) const;
+  uint32_t escritas() const { return _escritas; }
+  uint32_t erros() const { return _erros; }
+
+private:
+  struct Registro
+  {
+    uint16_t valor = 0;
+    bool buffer = false;
+    bool ganho1x = true;
+    bool ativa = false; // o chip liga com as saidas desligadas
+  };
+  uint8_t _saidas;
+  double _vref, _vdd;
+  Registro _entrada[2], _saida[2];
+  uint32_t _deslocamento = 0;
+  int _bits = 0;
+  bool _ldacBaixo = false;
+  uint32_t _escritas = 0, _erros = 0;
+};
+
+// MCP3208. depois do start bit: SGL/DIFF, D2, D1, D0, um clock de amostragem, o bit nulo e B11..B0 (MSB primeiro).
+// a entrada é lida no clock de amostragem pela função passada no construtor (tensão do canal 0 a 7)
+class ModeloMCP3208 : public DispositivoSPI
+{
+public:
+  ModeloMCP3208(std::function<double(int)> entrada, double vref = 3.3);
+  void seleciona(bool ativo) override;
+  bool bit(bool mosi) override;
+  uint32_t conversoes() const { return _conversoes; }
+  uint16_t ultima() const { return _amostra; }
+
+private:
+  std::function<double(int)> _entrada;
+  double _vref;
+  int _posicao = -1; // -1: aguardando o start bit
+  uint8_t _config = 0;
+  uint16_t _amostra = 0;
+  uint32_t _conversoes = 0;
+};
+
+// Laço de corrente de um canal: a leitura segue ganho * tensão do DAC com atraso de primeira ordem (constante
+// tau), limitada a [minimo, maximo], mais ruido gaussiano de desvio ruido na leitura
+struct ParametrosLaco
+{
+  double ganho = 1.0;
+  double tau = 0.010;   // s
+  double ruido = 0.0;   // V
+  double minimo = 0.0;  // V
+  double maximo = 3.3;  // V
+};
+
+class PlantaLaco
+{
+public:
+  PlantaLaco(int canais, std::function<double(int)> comando, uint32_t semente = 1);
+  ParametrosLaco &parametros(int canal) { return _parametros[canal]; }
+  void avanca(double segundos); // integra com o comando constante no intervalo
+  double leitura(int canal);    // saida do canal com ruido
+  double estado(int canal) const { return _estado[canal]; }
+
+private:
+  std::function<double(int)> _comando;
+  std::vector<ParametrosLaco> _parametros;
+  std::vector<double> _estado;
+  std::mt19937 _gerador;
+};
+
+// 74HC595 em cadeia (até 32 saidas). desloca na subida do clock, aplica na subida do latch. a saida k é o bit k do
+// registrador, então o ultimo bit deslocado vai para a saida 0. cada saida pode acionar o CS de um dispositivo
+class Modelo74HC595
+{
+public:
+  Modelo74HC595(uint8_t pinoDados, uint8_t pinoClock, uint8_t pinoLatch);
+  void conecta(uint8_t saida, DispositivoSPI *dispositivo);
+  uint32_t saidas() const { return _saidas; }
+
+private:
+  void clock(bool nivel);
+  void latch(bool nivel);
+  uint8_t _pinoDados;
+  uint32_t _registro = 0, _saidas = 0xFFFFFFFF;
+  DispositivoSPI *_dispositivos[32] = {};
+};
+
+// Estado global: relogio virtual, pinos e barramentos. as funções do Arduino.h/SPI.h do simulador usam a instancia
+// criada por ultimo
+class Simulador
+{
+public:
+  Simulador();
+  ~Simulador();
+  static Simulador &atual();
+
+  // relogio virtual em ns. avançar integra a planta, se houver
+  uint64_t agora() const { return _agora; }
+  void avanca(uint64_t ns);
+  void conectaPlanta(PlantaLaco *planta) { _planta = planta; }
+
+  // pinos: nivel atual e funções chamadas a cada escrita
+  void escreve(uint8_t pino, bool nivel);
+  bool le(uint8_t pino) const { return _niveis[pino]; }
+  void aoEscrever(uint8_t pino, std::function<void(bool)> funcao);
+  void conectaCS(uint8_t pino, DispositivoSPI *dispositivo); // CS direto em GPIO
+
+  // barramentos (VSPI, HSPI)
+  void conectaSPI(uint8_t barramento, DispositivoSPI *dispositivo);
+  void configuraSPI(uint8_t barramento, uint32_t clock);
+  uint8_t transfere(uint8_t barramento, uint8_t dado);
+  uint64_t bytesSPI() const { return _bytesSPI; }
+  uint32_t transacoes() const { return _transacoes; }
+  void contaTransacao() { _transacoes++; }
+
+private:
+  static Simulador *_atual;
+  uint64_t _agora = 0;
+  uint64_t _integrado = 0;
+  PlantaLaco *_planta = nullptr;
+  bool _niveis[64];
+  std::vector<std::function<void(bool)>> _aoEscrever[64];
+  std::vector<DispositivoSPI *> _barramentos[4];
+  uint32_t _clock[4];
+  uint64_t _bytesSPI = 0;
+  uint32_t _transacoes = 0;
+};
+
+#endif
@@ -0,0 +1,29 @@
+/*
+ * Arduino.h do simulador: o minimo que as bibliotecas dos DACs e ADCs usam,
+ * com os pinos e o tempo resolvidos pelo Simulador (relogio virtual)
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+void pinMode(uint8_t pino, uint8_t modo);
+void digitalWrite(uint8_t pino, uint8_t nivel);
+int digitalRead(uint8_t pino);
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#endif
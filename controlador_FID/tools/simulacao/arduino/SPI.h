@@ -0,0 +1,39 @@
+/*
+ * SPI.h do simulador: cada SPIClass é um BarramentoSPI do Simulador. as
+ * transferencias são feitas bit a bit nos modelos selecionados e avançam o
+ * relogio virtual pelo tempo de clock
+ */
+
+#ifndef SPI_h
+#define SPI_h
+
+#include "Arduino.h"
+
+#define VSPI 3
+#define HSPI 2
+
+class SPISettings
+{
+public:
+  SPISettings() : clock(1000000) {}
+  SPISettings(uint32_t clock, uint8_t, uint8_t) : clock(clock) {}
+  uint32_t clock;
+};
+
+class SPIClass
+{
+public:
+  SPIClass(uint8_t barramento = VSPI);
+  void begin(int8_t = -1, int8_t = -1, int8_t = -1, int8_t = -1) {}
+  void beginTransaction(SPISettings configuracao);
+  void endTransaction();
+  uint8_t transfer(uint8_t dado);
+  uint16_t transfer16(uint16_t dado);
+
+private:
+  uint8_t _barramento;
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,189 @@
+/*
+ * Sequencia exata do barramento no MCP492X::writeMany, verificada no host (Linux)
+ *
+ * Substitui o SPI.h e o Arduino.h do simulador por um barramento gravado: cada beginTransaction/endTransaction,
+ * palavra de transfer16, byte de transfer, borda de CS (digitalWrite) e chamada da função de seleção vira um
+ * evento numa lista, comparada com a sequencia esperada. as palavras esperadas são escritas à mão a partir do
+ * formato do datasheet (bit 15 saida, 14 buffer, 13 ganho 1x, 12 ativa, 11-0 valor), sem passar pelo commandWord.
+ * verifica: um chip com CS por pino, varios chips pela função de seleção (como os bancos do firmware), lotes de
+ * 32 (MCP492X_BATCH), 33 e 65 escritas, que atravessam a divisão interna em blocos sem abrir outra transação, o
+ * lote vazio e o analogWrite. devolve 0 se tudo passou.
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -Itools/simulacao/arduino -Ilib/MCP492X tools/simulacao/lote_fid.cpp lib/MCP492X/MCP492X.cpp \
+ *       -o lote_fid
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <MCP492X.h>
+
+static std::vector<std::string> eventos;
+
+static void grava(const char *formato, unsigned a, unsigned b = 0)
+{
+  char texto[32];
+  snprintf(texto, sizeof(texto), formato, a, b);
+  eventos.push_back(texto);
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Arduino.h e SPI.h gravados
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+void pinMode(uint8_t, uint8_t) {}
+
+void digitalWrite(uint8_t pino, uint8_t nivel)
+{
+  grava("cs%u=%u", pino, nivel);
+}
+
+int digitalRead(uint8_t)
+{
+  return 0;
+}
+
+unsigned long micros()
+{
+  return 0;
+}
+
+unsigned long millis()
+{
+  return 0;
+}
+
+void delay(unsigned long) {}
+
+void delayMicroseconds(unsigned int) {}
+
+SPIClass SPI(VSPI);
+
+SPIClass::SPIClass(uint8_t barramento) : _barramento(barramento) {}
+
+void SPIClass::beginTransaction(SPISettings configuracao)
+{
+  grava("inicio %u@%u", configuracao.clock, _barramento);
+}
+
+void SPIClass::endTransaction()
+{
+  grava("fim@%u", _barramento);
+}
+
+uint8_t SPIClass::transfer(uint8_t dado)
+{
+  grava("byte %02X", dado);
+  return 0;
+}
+
+uint16_t SPIClass::transfer16(uint16_t dado)
+{
+  grava("palavra %04X", dado);
+  return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// verificação
+//////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int falhas = 0;
+
+static void seleciona(void *banco, uint8_t chip, bool ativo)
+{
+  grava(ativo ? "sel%u.%u+" : "sel%u.%u-", (unsigned)(intptr_t)banco, chip);
+}
+
+static void confere(const char *teste, const std::vector<std::string> &esperado)
+{
+  size_t n = eventos.size() > esperado.size() ? eventos.size() : esperado.size();
+  for (size_t i = 0; i < n; i++)
+  {
+    const char *obtido = i < eventos.size() ? eventos[i].c_str() : "(nada)";
+    const char *previsto = i < esperado.size() ? esperado[i].c_str() : "(nada)";
+    if (std::string(obtido) != previsto)
+    {
+      printf("  FALHA %s, evento %zu: %s, esperado %s\n", teste, i, obtido, previsto);
+      falhas++;
+      break;
+    }
+  }
+  eventos.clear();
+}
+
+int main()
+{
+  const uint8_t pinoCS = 5;
+  SPIClass hspi(HSPI);
+  MCP492X dac(pinoCS, 20000000, &SPI);
+  MCP492X dacHSPI(0, 10000000, &hspi);
+  dac.begin();
+  dacHSPI.begin();
+  confere("begin", {"cs5=1", "cs0=1"});
+
+  // um chip, CS pelo pino do construtor: uma transação, CS baixo e alto em volta de cada palavra
+  {
+    const MCP492XWrite lote[] = {
+        {0, false, false, true, true, 0x000}, // A, sem buffer, 1x, ativa, 0
+        {0, true, true, false, true, 0xABC},  // B, buffer, 2x, ativa
+        {0, false, false, true, false, 0xFFF}, // A desligada, fundo de escala
+    };
+    dac.writeMany(lote, 3, NULL, NULL);
+    confere("um chip", {"inicio 20000000@3", "cs5=0", "palavra 3000", "cs5=1", "cs5=0", "palavra DABC", "cs5=1", "cs5=0",
+                        "palavra 2FFF", "cs5=1", "fim@3"});
+  }
+
+  // varios chips pela função de seleção, no barramento do banco; o pino do construtor não é tocado
+  {
+    const MCP492XWrite lote[] = {
+        {0, false, false, true, true, 1},
+        {0, true, false, true, true, 2},
+        {3, false, true, true, true, 0x800},
+        {7, true, false, false, true, 0x7FF},
+        {7, false, true, false, false, 0x1FFF}, // valor acima de 12 bits: só os 12 de baixo vão para o DAC
+    };
+    dacHSPI.writeMany(lote, 5, seleciona, (void *)(intptr_t)1);
+    confere("varios chips", {"inicio 10000000@2", "sel1.0+", "palavra 3001", "sel1.0-", "sel1.0+", "palavra B002",
+                             "sel1.0-", "sel1.3+", "palavra 7800", "sel1.3-", "sel1.7+", "palavra 97FF", "sel1.7-",
+                             "sel1.7+", "palavra 4FFF", "sel1.7-", "fim@2"});
+  }
+
+  // lotes em volta de MCP492X_BATCH: as palavras saem na ordem, numa unica transação, sem repetir nem pular a
+  // primeira de cada bloco interno
+  for (size_t quantidade : {(size_t)MCP492X_BATCH, (size_t)MCP492X_BATCH + 1, (size_t)2 * MCP492X_BATCH + 1})
+  {
+    std::vector<MCP492XWrite> lote;
+    std::vector<std::string> esperado = {"inicio 20000000@3"};
+    for (size_t i = 0; i < quantidade; i++)
+    {
+      uint8_t chip = i / 2 % 16;
+      bool odd = i % 2;
+      uint16_t valor = (i * 37) & 0xFFF;
+      lote.push_back({chip, odd, false, true, true, valor});
+      char evento[32];
+      snprintf(evento, sizeof(evento), "sel0.%u+", chip);
+      esperado.push_back(evento);
+      snprintf(evento, sizeof(evento), "palavra %04X", (odd ? 0x8000 : 0) | 0x3000 | valor);
+      esperado.push_back(evento);
+      snprintf(evento, sizeof(evento), "sel0.%u-", chip);
+      esperado.push_back(evento);
+    }
+    esperado.push_back("fim@3");
+    dac.writeMany(lote.data(), lote.size(), seleciona, (void *)(intptr_t)0);
+    char teste[32];
+    snprintf(teste, sizeof(teste), "lote de %zu", quantidade);
+    confere(teste, esperado);
+  }
+
+  // lote vazio: abre e fecha a transação, nenhum CS
+  dac.writeMany(NULL, 0, seleciona, NULL);
+  confere("lote vazio", {"inicio 20000000@3", "fim@3"});
+
+  // analogWrite: CS antes da transação, dois bytes
+  dac.analogWrite(true, 0x123);
+  confere("analogWrite", {"cs5=0", "inicio 20000000@3", "byte B1", "byte 23", "fim@3", "cs5=1"});
+
+  printf(falhas == 0 ? "OK\n" : "%d falhas\n", falhas);
+  return falhas == 0 ? 0 : 1;
+}
@@ -0,0 +1,483 @@
+/*
+ * Bancada simulada do controlador_FID, para rodar no host (Linux)
+ *
+ * Monta a placa escolhida (PLACA, como no firmware) com os modelos do Simulador: um modelo de DAC por chip, o CS
+ * direto ou pelos 74HC595 de cada banco, os ADCs no VSPI e a planta ligando cada saida de DAC à entrada do ADC do
+ * mesmo canal. as bibliotecas MCP492X e Mcp320x do firmware são usadas sem alteração. verifica:
+ *   1. escrita: analogWrite e writeMany chegam bit a bit aos registradores certos (valor, ganho, buffer, shutdown),
+ *      e com o LDAC alto as saidas só mudam na descida dele
+ *   2. leitura: a leitura do ADC de cada canal corresponde à saida do DAC depois de a planta estabilizar
+ *   3. malha fechada: um PI por canal a 1 kHz leva a leitura ao alvo com ruido e atraso na planta
+ *   4. troca de core com um W em curso: os workers dos DACs e as notificações do FreeRTOS modelados passo a passo
+ *      com o CoordenacaoDacs do firmware; a contagem de passadas zera, o LDAC desce e as saidas mostram o W
+ *   5. quadro completo: tempo para escrever todos os canais um por vez, como o dacUpdate antigo (com e sem os seus
+ *      delay(10)), e em lotes por banco, com os bancos em sequencia e em paralelo como nos workers do firmware
+ * e mede quantas vezes mais rapido que o tempo real a simulação roda. devolve 0 se tudo passou.
+ *
+ * compilar (de controlador_FID):
+ *   g++ -std=c++17 -O2 -DPLACA=PlacaFID8 -Itools/simulacao/arduino -Itools/simulacao -Iinclude -Ilib/MCP492X \
+ *       -Ilib/Mcp3208-1.4.0/src -Ilib/CoordenacaoDacs tools/simulacao/simula_fid.cpp tools/simulacao/Simulador.cpp \
+ *       lib/MCP492X/MCP492X.cpp lib/Mcp3208-1.4.0/src/Mcp320x.cpp lib/CoordenacaoDacs/CoordenacaoDacs.cpp -o simula_fid
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <CoordenacaoDacs.h>
+#include <MCP492X.h>
+#include <Mcp320x.h>
+#include "Placa.h"
+#include "Simulador.h"
+
+#ifndef PLACA
+#define PLACA PlacaFID8
+#endif
+using Placa = PLACA;
+using Mapa = MapaCanais<Placa>;
+static_assert(ValidaPlaca<Placa>::ok, "placa invalida");
+
+constexpr int CANAIS = Placa::canais;
+constexpr double VREF = 3.3;
+
+static int falhas = 0;
+
+static void verifica(bool condicao, const char *teste, int canal)
+{
+  if (!condicao)
+  {
+    falhas++;
+    if (falhas <= 20)
+    {
+      printf("  FALHA %s, canal %d\n", teste, canal);
+    }
+  }
+}
+
+// mesma seleção de chip do firmware (selecionaChip em src/main.cpp)
+static void selecionaChip(int banco, int chip, bool ativo)
+{
+  if (Mapa::csDireto(banco))
+  {
+    digitalWrite(Placa::pinosCS[chip], ativo ? LOW : HIGH);
+    return;
+  }
+  const BancoDAC &b = Placa::bancos[banco];
+  uint16_t linhas = ativo ? ~(1u << Placa::pinosCS[chip]) : 0xFFFF;
+  for (int bit = 15; bit >= 0; bit--)
+  {
+    digitalWrite(b.pinoDadosCS, (linhas >> bit) & 1);
+    digitalWrite(b.pinoClockCS, HIGH);
+    digitalWrite(b.pinoClockCS, LOW);
+  }
+  digitalWrite(b.pinoLatchCS, HIGH);
+  digitalWrite(b.pinoLatchCS, LOW);
+}
+
+static void selecionaChipLote(void *banco, uint8_t chip, bool ativo)
+{
+  selecionaChip((int)(intptr_t)banco, chip, ativo);
+}
+
+static uint8_t barramento(int banco)
+{
+  return Placa::bancos[banco].barramento == Barramento::Hspi ? HSPI : VSPI;
+}
+
+// worker de um banco na seção 4: só o contador de notificações da task
+struct WorkerSimulado
+{
+  int banco;
+  uint32_t notificacoes;
+  bool primeira; // a passada de criação, que conta pela notificação que pediu a troca
+  bool apagado;
+};
+
+// contexto das OperacoesTroca do worker antigo na seção 4
+struct TrocaSimulada
+{
+  std::function<void()> cede;
+  WorkerSimulado *antigo;
+  WorkerSimulado *substituto;
+};
+
+static const OperacoesTroca operacoesSimuladas = {
+    [](void *troca) { ((TrocaSimulada *)troca)->cede(); },
+    [](void *troca) {
+      uint32_t n = ((TrocaSimulada *)troca)->antigo->notificacoes;
+      ((TrocaSimulada *)troca)->antigo->notificacoes = 0;
+      return n;
+    },
+    [](void *troca) { ((TrocaSimulada *)troca)->substituto->notificacoes++; },
+};
+
+static double segundosReais()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main()
+{
+  Simulador sim;
+  std::vector<std::unique_ptr<ModeloMCP492X>> dacs;
+  std::vector<std::unique_ptr<Modelo74HC595>> registradores;
+  std::vector<std::unique_ptr<ModeloMCP3208>> adcs;
+
+  auto tensaoDAC = [&dacs](int canal) { return dacs[Mapa::chip(canal)]->tensao(Mapa::saida(canal)); };
+  PlantaLaco planta(CANAIS, tensaoDAC);
+  sim.conectaPlanta(&planta);
+
+  for (int banco = 0; banco < Mapa::bancos; banco++)
+  {
+    Modelo74HC595 *registrador = nullptr;
+    if (!Mapa::csDireto(banco))
+    {
+      const BancoDAC &b = Placa::bancos[banco];
+      registradores.emplace_back(new Modelo74HC595(b.pinoDadosCS, b.pinoClockCS, b.pinoLatchCS));
+      registrador = registradores.back().get();
+    }
+    for (int chip = Mapa::primeiroChip(banco); chip < Mapa::primeiroChip(banco) + Placa::bancos[banco].chips; chip++)
+    {
+      dacs.emplace_back(new ModeloMCP492X(Mapa::saidas, VREF, VREF));
+      ModeloMCP492X *dac = dacs.back().get();
+      sim.conectaSPI(barramento(banco), dac);
+      if (registrador)
+      {
+        registrador->conecta(Placa::pinosCS[chip], dac);
+      }
+      else
+      {
+        sim.conectaCS(Placa::pinosCS[chip], dac);
+      }
+      sim.aoEscrever(Placa::pinoLDAC, [dac](bool nivel) { dac->ldac(nivel); });
+    }
+  }
+  for (int chip = 0; chip < Mapa::adcs; chip++)
+  {
+    constexpr int entradas = entradasPorADC(Placa::adc);
+    adcs.emplace_back(new ModeloMCP3208([&planta, chip](int entrada) {
+      int canal = chip * entradas + entrada;
+      return canal < CANAIS ? planta.leitura(canal) : 0.0;
+    }, VREF));
+    sim.conectaSPI(VSPI, adcs.back().get());
+    sim.conectaCS(Placa::pinosCSADC[chip], adcs.back().get());
+  }
+
+  SPIClass spiHSPI(HSPI);
+  MCP492X myDac(Placa::pinoDummy, Placa::clockSPI, &SPI);
+  MCP492X myDacHSPI(Placa::pinoDummy, Placa::clockSPI, &spiHSPI);
+  myDac.begin();
+  myDacHSPI.begin();
+  for (int banco = 0; banco < Mapa::bancos; banco++)
+  {
+    selecionaChip(banco, Mapa::primeiroChip(banco), false);
+  }
+  digitalWrite(Placa::pinoLDAC, LOW);
+
+  auto dacDoBanco = [&](int banco) -> MCP492X & { return barramento(banco) == HSPI ? myDacHSPI : myDac; };
+  double inicioReal = segundosReais();
+
+  // 1. escrita
+  printf("escrita: %d canais\n", CANAIS);
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    int banco = Mapa::banco(canal);
+    uint16_t valor = (canal * 977 + 123) & 0x0FFF;
+    selecionaChip(banco, Mapa::chip(canal), true);
+    dacDoBanco(banco).analogWrite(Mapa::saida(canal), valor);
+    selecionaChip(banco, Mapa::chip(canal), false);
+    ModeloMCP492X &dac = *dacs[Mapa::chip(canal)];
+    verifica(dac.valor(Mapa::saida(canal)) == valor && dac.ativa(Mapa::saida(canal)) && !dac.ganho2x(Mapa::saida(canal)),
+             "analogWrite", canal);
+  }
+  for (int banco = 0; banco < Mapa::bancos; banco++)
+  {
+    std::vector<MCP492XWrite> lote;
+    for (int canal = Mapa::primeiroCanal(banco); canal < Mapa::primeiroCanal(banco) + Mapa::canaisDoBanco(banco); canal++)
+    {
+      bool configuracao = canal % 2;
+      lote.push_back({Mapa::chip(canal), (bool)Mapa::saida(canal), configuracao, !configuracao, true, (uint16_t)(4095 - canal)});
+    }
+    digitalWrite(Placa::pinoLDAC, HIGH); // segura as saidas
+    dacDoBanco(banco).writeMany(lote.data(), lote.size(), selecionaChipLote, (void *)(intptr_t)banco);
+    for (const MCP492XWrite &w : lote)
+    {
+      int canal = w.device * Mapa::saidas + w.odd;
+      verifica(dacs[w.device]->valor(w.odd) != w.value, "LDAC alto segura a saida", canal);
+    }
+    digitalWrite(Placa::pinoLDAC, LOW);
+    for (const MCP492XWrite &w : lote)
+    {
+      int canal = w.device * Mapa::saidas + w.odd;
+      ModeloMCP492X &dac = *dacs[w.device];
+      verifica(dac.valor(w.odd) == w.value && dac.buffer(w.odd) == w.buffered && dac.ganho2x(w.odd) == !w.gain,
+               "writeMany", canal);
+    }
+  }
+  for (auto &dac : dacs)
+  {
+    verifica(dac->erros() == 0, "palavras com numero de bits errado", -1);
+  }
+
+  // 2. leitura
+  printf("leitura: %d ADCs\n", Mapa::adcs);
+  using ADC = MCP3208;
+  auto leCanal = [](int canal) {
+    constexpr int entradas = entradasPorADC(Placa::adc);
+    ADC adc(VREF * 1000, Placa::pinosCSADC[canal / entradas], &SPI);
+    return adc.read(static_cast<ADC::Channel>(0b1000 | canal % entradas));
+  };
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    planta.parametros(canal).tau = 0.001;
+  }
+  delay(50);
+  SPI.beginTransaction(SPISettings(Placa::clockSPIADC, MSBFIRST, SPI_MODE0));
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    int esperado = dacs[Mapa::chip(canal)]->valor(Mapa::saida(canal));
+    if (dacs[Mapa::chip(canal)]->ganho2x(Mapa::saida(canal)))
+    {
+      esperado = esperado * 2 > 4095 ? 4095 : esperado * 2; // saturado no VDD
+    }
+    verifica(abs(leCanal(canal) - esperado) <= 2, "leitura do ADC", canal);
+  }
+  SPI.endTransaction();
+
+  // 3. malha fechada: PI por canal a 1 kHz, planta com ganho 0.8, tau 20 ms e 2 mV de ruido
+  printf("malha fechada: PI a 1 kHz, 2 s\n");
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    ParametrosLaco &p = planta.parametros(canal);
+    p.ganho = 0.8;
+    p.tau = 0.020;
+    p.ruido = 0.002;
+  }
+  std::vector<double> integral(CANAIS, 0.0), erroFinal(CANAIS, 0.0);
+  const int alvo = 2000;
+  const int passos = 2000;
+  uint64_t periodo = 1000000; // ns
+  for (int passo = 0; passo < passos; passo++)
+  {
+    uint64_t inicioPasso = sim.agora();
+    std::vector<MCP492XWrite> lotes[2];
+    SPI.beginTransaction(SPISettings(Placa::clockSPIADC, MSBFIRST, SPI_MODE0));
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      double erro = alvo - leCanal(canal);
+      integral[canal] += erro * 0.001;
+      double u = 0.2 * erro + 40 * integral[canal] + alvo / 0.8;
+      uint16_t valor = u < 0 ? 0 : u > 4095 ? 4095 : (uint16_t)u;
+      lotes[Mapa::banco(canal)].push_back({Mapa::chip(canal), (bool)Mapa::saida(canal), false, true, true, valor});
+      if (passo >= passos - 200)
+      {
+        erroFinal[canal] += fabs(erro) / 200;
+      }
+    }
+    SPI.endTransaction();
+    digitalWrite(Placa::pinoLDAC, HIGH);
+    for (int banco = 0; banco < Mapa::bancos; banco++)
+    {
+      dacDoBanco(banco).writeMany(lotes[banco].data(), lotes[banco].size(), selecionaChipLote, (void *)(intptr_t)banco);
+    }
+    digitalWrite(Placa::pinoLDAC, LOW);
+    uint64_t gasto = sim.agora() - inicioPasso;
+    verifica(gasto < periodo, "passo de controle cabe no periodo", -1);
+    sim.avanca(gasto < periodo ? periodo - gasto : 0);
+  }
+  double piorErro = 0;
+  for (int canal = 0; canal < CANAIS; canal++)
+  {
+    verifica(erroFinal[canal] < 6, "erro em regime", canal);
+    piorErro = erroFinal[canal] > piorErro ? erroFinal[canal] : piorErro;
+  }
+
+  // 4. troca de core (core_dacs) com um W em curso, na ordem mais desfavoravel: o C acorda todos os workers para se
+  // recriarem no outro core, e o changeDacs() do W seguinte lê o handle antigo do banco 0 e só notifica depois de
+  // aquele worker ter criado o substituto. as tasks rodam uma por vez, na ordem do roteiro. sem o repasse (como
+  // antes), a notificação do W morre com o worker antigo, a contagem não zera e o LDAC fica alto
+  printf("troca de core com um W em curso: %d bancos\n", Mapa::bancos);
+  for (bool repassar : {true, false})
+  {
+    std::deque<WorkerSimulado> workers; // endereços estaveis
+    std::vector<WorkerSimulado *> taskDacs(Mapa::bancos);
+    CoordenacaoDacs coordenacao(Mapa::bancos);
+    uint16_t valor = 1000; // escrito pelas passadas de criação; o W muda para outro
+
+    auto passada = [&](int banco) {
+      std::vector<MCP492XWrite> lote;
+      for (int canal = Mapa::primeiroCanal(banco); canal < Mapa::primeiroCanal(banco) + Mapa::canaisDoBanco(banco); canal++)
+      {
+        lote.push_back({Mapa::chip(canal), (bool)Mapa::saida(canal), false, true, true, valor});
+      }
+      dacDoBanco(banco).writeMany(lote.data(), lote.size(), selecionaChipLote, (void *)(intptr_t)banco);
+      if (coordenacao.concluiPassada())
+      {
+        digitalWrite(Placa::pinoLDAC, LOW);
+      }
+    };
+    auto cria = [&](int banco) {
+      workers.push_back({banco, 0, true, false});
+      taskDacs[banco] = &workers.back();
+    };
+    // um changeDacs() de todos os bancos, que pode parar depois de ler o handle do banco 0
+    WorkerSimulado *lido = nullptr;
+    auto iniciaChangeDacs = [&]() {
+      digitalWrite(Placa::pinoLDAC, HIGH);
+      coordenacao.iniciaNotificacao(Mapa::bancos);
+      lido = taskDacs[0];
+    };
+    auto terminaChangeDacs = [&]() {
+      lido->notificacoes++;
+      for (int banco = 1; banco < Mapa::bancos; banco++)
+      {
+        taskDacs[banco]->notificacoes++;
+      }
+      coordenacao.terminaNotificacao();
+      lido = nullptr;
+    };
+    // o worker atende as suas notificações. pedeTroca: a primeira notificação é a do C, que o faz mudar de core
+    auto roda = [&](WorkerSimulado &worker, bool pedeTroca) {
+      if (worker.primeira)
+      {
+        worker.primeira = false;
+        passada(worker.banco);
+      }
+      while (!worker.apagado && worker.notificacoes > 0)
+      {
+        worker.notificacoes--;
+        if (!pedeTroca)
+        {
+          passada(worker.banco);
+          continue;
+        }
+        cria(worker.banco);
+        TrocaSimulada troca = {[&]() {
+                                 if (lido != nullptr)
+                                 {
+                                   terminaChangeDacs();
+                                 }
+                               },
+                               &worker, taskDacs[worker.banco]};
+        if (repassar)
+        {
+          coordenacao.repassa(operacoesSimuladas, &troca);
+        }
+        worker.apagado = true;
+      }
+    };
+
+    digitalWrite(Placa::pinoLDAC, LOW);
+    for (int banco = 0; banco < Mapa::bancos; banco++)
+    {
+      cria(banco);
+      roda(*taskDacs[banco], false);
+    }
+    iniciaChangeDacs(); // C core_dacs
+    terminaChangeDacs();
+    valor = repassar ? 1111 : 2222;
+    iniciaChangeDacs(); // W: para depois de ler o handle do banco 0
+    for (int banco = 0; banco < Mapa::bancos; banco++)
+    {
+      roda(*taskDacs[banco], true);
+    }
+    if (lido != nullptr)
+    {
+      terminaChangeDacs(); // sem o repasse, o changeDacs() termina sozinho: notifica o worker já apagado
+    }
+    for (WorkerSimulado &worker : workers)
+    {
+      roda(worker, false);
+    }
+
+    bool saidasNoW = true;
+    for (int canal = 0; canal < CANAIS; canal++)
+    {
+      saidasNoW = saidasNoW && dacs[Mapa::chip(canal)]->valor(Mapa::saida(canal)) == valor;
+    }
+    printf("  %s: passadas pendentes %d, LDAC %s, saidas %s\n", repassar ? "com repasse" : "sem repasse",
+           coordenacao.ocupados(), coordenacao.ocupados() == 0 ? "baixo" : "alto",
+           saidasNoW ? "no W" : "presas no valor anterior");
+    if (repassar)
+    {
+      verifica(coordenacao.ocupados() == 0 && saidasNoW, "troca de core perde notificação", -1);
+    }
+    else
+    {
+      verifica(coordenacao.ocupados() != 0 && !saidasNoW, "roteiro da troca de core não reproduz a perda", -1);
+    }
+  }
+
+  // 5. quadro completo: todos os canais mudam. tempo virtual do SPI e dos GPIO (o CS pelos 595 inclusive); o custo
+  // de CPU das tasks fica de fora. cada banco tem o seu worker e o seu barramento, então no firmware o quadro leva
+  // o do banco mais lento; aqui os bancos rodam um depois do outro e o paralelo é o maior dos tempos
+  printf("quadro completo: %d canais em %d bancos\n", CANAIS, Mapa::bancos);
+  {
+    digitalWrite(Placa::pinoLDAC, LOW); // a seção 4 termina com o LDAC alto
+    auto confereQuadro = [&](uint16_t base, const char *teste) {
+      for (int canal = 0; canal < CANAIS; canal++)
+      {
+        verifica(dacs[Mapa::chip(canal)]->valor(Mapa::saida(canal)) == ((base + canal) & 0x0FFF), teste, canal);
+      }
+    };
+    // o dacUpdate de antes dos bancos: CS, analogWrite e CS de cada canal, opcionalmente com os delay(10)
+    auto umPorVez = [&](uint16_t base, bool atrasos) {
+      uint64_t inicio = sim.agora();
+      for (int canal = 0; canal < CANAIS; canal++)
+      {
+        int banco = Mapa::banco(canal);
+        selecionaChip(banco, Mapa::chip(canal), true);
+        if (atrasos)
+        {
+          delay(10);
+        }
+        dacDoBanco(banco).analogWrite(Mapa::saida(canal), (base + canal) & 0x0FFF);
+        selecionaChip(banco, Mapa::chip(canal), false);
+        if (atrasos)
+        {
+          delay(10);
+        }
+      }
+      return sim.agora() - inicio;
+    };
+    uint64_t comAtrasos = umPorVez(100, true);
+    confereQuadro(100, "quadro um canal por vez");
+    uint64_t semAtrasos = umPorVez(200, false);
+    confereQuadro(200, "quadro um canal por vez");
+
+    uint64_t emSequencia = 0;
+    uint64_t emParalelo = 0;
+    for (int banco = 0; banco < Mapa::bancos; banco++)
+    {
+      std::vector<MCP492XWrite> lote;
+      for (int canal = Mapa::primeiroCanal(banco); canal < Mapa::primeiroCanal(banco) + Mapa::canaisDoBanco(banco); canal++)
+      {
+        lote.push_back({Mapa::chip(canal), (bool)Mapa::saida(canal), false, true, true, (uint16_t)((300 + canal) & 0x0FFF)});
+      }
+      uint64_t inicio = sim.agora();
+      dacDoBanco(banco).writeMany(lote.data(), lote.size(), selecionaChipLote, (void *)(intptr_t)banco);
+      uint64_t gasto = sim.agora() - inicio;
+      emSequencia += gasto;
+      emParalelo = gasto > emParalelo ? gasto : emParalelo;
+    }
+    confereQuadro(300, "quadro em lotes");
+    verifica(emParalelo <= emSequencia && emSequencia < semAtrasos, "lote mais rapido que um canal por vez", -1);
+    printf("  um canal por vez, com os delay(10): %10.1f us\n", comAtrasos / 1000.0);
+    printf("  um canal por vez, sem os delay:     %10.1f us\n", semAtrasos / 1000.0);
+    printf("  lote por banco, bancos em sequencia: %9.1f us\n", emSequencia / 1000.0);
+    printf("  lote por banco, bancos em paralelo:  %9.1f us\n", emParalelo / 1000.0);
+  }
+
+  double real = segundosReais() - inicioReal;
+  double virtual_ = sim.agora() * 1e-9;
+  printf("erro medio em regime (pior canal): %.2f LSB\n", piorErro);
+  printf("tempo virtual %.3f s, real %.3f s (%.0fx), %llu bytes SPI, %u transações\n", virtual_, real,
+         real > 0 ? virtual_ / real : 0.0, (unsigned long long)sim.bytesSPI(), sim.transacoes());
+  printf(falhas == 0 ? "OK\n" : "%d falhas\n", falhas);
+  return falhas == 0 ? 0 : 1;
+}